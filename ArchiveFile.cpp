@@ -0,0 +1,489 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <ar.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <ElfProgram.h>
+
+/*
+ * One member of the archive. The name is either inside the member
+ * header, in the long-name table, or (BSD style) right after the
+ * header; it is copied so that it can be NUL terminated.
+ */
+struct ArchiveMember
+{
+   char* name;              // member name (allocated)
+   unsigned long hdrOffset; // offset of the member's ar_hdr
+   unsigned long offset;    // offset of the member data
+   unsigned long size;      // size of the member data
+   LoadObject* object;      // parsed object, or null
+};
+
+/*
+ * Parse a decimal field of an ar header (not NUL terminated).
+ */
+static unsigned long arField(const char* field, unsigned int len)
+{
+   char buf[24];
+   if (len >= sizeof(buf))
+      len = sizeof(buf)-1;
+   memcpy(buf, field, len);
+   buf[len] = '\0';
+   return strtoul(buf, 0, 10);
+}
+
+/*
+ * Read a big-endian word of the symbol index.
+ */
+static unsigned long bigEndianWord(const unsigned char* p, unsigned int size)
+{
+   unsigned long v = 0;
+   unsigned int i;
+   for (i=0; i < size; i++)
+      v = (v << 8) | p[i];
+   return v;
+}
+
+/**
+ * Open a static archive: mmap() it and parse the member headers,
+ * the GNU long-name table ("//") and the symbol index ("/" or
+ * "/SYM64/"). Members are not parsed as ELF objects until they
+ * are asked for (or parseAllMembers() is called).
+ * -- thin archives are not supported
+ * @param archiveFilename is the path of the .a file.
+ */
+ArchiveFile::ArchiveFile(char* archiveFilename)
+{
+   int fd;
+   struct stat st;
+   void* map;
+   unsigned int i;
+
+   image = 0;
+   imageSize = 0;
+   members = 0;
+   numMembers = 0;
+   longNames = 0;
+   longNamesSize = 0;
+   numIndexSymbols = 0;
+   indexNames = 0;
+   indexMembers = 0;
+   hashBuckets = 0;
+   hashChains = 0;
+   numBuckets = 0;
+   fileName = strdup(archiveFilename);
+
+   fd = open(archiveFilename, O_RDONLY);
+   if (fd < 0)
+      return;
+   if (fstat(fd, &st) || st.st_size < SARMAG)
+   {
+      close(fd);
+      return;
+   }
+   map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+      return;
+   if (memcmp(map, ARMAG, SARMAG))
+   {
+      munmap(map, st.st_size);
+      return;
+   }
+   image = (char*) map;
+   imageSize = st.st_size;
+   if (parseMembers())
+   {
+      // a malformed archive has no members: those parsed so far
+      // would point into the unmapped image
+      for (i=0; i < numMembers; i++)
+         free(members[i].name);
+      delete[] members;
+      members = 0;
+      numMembers = 0;
+      longNames = 0;
+      longNamesSize = 0;
+      munmap(image, imageSize);
+      image = 0;
+      imageSize = 0;
+   }
+}
+
+/**
+ * Deletes the member objects and unmaps the archive.
+ */
+ArchiveFile::~ArchiveFile()
+{
+   unsigned int i;
+   for (i=0; i < numMembers; i++)
+   {
+      if (members[i].object)
+         delete members[i].object;
+      free(members[i].name);
+   }
+   delete[] members;
+   delete[] indexMembers;
+   delete[] indexNames;
+   delete[] hashBuckets;
+   delete[] hashChains;
+   if (image)
+      munmap(image, imageSize);
+   free(fileName);
+}
+
+/**
+ * Walk the member headers. Special members (symbol index, long
+ * names) are remembered but not counted as members; the symbol
+ * index is parsed last, because it refers to members by the offset
+ * of their header.
+ * @return Zero on success, -1 if the archive is malformed.
+ */
+int ArchiveFile::parseMembers()
+{
+   struct ar_hdr* hdr;
+   unsigned long pos, size, nameLen, maxMembers = 16;
+   char *symIndex = 0, *name, *end;
+   unsigned long symIndexSize = 0;
+   unsigned int symIndexWord = 4;
+   ArchiveMember* tmp;
+
+   members = new ArchiveMember[maxMembers];
+   pos = SARMAG;
+   while (pos + sizeof(struct ar_hdr) <= imageSize)
+   {
+      hdr = (struct ar_hdr*) (image + pos);
+      if (memcmp(hdr->ar_fmag, ARFMAG, 2))
+         return -1;
+      size = arField(hdr->ar_size, sizeof(hdr->ar_size));
+      if (size > imageSize - pos - sizeof(struct ar_hdr))
+         return -1;
+      name = hdr->ar_name;
+      if (!memcmp(name, "/               ", 16))
+      {
+         symIndex = image + pos + sizeof(struct ar_hdr);
+         symIndexSize = size;
+         symIndexWord = 4;
+      }
+      else if (!memcmp(name, "/SYM64/         ", 16))
+      {
+         symIndex = image + pos + sizeof(struct ar_hdr);
+         symIndexSize = size;
+         symIndexWord = 8;
+      }
+      else if (!memcmp(name, "//              ", 16))
+      {
+         longNames = image + pos + sizeof(struct ar_hdr);
+         longNamesSize = size;
+      }
+      else
+      {
+         if (numMembers >= maxMembers)
+         {
+            maxMembers *= 2;
+            tmp = new ArchiveMember[maxMembers];
+            memcpy(tmp, members, sizeof(ArchiveMember)*numMembers);
+            delete[] members;
+            members = tmp;
+         }
+         ArchiveMember* m = &members[numMembers];
+         m->hdrOffset = pos;
+         m->offset = pos + sizeof(struct ar_hdr);
+         m->size = size;
+         m->object = 0;
+         if (name[0] == '/' && name[1] >= '0' && name[1] <= '9' && longNames)
+         {
+            // GNU long name: "/offset" into the "//" member,
+            // where names end with "/\n"
+            nameLen = arField(name+1, sizeof(hdr->ar_name)-1);
+            if (nameLen >= longNamesSize)
+               return -1;
+            name = longNames + nameLen;
+            end = (char*) memchr(name, '\n', longNamesSize - nameLen);
+            nameLen = end ? end - name : longNamesSize - nameLen;
+            if (nameLen && name[nameLen-1] == '/')
+               nameLen--;
+         }
+         else if (!memcmp(name, "#1/", 3))
+         {
+            // BSD long name: stored in front of the data
+            nameLen = arField(name+3, sizeof(hdr->ar_name)-3);
+            if (nameLen > size)
+               return -1;
+            name = image + m->offset;
+            m->offset += nameLen;
+            m->size -= nameLen;
+            nameLen = strnlen(name, nameLen);
+         }
+         else
+         {
+            end = (char*) memchr(name, '/', sizeof(hdr->ar_name));
+            nameLen = end ? end - name : sizeof(hdr->ar_name);
+            while (!end && nameLen && name[nameLen-1] == ' ')
+               nameLen--;
+         }
+         m->name = strndup(name, nameLen);
+         numMembers++;
+      }
+      // member data is padded to an even offset
+      pos += sizeof(struct ar_hdr) + size + (size & 1);
+   }
+   // a malformed index is dropped whole; lookups then scan the
+   // members' symbol tables instead
+   if (symIndex && parseSymbolIndex(symIndex, symIndexSize, symIndexWord))
+      dropSymbolIndex();
+   return 0;
+}
+
+/**
+ * Parse the archive symbol index: a big-endian count, that many
+ * big-endian member header offsets, then the symbol names. Each
+ * symbol is mapped to its member number and put in a hash table.
+ * Names must be NUL terminated inside the index, and offsets must be
+ * those of member headers.
+ * @param data is the index member's data.
+ * @param size is its size.
+ * @param wordSize is 4 for "/" and 8 for "/SYM64/".
+ * @return Zero on success, -1 if the index is malformed.
+ */
+int ArchiveFile::parseSymbolIndex(char* data, unsigned long size,
+                                  unsigned int wordSize)
+{
+   unsigned long count, i, hdrOffset, lo, hi, mid;
+   char *names, *end;
+   unsigned int h;
+
+   if (size < wordSize)
+      return -1;
+   count = bigEndianWord((unsigned char*) data, wordSize);
+   if (count > (size - wordSize) / wordSize)
+      return -1;
+   names = data + wordSize + count*wordSize;
+   end = data + size;
+   indexNames = new char*[count];
+   indexMembers = new unsigned int[count];
+   numIndexSymbols = 0;
+   for (i=0; i < count; i++)
+   {
+      if (names >= end || strnlen(names, end - names) == (unsigned long)
+                                                         (end - names))
+         return -1;
+      indexNames[i] = names;
+      names += strlen(names) + 1;
+      // members are in offset order, so binary search for the header
+      hdrOffset = bigEndianWord((unsigned char*) data + wordSize*(i+1),
+                                wordSize);
+      lo = 0; hi = numMembers;
+      while (lo < hi)
+      {
+         mid = (lo + hi) / 2;
+         if (members[mid].hdrOffset < hdrOffset)
+            lo = mid + 1;
+         else
+            hi = mid;
+      }
+      if (lo >= numMembers || members[lo].hdrOffset != hdrOffset)
+         return -1;
+      indexMembers[i] = lo;
+   }
+   numIndexSymbols = count;
+
+   for (numBuckets=16; numBuckets < numIndexSymbols; numBuckets *= 2)
+      ;
+   hashBuckets = new unsigned int[numBuckets];
+   hashChains = new unsigned int[numIndexSymbols];
+   memset(hashBuckets, 0xff, sizeof(unsigned int)*numBuckets);
+   // insert in reverse so that chains list the first entry first
+   for (i=numIndexSymbols; i > 0; i--)
+   {
+      h = DynamicSection::getGnuHash(indexNames[i-1]) & (numBuckets-1);
+      hashChains[i-1] = hashBuckets[h];
+      hashBuckets[h] = i-1;
+   }
+   return 0;
+}
+
+unsigned int ArchiveFile::isValidArchive()
+{
+   return (image != 0);
+}
+
+char* ArchiveFile::getName()
+{
+   return fileName;
+}
+
+unsigned int ArchiveFile::getNumberOfMembers()
+{
+   return numMembers;
+}
+
+char* ArchiveFile::getMemberName(unsigned int index)
+{
+   if (index >= numMembers)
+      return 0;
+   return members[index].name;
+}
+
+/**
+ * Get a member's raw data (zero-copy, points into the mapping).
+ * @param index is the member number.
+ * @param size is a return parameter set to the data size.
+ * @return Pointer to the member data, or null.
+ */
+char* ArchiveFile::getMemberData(unsigned int index, unsigned long* size)
+{
+   if (index >= numMembers)
+      return 0;
+   *size = members[index].size;
+   return image + members[index].offset;
+}
+
+/*
+ * Build the LoadObject for one member. The object is named
+ * "archive(member)" like ld and nm do.
+ */
+static LoadObject* makeMemberObject(char* archiveName, char* memberName,
+                                    char* data, unsigned long size)
+{
+   char* objName;
+   LoadObject* lo;
+   objName = (char*) malloc(strlen(archiveName) + strlen(memberName) + 3);
+   sprintf(objName, "%s(%s)", archiveName, memberName);
+   lo = new LoadObject(objName, data, size, 0);
+   free(objName);
+   if (!lo->isValidObject())
+   {
+      delete lo;
+      return 0;
+   }
+   return lo;
+}
+
+/**
+ * Get a member as a file-mode LoadObject over the member's slice of
+ * the archive mapping. The object is created on first use and owned
+ * by the archive. Members that are not ELF objects give null.
+ * @param index is the member number.
+ * @return LoadObject for the member, or null.
+ */
+LoadObject* ArchiveFile::getMemberObject(unsigned int index)
+{
+   if (index >= numMembers)
+      return 0;
+   if (!members[index].object)
+      members[index].object = makeMemberObject(fileName, members[index].name,
+                                               image + members[index].offset,
+                                               members[index].size);
+   return members[index].object;
+}
+
+static void parseMember(void* arg, unsigned int index, unsigned int worker)
+{
+   ((ArchiveFile*) arg)->getMemberObject(index);
+}
+
+/**
+ * Parse every member as an ELF object, using several threads. Each
+ * member is touched by exactly one thread, so no locking is needed.
+ * @param numThreads is the thread count (0 means one per CPU).
+ * @return The number of members that are ELF objects.
+ */
+unsigned int ArchiveFile::parseAllMembers(unsigned int numThreads)
+{
+   unsigned int i, count;
+   ParallelFor::run(numMembers, numThreads, parseMember, this);
+   count = 0;
+   for (i=0; i < numMembers; i++)
+      if (members[i].object)
+         count++;
+   return count;
+}
+
+unsigned int ArchiveFile::getNumberOfIndexSymbols()
+{
+   return numIndexSymbols;
+}
+
+/**
+ * Get one entry of the archive symbol index.
+ * @param index is the entry number.
+ * @param member is a return parameter set to the defining member number.
+ * @return The symbol name, or null.
+ */
+char* ArchiveFile::getIndexSymbol(unsigned int index, unsigned int* member)
+{
+   if (index >= numIndexSymbols)
+      return 0;
+   if (member)
+      *member = indexMembers[index];
+   return indexNames[index];
+}
+
+/*
+ * Forget a (malformed) symbol index.
+ */
+void ArchiveFile::dropSymbolIndex()
+{
+   delete[] indexNames;
+   delete[] indexMembers;
+   delete[] hashBuckets;
+   delete[] hashChains;
+   indexNames = 0;
+   indexMembers = 0;
+   hashBuckets = 0;
+   hashChains = 0;
+   numIndexSymbols = 0;
+   numBuckets = 0;
+}
+
+/*
+ * Find the first member whose static symbol table defines a global
+ * or weak symbol, for archives without a usable index.
+ */
+int ArchiveFile::scanMembersForSymbol(char* symbolName)
+{
+   ElfW(Sym)* syms;
+   char* strTable;
+   unsigned long strSize;
+   unsigned int i, k, count;
+   LoadObject* lo;
+   for (i=0; i < numMembers; i++)
+   {
+      if (!(lo = getMemberObject(i)) ||
+          !(syms = lo->getStaticSymbolTable(&count, &strTable, &strSize)))
+         continue;
+      for (k=1; k < count; k++)
+         if (syms[k].st_shndx != SHN_UNDEF &&
+             GEN_ST_BIND(syms[k].st_info) != STB_LOCAL &&
+             syms[k].st_name < strSize &&
+             !strcmp(symbolName, strTable + syms[k].st_name))
+            return i;
+   }
+   return -1;
+}
+
+/**
+ * Find which member defines a symbol, using the archive symbol index
+ * (no member is opened). If several members define it, the first in
+ * the index wins, which is the one the linker would use. An archive
+ * without a usable index has its members' symbol tables scanned.
+ * @param symbolName is the symbol to look for.
+ * @return The member number, or -1 if no member defines it.
+ */
+int ArchiveFile::findMemberDefiningSymbol(char* symbolName)
+{
+   unsigned int i;
+   if (!numIndexSymbols)
+      return scanMembersForSymbol(symbolName);
+   i = hashBuckets[DynamicSection::getGnuHash(symbolName) & (numBuckets-1)];
+   while (i != 0xffffffff)
+   {
+      if (!strcmp(symbolName, indexNames[i]))
+         return indexMembers[i];
+      i = hashChains[i];
+   }
+   return -1;
+}
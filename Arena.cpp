@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+#include <ElfProgram.h>
+
+/*
+ * Chunk header; the chunk's memory follows it.
+ */
+struct ArenaChunk
+{
+   struct ArenaChunk* next;   // Older chunk
+   unsigned long size;        // Usable bytes after the header
+};
+
+/**
+ * Create an empty arena; no memory is taken until the first
+ * allocation.
+ * @param chunkSize is the usual size of a chunk. Larger requests
+ *        get a chunk of their own size.
+ */
+Arena::Arena(unsigned long chunkSize)
+{
+   chunks = 0;
+   next = end = 0;
+   this->chunkSize = chunkSize;
+   allocated = 0;
+   reserved = 0;
+   numChunks = 0;
+}
+
+/**
+ * Give back every chunk. Destructors of objects placed in the arena
+ * are not run; the owner must do that first if they matter.
+ */
+Arena::~Arena()
+{
+   ArenaChunk *chunk, *older;
+   for (chunk=chunks; chunk; chunk = older)
+   {
+      older = chunk->next;
+      ::operator delete(chunk);
+   }
+}
+
+/**
+ * Allocate memory that lives until the arena is deleted.
+ * @param size is the number of bytes wanted.
+ * @param align is the alignment wanted (a power of two).
+ * @return Pointer to the memory (not zeroed).
+ */
+void* Arena::allocate(unsigned long size, unsigned long align)
+{
+   char* p = (char*) (((unsigned long) next + align - 1) & ~(align - 1));
+   if (!chunks || p + size > end)
+   {
+      unsigned long csize = size + align > chunkSize ? size + align :
+         chunkSize;
+      ArenaChunk* chunk = (ArenaChunk*) 
+         ::operator new(sizeof(ArenaChunk) + csize);
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      chunk->next = chunks;
+      chunk->size = csize;
+      chunks = chunk;
+      next = (char*) (chunk + 1);
+      end = next + csize;
+      reserved += sizeof(ArenaChunk) + csize;
+      numChunks++;
+      p = (char*) (((unsigned long) next + align - 1) & ~(align - 1));
+   }
+   next = p + size;
+   allocated += size;
+   return p;
+}
+
+unsigned long Arena::getBytesAllocated()
+{
+   return allocated;
+}
+
+unsigned long Arena::getBytesReserved()
+{
+   return reserved;
+}
+
+unsigned int Arena::getNumberOfChunks()
+{
+   return numChunks;
+}
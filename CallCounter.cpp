@@ -0,0 +1,327 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ElfProgram.h>
+
+//
+// Trampoline layout (x86-64). Each counted call runs:
+//
+//   endbr64                      (IBT .plt.sec stubs jump here)
+//   mov    %fs:0, %r11           thread pointer
+//   movabs $HASH, %r10
+//   imul   %r10, %r11            hash it ...
+//   shr    $(64-SHARD_BITS), %r11   ... down to a shard number
+//   imul   $STRIDE, %r11, %r11   byte offset of the shard
+//   lea    counter(%rip), %r10   this trampoline's counter in shard 0
+//   lock incq (%r10,%r11)
+//   jmp    *target(%rip)
+//
+// r10 and r11 carry no arguments in the SysV ABI (the PLT's own
+// resolver code uses r11 the same way), so the call arrives at its
+// target exactly as it would have through the PLT.
+//
+#define TRAMPOLINE_SIZE 64
+#define SHARD_BITS      6
+#define SHARD_HASH      0x9e3779b97f4a7c15UL
+
+/*
+ * One counted import: the object making the calls, the symbol, and
+ * the target the calls are passed on to.
+ */
+struct CallSite
+{
+   LoadObject* loadObject;  // Caller
+   char* symbolName;        // Import (in the object's string table)
+   unsigned int symIndex;   // Its dynamic symbol index
+   ElfW(Addr) target;       // Where calls go after counting
+};
+
+CallCounter::CallCounter()
+{
+   sites = 0;
+   numSites = 0;
+   maxSites = 0;
+   code = 0;
+   mapSize = 0;
+   targets = 0;
+   counters = 0;
+   shardStride = 0;
+   rebinder = 0;
+   installed = 0;
+}
+
+/**
+ * Restore the bindings and free the trampolines. If the bindings
+ * cannot be restored, the slots still lead into the trampolines, so
+ * their mapping is leaked rather than unmapped.
+ * -- a thread that is inside a trampoline at this moment would
+ *    crash; only delete a counter once calls through it have stopped
+ */
+CallCounter::~CallCounter()
+{
+   if (remove() >= 0 && code)
+      munmap(code, mapSize);
+   delete rebinder;
+   delete[] sites;
+}
+
+unsigned int CallCounter::isSupported()
+{
+#if defined(__x86_64__)
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Count the calls an object makes to one of its imports.
+ * @param loadObject is the (live) calling object.
+ * @param symbolName is the import ("name", "name@VER", "name@@VER").
+ * @return Zero, or -1 if the object does not import the symbol
+ *         through its GOT, or counting has already been installed.
+ */
+int CallCounter::addSymbol(LoadObject* loadObject, char* symbolName)
+{
+   DynamicSection* dyn;
+   PLTMap* map;
+   ElfW(Sym)* syms;
+   unsigned int numSyms;
+   int index;
+   if (code || !loadObject || loadObject->isFileImage() ||
+       loadObject->isSnapshotObject() ||
+       !(dyn = loadObject->getDynamicSection()) ||
+       !(map = loadObject->getPLTMap()) ||
+       (index = dyn->lookupVersionedSymbol(symbolName)) < 0 ||
+       (!map->findJumpSlot(index) && !map->findDataSlot(index)))
+      return -1;
+   syms = dyn->getSymbolTable(&numSyms);
+   if (numSites >= maxSites)
+   {
+      CallSite* tmp;
+      maxSites = maxSites ? maxSites * 2 : 16;
+      tmp = new CallSite[maxSites];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (numSites)
+         memcpy(tmp, sites, sizeof(CallSite) * numSites);
+      delete[] sites;
+      sites = tmp;
+   }
+   sites[numSites].loadObject = loadObject;
+   sites[numSites].symbolName = dyn->getSymbolString(syms + index);
+   sites[numSites].symIndex = index;
+   sites[numSites].target = 0;
+   numSites++;
+   return 0;
+}
+
+/**
+ * Count the calls every object of a program makes to a symbol (one
+ * counter per importing object).
+ * @param program is the (live) program.
+ * @param symbolName is the symbol.
+ * @return The number of objects that import it.
+ */
+int CallCounter::addProgramSymbol(ProgramInfo* program, char* symbolName)
+{
+   LoadObject* lo;
+   int n = 0;
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      if (!addSymbol(lo, symbolName))
+         n++;
+   return n;
+}
+
+/*
+ * Write trampoline i. The 32-bit displacements are relative to the
+ * end of their instruction.
+ */
+static void writeTrampoline(unsigned char* t, unsigned char* counter,
+                            unsigned char* target, unsigned int stride)
+{
+   static const unsigned char endbr64[] = { 0xf3, 0x0f, 0x1e, 0xfa };
+   static const unsigned char fsLoad[] =
+      { 0x64, 0x4c, 0x8b, 0x1c, 0x25, 0, 0, 0, 0 };
+   unsigned long hash = SHARD_HASH;
+   unsigned char* p = t;
+   int disp;
+   memcpy(p, endbr64, sizeof(endbr64));       // endbr64
+   p += sizeof(endbr64);
+   memcpy(p, fsLoad, sizeof(fsLoad));         // mov %fs:0,%r11
+   p += sizeof(fsLoad);
+   *p++ = 0x49; *p++ = 0xba;                  // movabs $hash,%r10
+   memcpy(p, &hash, 8);
+   p += 8;
+   *p++ = 0x4d; *p++ = 0x0f; *p++ = 0xaf; *p++ = 0xda; // imul %r10,%r11
+   *p++ = 0x49; *p++ = 0xc1; *p++ = 0xeb;     // shr $n,%r11
+   *p++ = 64 - SHARD_BITS;
+   *p++ = 0x4d; *p++ = 0x69; *p++ = 0xdb;     // imul $stride,%r11,%r11
+   memcpy(p, &stride, 4);
+   p += 4;
+   *p++ = 0x4c; *p++ = 0x8d; *p++ = 0x15;     // lea counter(%rip),%r10
+   disp = (int) (counter - (p + 4));
+   memcpy(p, &disp, 4);
+   p += 4;
+   *p++ = 0xf0; *p++ = 0x4b; *p++ = 0xff;     // lock incq (%r10,%r11)
+   *p++ = 0x04; *p++ = 0x1a;
+   *p++ = 0xff; *p++ = 0x25;                  // jmp *target(%rip)
+   disp = (int) (target - (p + 4));
+   memcpy(p, &disp, 4);
+   p += 4;
+   while (p < t + TRAMPOLINE_SIZE)
+      *p++ = 0xcc;                            // int3 padding
+}
+
+/**
+ * Generate the trampolines and point the GOT slots at them. Each
+ * trampoline counts the call and jumps on to the slot's resolved
+ * target (slots that lazy binding has not filled yet are resolved
+ * first, so the lazy resolver never sees them).
+ * @return The number of GOT slots redirected, or -1 on failure (no
+ *         trampolines for this machine, no memory, or the slots could
+ *         not be written).
+ */
+int CallCounter::install()
+{
+   unsigned long page = sysconf(_SC_PAGESIZE);
+   unsigned long codeSize, dataSize;
+   unsigned int i, k;
+   unsigned char* data;
+   PLTMap* map;
+   PLTSlot* slots[2];
+   int n;
+
+   if (installed)
+      return 0;
+   if (!isSupported() || !numSites)
+      return -1;
+   if (!code)
+   {
+      shardStride = (numSites * sizeof(unsigned long) + 63) & ~63UL;
+      codeSize = (numSites * TRAMPOLINE_SIZE + page - 1) & ~(page - 1);
+      dataSize = numSites * sizeof(ElfW(Addr)) + 64 +
+                 (1UL << SHARD_BITS) * shardStride;
+      dataSize = (dataSize + page - 1) & ~(page - 1);
+      mapSize = codeSize + dataSize;
+      code = (unsigned char*) mmap(0, mapSize, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (code == MAP_FAILED)
+      {
+         code = 0;
+         return -1;
+      }
+      data = code + codeSize;
+      targets = (ElfW(Addr)*) data;
+      counters = (unsigned long*) (((unsigned long) (targets + numSites) + 63)
+                                   & ~63UL);
+      rebinder = new GOTRebinder();
+      for (i=0; i < numSites; i++)
+      {
+         map = sites[i].loadObject->getPLTMap();
+         slots[0] = map->findJumpSlot(sites[i].symIndex);
+         slots[1] = map->findDataSlot(sites[i].symIndex);
+         sites[i].target = map->getImportTarget(sites[i].symIndex);
+         targets[i] = sites[i].target;
+         writeTrampoline(code + i * TRAMPOLINE_SIZE,
+                         (unsigned char*) (counters + i),
+                         (unsigned char*) (targets + i), shardStride);
+         for (k=0; k < 2; k++)
+            if (slots[k] && sites[i].target)
+               rebinder->addSlot(sites[i].loadObject,
+                                 map->getGOTEntry(slots[k]),
+                                 code + i * TRAMPOLINE_SIZE);
+      }
+      if (mprotect(code, codeSize, PROT_READ | PROT_EXEC))
+      {
+         // the slots would send calls to non-executable memory
+         delete rebinder;
+         rebinder = 0;
+         munmap(code, mapSize);
+         code = 0;
+         mapSize = 0;
+         targets = 0;
+         counters = 0;
+         return -1;
+      }
+   }
+   n = rebinder->apply();
+   if (n >= 0)
+      installed = 1;
+   return n;
+}
+
+/**
+ * Put the original bindings back. The counts are kept, and install()
+ * can redirect the slots again later.
+ * @return The number of slots restored, or -1 as for
+ *         GOTRebinder::rollback().
+ */
+int CallCounter::remove()
+{
+   int n;
+   if (!installed)
+      return 0;
+   n = rebinder->rollback();
+   if (n >= 0)
+      installed = 0;
+   return n;
+}
+
+unsigned int CallCounter::getNumberOfCounters()
+{
+   return numSites;
+}
+
+/**
+ * Get one counter's total (all shards).
+ * @param index is the counter (in the order the symbols were added).
+ * @return Calls counted so far.
+ */
+unsigned long CallCounter::getCount(unsigned int index)
+{
+   unsigned long total = 0;
+   unsigned int s;
+   if (!counters || index >= numSites)
+      return 0;
+   for (s=0; s < (1U << SHARD_BITS); s++)
+      total += __atomic_load_n((unsigned long*) ((char*) counters +
+                                  s * shardStride) + index,
+                               __ATOMIC_RELAXED);
+   return total;
+}
+
+/**
+ * Copy out every counter. Counts keep moving while calls are made,
+ * so each is exact only as of its own read.
+ * @param counts is the array to fill.
+ * @param maxCounts is its size.
+ * @return The number of entries filled.
+ */
+unsigned int CallCounter::snapshot(CallCount* counts, unsigned int maxCounts)
+{
+   unsigned int i;
+   for (i=0; i < numSites && i < maxCounts; i++)
+   {
+      counts[i].loadObject = sites[i].loadObject;
+      counts[i].symbolName = sites[i].symbolName;
+      counts[i].count = getCount(i);
+   }
+   return i;
+}
+
+/**
+ * Zero the counters (calls made meanwhile may or may not be lost).
+ */
+void CallCounter::reset()
+{
+   unsigned int s, i;
+   if (!counters)
+      return;
+   for (s=0; s < (1U << SHARD_BITS); s++)
+      for (i=0; i < numSites; i++)
+         __atomic_store_n((unsigned long*) ((char*) counters +
+                                           s * shardStride) + i, 0,
+                          __ATOMIC_RELAXED);
+}
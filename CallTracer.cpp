@@ -0,0 +1,781 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <ElfProgram.h>
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+//
+// How a traced call runs (x86-64). The GOT slot points at a small
+// per-site trampoline:
+//
+//   endbr64
+//   movabs $site, %r11
+//   movabs $elfreaderTraceStub, %r10
+//   jmp    *%r10
+//
+// The shared stub below saves the argument registers and calls
+// elfreaderTraceEnter(), which pushes the caller's return address and
+// a TSC timestamp on the thread's shadow stack. The stub then drops
+// the return address from the machine stack and calls the target, so
+// the target sees its arguments (stack ones included) exactly where
+// it would have, and returns into the stub. There
+// elfreaderTraceExit() takes the second timestamp, puts the latency
+// in the thread's ring buffer and hands back the caller's return
+// address, which the stub jumps to with the return registers intact.
+//
+#define TRAMPOLINE_SIZE   32
+#define SHADOW_DEPTH      256    // Nested traced calls per thread
+#define RING_BITS         15     // Records buffered per thread (log2)
+#define RING_SIZE         (1UL << RING_BITS)
+#define DRAIN_INTERVAL_NS 1000000
+
+//
+// Latency histograms are log-linear, as in HdrHistogram: values below
+// 2^SUB_BITS cycles get a bucket each, and every power of two above
+// that is split into 2^(SUB_BITS-1) equal buckets, so each bucket is
+// within about 3% of the values in it, from one cycle to 2^64.
+//
+#define SUB_BITS    5
+#define NUM_BUCKETS ((64 - SUB_BITS + 2) << (SUB_BITS - 1))
+
+/*
+ * One traced import and its latency histogram (in TSC cycles). The
+ * histogram is only touched by whoever holds drainLock.
+ */
+struct TraceSite
+{
+   LoadObject* loadObject;  // Caller
+   char* symbolName;        // Import (in the object's string table)
+   unsigned int symIndex;   // Its dynamic symbol index
+   ElfW(Addr) target;       // Where calls go
+   unsigned long count;     // Calls aggregated
+   unsigned long cycles;    // Sum of their latencies
+   unsigned long maxCycles; // Longest one
+   unsigned long* buckets;  // NUM_BUCKETS counts
+};
+
+/*
+ * A call in progress on this thread.
+ */
+struct ShadowFrame
+{
+   ElfW(Addr) returnAddress;  // Where the caller continues
+   unsigned long start;       // TSC at entry
+   TraceSite* site;           // What was called
+};
+
+/*
+ * A finished call waiting for the drainer.
+ */
+struct TraceRecord
+{
+   TraceSite* site;
+   unsigned long cycles;
+};
+
+/*
+ * Per-thread tracing state, mapped (not malloc'ed, since malloc
+ * itself may be traced) when a thread makes its first traced call.
+ * The ring has one producer, the thread, and one consumer, whichever
+ * drainer holds drainLock; head and tail sit on their own cache
+ * lines. Like LoadStats' ThreadStats, these are linked into a global
+ * list and never freed, so records left by a thread that has exited
+ * are still drained.
+ */
+struct TraceThread
+{
+   unsigned long head __attribute__((aligned(64))); // Next record written
+   unsigned long dropped;                           // Lost to a full ring
+   unsigned long tail __attribute__((aligned(64))); // Next record drained
+   struct TraceThread* next;
+   unsigned int depth;                              // Frames in use
+   ShadowFrame shadow[SHADOW_DEPTH];
+   TraceRecord ring[RING_SIZE];
+};
+
+/*
+ * What elfreaderTraceEnter() hands back to the stub (in rax:rdx).
+ */
+struct TraceEntry
+{
+   ElfW(Addr) target;    // Where to send the call
+   unsigned long traced; // Zero: just jump there, do not come back
+};
+
+static __thread TraceThread* traceThread
+   __attribute__((tls_model("initial-exec")));
+static __thread unsigned int traceBusy
+   __attribute__((tls_model("initial-exec")));
+static TraceThread* allTraceThreads;
+static pthread_mutex_t traceThreadLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t drainLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t calibrateOnce = PTHREAD_ONCE_INIT;
+static double cyclesPerNanosecond;
+
+static inline unsigned long readCycles()
+{
+#if defined(__x86_64__)
+   return __rdtsc();
+#else
+   return LoadStats::now();
+#endif
+}
+
+/*
+ * Measure the TSC rate against the monotonic clock (once, 10 ms).
+ */
+static void calibrateCycles()
+{
+   struct timespec pause = { 0, 10000000 };
+   unsigned long ns0, ns1, c0, c1;
+   ns0 = LoadStats::now();
+   c0 = readCycles();
+   nanosleep(&pause, 0);
+   ns1 = LoadStats::now();
+   c1 = readCycles();
+   cyclesPerNanosecond = (ns1 > ns0 && c1 > c0) ?
+      (double) (c1 - c0) / (ns1 - ns0) : 1.0;
+}
+
+static double cyclesToNanoseconds(unsigned long cycles)
+{
+   pthread_once(&calibrateOnce, calibrateCycles);
+   return cycles / cyclesPerNanosecond;
+}
+
+static unsigned int bucketOf(unsigned long cycles)
+{
+   unsigned int msb, shift;
+   if (cycles < (1UL << SUB_BITS))
+      return cycles;
+   msb = 63 - __builtin_clzl(cycles);
+   shift = msb - SUB_BITS + 1;
+   return (shift << (SUB_BITS - 1)) + (cycles >> shift);
+}
+
+/*
+ * Midpoint of the values that fall into a bucket.
+ */
+static unsigned long bucketValue(unsigned int bucket)
+{
+   unsigned int shift;
+   if (bucket < (1U << SUB_BITS))
+      return bucket;
+   shift = (bucket >> (SUB_BITS - 1)) - 1;
+   return ((unsigned long) (bucket - (shift << (SUB_BITS - 1))) << shift) +
+          ((1UL << shift) - 1) / 2;
+}
+
+static TraceThread* getTraceThread()
+{
+   TraceThread* tt;
+   if (traceThread)
+      return traceThread;
+   // mmap() and the lock could be traced imports themselves
+   traceBusy = 1;
+   tt = (TraceThread*) mmap(0, sizeof(TraceThread), PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   if (tt != MAP_FAILED)
+   {
+      pthread_mutex_lock(&traceThreadLock);
+      tt->next = allTraceThreads;
+      __atomic_store_n(&allTraceThreads, tt, __ATOMIC_RELEASE);
+      pthread_mutex_unlock(&traceThreadLock);
+      traceThread = tt;
+   }
+   traceBusy = 0;
+   return traceThread;
+}
+
+/*
+ * Called by the stub on entry. The frame is reserved before it is
+ * filled in, so a signal handler making traced calls on this thread
+ * in between uses the next one.
+ */
+extern "C" __attribute__((visibility("hidden")))
+TraceEntry elfreaderTraceEnter(TraceSite* site, ElfW(Addr) returnAddress)
+{
+   TraceEntry entry;
+   TraceThread* tt;
+   ShadowFrame* frame;
+   entry.target = site->target;
+   entry.traced = 0;
+   if (traceBusy || !(tt = getTraceThread()) || tt->depth >= SHADOW_DEPTH)
+      return entry;
+   frame = &tt->shadow[tt->depth++];
+   __atomic_signal_fence(__ATOMIC_SEQ_CST);
+   frame->returnAddress = returnAddress;
+   frame->site = site;
+   frame->start = readCycles();
+   entry.traced = 1;
+   return entry;
+}
+
+/*
+ * Called by the stub when the target returns.
+ * @return The caller's return address.
+ */
+extern "C" __attribute__((visibility("hidden")))
+ElfW(Addr) elfreaderTraceExit()
+{
+   unsigned long end = readCycles();
+   TraceThread* tt = traceThread;
+   ShadowFrame* frame = &tt->shadow[tt->depth - 1];
+   ElfW(Addr) returnAddress = frame->returnAddress;
+   TraceRecord record;
+   unsigned long head;
+   record.site = frame->site;
+   record.cycles = end - frame->start;
+   __atomic_signal_fence(__ATOMIC_SEQ_CST);
+   tt->depth--;
+   head = tt->head;
+   if (head - __atomic_load_n(&tt->tail, __ATOMIC_ACQUIRE) >= RING_SIZE)
+   {
+      tt->dropped++;
+      return returnAddress;
+   }
+   tt->ring[head & (RING_SIZE - 1)] = record;
+   __atomic_store_n(&tt->head, head + 1, __ATOMIC_RELEASE);
+   return returnAddress;
+}
+
+#if defined(__x86_64__)
+//
+// The shared entry/exit stub; r11 holds the TraceSite on entry. It
+// saves what can carry arguments (rdi..r9, rax for varargs) around
+// the entry call and what can carry results (rax, rdx) around the
+// exit call, and XSAVEs the x87, SSE, AVX and AVX-512 state around
+// both (XSAVE_COMPONENTS; not PKRU or AMX tiles): the helpers' code
+// may use any vector register, and a result can be in st0-st1 (long
+// double) or the upper halves of ymm/zmm registers. rbx, which the
+// target preserves, holds the stack pointer while the save area
+// (64-byte aligned, its header zeroed as XRSTOR wants) is below it.
+//
+#define XSAVE_COMPONENTS 0xe7
+#define XSAVE_MASK_STRING "0xe7"   // the same, for the asm below
+extern "C" unsigned long elfreaderTraceSaveSize
+   __attribute__((visibility("hidden")));
+unsigned long elfreaderTraceSaveSize;
+
+asm(
+"   .text\n"
+"   .p2align 4\n"
+"   .globl  elfreaderTraceStub\n"
+"   .hidden elfreaderTraceStub\n"
+"   .type   elfreaderTraceStub, @function\n"
+"elfreaderTraceStub:\n"
+"   endbr64\n"
+"   push    %rax\n"
+"   push    %rdi\n"
+"   push    %rsi\n"
+"   push    %rdx\n"
+"   push    %rcx\n"
+"   push    %r8\n"
+"   push    %r9\n"
+"   push    %rbx\n"
+"   mov     %rsp, %rbx\n"
+"   sub     elfreaderTraceSaveSize(%rip), %rsp\n"
+"   and     $-64, %rsp\n"
+"   call    2f\n"
+"   mov     %r11, %rdi\n"
+"   mov     64(%rbx), %rsi\n"
+"   call    elfreaderTraceEnter\n"
+"   mov     %rax, %r11\n"
+"   mov     %rdx, %r10\n"
+"   mov     $" XSAVE_MASK_STRING ", %eax\n"
+"   xor     %edx, %edx\n"
+"   xrstor64 (%rsp)\n"
+"   mov     %rbx, %rsp\n"
+"   pop     %rbx\n"
+"   pop     %r9\n"
+"   pop     %r8\n"
+"   pop     %rcx\n"
+"   pop     %rdx\n"
+"   pop     %rsi\n"
+"   pop     %rdi\n"
+"   pop     %rax\n"
+"   test    %r10, %r10\n"
+"   jz      1f\n"
+"   add     $8, %rsp\n"
+"   call    *%r11\n"
+"   push    %rax\n"
+"   push    %rdx\n"
+"   push    %rbx\n"
+"   mov     %rsp, %rbx\n"
+"   sub     elfreaderTraceSaveSize(%rip), %rsp\n"
+"   and     $-64, %rsp\n"
+"   call    2f\n"
+"   call    elfreaderTraceExit\n"
+"   mov     %rax, %r11\n"
+"   mov     $" XSAVE_MASK_STRING ", %eax\n"
+"   xor     %edx, %edx\n"
+"   xrstor64 (%rsp)\n"
+"   mov     %rbx, %rsp\n"
+"   pop     %rbx\n"
+"   pop     %rdx\n"
+"   pop     %rax\n"
+"   push    %r11\n"
+"   ret\n"
+"1: jmp     *%r11\n"
+// save the extended state at 8(%rsp) (the caller's rsp, skipping
+// the return address); clobbers rax and rdx
+"2: xor     %eax, %eax\n"
+"   mov     %rax, 8+512(%rsp)\n"
+"   mov     %rax, 8+512+8(%rsp)\n"
+"   mov     %rax, 8+512+16(%rsp)\n"
+"   mov     %rax, 8+512+24(%rsp)\n"
+"   mov     %rax, 8+512+32(%rsp)\n"
+"   mov     %rax, 8+512+40(%rsp)\n"
+"   mov     %rax, 8+512+48(%rsp)\n"
+"   mov     %rax, 8+512+56(%rsp)\n"
+"   mov     $" XSAVE_MASK_STRING ", %eax\n"
+"   xor     %edx, %edx\n"
+"   xsave64 8(%rsp)\n"
+"   ret\n"
+"   .size   elfreaderTraceStub, .-elfreaderTraceStub\n"
+);
+
+extern "C" char elfreaderTraceStub[] __attribute__((visibility("hidden")));
+#endif
+
+/*
+ * Background drainer, one per enabled tracer; it sleeps only when
+ * there was nothing to drain, and stops once the tracer is disabled.
+ */
+static void* drainLoop(void* arg)
+{
+   CallTracer* tracer = (CallTracer*) arg;
+   struct timespec interval = { 0, DRAIN_INTERVAL_NS };
+   while (tracer->isEnabled())
+   {
+      if (!tracer->drain())
+         nanosleep(&interval, 0);
+   }
+   return 0;
+}
+
+CallTracer::CallTracer()
+{
+   sites = 0;
+   numSites = 0;
+   maxSites = 0;
+   code = 0;
+   codeSize = 0;
+   buckets = 0;
+   rebinder = 0;
+   enabled = 0;
+   drainerRunning = 0;
+}
+
+/**
+ * Disable tracing and free the trampolines. If the bindings cannot
+ * be restored, the trampolines and histograms are leaked instead.
+ * -- as for CallCounter, only delete a tracer once calls through it
+ *    have stopped; a traced call still in progress would return into
+ *    freed records
+ */
+CallTracer::~CallTracer()
+{
+   if (disable() < 0)
+   {
+      // calls still reach the trampolines, which point at the sites
+      __atomic_store_n(&enabled, 0, __ATOMIC_RELEASE);
+      if (drainerRunning)
+         pthread_join(drainer, 0);
+      delete rebinder;
+      return;
+   }
+   delete rebinder;
+   delete[] buckets;
+   delete[] sites;
+   if (code)
+      munmap(code, codeSize);
+}
+
+unsigned int CallTracer::isSupported()
+{
+#if defined(__x86_64__)
+   unsigned int eax, ebx, ecx, edx, enabled, i;
+   unsigned long size = 576;   // legacy area and XSAVE header
+   if (elfreaderTraceSaveSize)
+      return 1;
+   // the stub needs XSAVE; its area ends with the last component
+   // saved (standard format: each at a fixed offset)
+   if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) ||
+       !__get_cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx))
+      return 0;
+   enabled = eax & XSAVE_COMPONENTS;
+   for (i=2; i < 8; i++)
+      if (((enabled >> i) & 1) &&
+          __get_cpuid_count(0xd, i, &eax, &ebx, &ecx, &edx) &&
+          ebx + eax > size)
+         size = ebx + eax;
+   __atomic_store_n(&elfreaderTraceSaveSize, (size + 63) & ~63UL,
+                    __ATOMIC_RELAXED);
+   return 1;
+#else
+   return 0;
+#endif
+}
+
+/**
+ * Trace the calls an object makes to one of its imports.
+ * @param loadObject is the (live) calling object.
+ * @param symbolName is the import ("name", "name@VER", "name@@VER").
+ * @return Zero, or -1 if the object does not import the symbol
+ *         through its GOT, or tracing has already been enabled.
+ */
+int CallTracer::addSymbol(LoadObject* loadObject, char* symbolName)
+{
+   DynamicSection* dyn;
+   PLTMap* map;
+   ElfW(Sym)* syms;
+   unsigned int numSyms;
+   int index;
+   if (code || !loadObject || loadObject->isFileImage() ||
+       loadObject->isSnapshotObject() ||
+       !(dyn = loadObject->getDynamicSection()) ||
+       !(map = loadObject->getPLTMap()) ||
+       (index = dyn->lookupVersionedSymbol(symbolName)) < 0 ||
+       (!map->findJumpSlot(index) && !map->findDataSlot(index)))
+      return -1;
+   syms = dyn->getSymbolTable(&numSyms);
+   if (numSites >= maxSites)
+   {
+      TraceSite* tmp;
+      maxSites = maxSites ? maxSites * 2 : 16;
+      tmp = new TraceSite[maxSites];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (numSites)
+         memcpy(tmp, sites, sizeof(TraceSite) * numSites);
+      delete[] sites;
+      sites = tmp;
+   }
+   memset(&sites[numSites], 0, sizeof(TraceSite));
+   sites[numSites].loadObject = loadObject;
+   sites[numSites].symbolName = dyn->getSymbolString(syms + index);
+   sites[numSites].symIndex = index;
+   numSites++;
+   return 0;
+}
+
+/**
+ * Trace the calls every object of a program makes to a symbol (one
+ * histogram per importing object).
+ * @param program is the (live) program.
+ * @param symbolName is the symbol.
+ * @return The number of objects that import it.
+ */
+int CallTracer::addProgramSymbol(ProgramInfo* program, char* symbolName)
+{
+   LoadObject* lo;
+   int n = 0;
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      if (!addSymbol(lo, symbolName))
+         n++;
+   return n;
+}
+
+/*
+ * Write one site's trampoline.
+ */
+static void writeTrampoline(unsigned char* t, TraceSite* site,
+                            unsigned char* stub)
+{
+   static const unsigned char endbr64[] = { 0xf3, 0x0f, 0x1e, 0xfa };
+   unsigned char* p = t;
+   memcpy(p, endbr64, sizeof(endbr64));
+   p += sizeof(endbr64);
+   *p++ = 0x49; *p++ = 0xbb;                  // movabs $site,%r11
+   memcpy(p, &site, 8);
+   p += 8;
+   *p++ = 0x49; *p++ = 0xba;                  // movabs $stub,%r10
+   memcpy(p, &stub, 8);
+   p += 8;
+   *p++ = 0x41; *p++ = 0xff; *p++ = 0xe2;     // jmp *%r10
+   while (p < t + TRAMPOLINE_SIZE)
+      *p++ = 0xcc;                            // int3 padding
+}
+
+/**
+ * Start tracing: generate the trampolines (the first time), point
+ * the GOT slots at them and start the background drainer.
+ * @return The number of GOT slots redirected, or -1 on failure (no
+ *         trampolines for this machine, no memory, or the slots could
+ *         not be written).
+ */
+int CallTracer::enable()
+{
+   unsigned long page = sysconf(_SC_PAGESIZE);
+   unsigned int i, k;
+   PLTMap* map;
+   PLTSlot* slots[2];
+   int n;
+
+   if (enabled)
+      return 0;
+   if (!isSupported() || !numSites)
+      return -1;
+#if defined(__x86_64__)
+   if (!code)
+   {
+      codeSize = (numSites * TRAMPOLINE_SIZE + page - 1) & ~(page - 1);
+      code = (unsigned char*) mmap(0, codeSize, PROT_READ | PROT_WRITE,
+                                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (code == MAP_FAILED)
+      {
+         code = 0;
+         return -1;
+      }
+      buckets = new unsigned long[numSites * NUM_BUCKETS];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      memset(buckets, 0, sizeof(unsigned long) * numSites * NUM_BUCKETS);
+      rebinder = new GOTRebinder();
+      for (i=0; i < numSites; i++)
+      {
+         map = sites[i].loadObject->getPLTMap();
+         slots[0] = map->findJumpSlot(sites[i].symIndex);
+         slots[1] = map->findDataSlot(sites[i].symIndex);
+         sites[i].target = map->getImportTarget(sites[i].symIndex);
+         sites[i].buckets = buckets + i * NUM_BUCKETS;
+         writeTrampoline(code + i * TRAMPOLINE_SIZE, &sites[i],
+                         (unsigned char*) elfreaderTraceStub);
+         for (k=0; k < 2; k++)
+            if (slots[k] && sites[i].target)
+               rebinder->addSlot(sites[i].loadObject,
+                                 map->getGOTEntry(slots[k]),
+                                 code + i * TRAMPOLINE_SIZE);
+      }
+      if (mprotect(code, codeSize, PROT_READ | PROT_EXEC))
+      {
+         // the slots would send calls to non-executable memory
+         delete rebinder;
+         rebinder = 0;
+         munmap(code, codeSize);
+         code = 0;
+         codeSize = 0;
+         for (i=0; i < numSites; i++)
+            sites[i].buckets = 0;
+         delete[] buckets;
+         buckets = 0;
+         return -1;
+      }
+   }
+#endif
+   n = rebinder->apply();
+   if (n < 0)
+      return -1;
+   __atomic_store_n(&enabled, 1, __ATOMIC_RELEASE);
+   drainerRunning = !pthread_create(&drainer, 0, drainLoop, this);
+   return n;
+}
+
+/**
+ * Stop tracing: put the original bindings back, stop the drainer and
+ * drain the records already taken. The histograms are kept, and
+ * enable() can start tracing again later.
+ * @return The number of slots restored, or -1 as for
+ *         GOTRebinder::rollback().
+ */
+int CallTracer::disable()
+{
+   int n;
+   if (!enabled)
+      return 0;
+   n = rebinder->rollback();
+   if (n < 0)
+      return -1;
+   __atomic_store_n(&enabled, 0, __ATOMIC_RELEASE);
+   if (drainerRunning)
+      pthread_join(drainer, 0);
+   drainerRunning = 0;
+   drain();
+   return n;
+}
+
+unsigned int CallTracer::isEnabled()
+{
+   return __atomic_load_n(&enabled, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Move the records buffered by every thread into the histograms of
+ * their sites. The drainer does this at least every millisecond;
+ * call it directly to see the latest calls.
+ * @return The number of records drained.
+ * -- records are drained into the site they name, whichever tracer
+ *    it belongs to, so tracers must not be deleted while others run
+ */
+unsigned long CallTracer::drain()
+{
+   unsigned long drained = 0;
+   TraceThread* tt;
+   TraceRecord* record;
+   TraceSite* site;
+   unsigned long head, tail;
+   pthread_mutex_lock(&drainLock);
+   for (tt = __atomic_load_n(&allTraceThreads, __ATOMIC_ACQUIRE); tt;
+        tt = tt->next)
+   {
+      head = __atomic_load_n(&tt->head, __ATOMIC_ACQUIRE);
+      for (tail = tt->tail; tail != head; tail++)
+      {
+         record = &tt->ring[tail & (RING_SIZE - 1)];
+         site = record->site;
+         site->count++;
+         site->cycles += record->cycles;
+         if (record->cycles > site->maxCycles)
+            site->maxCycles = record->cycles;
+         site->buckets[bucketOf(record->cycles)]++;
+      }
+      drained += head - tt->tail;
+      __atomic_store_n(&tt->tail, tail, __ATOMIC_RELEASE);
+   }
+   pthread_mutex_unlock(&drainLock);
+   return drained;
+}
+
+unsigned int CallTracer::getNumberOfSites()
+{
+   return numSites;
+}
+
+/**
+ * Summarize one site's histogram.
+ * @param index is the site (in the order the symbols were added).
+ * @param latency receives the summary.
+ * @return Zero, or -1 if there is no such site.
+ */
+int CallTracer::getLatency(unsigned int index, CallLatency* latency)
+{
+   static const double fractions[4] = { 0.5, 0.9, 0.99, 0.999 };
+   double* percentiles[4];
+   unsigned long seen, rank[4];
+   unsigned int b, p;
+   TraceSite* site;
+   if (index >= numSites)
+      return -1;
+   site = &sites[index];
+   memset(latency, 0, sizeof(CallLatency));
+   latency->loadObject = site->loadObject;
+   latency->symbolName = site->symbolName;
+   percentiles[0] = &latency->p50;
+   percentiles[1] = &latency->p90;
+   percentiles[2] = &latency->p99;
+   percentiles[3] = &latency->p999;
+   pthread_mutex_lock(&drainLock);
+   latency->calls = site->count;
+   if (site->count && site->buckets)
+   {
+      latency->mean = cyclesToNanoseconds(site->cycles) / site->count;
+      latency->max = cyclesToNanoseconds(site->maxCycles);
+      // the percentile is the value of the call at that rank (rounded up)
+      for (p=0; p < 4; p++)
+      {
+         rank[p] = (unsigned long) (fractions[p] * site->count);
+         if (rank[p] < fractions[p] * site->count || !rank[p])
+            rank[p]++;
+      }
+      seen = 0;
+      p = 0;
+      for (b=0; b < NUM_BUCKETS && p < 4; b++)
+      {
+         seen += site->buckets[b];
+         while (p < 4 && seen >= rank[p])
+            *percentiles[p++] = cyclesToNanoseconds(bucketValue(b));
+      }
+      // a bucket's midpoint can lie past the longest call in it
+      for (p=0; p < 4; p++)
+         if (*percentiles[p] > latency->max)
+            *percentiles[p] = latency->max;
+   }
+   pthread_mutex_unlock(&drainLock);
+   return 0;
+}
+
+/**
+ * Summarize every site.
+ * @param latencies is the array to fill.
+ * @param maxLatencies is its size.
+ * @return The number of entries filled.
+ */
+unsigned int CallTracer::snapshot(CallLatency* latencies,
+                                  unsigned int maxLatencies)
+{
+   unsigned int i;
+   for (i=0; i < numSites && i < maxLatencies; i++)
+      getLatency(i, &latencies[i]);
+   return i;
+}
+
+/**
+ * Count the records threads had to throw away because their ring
+ * was full (the drainer fell behind), over all tracers.
+ */
+unsigned long CallTracer::getDroppedRecords()
+{
+   TraceThread* tt;
+   unsigned long total = 0;
+   for (tt = __atomic_load_n(&allTraceThreads, __ATOMIC_ACQUIRE); tt;
+        tt = tt->next)
+      total += __atomic_load_n(&tt->dropped, __ATOMIC_RELAXED);
+   return total;
+}
+
+/**
+ * Empty the histograms (records still buffered are drained first, so
+ * they do not reappear).
+ */
+void CallTracer::reset()
+{
+   unsigned int i;
+   drain();
+   pthread_mutex_lock(&drainLock);
+   for (i=0; i < numSites; i++)
+   {
+      sites[i].count = 0;
+      sites[i].cycles = 0;
+      sites[i].maxCycles = 0;
+   }
+   if (buckets)
+      memset(buckets, 0, sizeof(unsigned long) * numSites * NUM_BUCKETS);
+   pthread_mutex_unlock(&drainLock);
+}
+
+/**
+ * Write the latencies as text: a header, then one line per site with
+ * its call count and mean, percentiles and maximum in nanoseconds.
+ * @param out is where the report goes.
+ */
+void CallTracer::writeReport(OutputBuffer* out)
+{
+   CallLatency latency;
+   char line[512];
+   unsigned int i;
+   drain();
+   snprintf(line, sizeof(line), "%-24s %10s %9s %9s %9s %9s %9s %10s  %s\n",
+            "symbol", "calls", "mean", "p50", "p90", "p99", "p99.9", "max",
+            "caller");
+   out->putString(line);
+   for (i=0; i < numSites; i++)
+   {
+      getLatency(i, &latency);
+      snprintf(line, sizeof(line),
+               "%-24s %10lu %9.1f %9.1f %9.1f %9.1f %9.1f %10.1f  %s\n",
+               latency.symbolName, latency.calls, latency.mean, latency.p50,
+               latency.p90, latency.p99, latency.p999, latency.max,
+               latency.loadObject->getName() ?
+                  latency.loadObject->getName() : "(main)");
+      out->putString(line);
+   }
+   snprintf(line, sizeof(line), "(nanoseconds; %lu records dropped)\n",
+            getDroppedRecords());
+   out->putString(line);
+}
@@ -0,0 +1,323 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <ElfProgram.h>
+
+/*
+ * Slicing-by-8 tables for the reflected CRC32 polynomial 0xEDB88320,
+ * which is what .gnu_debuglink uses (same as zlib's crc32). Table 0
+ * is the classic byte-at-a-time table; table k advances a byte that
+ * is k positions further from the end of an 8-byte block.
+ */
+static unsigned int crcTable[8][256];
+static pthread_once_t crcTableOnce = PTHREAD_ONCE_INIT;
+
+static void initCrcTable(void)
+{
+   unsigned int i, j, c;
+   for (i=0; i < 256; i++)
+   {
+      c = i;
+      for (j=0; j < 8; j++)
+         c = (c & 1) ? (c >> 1) ^ 0xEDB88320 : (c >> 1);
+      crcTable[0][i] = c;
+   }
+   for (i=0; i < 256; i++)
+      for (j=1; j < 8; j++)
+         crcTable[j][i] = (crcTable[j-1][i] >> 8) ^
+                          crcTable[0][crcTable[j-1][i] & 0xff];
+}
+
+/*
+ * The debuglink cache is shared by all finders in the process.
+ */
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static void getCacheFileName(char* buf, unsigned int size)
+{
+   char* env = getenv("ELFREADER_DEBUG_CACHE");
+   char* home;
+   if (env)
+   {
+      snprintf(buf, size, "%s", env);
+      return;
+   }
+   home = getenv("HOME");
+   snprintf(buf, size, "%s/.cache/elfreader-debuglink", home ? home : "/tmp");
+}
+
+/**
+ * Set up a finder for one load object.
+ * @param loadObject is the (stripped) object whose debug file we want.
+ */
+DebugInfoFinder::DebugInfoFinder(LoadObject* loadObject)
+{
+   this->loadObject = loadObject;
+   debugRoot = getenv("ELFREADER_DEBUG_ROOT");
+   if (!debugRoot)
+      debugRoot = (char*) "/usr/lib/debug";
+}
+
+DebugInfoFinder::~DebugInfoFinder()
+{
+}
+
+/**
+ * Find the separate debug file, trying the build-id first because
+ * it needs no checksum.
+ * @return A file-mode LoadObject for the debug file (caller owns it),
+ *         or null if none was found.
+ */
+LoadObject* DebugInfoFinder::findDebugObject()
+{
+   LoadObject* dbg;
+   if (!loadObject->isValidObject() || !loadObject->getName())
+      return 0;
+   dbg = findByBuildId();
+   if (!dbg)
+      dbg = findByDebugLink();
+   return dbg;
+}
+
+/**
+ * Look for <root>/.build-id/xx/yyyy.debug, where xx is the first byte
+ * of the build-id in hex and yyyy the rest. The candidate is accepted
+ * only if its own build-id note matches ours and it has a symtab.
+ * @return A LoadObject for the debug file, or null.
+ */
+LoadObject* DebugInfoFinder::findByBuildId()
+{
+   unsigned char *id, *dbgId;
+   unsigned int idLen, dbgIdLen, i;
+   char path[PATH_MAX];
+   int pos;
+   LoadObject* dbg;
+
+   id = loadObject->getBuildId(&idLen);
+   if (!id || idLen < 2)
+      return 0;
+   pos = snprintf(path, sizeof(path), "%s/.build-id/%02x/", debugRoot, id[0]);
+   if (pos < 0 || pos + 2*(idLen-1) + sizeof(".debug") > sizeof(path))
+      return 0;
+   for (i=1; i < idLen; i++)
+      pos += sprintf(path+pos, "%02x", id[i]);
+   strcpy(path+pos, ".debug");
+   if (access(path, R_OK))
+      return 0;
+   dbg = new LoadObject(path, 0);
+   dbgId = dbg->isValidObject() ? dbg->getBuildId(&dbgIdLen) : 0;
+   if (!dbgId || dbgIdLen != idLen || memcmp(id, dbgId, idLen) ||
+       !dbg->getNumberOfStaticSymbols())
+   {
+      delete dbg;
+      return 0;
+   }
+   return dbg;
+}
+
+/**
+ * Follow the .gnu_debuglink section. Like gdb, the named file is
+ * looked for next to the object, in a .debug subdirectory, and under
+ * the debug root with the object's directory appended.
+ * @return A LoadObject for the debug file, or null.
+ */
+LoadObject* DebugInfoFinder::findByDebugLink()
+{
+   ElfSection* sec;
+   char *data, *slash;
+   unsigned int size, nameLen, crc;
+   unsigned int allocated = 0;
+   char objPath[PATH_MAX], path[PATH_MAX];
+   LoadObject* dbg = 0;
+
+   sec = loadObject->getWellKnownSection(SECTION_GNU_DEBUGLINK);
+   if (!sec)
+      return 0;
+   size = sec->getSizeInBytes();
+   data = loadObject->getFileRangePtr(sec->getFileOffset(), size);
+   if (!data)
+   {
+      data = loadObject->getFileSection(sec->getFileOffset(), size);
+      allocated = 1;
+   }
+   if (!data)
+      return 0;
+   // file name, NUL, padding to 4 bytes, then the CRC
+   nameLen = strnlen(data, size);
+   if (nameLen == 0 || ((nameLen + 4) & ~3) + 4 > size ||
+       !realpath(loadObject->getName(), objPath))
+   {
+      if (allocated)
+         delete[] data;
+      return 0;
+   }
+   memcpy(&crc, data + ((nameLen + 4) & ~3), sizeof(crc));
+   slash = strrchr(objPath, '/');
+   *slash = '\0';
+
+   // a candidate too long for PATH_MAX is skipped, not probed cut short
+   if (snprintf(path, sizeof(path), "%s/%s", objPath, data) <
+       (int) sizeof(path))
+      dbg = tryDebugLinkFile(path, crc);
+   if (!dbg && snprintf(path, sizeof(path), "%s/.debug/%s", objPath, data) <
+               (int) sizeof(path))
+      dbg = tryDebugLinkFile(path, crc);
+   if (!dbg && snprintf(path, sizeof(path), "%s%s/%s", debugRoot, objPath,
+                        data) < (int) sizeof(path))
+      dbg = tryDebugLinkFile(path, crc);
+   if (allocated)
+      delete[] data;
+   return dbg;
+}
+
+/**
+ * Check one debuglink candidate: it must exist, not be the object
+ * itself, and its contents must have the CRC the object recorded
+ * (unless the cache says it was already verified).
+ * @param path is the candidate file.
+ * @param crc is the CRC32 from the .gnu_debuglink section.
+ * @return A LoadObject for the debug file, or null.
+ */
+LoadObject* DebugInfoFinder::tryDebugLinkFile(char* path, unsigned int crc)
+{
+   struct stat st, ost;
+   LoadObject* dbg;
+   if (stat(path, &st) || !S_ISREG(st.st_mode))
+      return 0;
+   if (!stat(loadObject->getName(), &ost) &&
+       st.st_ino == ost.st_ino && st.st_dev == ost.st_dev)
+      return 0;
+   dbg = new LoadObject(path, 0);
+   if (!dbg->isValidObject() || !dbg->getNumberOfStaticSymbols())
+   {
+      delete dbg;
+      return 0;
+   }
+   if (isCachedMatch(path, crc))
+      return dbg;
+   // the whole file is read once, sequentially
+   madvise(dbg->getBaseAddress(), dbg->getImageSize(), MADV_SEQUENTIAL);
+   STATS_COUNT(STATS_BYTES_READ, dbg->getImageSize());
+   if (crc32(0, (unsigned char*) dbg->getBaseAddress(),
+             dbg->getImageSize()) != crc)
+   {
+      delete dbg;
+      return 0;
+   }
+   addCachedMatch(path, crc);
+   return dbg;
+}
+
+/**
+ * Look the candidate up in the cache file. A cache line is
+ * "crc size mtime inode path", so a file that has been replaced
+ * or modified since it was verified no longer matches.
+ * @return 1 if the file was verified before with this CRC, else 0.
+ */
+int DebugInfoFinder::isCachedMatch(char* path, unsigned int crc)
+{
+   char cacheName[PATH_MAX], line[PATH_MAX+80], cpath[PATH_MAX];
+   unsigned int ccrc;
+   unsigned long csize, cino;
+   long cmtime;
+   struct stat st;
+   FILE* fp;
+   int found = 0;
+   if (stat(path, &st))
+      return 0;
+   getCacheFileName(cacheName, sizeof(cacheName));
+   pthread_mutex_lock(&cacheLock);
+   fp = fopen(cacheName, "r");
+   STATS_COUNT(STATS_FILE_OPENS, 1);
+   while (fp && !found && fgets(line, sizeof(line), fp))
+   {
+      if (sscanf(line, "%x %lu %ld %lu %[^\n]", &ccrc, &csize, &cmtime,
+                 &cino, cpath) != 5)
+         continue;
+      if (ccrc == crc && csize == (unsigned long) st.st_size &&
+          cmtime == (long) st.st_mtime && cino == (unsigned long) st.st_ino &&
+          !strcmp(cpath, path))
+         found = 1;
+   }
+   if (fp)
+      fclose(fp);
+   pthread_mutex_unlock(&cacheLock);
+   return found;
+}
+
+/**
+ * Append a verified debuglink match to the cache file. Failure to
+ * write the cache is not an error; the next process just checksums
+ * the file again.
+ */
+void DebugInfoFinder::addCachedMatch(char* path, unsigned int crc)
+{
+   char cacheName[PATH_MAX], *slash;
+   struct stat st;
+   FILE* fp;
+   if (stat(path, &st))
+      return;
+   getCacheFileName(cacheName, sizeof(cacheName));
+   pthread_mutex_lock(&cacheLock);
+   fp = fopen(cacheName, "a");
+   if (!fp && (slash = strrchr(cacheName, '/')))
+   {
+      *slash = '\0';
+      mkdir(cacheName, 0755);
+      *slash = '/';
+      fp = fopen(cacheName, "a");
+   }
+   if (fp)
+   {
+      fprintf(fp, "%08x %lu %ld %lu %s\n", crc, (unsigned long) st.st_size,
+              (long) st.st_mtime, (unsigned long) st.st_ino, path);
+      fclose(fp);
+   }
+   pthread_mutex_unlock(&cacheLock);
+}
+
+/**
+ * CRC32 using slicing-by-8: eight table lookups per 8-byte block
+ * with no dependency between them, which runs several times faster
+ * than the byte-at-a-time loop. Chain calls by passing the previous
+ * result as crc (start with 0).
+ * @param crc is the running CRC.
+ * @param buf is the data.
+ * @param len is the data length in bytes.
+ * @return The updated CRC.
+ */
+unsigned int DebugInfoFinder::crc32(unsigned int crc, const unsigned char* buf,
+                                   unsigned long len)
+{
+   unsigned int one, two;
+   pthread_once(&crcTableOnce, initCrcTable);
+   crc = ~crc;
+   while (len && ((unsigned long) buf & 7))
+   {
+      crc = crcTable[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+      len--;
+   }
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+   while (len >= 8)
+   {
+      one = *(const unsigned int*) buf ^ crc;
+      two = *(const unsigned int*) (buf + 4);
+      crc = crcTable[7][one & 0xff] ^ crcTable[6][(one >> 8) & 0xff] ^
+            crcTable[5][(one >> 16) & 0xff] ^ crcTable[4][one >> 24] ^
+            crcTable[3][two & 0xff] ^ crcTable[2][(two >> 8) & 0xff] ^
+            crcTable[1][(two >> 16) & 0xff] ^ crcTable[0][two >> 24];
+      buf += 8;
+      len -= 8;
+   }
+#else
+   (void) one; (void) two;
+#endif
+   while (len--)
+      crc = crcTable[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+   return ~crc;
+}
@@ -4,6 +4,70 @@
 #include <ElfProgram.h>
 //#include <libelf.h>
 
+// tags from newer elf.h versions, for older build hosts
+#ifndef DT_RELR
+#define DT_RELRSZ 35
+#define DT_RELR 36
+#define DT_RELRENT 37
+#endif
+
+/*
+ * One defined symbol in the address index.
+ */
+struct SymbolAddressEntry
+{
+   ElfW(Addr) start;    // st_value
+   ElfW(Addr) end;      // one past the last byte (at least start + 1)
+   unsigned int index;  // dynamic symbol index
+   unsigned int rank;   // lower is the better name for the address
+};
+
+/*
+ * Slot in the tag table for a tag, or -1 if the tag has none. The GNU
+ * ranges count down from their top, like the DT_*TAGIDX() macros.
+ */
+static int tagSlot(unsigned long tag)
+{
+   int slot = DYNAMIC_STANDARD_TAGS;
+   if (tag < DYNAMIC_STANDARD_TAGS)
+      return tag;
+   if (tag >= DT_VALRNGLO && tag <= DT_VALRNGHI)
+      return DT_VALTAGIDX(tag) < DT_VALNUM ? slot + DT_VALTAGIDX(tag) : -1;
+   slot += DT_VALNUM;
+   if (tag >= DT_ADDRRNGLO && tag <= DT_ADDRRNGHI)
+      return DT_ADDRTAGIDX(tag) < DT_ADDRNUM ? slot + DT_ADDRTAGIDX(tag) : -1;
+   slot += DT_ADDRNUM;
+   if (tag >= DT_VERSYM && tag <= DT_VERNEEDNUM)
+      return slot + DT_VERSIONTAGIDX(tag);
+   slot += DT_VERSIONTAGNUM;
+   if (tag == DT_AUXILIARY || tag == DT_FILTER)
+      return slot + DT_EXTRATAGIDX(tag);
+   return -1;
+}
+
+/*
+ * Number of symbols covered by a GNU hash table: one past the last
+ * symbol of the highest non-empty chain (chains end with a set low
+ * bit), or the first hashed symbol if every bucket is empty.
+ */
+static unsigned int gnuHashSymbolCount(char* table)
+{
+   unsigned int* words = (unsigned int*) table;
+   unsigned int numBuckets = words[0], symOffset = words[1];
+   unsigned int bloomWords = words[2], i, last = 0;
+   unsigned int* buckets = (unsigned int*) 
+      (table + 4*sizeof(unsigned int) + bloomWords*sizeof(ElfW(Addr)));
+   unsigned int* chains = buckets + numBuckets;
+   for (i=0; i < numBuckets; i++)
+      if (buckets[i] > last)
+         last = buckets[i];
+   if (last < symOffset)
+      return symOffset;
+   while (!(chains[last - symOffset] & 1))
+      last++;
+   return last + 1;
+}
+
 /**
  * Sets up info about a dynamic section. The dynamic section contains
  * all the info to be able to dynamically link this object with other
@@ -17,80 +81,216 @@ DynamicSection::DynamicSection(char* dynamicSectionAddress, unsigned int size,
                   LoadObject* loadObject)
 {
    ElfW(Dyn) *dynamicEntry = (ElfW(Dyn)*) dynamicSectionAddress;
+   unsigned int lastEntry[DYNAMIC_TAG_SLOTS];
+   STATS_COUNT(STATS_OBJECTS, 1);
    dynamicSec = dynamicEntry;
    numEntries = size / sizeof(ElfW(Dyn));
    unsigned int i;
-   RelASection=0;
-   RelSection=0;
-   PLTRels=0;
-   stringTable=0;
-   symbolTable=0;
-   stringTableSize=0;
-   symbolTableCount=0;
-   symbolEntrySize=0;
+   int slot;
+   ElfW(Addr) got;
    this->loadObject = loadObject;
    //
-   // first find string table and symbol table, and hash table
+   // one pass to index every entry by tag; repeats of a tag are
+   // chained in file order
    //
-   for (i=0; i < numEntries && dynamicEntry->d_tag != DT_NULL; i++)
+   memset(firstEntry, 0, sizeof(firstEntry));
+   memset(entryCount, 0, sizeof(entryCount));
+   nextEntry = (unsigned int*) loadObject->allocateMetadata(
+      sizeof(unsigned int) * (numEntries ? numEntries : 1));
+   for (i=0; i < numEntries && dynamicEntry->d_tag != DT_NULL; 
+        i++, dynamicEntry++)
    {
-      if (dynamicEntry->d_tag == DT_STRTAB)
-         stringTable = (char*) dynamicEntry->d_un.d_ptr;
-      if (dynamicEntry->d_tag == DT_SYMTAB)
-         symbolTable = (ElfW(Sym)*) dynamicEntry->d_un.d_ptr;
-      if (dynamicEntry->d_tag == DT_STRSZ)
-         stringTableSize = dynamicEntry->d_un.d_val;
-      if (dynamicEntry->d_tag == DT_SYMENT)
-         symbolEntrySize = dynamicEntry->d_un.d_val;
-      if (dynamicEntry->d_tag == DT_HASH)
-      {
-         hashTable = (char*) dynamicEntry->d_un.d_ptr;
-         symbolTableCount = *(((int*)dynamicEntry->d_un.d_ptr)+1);
-      }
-      dynamicEntry++;
+      nextEntry[i] = 0;
+      if ((slot = tagSlot(dynamicEntry->d_tag)) < 0)
+         continue;
+      if (entryCount[slot]++)
+         nextEntry[lastEntry[slot]] = i + 1;
+      else
+         firstEntry[slot] = i + 1;
+      lastEntry[slot] = i;
    }
+   numUsedEntries = i;
    //
-   // Now find the PLT, GOT, and relocation information
+   // then pick out the string table, symbol table, hash tables,
+   // PLT, GOT, and relocation information; address entries go
+   // through the load object, which knows whether they have been
+   // relocated or need a file offset
    //
-   dynamicEntry = (ElfW(Dyn)*) dynamicSectionAddress;
-   for (i=0; i < numEntries && dynamicEntry->d_tag != DT_NULL; i++)
+   stringTable = getPointer(DT_STRTAB);
+   symbolTable = (ElfW(Sym)*) getPointer(DT_SYMTAB);
+   stringTableSize = getValue(DT_STRSZ);
+   symbolEntrySize = getValue(DT_SYMENT);
+   hashTable = getPointer(DT_HASH);
+   gnuHashTable = getPointer(DT_GNU_HASH);
+   symbolTableCount = 0;
+   if (hashTable)
+      symbolTableCount = *(((int*)hashTable)+1);
+   else if (gnuHashTable)
+      symbolTableCount = gnuHashSymbolCount(gnuHashTable);
+   RelASection = (ElfW(Rela)*) getPointer(DT_RELA);
+   RelaSize = getValue(DT_RELASZ);
+   RelaEntSize = getValue(DT_RELAENT);
+   RelSection = (ElfW(Rel)*) getPointer(DT_REL);
+   RelSize = getValue(DT_RELSZ);
+   RelEntSize = getValue(DT_RELENT);
+   if (hasEntry(DT_PLTGOT))
    {
-      if (dynamicEntry->d_tag == DT_RELA)
-         RelASection = (ElfW(Rela)*)dynamicEntry->d_un.d_ptr;
-      if (dynamicEntry->d_tag == DT_RELASZ)
-         RelaSize = (unsigned int)dynamicEntry->d_un.d_val;
-      if (dynamicEntry->d_tag == DT_RELAENT)
-         RelaEntSize = (unsigned int)dynamicEntry->d_un.d_val;
-      if (dynamicEntry->d_tag == DT_REL)
-         RelSection = (ElfW(Rel)*)dynamicEntry->d_un.d_ptr;
-      if (dynamicEntry->d_tag == DT_RELSZ)
-         RelSize = (unsigned int)dynamicEntry->d_un.d_val;
-      if (dynamicEntry->d_tag == DT_RELENT)
-         RelEntSize = (unsigned int)dynamicEntry->d_un.d_val;
-      if (dynamicEntry->d_tag == DT_PLTGOT)
-         loadObject->setGOTAddress((char*)dynamicEntry->d_un.d_ptr);
-      if (dynamicEntry->d_tag == DT_JMPREL)
+      // a snapshot object's GOT is where it was in the process, as
+      // for a live object, not where the snapshot maps its copy
+      got = getEntry(DT_PLTGOT)->d_un.d_ptr;
+      if (!loadObject->isSnapshotObject())
+         loadObject->setGOTAddress(getPointer(DT_PLTGOT));
+      else if ((char*) got >= loadObject->getBaseAddress() &&
+               (char*) got < loadObject->getHighAddress())
+         loadObject->setGOTAddress((char*) got);
+      else
+         loadObject->setGOTAddress(loadObject->vaddrToAddress(got));
+   }
+   PLTRels = (ElfW(Rel)*) getPointer(DT_JMPREL);
+   PLTRType = PLTREntSize = 0;
+   if (hasEntry(DT_PLTREL))
+   {
+      PLTRType = getValue(DT_PLTREL);
+      if (PLTRType == DT_REL)
+         PLTREntSize = sizeof(ElfW(Rel));
+      else
+         PLTREntSize = sizeof(ElfW(Rela));
+   }
+   PLTRSize = getValue(DT_PLTRELSZ);
+   versymTable = (ElfW(Half)*) getPointer(DT_VERSYM);
+   versionNames = versionFiles = 0;
+   numVersions = 0;
+   readVersions();
+   addressIndex = 0;
+   numAddressed = 0;
+}
+
+/**
+ * Nothing to free: the lookup tables are in the object's arena.
+ */
+DynamicSection::~DynamicSection()
+{
+}
+
+/*
+ * A string table entry, or null if the offset is out of range.
+ */
+static char* tableString(char* table, unsigned int size, unsigned long offset)
+{
+   return (table && offset < size) ? table + offset : 0;
+}
+
+/**
+ * Read the version definitions (.gnu.version_d) and needs
+ * (.gnu.version_r) into a table of names indexed by version index,
+ * which is what the .gnu.version entries hold. The first pass finds
+ * the largest index, the second fills in the names.
+ */
+void DynamicSection::readVersions()
+{
+   ElfW(Verdef)* vd;
+   ElfW(Verdaux)* vda;
+   ElfW(Verneed)* vn;
+   ElfW(Vernaux)* vna;
+   char* verdefs = getPointer(DT_VERDEF);
+   char* verneeds = getPointer(DT_VERNEED);
+   unsigned long numDefs = getValue(DT_VERDEFNUM);
+   unsigned long numNeeds = getValue(DT_VERNEEDNUM);
+   unsigned int pass, i, j, ndx, maxIndex = 1;
+   if (!versymTable || (!verdefs && !verneeds))
+      return;
+   for (pass=0; pass < 2; pass++)
+   {
+      if (pass == 1)
       {
-         PLTRels = (ElfW(Rel)*)dynamicEntry->d_un.d_ptr;
+         numVersions = maxIndex + 1;
+         versionNames = (char**) loadObject->allocateMetadata(
+            sizeof(char*) * numVersions);
+         versionFiles = (char**) loadObject->allocateMetadata(
+            sizeof(char*) * numVersions);
+         memset(versionNames, 0, sizeof(char*) * numVersions);
+         memset(versionFiles, 0, sizeof(char*) * numVersions);
       }
-      if (dynamicEntry->d_tag == DT_PLTREL)
+      vd = (ElfW(Verdef)*) verdefs;
+      for (i=0; vd && i < numDefs; i++)
       {
-         PLTRType = dynamicEntry->d_un.d_val;
-         if (dynamicEntry->d_un.d_val == DT_REL)
-            PLTREntSize = sizeof(ElfW(Rel));
-         else
-            PLTREntSize = sizeof(ElfW(Rela));
+         ndx = vd->vd_ndx & 0x7fff;
+         if (pass == 0 && ndx > maxIndex)
+            maxIndex = ndx;
+         // the base definition names the object itself, not a version
+         if (pass == 1 && vd->vd_cnt && !(vd->vd_flags & VER_FLG_BASE))
+         {
+            vda = (ElfW(Verdaux)*) ((char*) vd + vd->vd_aux);
+            versionNames[ndx] = tableString(stringTable, stringTableSize,
+                                            vda->vda_name);
+         }
+         vd = vd->vd_next ? (ElfW(Verdef)*) ((char*) vd + vd->vd_next) : 0;
       }
-      if (dynamicEntry->d_tag == DT_PLTRELSZ)
+      vn = (ElfW(Verneed)*) verneeds;
+      for (i=0; vn && i < numNeeds; i++)
       {
-         PLTRSize = dynamicEntry->d_un.d_val;
+         vna = (ElfW(Vernaux)*) ((char*) vn + vn->vn_aux);
+         for (j=0; j < vn->vn_cnt; j++)
+         {
+            ndx = vna->vna_other & 0x7fff;
+            if (pass == 0 && ndx > maxIndex)
+               maxIndex = ndx;
+            if (pass == 1)
+            {
+               versionNames[ndx] = tableString(stringTable, stringTableSize,
+                                               vna->vna_name);
+               versionFiles[ndx] = tableString(stringTable, stringTableSize,
+                                               vn->vn_file);
+            }
+            if (!vna->vna_next)
+               break;
+            vna = (ElfW(Vernaux)*) ((char*) vna + vna->vna_next);
+         }
+         vn = vn->vn_next ? (ElfW(Verneed)*) ((char*) vn + vn->vn_next) : 0;
       }
-      dynamicEntry++;
    }
 }
 
-DynamicSection::~DynamicSection()
+int DynamicSection::getSymbolIndex(ElfW(Sym)* sym)
+{
+   if (!symbolTable || sym < symbolTable || 
+       sym >= symbolTable + symbolTableCount)
+      return -1;
+   return sym - symbolTable;
+}
+
+unsigned int DynamicSection::getSymbolVersionIndex(unsigned int symIndex)
+{
+   if (!versymTable || symIndex >= symbolTableCount)
+      return VER_NDX_GLOBAL;
+   return versymTable[symIndex] & 0x7fff;
+}
+
+unsigned int DynamicSection::isHiddenVersion(unsigned int symIndex)
+{
+   if (!versymTable || symIndex >= symbolTableCount)
+      return 0;
+   return (versymTable[symIndex] & 0x8000) != 0;
+}
+
+char* DynamicSection::getSymbolVersionName(unsigned int symIndex)
+{
+   return getVersionName(getSymbolVersionIndex(symIndex));
+}
+
+char* DynamicSection::getVersionName(unsigned int versionIndex)
+{
+   return versionIndex < numVersions ? versionNames[versionIndex] : 0;
+}
+
+char* DynamicSection::getVersionFile(unsigned int versionIndex)
 {
+   return versionIndex < numVersions ? versionFiles[versionIndex] : 0;
+}
+
+unsigned int DynamicSection::getNumberOfVersions()
+{
+   return numVersions;
 }
 
 void DynamicSection::debugPrintInfo()
@@ -161,12 +361,15 @@ void DynamicSection::debugPrintInfo()
    printf("string table (%p) size (0x%x)\n", stringTable, stringTableSize);
    printf("symbol table (%p) size (0x%x,%d)\n", symbolTable, symbolEntrySize,
           symbolTableCount);
+   // GOT entries can only be read through in a live process
+   unsigned int live = !loadObject->isFileImage() &&
+                       !loadObject->isSnapshotObject();
    int *p = (int*) findGOTEntryByName("printf");
    printf("DSG: printf is in GOT at %p (val=%x)\n",
-          p, p?*p:0);
+          p, (p && live)?*p:0);
    p = (int*) findGOTPLTEntryByName("printf");
    printf("DSG: printf is in GOT at %p (val=%x)\n",
-          p, p?*p:0);
+          p, (p && live)?*p:0);
    //int symcount = 4;
    //if (stringTable)
    //   symcount = DoDumpStringTable(stringTable, stringTableSize);
@@ -235,14 +438,7 @@ void DynamicSection::debugPrintInfo()
 
 unsigned long DynamicSection::findDynamicEntry(unsigned int EntryType)
 {
-   ElfW(Dyn) *dynamicEntry = dynamicSec;
-   unsigned int i;
-   for (i=0; i < numEntries && dynamicEntry->d_tag != DT_NULL; i++)
-   {
-      if ((unsigned long)dynamicEntry->d_tag == EntryType)
-         return (unsigned long) dynamicEntry;
-   }
-   return 0;
+   return (unsigned long) getEntry(EntryType);
 }
 
 char* DynamicSection::getSymbolString(ElfW(Sym)* dsym)
@@ -277,179 +473,732 @@ ElfW(Sym)* DynamicSection::findDynamicSymbolByName(char* name)
 }
 ****/
 
-ElfSymbol* DynamicSection::findDynamicSymbolByName(char *name)
-{
-   ElfSymbol *esym;
-   ElfW(Sym) *sym = symbolTable;
-   char *gote, *plte; int goti;
-   int* hashBuckets;
-   int* hashChains;
-   unsigned int index, hi;
-   unsigned int numBuckets;
-   unsigned int numChains;
-   if (!hashTable)
-      return 0;
-   numBuckets = *((unsigned int*)hashTable);
-   numChains = *((unsigned int*)hashTable+1);
-   hashBuckets = (int*)hashTable+2;
-   hashChains = (int*)hashTable+2+numBuckets;
-   hi = elfHash((const unsigned char*)name); //elf_hash(name);
-   index = hashBuckets[hi%numBuckets];
-   do {
-      sym = symbolTable+index;
-      if (index == STN_UNDEF)
-         return 0;
-      if (!strcmp(name,getSymbolString(sym)))
-         break;
-      index = hashChains[index];
-   } while (index < numChains); // just for safety
-   if (index >= numChains)
-      return 0;
-
-   if (GEN_ST_TYPE(sym->st_info) == STT_OBJECT)
-      gote = findGOTEntryByName(getSymbolString(sym));
-   else
-      gote = findGOTPLTEntryByName(getSymbolString(sym));
-   goti = ((unsigned long)gote - (unsigned long)loadObject->getGOTAddress())/4;
-   plte = loadObject->getPLTAddress() + (goti*16);
-   esym = new ElfSymbol(sym, stringTable, loadObject, plte, gote);
-   return esym;
-}
-
-unsigned long DynamicSection::elfHash(const unsigned char *name)
+/*
+ * Hashes over the first len characters of a name: the SysV ELF hash
+ * (DT_HASH) and the GNU hash (DT_GNU_HASH).
+ */
+static unsigned int sysvHash(const char* name, unsigned int len)
 {
-   unsigned long h = 0;
-   unsigned long g;
-   while (*name)
+   unsigned int h = 0, g;
+   while (len--)
    {
-      h = (h << 4) + (unsigned long) *name++;
-      if ((g = h & (unsigned long) 0xf0000000))
+      h = (h << 4) + (unsigned char) *name++;
+      if ((g = h & 0xf0000000))
          h ^= g >> 24;
       h &= ~g;
    }
    return h;
 }
 
-// return ptr to GOT entry of symbolName
-char *DynamicSection::findGOTEntryByName(char *symbolName)
+static unsigned int gnuHash(const char* name, unsigned int len)
 {
-   if (RelASection)
+   unsigned int h = 5381;
+   while (len--)
+      h = h*33 + (unsigned char) *name++;
+   return h;
+}
+
+/**
+ * Find a dynamic symbol through the hash table (GNU or SysV). A
+ * symbol matches if it has the name and, when a version is given,
+ * that version. With no version, a non-hidden (default) match wins
+ * over a hidden one, which is only returned if there is nothing
+ * else; this is close to what the dynamic linker does for an
+ * unversioned reference.
+ * -- GNU hash tables leave out undefined symbols, so when the hash
+ *    lookup fails those (at the front of the table) are searched,
+ *    unless only definitions are wanted (executables do hash some
+ *    undefined symbols, so those are skipped in the chains too)
+ * @param name is the symbol name (need not be NUL terminated).
+ * @param nameLength is the length of the name.
+ * @param version is the version wanted, or null for any.
+ * @param defaultOnly is nonzero to skip hidden versions ("@@").
+ * @param definedOnly is nonzero to skip undefined symbols.
+ * @return Symbol table index, or -1 if there is no match.
+ */
+int DynamicSection::lookupSymbol(const char* name, unsigned int nameLength,
+                                 const char* version, 
+                                 unsigned int defaultOnly,
+                                 unsigned int definedOnly)
+{
+   unsigned int* words;
+   unsigned int numBuckets, symOffset, bloomWords, h, h2, index, limit;
+   unsigned int* buckets;
+   unsigned int* chains;
+   ElfW(Addr)* bloom;
+   ElfW(Addr) bits;
+   int hidden = -1;
+   char *symName, *symVersion;
+   unsigned int bitsPerWord = sizeof(ElfW(Addr)) * 8;
+
+   if (!symbolTable || !stringTable)
+      return -1;
+#define SYMBOL_MATCHES(i) \
+   ((symName = tableString(stringTable, stringTableSize, \
+                           symbolTable[i].st_name)) && \
+    !strncmp(symName, name, nameLength) && !symName[nameLength] && \
+    (!version || ((symVersion = getSymbolVersionName(i)) && \
+                  !strcmp(symVersion, version))))
+   if (gnuHashTable)
    {
-      ElfW(Rela) *relsym = RelASection;
-      unsigned int count = RelaSize/RelaEntSize;
-      unsigned int i = 0;
-      while (i < count)
+      words = (unsigned int*) gnuHashTable;
+      numBuckets = words[0];
+      symOffset = words[1];
+      bloomWords = words[2];
+      bloom = (ElfW(Addr)*) (words + 4);
+      buckets = (unsigned int*) (bloom + bloomWords);
+      chains = buckets + numBuckets;
+      h = gnuHash(name, nameLength);
+      bits = bloomWords ? bloom[(h / bitsPerWord) & (bloomWords - 1)] : 0;
+      if (numBuckets && bloomWords &&
+          ((bits >> (h % bitsPerWord)) & 
+           (bits >> ((h >> words[3]) % bitsPerWord)) & 1))
       {
-         if (!strcmp(symbolName, getSymbolString(symbolTable+
-                                             GEN_R_SYM(relsym->r_info))))
+         index = buckets[h % numBuckets];
+         while (index >= symOffset && index < symbolTableCount)
          {
-            return (char*) relsym->r_offset; // correct??? + relsym->r_addend ???
+            h2 = chains[index - symOffset];
+            if ((h | 1) == (h2 | 1) &&
+                (!definedOnly || symbolTable[index].st_shndx != SHN_UNDEF) &&
+                SYMBOL_MATCHES(index))
+            {
+               if (!isHiddenVersion(index))
+                  return index;
+               if (hidden < 0 && !defaultOnly)
+                  hidden = index;
+            }
+            if (h2 & 1)
+               break;
+            index++;
          }
-         relsym++;
-         i++;
       }
+      if (hidden >= 0 || definedOnly)
+         return hidden;
+      // undefined symbols are not hashed
+      limit = symOffset < symbolTableCount ? symOffset : symbolTableCount;
+      for (index=1; index < limit; index++)
+         if (SYMBOL_MATCHES(index))
+            return index;
+      return -1;
    }
-   if (RelSection)
+   if (!hashTable)
+      return -1;
+   words = (unsigned int*) hashTable;
+   numBuckets = words[0];
+   buckets = words + 2;
+   chains = buckets + numBuckets;
+   if (!numBuckets)
+      return -1;
+   index = buckets[sysvHash(name, nameLength) % numBuckets];
+   for (limit=0; index != STN_UNDEF && index < symbolTableCount &&
+        limit < symbolTableCount; limit++) // limit guards against loops
    {
-      ElfW(Rel) *relsym = RelSection;
-      int count = RelSize/RelEntSize;
-      int i = 0;
-      while (i < count)
+      if ((!definedOnly || symbolTable[index].st_shndx != SHN_UNDEF) &&
+          SYMBOL_MATCHES(index))
       {
-         if (!strcmp(symbolName, getSymbolString(symbolTable+
-                                             GEN_R_SYM(relsym->r_info))))
-         {
-            return (char*)relsym->r_offset; // correct???
-         }
-         relsym++;
-         i++;
+         if (!isHiddenVersion(index))
+            return index;
+         if (hidden < 0 && !defaultOnly)
+            hidden = index;
       }
+      index = chains[index];
    }
-   return (char*)0;
+#undef SYMBOL_MATCHES
+   return hidden;
 }
 
-
-// return ptr to GOT entry of PLT-based symbolName
-char *DynamicSection::findGOTPLTEntryByName(char *symbolName)
+/*
+ * Find a dynamic symbol's index from a name that may carry a
+ * version: "name@VER" (that version, default or not) or "name@@VER"
+ * (that version, only if it is the default). Without one, the
+ * default version is found.
+ */
+int DynamicSection::lookupVersionedSymbol(char* name)
 {
-   if (!PLTRels)
-      return 0;
-   if (PLTRType == DT_RELA)
+   char *at = strchr(name, '@');
+   char *version = 0;
+   unsigned int defaultOnly = 0;
+   if (at)
    {
-      ElfW(Rela) *relsym = (ElfW(Rela) *) PLTRels;
-      unsigned int count = PLTRSize/PLTREntSize;
-      unsigned int i = 0;
-      while (i < count)
+      version = at + 1;
+      if (*version == '@')
       {
-         if (!strcmp(symbolName, getSymbolString(symbolTable+
-                                             GEN_R_SYM(relsym->r_info))))
-         {
-            return (char*)relsym->r_offset; // correct??? + relsym->r_addend ???
-         }
-         relsym++;
-         i++;
+         version++;
+         defaultOnly = 1;
       }
    }
-   else
+   return lookupSymbol(name, at ? at - name : strlen(name), version,
+                       defaultOnly);
+}
+
+/**
+ * Find the definition this object offers for a reference, as the
+ * dynamic linker looks for one in each object of its search scope:
+ * through the hash table only, skipping undefined symbols. A
+ * versioned reference matches that version; an object without
+ * version information satisfies any.
+ * @param name is the symbol name.
+ * @param version is the version referenced, or null.
+ * @return The symbol's index, or -1 if the object does not define it.
+ */
+int DynamicSection::findDefinition(const char* name, const char* version)
+{
+   int index;
+   if (!versymTable)
+      version = 0;
+   index = lookupSymbol(name, strlen(name), version, 0, 1);
+   if (index >= 0 && GEN_ST_BIND(symbolTable[index].st_info) == STB_LOCAL)
+      return -1;
+   return index;
+}
+
+/*
+ * The dynamic linker's check_match(): would it take this symbol for
+ * a reference? Cheap tests on the symbol come first, so only the
+ * plausible candidates cost a string compare.
+ */
+unsigned int DynamicSection::matchesLookup(unsigned int index,
+                                           const char* name,
+                                           const char* version,
+                                           unsigned int pltClass,
+                                           LookupCounts* counts)
+{
+   static const unsigned int allowedTypes = (1 << STT_NOTYPE) |
+      (1 << STT_OBJECT) | (1 << STT_FUNC) | (1 << STT_COMMON) |
+      (1 << STT_TLS) | (1 << STT_GNU_IFUNC);
+   ElfW(Sym)* sym = &symbolTable[index];
+   unsigned int type = GEN_ST_TYPE(sym->st_info);
+   char *symName, *symVersion;
+   if ((sym->st_value == 0 && type != STT_TLS && sym->st_shndx != SHN_ABS) ||
+       (pltClass && sym->st_shndx == SHN_UNDEF) ||
+       !((1U << type) & allowedTypes))
+      return 0;
+   counts->stringCompares++;
+   if (!(symName = tableString(stringTable, stringTableSize, sym->st_name)) ||
+       strcmp(symName, name))
+      return 0;
+   if (version && versymTable)
    {
-      ElfW(Rel) *relsym = PLTRels;
-      unsigned int count = PLTRSize/PLTREntSize;
-      unsigned int i = 0;
-      while (i < count)
+      if (!(symVersion = getSymbolVersionName(index)) ||
+          strcmp(symVersion, version))
+         return 0;
+   }
+   else if (!version && isHiddenVersion(index))
+      return 0;
+   // local symbols are skipped; the search goes on
+   return GEN_ST_BIND(sym->st_info) != STB_LOCAL;
+}
+
+/**
+ * Look a reference up in this object the way the dynamic linker's
+ * do_lookup_x() does for each object of its search scope, counting
+ * the work: the bloom filter test (GNU hash), each hash chain entry
+ * examined, and each name compare.
+ * -- version matching is simplified: an unversioned reference takes
+ *    the first non-hidden definition, and a versioned one only that
+ *    version (any definition, if this object is not versioned)
+ * @param name is the symbol name.
+ * @param gnuHashValue is getGnuHash(name).
+ * @param sysvHashValue is elfHash(name).
+ * @param version is the version referenced, or null.
+ * @param pltClass is nonzero for a JUMP_SLOT lookup, which passes
+ *        over undefined symbols that have an address (an executable's
+ *        canonical PLT entries).
+ * @param counts is where the work is added (objectsSearched, bloom
+ *        and chain counts, string compares).
+ * @return The index of the definition, or -1 if there is none here.
+ */
+int DynamicSection::traceLookup(const char* name, unsigned int gnuHashValue,
+                                unsigned int sysvHashValue,
+                                const char* version, unsigned int pltClass,
+                                LookupCounts* counts)
+{
+   unsigned int* words;
+   unsigned int numBuckets, symOffset, bloomWords, h2, index, limit;
+   unsigned int* buckets;
+   unsigned int* chains;
+   ElfW(Addr)* bloom;
+   ElfW(Addr) bits;
+   unsigned int bitsPerWord = sizeof(ElfW(Addr)) * 8;
+
+   counts->objectsSearched++;
+   if (!symbolTable || !stringTable)
+      return -1;
+   if (gnuHashTable)
+   {
+      words = (unsigned int*) gnuHashTable;
+      numBuckets = words[0];
+      symOffset = words[1];
+      bloomWords = words[2];
+      bloom = (ElfW(Addr)*) (words + 4);
+      buckets = (unsigned int*) (bloom + bloomWords);
+      chains = buckets + numBuckets;
+      bits = bloomWords ?
+         bloom[(gnuHashValue / bitsPerWord) & (bloomWords - 1)] : 0;
+      if (!numBuckets ||
+          !((bits >> (gnuHashValue % bitsPerWord)) &
+            (bits >> ((gnuHashValue >> words[3]) % bitsPerWord)) & 1))
       {
-         if (!strcmp(symbolName, getSymbolString(symbolTable+
-                                             GEN_R_SYM(relsym->r_info))))
-         {
-            return (char*)relsym->r_offset; // correct???
-         }
-         relsym++;
-         i++;
+         counts->bloomRejects++;
+         return -1;
       }
+      index = buckets[gnuHashValue % numBuckets];
+      while (index && index >= symOffset && index < symbolTableCount)
+      {
+         h2 = chains[index - symOffset];
+         counts->chainProbes++;
+         if (((gnuHashValue ^ h2) >> 1) == 0 &&
+             matchesLookup(index, name, version, pltClass, counts))
+            return index;
+         if (h2 & 1)
+            break;
+         index++;
+      }
+      counts->bloomFalsePositives++;
+      return -1;
+   }
+   if (!hashTable)
+      return -1;
+   words = (unsigned int*) hashTable;
+   numBuckets = words[0];
+   buckets = words + 2;
+   chains = buckets + numBuckets;
+   if (!numBuckets)
+      return -1;
+   index = buckets[sysvHashValue % numBuckets];
+   for (limit=0; index != STN_UNDEF && index < symbolTableCount &&
+        limit < symbolTableCount; limit++) // limit guards against loops
+   {
+      counts->chainProbes++;
+      if (matchesLookup(index, name, version, pltClass, counts))
+         return index;
+      index = chains[index];
+   }
+   return -1;
+}
+
+unsigned int DynamicSection::getGnuHash(const char* name)
+{
+   return gnuHash(name, strlen(name));
+}
+
+/**
+ * Find a dynamic symbol by name. The name may carry a version, as in
+ * "memcpy@GLIBC_2.2.5" (that version, default or not) or
+ * "memcpy@@GLIBC_2.14" (that version, only if it is the default).
+ * Without one, the default version is found.
+ * @param name is the symbol name.
+ * @return A new ElfSymbol, or null if there is no such symbol.
+ */
+ElfSymbol* DynamicSection::findDynamicSymbolByName(char *name)
+{
+   int index = lookupVersionedSymbol(name);
+   if (index < 0)
+      return 0;
+   return newSymbol(index);
+}
+
+/*
+ * Order for the address index: by address, and at one address the
+ * name to report first: default versions, then typed symbols before
+ * NOTYPE ones, then public names before ones starting with '_' (so
+ * printf before _IO_printf, and weak strdup before __strdup), then
+ * global before weak.
+ */
+static int compareAddressEntries(const void* a, const void* b)
+{
+   const SymbolAddressEntry* x = (const SymbolAddressEntry*) a;
+   const SymbolAddressEntry* y = (const SymbolAddressEntry*) b;
+   if (x->start != y->start)
+      return (x->start > y->start) - (x->start < y->start);
+   if (x->rank != y->rank)
+      return (x->rank > y->rank) - (x->rank < y->rank);
+   return (x->index > y->index) - (x->index < y->index);
+}
+
+/*
+ * Sort the defined dynamic symbols by address (once, on first use).
+ */
+void DynamicSection::buildAddressIndex()
+{
+   ElfW(Sym)* sym;
+   SymbolAddressEntry* e;
+   unsigned int i, type;
+   if (addressIndex || !symbolTable || !symbolTableCount)
+      return;
+   addressIndex = (SymbolAddressEntry*) loadObject->allocateMetadata(
+      sizeof(SymbolAddressEntry) * symbolTableCount);
+   for (i=1; i < symbolTableCount; i++)
+   {
+      sym = &symbolTable[i];
+      type = GEN_ST_TYPE(sym->st_info);
+      if (sym->st_shndx == SHN_UNDEF || sym->st_shndx == SHN_ABS ||
+          type == STT_TLS || type == STT_SECTION || type == STT_FILE)
+         continue;
+      e = &addressIndex[numAddressed++];
+      e->start = sym->st_value;
+      e->end = sym->st_value + (sym->st_size ? sym->st_size : 1);
+      e->index = i;
+      e->rank = isHiddenVersion(i) * 8 + (type == STT_NOTYPE) * 4 +
+                (stringTable && getSymbolString(sym)[0] == '_') * 2 +
+                (GEN_ST_BIND(sym->st_info) != STB_GLOBAL);
+   }
+   qsort(addressIndex, numAddressed, sizeof(SymbolAddressEntry),
+         compareAddressEntries);
+}
+
+/**
+ * Find the dynamic symbol an address falls in, as for attributing a
+ * GOT slot's target. Of several symbols at the same address (aliases)
+ * the global, default-version one is preferred. The first call sorts
+ * the symbols by address.
+ * @param vaddr is a link-time address (see LoadObject::addressToVaddr()).
+ * @return The symbol's index in the dynamic symbol table, or -1 if
+ *         no defined dynamic symbol covers the address.
+ */
+int DynamicSection::findSymbolByAddress(ElfW(Addr) vaddr)
+{
+   unsigned int low = 0, high, mid, i;
+   buildAddressIndex();
+   high = numAddressed;
+   // first entry that starts past the address
+   while (low < high)
+   {
+      mid = (low + high) / 2;
+      if (addressIndex[mid].start <= vaddr)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   if (!low)
+      return -1;
+   // back to the first symbol at the nearest address below it
+   i = low - 1;
+   while (i > 0 && addressIndex[i-1].start == addressIndex[low-1].start)
+      i--;
+   for (; i < low; i++)
+      if (vaddr < addressIndex[i].end)
+         return addressIndex[i].index;
+   return -1;
+}
+
+/**
+ * Bytes held by the lookup tables (tag chains, versions and the
+ * address index); they are part of the object's arena.
+ */
+unsigned long DynamicSection::getMemoryUsage()
+{
+   return sizeof(unsigned int) * (numEntries ? numEntries : 1) +
+          2 * sizeof(char*) * numVersions +
+          (addressIndex ? sizeof(SymbolAddressEntry) * symbolTableCount : 0);
+}
+
+/*
+ * Make an ElfSymbol for a dynamic symbol, with its PLT stub and GOT
+ * entry from the object's PLT map. Data symbols get their GLOB_DAT
+ * slot and functions their PLT slot, each falling back to the other
+ * (address-taken functions and .plt.got stubs use GLOB_DAT slots).
+ */
+ElfSymbol* DynamicSection::newSymbol(unsigned int index)
+{
+   ElfW(Sym)* sym = symbolTable + index;
+   PLTMap* map = loadObject->getPLTMap();
+   PLTSlot *jump = 0, *data = 0, *got;
+   char *plte = 0, *gote = 0;
+   if (map)
+   {
+      jump = map->findJumpSlot(index);
+      data = map->findDataSlot(index);
+      if (GEN_ST_TYPE(sym->st_info) == STT_OBJECT)
+         got = data ? data : jump;
+      else
+         got = jump ? jump : data;
+      gote = map->getGOTEntry(got);
+      plte = map->getPLTEntry(jump);
+      if (!plte)
+         plte = map->getPLTEntry(data);
    }
-   return (char*)0;
+   return new ElfSymbol(sym, stringTable, loadObject, plte, gote);
+}
+
+unsigned long DynamicSection::elfHash(const unsigned char *name)
+{
+   return sysvHash((const char*) name, strlen((const char*) name));
+}
+
+/**
+ * Find the GOT entry that the dynamic linker fills with a symbol's
+ * address (its GLOB_DAT slot).
+ * @param symbolName is the symbol name (versions as for
+ *        findDynamicSymbolByName()).
+ * @return Run-time address of the GOT entry, or null.
+ */
+char *DynamicSection::findGOTEntryByName(char *symbolName)
+{
+   PLTMap* map = loadObject->getPLTMap();
+   int index = lookupVersionedSymbol(symbolName);
+   if (!map || index < 0)
+      return 0;
+   return map->getGOTEntry(map->findDataSlot(index));
+}
+
+/**
+ * Find the GOT entry that a symbol's PLT stub jumps through (its
+ * JUMP_SLOT).
+ * @param symbolName is the symbol name (versions as for
+ *        findDynamicSymbolByName()).
+ * @return Run-time address of the GOT entry, or null.
+ */
+char *DynamicSection::findGOTPLTEntryByName(char *symbolName)
+{
+   PLTMap* map = loadObject->getPLTMap();
+   int index = lookupVersionedSymbol(symbolName);
+   if (!map || index < 0)
+      return 0;
+   return map->getGOTEntry(map->findJumpSlot(index));
 }
 
 ElfSymbol* DynamicSection::startDynamicSymbolIter(unsigned int* iter)
 {
-   char *gote, *plte;
-   int goti;
    if (!stringTable || !symbolTable)
       return 0;
    *iter = 0;
-   ElfW(Sym) *sym = symbolTable;
-   if (GEN_ST_TYPE(sym->st_info) == STT_OBJECT)
-      gote = findGOTEntryByName(getSymbolString(sym));
-   else
-      gote = findGOTPLTEntryByName(getSymbolString(sym));
-   goti = ((unsigned long)gote - (unsigned long)loadObject->getGOTAddress())/4;
-   plte = loadObject->getPLTAddress() + (goti*16);
-   ElfSymbol *esym = new ElfSymbol(sym, stringTable, loadObject, plte, gote);
-   return esym;
+   return newSymbol(0);
 }
 
 ElfSymbol* DynamicSection::nextDynamicSymbolIter(unsigned int* iter)
 {
-   char *gote, *plte;
-   int goti;
    if (!stringTable || !symbolTable)
       return 0;
    (*iter)++;
    if (*iter >= symbolTableCount)
       return 0;
-   ElfW(Sym) *sym = symbolTable;
-   sym += *iter;
-   if (GEN_ST_TYPE(sym->st_info) == STT_OBJECT)
-      gote = findGOTEntryByName(getSymbolString(sym));
-   else
-      gote = findGOTPLTEntryByName(getSymbolString(sym));
-   goti = (((unsigned long)gote) - 
-           ((unsigned long)loadObject->getGOTAddress()))/4;
-   goti -= 2; // hack; why??
-   plte = loadObject->getPLTAddress() + (goti*16);
-   if (0) printf("got=%p  gote=%p  goti=%d  plt=%p  plte=%p\n",
-          loadObject->getGOTAddress(), gote, goti, 
-          loadObject->getPLTAddress(), plte);
-   ElfSymbol *esym = new ElfSymbol(sym, stringTable, loadObject, plte, gote);
-   return esym;
+   return newSymbol(*iter);
+}
+
+/**
+ * Get the raw dynamic entries, for callers that walk them directly.
+ * @param count is a return parameter set to the number of entries
+ *        before the terminating DT_NULL.
+ * @return Pointer to the first entry.
+ */
+ElfW(Dyn)* DynamicSection::getDynamicEntries(unsigned int* count)
+{
+   *count = numUsedEntries;
+   return dynamicSec;
+}
+
+/**
+ * Get the raw dynamic symbol table.
+ * @param count is a return parameter set to the number of symbols; this
+ *        is only known from a DT_HASH or DT_GNU_HASH table, otherwise
+ *        it is 0.
+ * @return The symbol array, or null.
+ */
+ElfW(Sym)* DynamicSection::getSymbolTable(unsigned int* count)
+{
+   *count = symbolTableCount;
+   return symbolTable;
+}
+
+char* DynamicSection::getStringTable(unsigned int* size)
+{
+   *size = stringTableSize;
+   return stringTable;
+}
+
+/**
+ * Get one of the relocation tables the dynamic section points to.
+ * @param tag is DT_RELA, DT_REL or DT_JMPREL.
+ * @param count is a return parameter set to the number of relocations.
+ * @param withAddends is a return parameter set to 1 if the entries
+ *        are ElfW(Rela), 0 if they are ElfW(Rel).
+ * @return Pointer to the first relocation, or null if there are none.
+ */
+char* DynamicSection::getRelocationTable(unsigned int tag, unsigned int* count,
+                                         unsigned int* withAddends)
+{
+   *count = 0;
+   *withAddends = 0;
+   if (tag == DT_RELA && RelASection)
+   {
+      *count = RelaSize / (RelaEntSize ? RelaEntSize : sizeof(ElfW(Rela)));
+      *withAddends = 1;
+      return (char*) RelASection;
+   }
+   if (tag == DT_REL && RelSection)
+   {
+      *count = RelSize / (RelEntSize ? RelEntSize : sizeof(ElfW(Rel)));
+      return (char*) RelSection;
+   }
+   if (tag == DT_JMPREL && PLTRels && PLTREntSize)
+   {
+      *count = PLTRSize / PLTREntSize;
+      *withAddends = (PLTRType == DT_RELA);
+      return (char*) PLTRels;
+   }
+   return 0;
+}
+
+/**
+ * Get the first dynamic entry with a tag.
+ * @param tag is the DT_* tag.
+ * @return The entry, or null if the tag is not present (or has no
+ *         slot in the tag table).
+ */
+ElfW(Dyn)* DynamicSection::getEntry(unsigned long tag)
+{
+   int slot = tagSlot(tag);
+   if (slot < 0 || !firstEntry[slot])
+      return 0;
+   return &dynamicSec[firstEntry[slot] - 1];
+}
+
+unsigned int DynamicSection::hasEntry(unsigned long tag)
+{
+   return getEntry(tag) != 0;
+}
+
+unsigned int DynamicSection::getEntryCount(unsigned long tag)
+{
+   int slot = tagSlot(tag);
+   return slot < 0 ? 0 : entryCount[slot];
+}
+
+unsigned long DynamicSection::getValue(unsigned long tag, 
+                                       unsigned long missing)
+{
+   ElfW(Dyn)* entry = getEntry(tag);
+   return entry ? entry->d_un.d_val : missing;
+}
+
+/**
+ * Get what an address-valued tag points to, through the load object
+ * (which knows whether the address has been relocated, or must be
+ * turned into a file offset).
+ * @param tag is the DT_* tag.
+ * @return Pointer to the data, or null.
+ */
+char* DynamicSection::getPointer(unsigned long tag)
+{
+   ElfW(Dyn)* entry = getEntry(tag);
+   if (!entry)
+      return 0;
+   return loadObject->getVaddrDataPtr(entry->d_un.d_ptr);
+}
+
+/**
+ * Get the string named by a tag whose value is a string table offset.
+ * @param tag is the DT_* tag (DT_SONAME, DT_RUNPATH, ...).
+ * @return The string, or null.
+ */
+char* DynamicSection::getString(unsigned long tag)
+{
+   ElfW(Dyn)* entry = getEntry(tag);
+   if (!entry || !stringTable || entry->d_un.d_val >= stringTableSize)
+      return 0;
+   return stringTable + entry->d_un.d_val;
+}
+
+/**
+ * Start an iteration over all entries with a tag, in file order.
+ * @param tag is the DT_* tag.
+ * @param iter is the iteration state, for nextTagIter().
+ * @return The first entry, or null if there are none.
+ */
+ElfW(Dyn)* DynamicSection::startTagIter(unsigned long tag, unsigned int* iter)
+{
+   int slot = tagSlot(tag);
+   *iter = slot < 0 ? 0 : firstEntry[slot];
+   return *iter ? &dynamicSec[*iter - 1] : 0;
+}
+
+ElfW(Dyn)* DynamicSection::nextTagIter(unsigned int* iter)
+{
+   if (!*iter)
+      return 0;
+   *iter = nextEntry[*iter - 1];
+   return *iter ? &dynamicSec[*iter - 1] : 0;
+}
+
+char* DynamicSection::startNeededIter(unsigned int* iter)
+{
+   ElfW(Dyn)* entry = startTagIter(DT_NEEDED, iter);
+   while (entry && (!stringTable || entry->d_un.d_val >= stringTableSize))
+      entry = nextTagIter(iter);
+   return entry ? stringTable + entry->d_un.d_val : 0;
+}
+
+char* DynamicSection::nextNeededIter(unsigned int* iter)
+{
+   ElfW(Dyn)* entry = nextTagIter(iter);
+   while (entry && (!stringTable || entry->d_un.d_val >= stringTableSize))
+      entry = nextTagIter(iter);
+   return entry ? stringTable + entry->d_un.d_val : 0;
+}
+
+unsigned int DynamicSection::getNumberOfNeeded()
+{
+   return getEntryCount(DT_NEEDED);
+}
+
+char* DynamicSection::getSoname()
+{
+   return getString(DT_SONAME);
+}
+
+char* DynamicSection::getRunPath()
+{
+   return hasEntry(DT_RUNPATH) ? getString(DT_RUNPATH) : getString(DT_RPATH);
+}
+
+unsigned long DynamicSection::getFlags()
+{
+   return getValue(DT_FLAGS);
+}
+
+unsigned long DynamicSection::getFlags1()
+{
+   return getValue(DT_FLAGS_1);
+}
+
+/*
+ * An array given by an address tag and a size-in-bytes tag.
+ */
+static ElfW(Addr)* getTagArray(DynamicSection* dyn, unsigned long tag,
+                               unsigned long sizeTag, unsigned int* count)
+{
+   ElfW(Addr)* array = (ElfW(Addr)*) dyn->getPointer(tag);
+   *count = array ? dyn->getValue(sizeTag) / sizeof(ElfW(Addr)) : 0;
+   return array;
+}
+
+ElfW(Addr)* DynamicSection::getInitArray(unsigned int* count)
+{
+   return getTagArray(this, DT_INIT_ARRAY, DT_INIT_ARRAYSZ, count);
+}
+
+ElfW(Addr)* DynamicSection::getFiniArray(unsigned int* count)
+{
+   return getTagArray(this, DT_FINI_ARRAY, DT_FINI_ARRAYSZ, count);
+}
+
+ElfW(Addr)* DynamicSection::getPreInitArray(unsigned int* count)
+{
+   return getTagArray(this, DT_PREINIT_ARRAY, DT_PREINIT_ARRAYSZ, count);
+}
+
+ElfW(Addr)* DynamicSection::getRelrTable(unsigned int* count)
+{
+   return getTagArray(this, DT_RELR, DT_RELRSZ, count);
 }
 
+char* DynamicSection::getGnuHashTable()
+{
+   return gnuHashTable;
+}
+
+char* DynamicSection::getHashTable()
+{
+   return hashTable;
+}
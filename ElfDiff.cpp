@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ElfProgram.h>
+
+/*
+ * One side of a join: a key (name plus optional version), what it
+ * refers to, and the index of its partner on the other side.
+ */
+struct DiffKey
+{
+   const char* name;
+   const char* version;
+   unsigned int hash;
+   int match;            // index of the matching key on the other side
+   ElfW(Sym)* sym;
+   unsigned long size;
+   unsigned long contentHash;  // sections only
+   unsigned int hasContent;    // nonzero if contentHash is set
+};
+
+static unsigned int keyHash(const char* name, const char* version)
+{
+   unsigned int h = 5381;
+   while (*name)
+      h = h*33 + (unsigned char) *name++;
+   if (version)
+   {
+      h = h*33 + '@';
+      while (*version)
+         h = h*33 + (unsigned char) *version++;
+   }
+   return h;
+}
+
+static unsigned int keysEqual(DiffKey* a, DiffKey* b)
+{
+   return a->hash == b->hash && !strcmp(a->name, b->name) &&
+          !strcmp(a->version ? a->version : "", b->version ? b->version : "");
+}
+
+static void setKey(DiffKey* key, const char* name, const char* version)
+{
+   key->name = name;
+   key->version = version;
+   key->hash = keyHash(name, version);
+   key->match = -1;
+   key->sym = 0;
+   key->size = 0;
+   key->hasContent = 0;
+}
+
+/*
+ * Pair up equal keys of the two sides: the old keys go into a hash
+ * table, then each new key takes the first unmatched old key that is
+ * equal to it. Repeated keys are paired in table order.
+ */
+static void joinKeys(DiffKey* oldKeys, unsigned int numOld,
+                     DiffKey* newKeys, unsigned int numNew)
+{
+   unsigned int numBuckets, i, j;
+   int *buckets, *chains, k;
+   for (numBuckets=16; numBuckets < numOld*2; numBuckets <<= 1)
+      ;
+   buckets = new int[numBuckets];
+   chains = new int[numOld+1];
+   memset(buckets, 0xff, numBuckets * sizeof(int));
+   // insert backwards so that chains run in table order
+   for (i=numOld; i > 0; i--)
+   {
+      chains[i-1] = buckets[oldKeys[i-1].hash & (numBuckets-1)];
+      buckets[oldKeys[i-1].hash & (numBuckets-1)] = i-1;
+   }
+   for (j=0; j < numNew; j++)
+   {
+      for (k = buckets[newKeys[j].hash & (numBuckets-1)]; k >= 0;
+           k = chains[k])
+         if (oldKeys[k].match < 0 && keysEqual(&oldKeys[k], &newKeys[j]))
+         {
+            oldKeys[k].match = j;
+            newKeys[j].match = k;
+            break;
+         }
+   }
+   delete[] buckets;
+   delete[] chains;
+}
+
+/*
+ * Collect the symbols to compare: the dynamic symbol table (with
+ * versions) if there is one, else the global symbols of the static
+ * symbol table. Local, section and file symbols are left out.
+ */
+static DiffKey* collectSymbols(LoadObject* lo, unsigned int* count)
+{
+   ElfW(Sym) *syms;
+   char* strTable;
+   unsigned long strSize;
+   unsigned int numSyms, i, n, type;
+   DiffKey* keys;
+   DynamicSection* dyn = lo->getDynamicSection();
+   syms = lo->getDynamicSymbolTable(&numSyms, &strTable, &strSize);
+   if (!syms || !numSyms)
+   {
+      syms = lo->getStaticSymbolTable(&numSyms, &strTable, &strSize);
+      dyn = 0;
+   }
+   keys = new DiffKey[numSyms ? numSyms : 1];
+   for (i=1, n=0; syms && i < numSyms; i++)
+   {
+      type = GEN_ST_TYPE(syms[i].st_info);
+      if (GEN_ST_BIND(syms[i].st_info) == STB_LOCAL ||
+          type == STT_SECTION || type == STT_FILE ||
+          (strSize && syms[i].st_name >= strSize))
+         continue;
+      // dynamic symbols are keyed by name and version, so that a new
+      // version of a symbol shows as an addition
+      setKey(&keys[n], strTable + syms[i].st_name,
+             dyn ? dyn->getSymbolVersionName(i) : 0);
+      keys[n].sym = &syms[i];
+      keys[n].size = syms[i].st_size;
+      n++;
+   }
+   *count = n;
+   return keys;
+}
+
+static DiffKey* collectSections(LoadObject* lo, unsigned int* count)
+{
+   char* shStrTable = lo->getSectionHeaderStringTable();
+   ElfSection* sec;
+   DiffKey* keys;
+   unsigned int i, n;
+   for (n=0; lo->getSection(n); n++)
+      ;
+   keys = new DiffKey[n ? n : 1];
+   for (i=1, n=0; shStrTable && (sec = lo->getSection(i)); i++)
+   {
+      setKey(&keys[n], sec->getName(shStrTable), 0);
+      keys[n].size = sec->getSizeInBytes();
+      keys[n].hasContent = !sec->getContentHash(&keys[n].contentHash);
+      n++;
+   }
+   *count = n;
+   return keys;
+}
+
+static DiffKey* collectNeeded(LoadObject* lo, unsigned int* count)
+{
+   DynamicSection* dyn = lo->getDynamicSection();
+   DiffKey* keys;
+   unsigned int numNeeded = dyn ? dyn->getNumberOfNeeded() : 0, iter, n = 0;
+   char* name;
+   keys = new DiffKey[numNeeded ? numNeeded : 1];
+   for (name = dyn ? dyn->startNeededIter(&iter) : 0; name;
+        name = dyn->nextNeededIter(&iter))
+      setKey(&keys[n++], name, 0);
+   *count = n;
+   return keys;
+}
+
+/**
+ * Set up a diff of two objects the caller owns.
+ * @param oldObject is the old version.
+ * @param newObject is the new version.
+ */
+ElfDiff::ElfDiff(LoadObject* oldObject, LoadObject* newObject)
+{
+   init(oldObject, newObject);
+}
+
+/**
+ * Set up a diff of two files, which are opened as file-mode
+ * LoadObjects (without looking for separate debug files).
+ * @param oldFilename is the old version.
+ * @param newFilename is the new version.
+ */
+ElfDiff::ElfDiff(char* oldFilename, char* newFilename)
+{
+   init(new LoadObject(oldFilename, 0), new LoadObject(newFilename, 0));
+   ownsObjects = 1;
+}
+
+void ElfDiff::init(LoadObject* oldObject, LoadObject* newObject)
+{
+   this->oldObject = oldObject;
+   this->newObject = newObject;
+   ownsObjects = 0;
+   changes = 0;
+   numChanges = 0;
+   maxChanges = 0;
+}
+
+ElfDiff::~ElfDiff()
+{
+   delete[] changes;
+   if (ownsObjects)
+   {
+      delete oldObject;
+      delete newObject;
+   }
+}
+
+unsigned int ElfDiff::isValidDiff()
+{
+   return oldObject && newObject && oldObject->isValidObject() &&
+          newObject->isValidObject();
+}
+
+static int compareChanges(const void* a, const void* b)
+{
+   const ElfDiffChange* x = (const ElfDiffChange*) a;
+   const ElfDiffChange* y = (const ElfDiffChange*) b;
+   int c;
+   if (x->item != y->item)
+      return x->item < y->item ? -1 : 1;
+   if (x->change != y->change)
+      return x->change < y->change ? -1 : 1;
+   c = strcmp(x->name, y->name);
+   if (c)
+      return c;
+   return strcmp(x->version ? x->version : "", y->version ? y->version : "");
+}
+
+/**
+ * Compare the two objects. The changes are sorted by item, kind of
+ * change, and name.
+ * @return The number of changes, or -1 if the objects are not valid.
+ */
+int ElfDiff::compare()
+{
+   if (!isValidDiff())
+      return -1;
+   numChanges = 0;
+   compareSymbols();
+   compareSections();
+   compareNeeded();
+   qsort(changes, numChanges, sizeof(ElfDiffChange), compareChanges);
+   return numChanges;
+}
+
+ElfDiffChange* ElfDiff::addChange(unsigned int item, unsigned int change,
+                                  const char* name)
+{
+   ElfDiffChange* c;
+   if (numChanges == maxChanges)
+   {
+      maxChanges = maxChanges ? maxChanges*2 : 64;
+      c = new ElfDiffChange[maxChanges];
+      if (numChanges)
+         memcpy(c, changes, numChanges * sizeof(ElfDiffChange));
+      delete[] changes;
+      changes = c;
+   }
+   c = &changes[numChanges++];
+   memset(c, 0, sizeof(*c));
+   c->item = item;
+   c->change = change;
+   c->name = name;
+   return c;
+}
+
+void ElfDiff::compareSymbols()
+{
+   DiffKey *oldKeys, *newKeys, *o, *n;
+   unsigned int numOld, numNew, i;
+   ElfDiffChange* c;
+   oldKeys = collectSymbols(oldObject, &numOld);
+   newKeys = collectSymbols(newObject, &numNew);
+   joinKeys(oldKeys, numOld, newKeys, numNew);
+   for (i=0; i < numNew; i++)
+   {
+      n = &newKeys[i];
+      o = (n->match >= 0) ? &oldKeys[n->match] : 0;
+      if (o && o->size == n->size && o->sym->st_info == n->sym->st_info &&
+          (o->sym->st_shndx == SHN_UNDEF) == (n->sym->st_shndx == SHN_UNDEF))
+         continue;
+      c = addChange(DIFF_SYMBOL, o ? DIFF_CHANGED : DIFF_ADDED, n->name);
+      c->version = n->version;
+      c->newSym = n->sym;
+      c->newSize = n->size;
+      if (o)
+      {
+         c->oldSym = o->sym;
+         c->oldSize = o->size;
+      }
+   }
+   for (i=0; i < numOld; i++)
+   {
+      o = &oldKeys[i];
+      if (o->match >= 0)
+         continue;
+      c = addChange(DIFF_SYMBOL, DIFF_REMOVED, o->name);
+      c->version = o->version;
+      c->oldSym = o->sym;
+      c->oldSize = o->size;
+   }
+   delete[] oldKeys;
+   delete[] newKeys;
+}
+
+void ElfDiff::compareSections()
+{
+   DiffKey *oldKeys, *newKeys, *o;
+   unsigned int numOld, numNew, i;
+   ElfDiffChange* c;
+   oldKeys = collectSections(oldObject, &numOld);
+   newKeys = collectSections(newObject, &numNew);
+   joinKeys(oldKeys, numOld, newKeys, numNew);
+   for (i=0; i < numNew; i++)
+   {
+      o = (newKeys[i].match >= 0) ? &oldKeys[newKeys[i].match] : 0;
+      if (o && o->size == newKeys[i].size &&
+          (!o->hasContent || !newKeys[i].hasContent ||
+           o->contentHash == newKeys[i].contentHash))
+         continue;
+      c = addChange(DIFF_SECTION,
+                    newKeys[i].match >= 0 ? DIFF_CHANGED : DIFF_ADDED,
+                    newKeys[i].name);
+      c->newSize = newKeys[i].size;
+      if (newKeys[i].match >= 0)
+         c->oldSize = oldKeys[newKeys[i].match].size;
+   }
+   for (i=0; i < numOld; i++)
+      if (oldKeys[i].match < 0)
+         addChange(DIFF_SECTION, DIFF_REMOVED, oldKeys[i].name)->oldSize =
+            oldKeys[i].size;
+   delete[] oldKeys;
+   delete[] newKeys;
+}
+
+void ElfDiff::compareNeeded()
+{
+   DiffKey *oldKeys, *newKeys;
+   unsigned int numOld, numNew, i;
+   oldKeys = collectNeeded(oldObject, &numOld);
+   newKeys = collectNeeded(newObject, &numNew);
+   joinKeys(oldKeys, numOld, newKeys, numNew);
+   for (i=0; i < numNew; i++)
+      if (newKeys[i].match < 0)
+         addChange(DIFF_NEEDED, DIFF_ADDED, newKeys[i].name);
+   for (i=0; i < numOld; i++)
+      if (oldKeys[i].match < 0)
+         addChange(DIFF_NEEDED, DIFF_REMOVED, oldKeys[i].name);
+   delete[] oldKeys;
+   delete[] newKeys;
+}
+
+unsigned int ElfDiff::getNumberOfChanges()
+{
+   return numChanges;
+}
+
+ElfDiffChange* ElfDiff::getChange(unsigned int index)
+{
+   if (index >= numChanges)
+      return 0;
+   return &changes[index];
+}
+
+/**
+ * Count changes of one kind.
+ * @param item is an ElfDiffItem (0 for all items).
+ * @param change is an ElfDiffKind (0 for all kinds).
+ */
+unsigned int ElfDiff::countChanges(unsigned int item, unsigned int change)
+{
+   unsigned int i, count = 0;
+   for (i=0; i < numChanges; i++)
+      if ((!item || changes[i].item == item) &&
+          (!change || changes[i].change == change))
+         count++;
+   return count;
+}
+
+static void putSymbolInfo(OutputBuffer* out, ElfW(Sym)* sym)
+{
+   const char* name;
+   out->putChar(' ');
+   name = ElfExporter::getSymbolTypeName(GEN_ST_TYPE(sym->st_info));
+   if (name)
+      out->putString(name);
+   else
+      out->putDecimal(GEN_ST_TYPE(sym->st_info));
+   out->putChar(' ');
+   name = ElfExporter::getSymbolBindName(GEN_ST_BIND(sym->st_info));
+   if (name)
+      out->putString(name);
+   else
+      out->putDecimal(GEN_ST_BIND(sym->st_info));
+   if (sym->st_shndx == SHN_UNDEF)
+      out->putString(" UND");
+}
+
+static void putSizeChange(OutputBuffer* out, unsigned long oldSize,
+                          unsigned long newSize)
+{
+   out->putString(" size ");
+   out->putDecimal(oldSize);
+   out->putString(" -> ");
+   out->putDecimal(newSize);
+   out->putString(" (");
+   if (newSize >= oldSize)
+      out->putChar('+');
+   out->putSigned((long) (newSize - oldSize));
+   out->putChar(')');
+}
+
+/**
+ * Write the changes as text, one per line, followed by a summary:
+ *   symbol + name FUNC GLOBAL size 12
+ *   symbol ~ name size 12 -> 16 (+4)
+ *   section ~ .text size 1000 -> 1010 (+10)
+ *   needed - libfoo.so.1
+ * @param out is the buffer to write to.
+ */
+void ElfDiff::writeReport(OutputBuffer* out)
+{
+   static const char changeMarks[] = " +-~";
+   static const char* itemNames[] = { "", "symbol", "section", "needed" };
+   static const char* summaryNames[] = { "", "symbols", "sections", "needed" };
+   ElfDiffChange* c;
+   unsigned int i;
+   out->putString("--- ");
+   out->putString(oldObject ? oldObject->getName() : "(none)");
+   out->putString("\n+++ ");
+   out->putString(newObject ? newObject->getName() : "(none)");
+   out->putChar('\n');
+   if (!isValidDiff())
+   {
+      out->putString("error: cannot read ");
+      out->putString(oldObject && oldObject->isValidObject() ?
+                     "new" : "old");
+      out->putString(" object\n");
+      return;
+   }
+   for (i=0; i < numChanges; i++)
+   {
+      c = &changes[i];
+      out->putString(itemNames[c->item]);
+      out->putChar(' ');
+      out->putChar(changeMarks[c->change]);
+      out->putChar(' ');
+      out->putString(c->name);
+      if (c->version)
+      {
+         out->putChar('@');
+         out->putString(c->version);
+      }
+      if (c->change == DIFF_CHANGED)
+      {
+         if (c->oldSize != c->newSize)
+            putSizeChange(out, c->oldSize, c->newSize);
+         else if (c->item == DIFF_SECTION)
+            out->putString(" contents");
+         if (c->item == DIFF_SYMBOL &&
+             (c->oldSym->st_info != c->newSym->st_info ||
+              (c->oldSym->st_shndx == SHN_UNDEF) !=
+              (c->newSym->st_shndx == SHN_UNDEF)))
+         {
+            putSymbolInfo(out, c->oldSym);
+            out->putString(" ->");
+            putSymbolInfo(out, c->newSym);
+         }
+      }
+      else if (c->item == DIFF_SYMBOL)
+      {
+         putSymbolInfo(out, c->newSym ? c->newSym : c->oldSym);
+         out->putString(" size ");
+         out->putDecimal(c->newSym ? c->newSize : c->oldSize);
+      }
+      else if (c->item == DIFF_SECTION)
+      {
+         out->putString(" size ");
+         out->putDecimal(c->newSize ? c->newSize : c->oldSize);
+      }
+      out->putChar('\n');
+   }
+   out->putString("summary:");
+   for (i=DIFF_SYMBOL; i <= DIFF_NEEDED; i++)
+   {
+      out->putChar(' ');
+      out->putString(summaryNames[i]);
+      out->putString(" +");
+      out->putDecimal(countChanges(i, DIFF_ADDED));
+      out->putString(" -");
+      out->putDecimal(countChanges(i, DIFF_REMOVED));
+      if (i != DIFF_NEEDED)
+      {
+         out->putString(" ~");
+         out->putDecimal(countChanges(i, DIFF_CHANGED));
+      }
+      out->putChar(i == DIFF_NEEDED ? '\n' : ',');
+   }
+}
+
+/*
+ * The file pairs being diffed, and where the results go.
+ */
+struct DiffWork
+{
+   char** oldFiles;
+   char** newFiles;
+   ElfDiff** diffs;
+};
+
+static void diffPair(void* arg, unsigned int index, unsigned int worker)
+{
+   DiffWork* work = (DiffWork*) arg;
+   work->diffs[index] = new ElfDiff(work->oldFiles[index],
+                                    work->newFiles[index]);
+   work->diffs[index]->compare();
+}
+
+/**
+ * Diff many pairs of files, using several threads. Each pair is
+ * handled by one thread from start to finish, so no locking is needed.
+ * @param oldFiles are the old versions.
+ * @param newFiles are the new versions (same order).
+ * @param count is the number of pairs.
+ * @param numThreads is the thread count (0 means one per CPU).
+ * @return An array of compared ElfDiffs, in pair order (caller
+ *         deletes each one, and the array with delete[]).
+ */
+ElfDiff** ElfDiff::compareFiles(char** oldFiles, char** newFiles,
+                                unsigned int count, unsigned int numThreads)
+{
+   DiffWork work;
+   work.oldFiles = oldFiles;
+   work.newFiles = newFiles;
+   work.diffs = new ElfDiff*[count ? count : 1];
+   ParallelFor::run(count, numThreads, diffPair, &work);
+   return work.diffs;
+}
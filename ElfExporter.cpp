@@ -0,0 +1,742 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <ElfProgram.h>
+
+//
+// Record kinds (index into the column tables) and their columns.
+// Column names are what setColumns() accepts and what appears in
+// the JSON keys and CSV headers.
+//
+#define KIND_SYMBOL   0
+#define KIND_SECTION  1
+#define KIND_SEGMENT  2
+#define KIND_DYNAMIC  3
+#define KIND_RELOC    4
+#define NUM_KINDS     5
+
+static const char* kindNames[NUM_KINDS] =
+   { "symbol", "section", "segment", "dynamic", "reloc" };
+
+enum { SYM_OBJECT, SYM_TABLE, SYM_INDEX, SYM_NAME, SYM_VALUE, SYM_SIZE,
+       SYM_TYPE, SYM_BIND, SYM_VISIBILITY, SYM_SHNDX, SYM_SHNDX_NAME,
+       SYM_VERSION };
+enum { SEC_OBJECT, SEC_INDEX, SEC_NAME, SEC_TYPE, SEC_FLAGS, SEC_ADDR,
+       SEC_OFFSET, SEC_SIZE, SEC_LINK, SEC_INFO, SEC_ALIGN, SEC_ENTSIZE };
+enum { SEG_OBJECT, SEG_INDEX, SEG_TYPE, SEG_FLAGS, SEG_VADDR, SEG_PADDR,
+       SEG_OFFSET, SEG_FILESZ, SEG_MEMSZ, SEG_ALIGN };
+enum { DYN_OBJECT, DYN_INDEX, DYN_TAG, DYN_VALUE, DYN_NAME };
+enum { REL_OBJECT, REL_TABLE, REL_OFFSET, REL_TYPE, REL_SYMINDEX,
+       REL_NAME, REL_ADDEND };
+
+static const char* symbolColumns[] =
+   { "object", "table", "index", "name", "value", "size", "type", "bind",
+     "visibility", "shndx", "shndx_name", "version", 0 };
+static const char* sectionColumns[] =
+   { "object", "index", "name", "type", "flags", "addr", "offset", "size",
+     "link", "info", "align", "entsize", 0 };
+static const char* segmentColumns[] =
+   { "object", "index", "type", "flags", "vaddr", "paddr", "offset",
+     "filesz", "memsz", "align", 0 };
+static const char* dynamicColumns[] =
+   { "object", "index", "tag", "value", "name", 0 };
+static const char* relocColumns[] =
+   { "object", "table", "offset", "type", "symindex", "name", "addend", 0 };
+
+static const char** kindColumns[NUM_KINDS] =
+   { symbolColumns, sectionColumns, segmentColumns, dynamicColumns,
+     relocColumns };
+
+//
+// JSON field prefixes (',"name":') for every column, built once so
+// that starting a field is a single copy
+//
+static char fieldKeys[NUM_KINDS][16][24];
+static unsigned char fieldKeyLengths[NUM_KINDS][16];
+static pthread_once_t fieldKeysOnce = PTHREAD_ONCE_INIT;
+
+static void initFieldKeys(void)
+{
+   unsigned int k, c;
+   for (k=0; k < NUM_KINDS; k++)
+      for (c=0; kindColumns[k][c]; c++)
+         fieldKeyLengths[k][c] = snprintf(fieldKeys[k][c],
+                                          sizeof(fieldKeys[k][c]),
+                                          ",\"%s\":", kindColumns[k][c]);
+}
+
+//
+// Names for the common type codes; anything else is written in hex
+//
+static const char* symbolTypeNames[] =
+   { "NOTYPE", "OBJECT", "FUNC", "SECTION", "FILE", "COMMON", "TLS" };
+static const char* symbolBindNames[] = { "LOCAL", "GLOBAL", "WEAK" };
+static const char* visibilityNames[] =
+   { "DEFAULT", "INTERNAL", "HIDDEN", "PROTECTED" };
+static const char* sectionTypeNames[] =
+   { "NULL", "PROGBITS", "SYMTAB", "STRTAB", "RELA", "HASH", "DYNAMIC",
+     "NOTE", "NOBITS", "REL", "SHLIB", "DYNSYM", 0, 0, "INIT_ARRAY",
+     "FINI_ARRAY", "PREINIT_ARRAY", "GROUP", "SYMTAB_SHNDX" };
+static const char* segmentTypeNames[] =
+   { "NULL", "LOAD", "DYNAMIC", "INTERP", "NOTE", "SHLIB", "PHDR", "TLS" };
+static const char* dynamicTagNames[] =
+   { "NULL", "NEEDED", "PLTRELSZ", "PLTGOT", "HASH", "STRTAB", "SYMTAB",
+     "RELA", "RELASZ", "RELAENT", "STRSZ", "SYMENT", "INIT", "FINI",
+     "SONAME", "RPATH", "SYMBOLIC", "REL", "RELSZ", "RELENT", "PLTREL",
+     "DEBUG", "TEXTREL", "JMPREL", "BIND_NOW", "INIT_ARRAY", "FINI_ARRAY",
+     "INIT_ARRAYSZ", "FINI_ARRAYSZ", "RUNPATH", "FLAGS", 0,
+     "PREINIT_ARRAY", "PREINIT_ARRAYSZ", "SYMTAB_SHNDX" };
+
+struct CodeName
+{
+   unsigned long code;
+   const char* name;
+};
+
+static const struct CodeName osSectionTypes[] =
+   { { SHT_GNU_HASH, "GNU_HASH" }, { SHT_GNU_verdef, "VERDEF" },
+     { SHT_GNU_verneed, "VERNEED" }, { SHT_GNU_versym, "VERSYM" },
+     { 0, 0 } };
+static const struct CodeName osSegmentTypes[] =
+   { { PT_GNU_EH_FRAME, "GNU_EH_FRAME" }, { PT_GNU_STACK, "GNU_STACK" },
+     { PT_GNU_RELRO, "GNU_RELRO" }, { 0x6474e553, "GNU_PROPERTY" },
+     { 0, 0 } };
+static const struct CodeName osDynamicTags[] =
+   { { DT_GNU_HASH, "GNU_HASH" }, { DT_VERSYM, "VERSYM" },
+     { DT_RELACOUNT, "RELACOUNT" }, { DT_RELCOUNT, "RELCOUNT" },
+     { DT_FLAGS_1, "FLAGS_1" }, { DT_VERDEF, "VERDEF" },
+     { DT_VERDEFNUM, "VERDEFNUM" }, { DT_VERNEED, "VERNEED" },
+     { DT_VERNEEDNUM, "VERNEEDNUM" }, { 0, 0 } };
+
+/**
+ * Look up the name of a type code.
+ * @return The name, or null if the code has none.
+ */
+static const char* codeName(unsigned long code, const char** names,
+                            unsigned int numNames,
+                            const struct CodeName* osNames)
+{
+   if (code < numNames)
+      return names[code];
+   for (; osNames && osNames->name; osNames++)
+      if (osNames->code == code)
+         return osNames->name;
+   return 0;
+}
+
+#define NUM_NAMES(a) (sizeof(a)/sizeof(a[0]))
+
+//
+// Dynamic tags whose value is an offset into the dynamic string table
+//
+static unsigned int isStringTag(unsigned long tag)
+{
+   return tag == DT_NEEDED || tag == DT_SONAME || tag == DT_RPATH ||
+          tag == DT_RUNPATH;
+}
+
+/**
+ * Set up an exporter writing to a buffer. All columns of every
+ * record kind are selected and there are no filters.
+ * @param out is the buffer records are written to.
+ * @param csv is nonzero for CSV output, zero for NDJSON.
+ */
+ElfExporter::ElfExporter(OutputBuffer* out, unsigned int csv)
+{
+   unsigned int k, c;
+   pthread_once(&fieldKeysOnce, initFieldKeys);
+   this->out = out;
+   this->csv = csv;
+   kind = 0;
+   lastKind = NUM_KINDS;
+   numFields = 0;
+   for (k=0; k < NUM_KINDS; k++)
+   {
+      for (c=0; kindColumns[k][c]; c++)
+         columns[k][c] = c;
+      numColumns[k] = c;
+   }
+   namePattern = 0;
+   prefixLength = 0;
+   prefixOnly = 0;
+   typeFilter = -1;
+   bindFilter = -1;
+   definedFilter = -1;
+   records = 0;
+}
+
+ElfExporter::~ElfExporter()
+{
+   free(namePattern);
+}
+
+/**
+ * Select the columns to write. Each record kind gets the listed
+ * columns it has, in the order given; names a kind does not have
+ * are skipped for that kind.
+ * @param columnList is a comma separated list of column names.
+ * @return 0 on success, -1 if a name is not a column of any kind
+ *         (the selection is then left unchanged).
+ */
+int ElfExporter::setColumns(char* columnList)
+{
+   unsigned char newColumns[NUM_KINDS][16];
+   unsigned int newCount[NUM_KINDS];
+   unsigned int k, c, len, found;
+   char *name, *end;
+   memset(newCount, 0, sizeof(newCount));
+   for (name=columnList; *name; name = *end ? end+1 : end)
+   {
+      end = strchr(name, ',');
+      if (!end)
+         end = name + strlen(name);
+      len = end - name;
+      if (!len)
+         continue;
+      found = 0;
+      for (k=0; k < NUM_KINDS; k++)
+         for (c=0; kindColumns[k][c]; c++)
+            if (!strncmp(kindColumns[k][c], name, len) &&
+                !kindColumns[k][c][len])
+            {
+               if (newCount[k] < sizeof(newColumns[k]))
+                  newColumns[k][newCount[k]++] = c;
+               found = 1;
+            }
+      if (!found)
+         return -1;
+   }
+   memcpy(columns, newColumns, sizeof(columns));
+   memcpy(numColumns, newCount, sizeof(numColumns));
+   return 0;
+}
+
+/**
+ * Only export symbols, sections and relocations whose name matches
+ * a shell glob. The literal prefix of the pattern is checked with a
+ * plain compare first, so a prefix pattern ("foo*") never reaches
+ * fnmatch().
+ * @param pattern is the glob, or null to remove the filter.
+ */
+void ElfExporter::setNameFilter(char* pattern)
+{
+   free(namePattern);
+   namePattern = pattern ? strdup(pattern) : 0;
+   if (!namePattern)
+      return;
+   prefixLength = strcspn(namePattern, "*?[\\");
+   prefixOnly = namePattern[prefixLength] == '*' &&
+                namePattern[prefixLength+1] == '\0';
+}
+
+void ElfExporter::setTypeFilter(int type)
+{
+   typeFilter = type;
+}
+
+void ElfExporter::setBindFilter(int bind)
+{
+   bindFilter = bind;
+}
+
+void ElfExporter::setDefinedFilter(int defined)
+{
+   definedFilter = defined;
+}
+
+/**
+ * Name of a symbol type, as written in symbol records.
+ * @return The name, or null for an unnamed type.
+ */
+const char* ElfExporter::getSymbolTypeName(unsigned int type)
+{
+   if (type == STT_GNU_IFUNC)
+      return "GNU_IFUNC";
+   return codeName(type, symbolTypeNames, NUM_NAMES(symbolTypeNames), 0);
+}
+
+/**
+ * Name of a symbol binding, as written in symbol records.
+ * @return The name, or null for an unnamed binding.
+ */
+const char* ElfExporter::getSymbolBindName(unsigned int bind)
+{
+   if (bind == STB_GNU_UNIQUE)
+      return "GNU_UNIQUE";
+   return codeName(bind, symbolBindNames, NUM_NAMES(symbolBindNames), 0);
+}
+
+unsigned long ElfExporter::getRecordCount()
+{
+   return records;
+}
+
+unsigned int ElfExporter::nameMatches(const char* name)
+{
+   if (!namePattern)
+      return 1;
+   if (strncmp(name, namePattern, prefixLength))
+      return 0;
+   if (prefixOnly)
+      return 1;
+   if (!namePattern[prefixLength])
+      return name[prefixLength] == '\0';
+   return !fnmatch(namePattern, name, 0);
+}
+
+/**
+ * Start a record; for CSV, a header line is written first if the
+ * record kind differs from the previous record's.
+ */
+void ElfExporter::beginRecord(unsigned int kind)
+{
+   unsigned int c;
+   this->kind = kind;
+   numFields = 0;
+   records++;
+   if (!csv)
+   {
+      out->putString("{\"kind\":\"");
+      out->putString(kindNames[kind]);
+      out->putChar('"');
+      return;
+   }
+   if (kind != lastKind)
+   {
+      out->putString("kind");
+      for (c=0; c < numColumns[kind]; c++)
+      {
+         out->putChar(',');
+         out->putString(kindColumns[kind][columns[kind][c]]);
+      }
+      out->putChar('\n');
+      lastKind = kind;
+   }
+   out->putString(kindNames[kind]);
+}
+
+void ElfExporter::beginField(unsigned int field)
+{
+   if (csv)
+   {
+      out->putChar(',');
+      return;
+   }
+   out->putBytes(fieldKeys[kind][field], fieldKeyLengths[kind][field]);
+}
+
+void ElfExporter::endRecord()
+{
+   if (!csv)
+      out->putChar('}');
+   out->putChar('\n');
+}
+
+void ElfExporter::putString(const char* str)
+{
+   if (csv)
+      out->putCSVString(str);
+   else
+      out->putJSONString(str);
+}
+
+//
+// Addresses and flags are written as "0x..." strings in JSON, since
+// JSON has no hex numbers and 64-bit values do not survive a double
+//
+void ElfExporter::putHexField(unsigned long value)
+{
+   if (csv)
+   {
+      out->putBytes("0x", 2);
+      out->putHex(value);
+      return;
+   }
+   out->putBytes("\"0x", 3);
+   out->putHex(value);
+   out->putChar('"');
+}
+
+/**
+ * Export one object.
+ * @param lo is the object.
+ * @param kinds is a mask of ExportRecordKind values.
+ * @return The number of records written so far (all objects).
+ */
+unsigned long ElfExporter::exportObject(LoadObject* lo, unsigned int kinds)
+{
+   ElfW(Sym)* syms;
+   unsigned int count;
+   char* strTable;
+   unsigned long strTableSize;
+   if (!lo || !lo->isValidObject())
+      return records;
+   if (kinds & EXPORT_SECTIONS)
+      exportSections(lo);
+   if (kinds & EXPORT_SEGMENTS)
+      exportSegments(lo);
+   if (kinds & EXPORT_DYNAMIC)
+      exportDynamic(lo);
+   if (kinds & EXPORT_SYMTAB)
+   {
+      syms = lo->getStaticSymbolTable(&count, &strTable, &strTableSize);
+      exportSymbols(lo, syms, count, strTable, strTableSize, "symtab");
+   }
+   if (kinds & EXPORT_DYNSYM)
+   {
+      syms = lo->getDynamicSymbolTable(&count, &strTable, &strTableSize);
+      exportSymbols(lo, syms, count, strTable, strTableSize, "dynsym");
+   }
+   if (kinds & EXPORT_RELOCS)
+      exportRelocations(lo);
+   return records;
+}
+
+unsigned long ElfExporter::exportProgram(ProgramInfo* program,
+                                         unsigned int kinds)
+{
+   LoadObject* lo;
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      exportObject(lo, kinds);
+   return records;
+}
+
+void ElfExporter::exportSymbols(LoadObject* lo, ElfW(Sym)* syms,
+                                unsigned int count, char* strTable,
+                                unsigned long strTableSize,
+                                const char* tableName)
+{
+   unsigned int i, c, type, bind;
+   ElfW(Sym)* sym;
+   const char *name, *tname;
+   char* objName = lo->getName();
+   DynamicSection* dyn = strcmp(tableName, "dynsym") ? 0 :
+                         lo->getDynamicSection();
+   char version[256];
+   if (!syms || !strTable)
+      return;
+   for (i=0, sym=syms; i < count; i++, sym++)
+   {
+      type = GEN_ST_TYPE(sym->st_info);
+      bind = GEN_ST_BIND(sym->st_info);
+      if ((typeFilter >= 0 && type != (unsigned int) typeFilter) ||
+          (bindFilter >= 0 && bind != (unsigned int) bindFilter) ||
+          (definedFilter >= 0 &&
+           (sym->st_shndx != SHN_UNDEF) != (unsigned int) definedFilter))
+         continue;
+      name = (strTableSize && sym->st_name >= strTableSize) ? "" :
+             strTable + sym->st_name;
+      if (!nameMatches(name))
+         continue;
+      beginRecord(KIND_SYMBOL);
+      for (c=0; c < numColumns[KIND_SYMBOL]; c++)
+      {
+         beginField(columns[KIND_SYMBOL][c]);
+         switch (columns[KIND_SYMBOL][c])
+         {
+          case SYM_OBJECT: putString(objName); break;
+          case SYM_TABLE: putString(tableName); break;
+          case SYM_INDEX: out->putDecimal(i); break;
+          case SYM_NAME: putString(name); break;
+          case SYM_VALUE: putHexField(sym->st_value); break;
+          case SYM_SIZE: out->putDecimal(sym->st_size); break;
+          case SYM_TYPE:
+            tname = getSymbolTypeName(type);
+            if (tname)
+               putString(tname);
+            else
+               putHexField(type);
+            break;
+          case SYM_BIND:
+            tname = getSymbolBindName(bind);
+            if (tname)
+               putString(tname);
+            else
+               putHexField(bind);
+            break;
+          case SYM_VISIBILITY:
+            putString(visibilityNames[ELF64_ST_VISIBILITY(sym->st_other)]);
+            break;
+          case SYM_SHNDX: out->putDecimal(sym->st_shndx); break;
+          case SYM_SHNDX_NAME:
+            // readelf's names for the special indexes, else empty
+            if (sym->st_shndx == SHN_UNDEF)
+               putString("UND");
+            else if (sym->st_shndx == SHN_ABS)
+               putString("ABS");
+            else if (sym->st_shndx == SHN_COMMON)
+               putString("COM");
+            else
+               putString("");
+            break;
+          case SYM_VERSION:
+            // written as the linker would: "@VER" hidden, "@@VER" default
+            tname = dyn ? dyn->getSymbolVersionName(i) : 0;
+            if (tname)
+               snprintf(version, sizeof(version), "%s%s",
+                        dyn->isHiddenVersion(i) ? "@" : "@@", tname);
+            putString(tname ? version : "");
+            break;
+         }
+      }
+      endRecord();
+   }
+}
+
+void ElfExporter::exportSections(LoadObject* lo)
+{
+   static const char flagLetters[] = "WAXxMSILOGT";
+   unsigned int i, c, f, n;
+   ElfSection* sec;
+   ElfW(Shdr)* sh;
+   char* shStrTable = lo->getSectionHeaderStringTable();
+   char* objName = lo->getName();
+   const char *name, *tname;
+   char flags[16];
+   unsigned long shStrSize = 0;
+   if (shStrTable && (sec = lo->getSection(lo->getSectionHeaderStringIndex())))
+      shStrSize = sec->getSizeInBytes();
+   for (i=0; (sec = lo->getSection(i)); i++)
+   {
+      sh = sec->getSectionHeader();
+      name = sh->sh_name < shStrSize ? shStrTable + sh->sh_name : "";
+      if (!nameMatches(name))
+         continue;
+      beginRecord(KIND_SECTION);
+      for (c=0; c < numColumns[KIND_SECTION]; c++)
+      {
+         beginField(columns[KIND_SECTION][c]);
+         switch (columns[KIND_SECTION][c])
+         {
+          case SEC_OBJECT: putString(objName); break;
+          case SEC_INDEX: out->putDecimal(i); break;
+          case SEC_NAME: putString(name); break;
+          case SEC_TYPE:
+            tname = codeName(sh->sh_type, sectionTypeNames,
+                             NUM_NAMES(sectionTypeNames), osSectionTypes);
+            if (tname)
+               putString(tname);
+            else
+               putHexField(sh->sh_type);
+            break;
+          case SEC_FLAGS:
+            // readelf's flag letters; bit 3 is unused
+            for (f=0, n=0; f < sizeof(flagLetters)-1; f++)
+               if ((sh->sh_flags & (1UL << f)) && flagLetters[f] != 'x')
+                  flags[n++] = flagLetters[f];
+            flags[n] = '\0';
+            putString(flags);
+            break;
+          case SEC_ADDR: putHexField(sh->sh_addr); break;
+          case SEC_OFFSET: putHexField(sh->sh_offset); break;
+          case SEC_SIZE: out->putDecimal(sh->sh_size); break;
+          case SEC_LINK: out->putDecimal(sh->sh_link); break;
+          case SEC_INFO: out->putDecimal(sh->sh_info); break;
+          case SEC_ALIGN: out->putDecimal(sh->sh_addralign); break;
+          case SEC_ENTSIZE: out->putDecimal(sh->sh_entsize); break;
+         }
+      }
+      endRecord();
+   }
+}
+
+void ElfExporter::exportSegments(LoadObject* lo)
+{
+   unsigned int i, c, n;
+   ElfSegment* seg;
+   ElfW(Phdr)* ph;
+   char* objName = lo->getName();
+   const char* tname;
+   char flags[4];
+   for (i=0; (seg = lo->getSegment(i)); i++)
+   {
+      ph = seg->getSegmentHeader();
+      beginRecord(KIND_SEGMENT);
+      for (c=0; c < numColumns[KIND_SEGMENT]; c++)
+      {
+         beginField(columns[KIND_SEGMENT][c]);
+         switch (columns[KIND_SEGMENT][c])
+         {
+          case SEG_OBJECT: putString(objName); break;
+          case SEG_INDEX: out->putDecimal(i); break;
+          case SEG_TYPE:
+            tname = codeName(ph->p_type, segmentTypeNames,
+                             NUM_NAMES(segmentTypeNames), osSegmentTypes);
+            if (tname)
+               putString(tname);
+            else
+               putHexField(ph->p_type);
+            break;
+          case SEG_FLAGS:
+            n = 0;
+            if (ph->p_flags & PF_R)
+               flags[n++] = 'R';
+            if (ph->p_flags & PF_W)
+               flags[n++] = 'W';
+            if (ph->p_flags & PF_X)
+               flags[n++] = 'X';
+            flags[n] = '\0';
+            putString(flags);
+            break;
+          case SEG_VADDR: putHexField(ph->p_vaddr); break;
+          case SEG_PADDR: putHexField(ph->p_paddr); break;
+          case SEG_OFFSET: putHexField(ph->p_offset); break;
+          case SEG_FILESZ: out->putDecimal(ph->p_filesz); break;
+          case SEG_MEMSZ: out->putDecimal(ph->p_memsz); break;
+          case SEG_ALIGN: out->putDecimal(ph->p_align); break;
+         }
+      }
+      endRecord();
+   }
+}
+
+void ElfExporter::exportDynamic(LoadObject* lo)
+{
+   DynamicSection* dyn = lo->getDynamicSection();
+   ElfW(Dyn)* entries;
+   unsigned int i, c, count, strSize;
+   char* strTable;
+   char* objName = lo->getName();
+   const char* tname;
+   if (!dyn)
+      return;
+   entries = dyn->getDynamicEntries(&count);
+   strTable = dyn->getStringTable(&strSize);
+   for (i=0; i < count; i++)
+   {
+      beginRecord(KIND_DYNAMIC);
+      for (c=0; c < numColumns[KIND_DYNAMIC]; c++)
+      {
+         beginField(columns[KIND_DYNAMIC][c]);
+         switch (columns[KIND_DYNAMIC][c])
+         {
+          case DYN_OBJECT: putString(objName); break;
+          case DYN_INDEX: out->putDecimal(i); break;
+          case DYN_TAG:
+            tname = codeName(entries[i].d_tag, dynamicTagNames,
+                             NUM_NAMES(dynamicTagNames), osDynamicTags);
+            if (tname)
+               putString(tname);
+            else
+               putHexField(entries[i].d_tag);
+            break;
+          case DYN_VALUE: putHexField(entries[i].d_un.d_val); break;
+          case DYN_NAME:
+            if (strTable && isStringTag(entries[i].d_tag) &&
+                entries[i].d_un.d_val < strSize)
+               putString(strTable + entries[i].d_un.d_val);
+            else
+               putString("");
+            break;
+         }
+      }
+      endRecord();
+   }
+}
+
+/**
+ * Export relocations: those the dynamic section points to if there
+ * is one, otherwise (relocatable objects) the REL/RELA sections of
+ * a file image.
+ */
+void ElfExporter::exportRelocations(LoadObject* lo)
+{
+   static const unsigned int tags[3] = { DT_RELA, DT_REL, DT_JMPREL };
+   static const char* tagNames[3] = { "DT_RELA", "DT_REL", "DT_JMPREL" };
+   DynamicSection* dyn = lo->getDynamicSection();
+   ElfSection *sec, *symSec, *strSec;
+   ElfW(Sym)* syms;
+   unsigned int i, count, numSyms, withAddends;
+   char *rels, *strTable, *shStrTable;
+   unsigned long strSize;
+   if (dyn)
+   {
+      syms = lo->getDynamicSymbolTable(&numSyms, &strTable, &strSize);
+      for (i=0; i < 3; i++)
+      {
+         rels = dyn->getRelocationTable(tags[i], &count, &withAddends);
+         if (rels)
+            exportRelocationTable(lo, tagNames[i], rels, count, withAddends,
+                                  syms, numSyms, strTable, strSize);
+      }
+      return;
+   }
+   if (!lo->isFileImage())
+      return;
+   shStrTable = lo->getSectionHeaderStringTable();
+   for (i=0; (sec = lo->getSection(i)); i++)
+   {
+      if ((sec->getType() != SHT_RELA && sec->getType() != SHT_REL) ||
+          !sec->getEntrySize())
+         continue;
+      symSec = lo->getSection(sec->getSectionLink());
+      strSec = symSec ? lo->getSection(symSec->getSectionLink()) : 0;
+      syms = 0;
+      numSyms = 0;
+      strTable = 0;
+      strSize = 0;
+      if (strSec && symSec->getEntrySize())
+      {
+         syms = (ElfW(Sym)*) symSec->getSectionDataPtr();
+         numSyms = symSec->getSizeInBytes() / symSec->getEntrySize();
+         strTable = strSec->getSectionDataPtr();
+         strSize = strSec->getSizeInBytes();
+      }
+      exportRelocationTable(lo, shStrTable ? sec->getName(shStrTable) : "",
+                            sec->getSectionDataPtr(),
+                            sec->getSizeInBytes() / sec->getEntrySize(),
+                            sec->getType() == SHT_RELA, syms, numSyms,
+                            strTable, strSize);
+   }
+}
+
+/**
+ * Export one relocation table. Relocation types are written as
+ * numbers, since their names depend on the machine.
+ */
+void ElfExporter::exportRelocationTable(LoadObject* lo, const char* tableName,
+                                        char* rels, unsigned int count,
+                                        unsigned int withAddends,
+                                        ElfW(Sym)* syms, unsigned int numSyms,
+                                        char* strTable,
+                                        unsigned long strTableSize)
+{
+   unsigned int i, c;
+   unsigned long symIndex, entSize;
+   ElfW(Rela)* rel;
+   char* objName = lo->getName();
+   const char* name;
+   entSize = withAddends ? sizeof(ElfW(Rela)) : sizeof(ElfW(Rel));
+   for (i=0; i < count; i++, rels += entSize)
+   {
+      // Rel is a prefix of Rela; r_addend is only read for Rela
+      rel = (ElfW(Rela)*) rels;
+      symIndex = GEN_R_SYM(rel->r_info);
+      name = "";
+      if (symIndex && syms && strTable && (!numSyms || symIndex < numSyms) &&
+          (!strTableSize || syms[symIndex].st_name < strTableSize))
+         name = strTable + syms[symIndex].st_name;
+      if (!nameMatches(name))
+         continue;
+      beginRecord(KIND_RELOC);
+      for (c=0; c < numColumns[KIND_RELOC]; c++)
+      {
+         beginField(columns[KIND_RELOC][c]);
+         switch (columns[KIND_RELOC][c])
+         {
+          case REL_OBJECT: putString(objName); break;
+          case REL_TABLE: putString(tableName); break;
+          case REL_OFFSET: putHexField(rel->r_offset); break;
+          case REL_TYPE: out->putDecimal(GEN_R_TYPE(rel->r_info)); break;
+          case REL_SYMINDEX: out->putDecimal(symIndex); break;
+          case REL_NAME: putString(name); break;
+          case REL_ADDEND:
+            out->putSigned(withAddends ? (long) rel->r_addend : 0);
+            break;
+         }
+      }
+      endRecord();
+   }
+}
@@ -29,10 +29,12 @@
 #include <assert.h>
 //#include <elf.h>
 #include <link.h>
+#include <pthread.h>
 #include <bits/elfclass.h>
 
 #define GEN_ST_TYPE _GTYPE1 (ELF, __ELF_NATIVE_CLASS, _ST_TYPE)
 #define GEN_ST_BIND _GTYPE1 (ELF, __ELF_NATIVE_CLASS, _ST_BIND)
+#define GEN_ST_VISIBILITY _GTYPE1 (ELF, __ELF_NATIVE_CLASS, _ST_VISIBILITY)
 #define GEN_R_SYM  _GTYPE1 (ELF, __ELF_NATIVE_CLASS, _R_SYM)
 #define GEN_R_TYPE _GTYPE1 (ELF, __ELF_NATIVE_CLASS, _R_TYPE)
 #define GEN_R_INFO _GTYPE1 (ELF, __ELF_NATIVE_CLASS, _R_INFO)
@@ -42,7 +44,7 @@
 /**
  * ElfSymbol is a class embodying a generic program symbol. 
  * ElfSymbol is returned in many places, and thus is worth declaring first.
- * -- still needs version checking and reporting in here (and everywhere)
+ * -- versions are only known for dynamic symbols (from .gnu.version)
  * -- getSymbolAddress() may still need some work. It tries to do 
  *    alot: for an undefined symbol, it returns the PLT entry address
  *    for a code symbol, and the GOT entry address for a data symbol;
@@ -72,6 +74,8 @@ class ElfSymbol
    char* getGOTEntryAddress();  //!< Pointer to actual GOT entry
    char* getPLTEntryAddress();  //!< Pointer to actual PLT entry (for functions)
    class LoadObject* getLoadObject(); //!< Return ELF object this symbol is in
+   char* getVersionName();      //!< Symbol version, or null if none
+   unsigned int isDefaultVersion(); //!< True for "name@@VER" (or none)
   private:
    ElfW(Sym)* sym;         //!< Pointer to sym entry (somewhere?)
    char* strTable;         //!< String table this symbol is in
@@ -92,44 +96,263 @@ class ProgramInfo
   public:
    ProgramInfo(void); 
    ProgramInfo(char* objFilename);
+   ProgramInfo(class ProgramSnapshot* snapshot);
    ~ProgramInfo();
    void debugPrintInfo();
    int addLoadObject(class LoadObject* lo); 
    ElfSymbol** findSymbolDefinitions(char* symbolName, int* numDefs);
    ElfSymbol** findSymbolUses(char* symbolName, int* numUses);
+   class LoadStats* getStats();     //!< Own stats (maps), null if disabled
+   //! Add up the stats of this program and all of its objects
+   void getTotalStats(class LoadStats* totals);
+   void writeStatsReport(class OutputBuffer* out);
+   //! Heap bytes held by all objects in one category (or all, if -1)
+   unsigned long getMemoryUsage(int category=-1);
+   //! Tracer for this program's import latencies (made on first use)
+   class CallTracer* getCallTracer();
+   //! Object whose mapping holds a run-time address, or null
+   class LoadObject* findObjectByAddress(char* address);
+   //! Live objects in link map order (new[]'d)
+   class LoadObject** getObjectsInLoadOrder(unsigned int* count);
    //int addProgramSymbol(void);
    //private:
    char* name;                      //!< Program name
    unsigned int pid;                //!< Process ID
    class LoadObject* loadedObjects; //!< Loaded objects list
+   class LoadStats* stats;          //!< Statistics for maps parsing
+   class CallTracer* tracer;        //!< Import latency tracer, or null
+   struct ObjectRange* objectRanges; //!< Objects by address (lazy)
+   unsigned int numObjectRanges;    //!< Entries in it
    //class ProgramSymbol* symbols;  // list
 };
 
+/**
+ * Arena is a bump allocator for metadata that lives exactly as long
+ * as its owner. Memory is carved out of large chunks in order and
+ * only given back all at once, when the arena is deleted, so objects
+ * allocated together sit next to each other and teardown is one free
+ * per chunk.
+ * -- destructors of objects placed in an arena are not run by it
+ */
+class Arena
+{
+  public:
+   Arena(unsigned long chunkSize=4096);
+   ~Arena();
+   void* allocate(unsigned long size, unsigned long align=sizeof(void*));
+   unsigned long getBytesAllocated(); //!< Sum of the sizes requested
+   unsigned long getBytesReserved();  //!< Sum of the chunk sizes
+   unsigned int getNumberOfChunks();
+  private:
+   struct ArenaChunk* chunks;  //!< Chunk list, newest first
+   char* next;                 //!< Next free byte in the newest chunk
+   char* end;                  //!< End of the newest chunk
+   unsigned long chunkSize;    //!< Usual size of a new chunk
+   unsigned long allocated;    //!< Bytes handed out
+   unsigned long reserved;     //!< Bytes taken from the heap
+   unsigned int numChunks;     //!< Chunks in the list
+};
+
+//! One item of a ParallelFor::run(): its index, and the worker (below
+//! the thread count) running it, for per-thread state
+typedef void (*ParallelWork)(void* arg, unsigned int index,
+                             unsigned int worker);
+
+/**
+ * ParallelFor hands the items of a loop to a few threads, the
+ * caller's among them. Items are taken one at a time from a shared
+ * counter, so uneven items balance out; each item is run by exactly
+ * one thread, so work on separate items needs no locking.
+ */
+class ParallelFor
+{
+  public:
+   //! Threads run() would use (0 means one per CPU; none past count)
+   static unsigned int getThreadCount(unsigned int numThreads,
+                                      unsigned int count);
+   static void run(unsigned int count, unsigned int numThreads,
+                   ParallelWork work, void* arg);
+};
+
+//! Bit for a symbol type (STT_*) in SymbolFilter::typeMask
+#define SYMBOL_TYPE_BIT(t) (1U << (t))
+//! Bit for a symbol binding (STB_*) in SymbolFilter::bindMask
+#define SYMBOL_BIND_BIT(b) (1U << (b))
+
+/**
+ * A predicate for SymbolStore::scan(); a symbol matches if it passes
+ * every test. SymbolStore::initFilter() sets up a filter that
+ * matches everything, so callers only fill in what they care about.
+ */
+struct SymbolFilter
+{
+   unsigned int typeMask;     //!< SYMBOL_TYPE_BIT()s of types wanted
+   unsigned int bindMask;     //!< SYMBOL_BIND_BIT()s of bindings wanted
+   unsigned int definedOnly;  //!< Nonzero to skip SHN_UNDEF symbols
+   unsigned long minSize;     //!< Smallest st_size wanted
+   unsigned long maxSize;     //!< Largest st_size wanted
+   unsigned long lowAddress;  //!< Lowest st_value wanted
+   unsigned long highAddress; //!< st_value must be below this
+};
+
+/**
+ * SymbolStore is a column-wise copy of a symbol table: the values,
+ * sizes, info bytes, section indexes and name offsets each sit in an
+ * array of their own. Filtering then reads only the columns it
+ * needs, in order, without making an ElfSymbol per entry; scan() uses
+ * AVX2 when the CPU has it and a scalar loop otherwise.
+ * -- st_value is the raw value, so address ranges are link-time
+ *    addresses (add LoadObject::getLoadBias() for run-time ones)
+ * -- symbols made by getSymbol() have no PLT/GOT information
+ */
+class SymbolStore
+{
+  public:
+   SymbolStore(ElfW(Sym)* symbols, unsigned int count, char* strTable,
+               unsigned long strTableSize, class LoadObject* loadObject);
+   ~SymbolStore();
+   static void initFilter(struct SymbolFilter* filter);
+   //! Indexes of matching symbols, in table order (new[]'d, may be null)
+   unsigned int* scan(struct SymbolFilter* filter, unsigned int* numFound,
+                      unsigned int useSIMD=1);
+   static unsigned int hasSIMD();  //!< True if scan() can use AVX2
+   unsigned int getCount();
+   unsigned long getValue(unsigned int index);
+   unsigned long getSize(unsigned int index);
+   unsigned int getInfo(unsigned int index);
+   unsigned int getSHIndex(unsigned int index);
+   char* getName(unsigned int index);
+   ElfSymbol* getSymbol(unsigned int index); //!< New wrapper for an entry
+   unsigned long getMemoryUsage();  //!< Bytes held by the columns
+  private:
+   unsigned long* values;       //!< st_value column
+   unsigned long* sizes;        //!< st_size column
+   unsigned char* info;         //!< st_info column
+   unsigned short* shndx;       //!< st_shndx column
+   unsigned int* nameOffsets;   //!< st_name column
+   unsigned int count;          //!< Number of symbols
+   ElfW(Sym)* symbols;          //!< Table the columns were made from
+   char* strTable;              //!< Its string table
+   unsigned long strTableSize;  //!< Size of that string table
+   class LoadObject* loadObject; //!< Object the table belongs to
+};
+
+/**
+ * Categories of heap memory held by a LoadObject, for
+ * LoadObject::getMemoryUsage().
+ */
+enum LoadMemoryCategory
+{
+   MEM_SECTION_HEADERS,  //!< Section header table copied from the file
+   MEM_SYMTAB,           //!< Symbol tables copied from the file
+   MEM_STRTAB,           //!< String tables copied from the file
+   MEM_OBJECTS,          //!< LoadObject and its arena (sections, segments...)
+   MEM_INDEXES,          //!< Lookup indexes and symbol stores
+   MEM_OTHER,            //!< Names and statistics records
+   MEM_NUM_CATEGORIES
+};
+
+/**
+ * Sections that the library (or its users) commonly look for by name;
+ * LoadObject resolves them into a slot table when it reads the
+ * section headers, see LoadObject::getWellKnownSection().
+ */
+enum WellKnownSection
+{
+   SECTION_TEXT, SECTION_RODATA, SECTION_DATA, SECTION_BSS,
+   SECTION_PLT, SECTION_PLT_SEC, SECTION_PLT_GOT, SECTION_GOT,
+   SECTION_GOT_PLT, SECTION_DYNAMIC, SECTION_DYNSYM, SECTION_DYNSTR,
+   SECTION_SYMTAB, SECTION_STRTAB, SECTION_HASH, SECTION_GNU_HASH,
+   SECTION_GNU_VERSION, SECTION_GNU_VERSION_D, SECTION_GNU_VERSION_R,
+   SECTION_RELA_DYN, SECTION_RELA_PLT, SECTION_INTERP, SECTION_EH_FRAME,
+   SECTION_EH_FRAME_HDR, SECTION_INIT_ARRAY, SECTION_FINI_ARRAY,
+   SECTION_BUILD_ID, SECTION_GNU_DEBUGLINK,
+   SECTION_NUM_WELL_KNOWN
+};
+
 /**
  * Each object of the class LoadObject represents one loaded ELF
  * object, the executable program itself or the shared libs that have
  * been loaded.
+ * -- address lookups (findSectionByAddress() etc.) use sorted interval
+ *    tables made on first use; a runtime address is a vaddr plus
+ *    getLoadBias(), which is 0 for file images
  */
 class LoadObject
 {
   public:
    LoadObject(char* objectName, char* baseAddress, char* endAddress);
-   LoadObject(char* objFilename);
+   LoadObject(char* objFilename, unsigned int findDebugInfo=1);
+   LoadObject(char* objectName, char* image, unsigned long imageSize,
+              unsigned int findDebugInfo);
+   LoadObject(class ProgramSnapshot* snapshot, unsigned int objectIndex);
    ~LoadObject();
    void debugPrintInfo();
    char* getName();
+   unsigned int isValidObject();   //!< False if the object failed to load
+   unsigned int isFileImage();     //!< True if object is a mmap()'d file
+   unsigned int isSnapshotObject(); //!< True if read from a snapshot
+   unsigned long getImageSize();   //!< Size of the file image (file mode)
    int processSegmentHeaders();
    int processSectionHeaders(char* secHeaderData=0);
    int processDynamicSection(char* dynamicSectionAddress, unsigned int size);
+   class ElfSection* getSection(unsigned int index);
+   class ElfSegment* getSegment(unsigned int index);
+   class DynamicSection* getDynamicSection();
+   ElfW(Sym)* getStaticSymbolTable(unsigned int* count, char** strTable,
+                                   unsigned long* strTableSize);
+   ElfW(Sym)* getDynamicSymbolTable(unsigned int* count, char** strTable,
+                                    unsigned long* strTableSize);
    char* getFileSection(unsigned int offset, unsigned int size);
+   char* getFileRangePtr(unsigned long offset, unsigned long size);
+   char* getVaddrDataPtr(ElfW(Addr) vaddr);
+   ElfW(Addr) getLoadBias();
+   //! Runtime address (vaddr plus load bias) to/from link-time vaddr
+   char* vaddrToAddress(ElfW(Addr) vaddr);
+   ElfW(Addr) addressToVaddr(char* address);
+   //! File offset of a vaddr, and back (-1 if not backed by the file)
+   int vaddrToFileOffset(ElfW(Addr) vaddr, unsigned long* offset);
+   int fileOffsetToVaddr(unsigned long offset, ElfW(Addr)* vaddr);
+   //! PT_LOAD segment or SHF_ALLOC section containing an address
+   class ElfSegment* findSegmentByAddress(char* address);
+   class ElfSegment* findSegmentByVaddr(ElfW(Addr) vaddr);
+   class ElfSegment* findSegmentByFileOffset(unsigned long offset);
+   class ElfSection* findSectionByAddress(char* address);
+   class ElfSection* findSectionByVaddr(ElfW(Addr) vaddr);
+   class ElfSection* findSectionByFileOffset(unsigned long offset);
+   unsigned char* getBuildId(unsigned int* length);
+   int findAndLoadDebugObject();
+   class LoadObject* getDebugObject();
+   class LoadStats* getStats();    //!< Null unless stats were enabled
+   //! Heap bytes held in one category (including the debug object)
+   unsigned long getMemoryUsage(unsigned int category);
+   unsigned long getTotalMemoryUsage();
+   static const char* getMemoryCategoryName(unsigned int category);
+   //! Hash every section's contents (0 threads means one per CPU)
+   unsigned int hashSections(unsigned int numThreads=1, 
+                             unsigned int useCache=1);
+   char* getSectionHeaderStringTable();
    class ElfSection* findSectionByName(char* sectionName);
+   //! Sections whose names start with a prefix, in name order (new[]'d)
+   class ElfSection** findSectionsByPrefix(char* prefix, 
+                                           unsigned int* numFound);
+   class ElfSection* getWellKnownSection(unsigned int which);
+   static const char* getWellKnownSectionName(unsigned int which);
    ElfSymbol* findStaticSymbolByName(char* symbolName);
    ElfSymbol* findDynamicSymbolByName(char* symbolName);
    ElfSymbol* startDynamicSymbolIter(unsigned int* iter);
    ElfSymbol* nextDynamicSymbolIter(unsigned int* iter);
    ElfSymbol* startStaticSymbolIter(unsigned int* iter);
    ElfSymbol* nextStaticSymbolIter(unsigned int* iter);
+   unsigned int getNumberOfStaticSymbols();
+   //! Column-wise copy of the static (or dynamic) symbols, made once
+   class SymbolStore* getSymbolStore(unsigned int dynamic=0);
+   //! PLT stub / GOT slot / symbol table, made once
+   class PLTMap* getPLTMap();
+   //! Memory freed with this object (its arena), for its parts' tables
+   void* allocateMetadata(unsigned long size);
    struct link_map* getLinkMap();
+   int getLinkMapIndex();  //!< Position in the dynamic linker's list, or -1
    int findAndSetLinkMap();
    char* getGOTAddress();
    void setGOTAddress(char* address);
@@ -170,6 +393,14 @@ class LoadObject
    unsigned int getHeaderFlags();      //!< From e_flags
    class LoadObject* next;
   private:
+   void initMembers();
+   int initFileImage(char* image, unsigned long size, char* objectName,
+                     unsigned int findDebugInfo);
+   ElfW(Shdr)* getSectionZeroHeader();
+   char* getSectionName(unsigned int index);
+   void buildSectionNameIndex();
+   int buildSortedSectionNames();
+   struct AddressMap* getAddressMap();
    char* name;               //!< Loaded object internal name (sometimes null?)
    ElfW(Ehdr)* elfHeader;    //!< Pointer to ELF header of this object
    char* baseAddress;        //!< Beginning address (same as elfHeader?)
@@ -181,9 +412,9 @@ class LoadObject
    char* PLTAddress;         //!< Address of PLT
    //class GOTInfo* got;       //!< Not used?
    //class PLTInfo* plt;       //!< Not used?
-   class ElfSegment** segments;            //!< Segment object array
+   class ElfSegment* segments;             //!< Segment objects (in arena)
    unsigned int numSegments;               //!< Number of segments
-   class ElfSection** sections;            //!< Section object array
+   class ElfSection* sections;             //!< Section objects (in arena)
    unsigned int numSections;               //!< Number of sections
    class DynamicSection* dynamicSection;   //!< Special dynamic section
    //class ProgramSymbol* dynamicSymbols;  // list
@@ -191,8 +422,31 @@ class LoadObject
    ElfW(Sym)* staticSymbols;               //!< Static symbol array
    unsigned int numStaticSymbols;          //!< Number of static symbols
    char* symbolStringTable;                //!< Static symbol string table
+   unsigned long symbolStringTableSize;    //!< Size of that string table
    char* secHeaderStringTable;             //!< Section header string table
    struct link_map *l_map;       //!< Dynamic linker's link_map for this object
+   unsigned int fileImage;       //!< Nonzero if object is a file image
+   unsigned int ownsImage;       //!< Nonzero if we mmap()'d the image
+   class ProgramSnapshot* snapshot; //!< Snapshot we were read from (or null)
+   unsigned int snapshotIndex;   //!< Our object number in the snapshot
+   unsigned long imageSize;      //!< Length of the file image mapping
+   class LoadObject* debugObject;  //!< Separate debug file (or null)
+   ElfW(Shdr) sectionZero;       //!< Copy of section header zero
+   int sectionZeroState;         //!< 0 unread, 1 valid, -1 unreadable
+   class LoadStats* stats;       //!< Statistics for reading this object
+   char* sectionHeaderCopy;      //!< Section headers read from file (or null)
+   class Arena* arena;           //!< Sections, segments and dynamic data
+   class SymbolStore* staticStore;  //!< Columns of the static symbols
+   class SymbolStore* dynamicStore; //!< Columns of the dynamic symbols
+   unsigned long secHeaderStringTableSize; //!< Size of .shstrtab
+   unsigned int* sectionHashBuckets; //!< Section name hash buckets
+   unsigned int* sectionHashChains;  //!< Section name hash chains
+   unsigned int numSectionBuckets;   //!< Number of buckets (power of 2)
+   struct SectionNameEntry* sectionsByName; //!< Sorted names (lazy)
+   //! Section index of each WellKnownSection (0 if absent)
+   unsigned int wellKnownSections[SECTION_NUM_WELL_KNOWN];
+   struct AddressMap* addressMap; //!< Sorted address intervals (lazy)
+   class PLTMap* pltMap;          //!< Decoded PLT (lazy)
 };
 
 /**
@@ -211,10 +465,13 @@ class ElfSegment
    void debugPrintInfo();
    char* getBaseAddress();
    char* getHighAddress();
+   ElfW(Phdr)* getSegmentHeader();
    unsigned int getAlignmentMask();
    char* getVirtualAddress();
    char* getPhysicalAddress();
    unsigned int getFileOffset();
+   unsigned long getFileSize();
+   unsigned long getMemorySize();
    unsigned int getType();
    unsigned int getFlags();
    unsigned int isLoadable();
@@ -299,6 +556,15 @@ class ElfSection
    unsigned int nonConformingOS();          //!< From sh_flags
    unsigned int isGroupMember();            //!< From sh_flags
    unsigned int isThreadLocalStorage();     //!< From sh_flags
+   unsigned int hasContentData(); //!< True if the contents can be read
+   //! XXH64 of the section contents; -1 if they cannot be read
+   int getContentHash(unsigned long* hash);
+   void setContentHash(unsigned long hash); //!< E.g., from a cache
+   //! XXH64 (seeded) of a block of memory
+   static unsigned long xxHash64(const void* data, unsigned long length,
+                                 unsigned long seed=0);
+   //! Bytes of section data copied from the file and held by us
+   unsigned long getOwnedDataSize();
   private:
    unsigned int index;     //!< This section's index number
    ElfW(Shdr)* secHeader;  //!< Header for this section
@@ -307,12 +573,41 @@ class ElfSection
    char* sectionDataPtr;   //!< Data pointer (same as base address?)
    unsigned int alignMask; //!< ~(1 - alignment)
    LoadObject* loadObject; //!< Load object of this section
+   unsigned long contentHash; //!< Hash of the contents, once known
+   unsigned int hashValid;    //!< Nonzero if contentHash is set
+   unsigned int ownsData;     //!< Nonzero if sectionDataPtr was new[]'d
+};
 
+//! Standard dynamic tags with a slot of their own (DT_NULL..DT_RELRENT)
+#define DYNAMIC_STANDARD_TAGS 38
+//! Slots in the dynamic tag table: the standard tags, then the GNU
+//! DT_VALRNG, DT_ADDRRNG and version tags, then DT_AUXILIARY/DT_FILTER
+#define DYNAMIC_TAG_SLOTS (DYNAMIC_STANDARD_TAGS + DT_VALNUM + DT_ADDRNUM + \
+                           DT_VERSIONTAGNUM + DT_EXTRANUM)
+
+/**
+ * Work done by symbol lookups, as counted by
+ * DynamicSection::traceLookup() and LookupCostModel.
+ */
+struct LookupCounts
+{
+   unsigned long lookups;             //!< Symbol lookups
+   unsigned long objectsSearched;     //!< Objects whose tables were tried
+   unsigned long bloomRejects;        //!< ... turned away by the bloom filter
+   unsigned long bloomFalsePositives; //!< ... passed it, but no definition
+   unsigned long chainProbes;         //!< Hash chain entries examined
+   unsigned long stringCompares;      //!< Symbol name strcmp() calls
+   unsigned long unresolved;          //!< Lookups that found nothing
 };
 
 /**
  * This class represents the ".dynamic" section, and retrieves all of
  * the dynamic symbol and other information from it.
+ * -- the entries are decoded once, into a table indexed by tag, so
+ *    looking up a tag is constant time; repeated tags (DT_NEEDED,
+ *    DT_AUXILIARY, ...) are chained and walked with startTagIter()
+ * -- tags outside the table (processor specific ones, for example)
+ *    can still be had by walking getDynamicEntries()
  */
 class DynamicSection
 {
@@ -321,22 +616,85 @@ class DynamicSection
                   LoadObject* loadObject); //!< Constructor (does alot!)
    ~DynamicSection(); //!< Destructor
    void debugPrintInfo(); //!< Print info about object
-   //! Find a dynamic entry based on type (should return ptr?)
+   //! Find a dynamic entry based on type (pointer to it, as a long)
    unsigned long findDynamicEntry(unsigned int EntryType);
+   //! First entry with a tag, or null
+   ElfW(Dyn)* getEntry(unsigned long tag);
+   unsigned int hasEntry(unsigned long tag);
+   unsigned int getEntryCount(unsigned long tag); //!< Repeats of a tag
+   //! d_val of a tag, or a default if it is not present
+   unsigned long getValue(unsigned long tag, unsigned long missing=0);
+   //! d_ptr of a tag, as a pointer we can read through (or null)
+   char* getPointer(unsigned long tag);
+   //! String table entry named by a tag's d_val (e.g. DT_SONAME)
+   char* getString(unsigned long tag);
+   //! Iterate over all entries with a tag (returns null when done)
+   ElfW(Dyn)* startTagIter(unsigned long tag, unsigned int* iter);
+   ElfW(Dyn)* nextTagIter(unsigned int* iter);
+   //! Iterate over the DT_NEEDED library names
+   char* startNeededIter(unsigned int* iter);
+   char* nextNeededIter(unsigned int* iter);
+   unsigned int getNumberOfNeeded();
+   char* getSoname();
+   char* getRunPath();  //!< DT_RUNPATH, else DT_RPATH (or null)
+   unsigned long getFlags();   //!< DT_FLAGS (DF_*)
+   unsigned long getFlags1();  //!< DT_FLAGS_1 (DF_1_*)
+   //! DT_INIT_ARRAY/DT_FINI_ARRAY/DT_PREINIT_ARRAY and their lengths
+   ElfW(Addr)* getInitArray(unsigned int* count);
+   ElfW(Addr)* getFiniArray(unsigned int* count);
+   ElfW(Addr)* getPreInitArray(unsigned int* count);
+   //! DT_RELR table of packed relative relocations
+   ElfW(Addr)* getRelrTable(unsigned int* count);
+   char* getGnuHashTable();    //!< DT_GNU_HASH table, or null
+   char* getHashTable();       //!< DT_HASH (SysV) table, or null
    //! Get a symbol's string from its dynamic struct
    char* getSymbolString(ElfW(Sym)* dsym);
-   //! Find a dynamic symbol
+   //! Find a dynamic symbol ("name", "name@VER" or "name@@VER")
    ElfSymbol* findDynamicSymbolByName(char *name);
+   //! Dynamic symbol table index of a symbol, or -1 if not ours
+   int getSymbolIndex(ElfW(Sym)* sym);
+   //! Index of a symbol by name (versions as above), or -1
+   int lookupVersionedSymbol(char* name);
+   //! Index of the definition we offer for a reference, or -1
+   int findDefinition(const char* name, const char* version);
+   //! findDefinition() step by step as ld.so does it, counting the work
+   int traceLookup(const char* name, unsigned int gnuHashValue,
+                   unsigned int sysvHashValue, const char* version,
+                   unsigned int pltClass, struct LookupCounts* counts);
+   //! Version index of a symbol (.gnu.version, without the hidden bit)
+   unsigned int getSymbolVersionIndex(unsigned int symIndex);
+   //! True if a symbol's version is hidden (a non-default "name@VER")
+   unsigned int isHiddenVersion(unsigned int symIndex);
+   //! Version name of a symbol, or null if it is not versioned
+   char* getSymbolVersionName(unsigned int symIndex);
+   //! Name of a version index (from .gnu.version_d or _r), or null
+   char* getVersionName(unsigned int versionIndex);
+   //! Library a needed version comes from (null for our own versions)
+   char* getVersionFile(unsigned int versionIndex);
+   unsigned int getNumberOfVersions(); //!< Version indexes in use + 1
    //! Hash a symbol string
    unsigned long elfHash(const unsigned char *name);
-   //! Find a GOT entry by symbol name (works?)
+   static unsigned int getGnuHash(const char* name); //!< DT_GNU_HASH hash
+   //! GOT entry (GLOB_DAT slot) of a symbol, by name
    char *findGOTEntryByName(char *symbolName);
-   //! Find a GOTPLT entry by symbol name (works?)
+   //! GOT entry its PLT stub jumps through (JUMP_SLOT), by name
    char *findGOTPLTEntryByName(char *symbolName);
    //! Start an iteration over the dynamic symbols
    ElfSymbol* startDynamicSymbolIter(unsigned int* iter);
    //! Continue a dyn_sym iteration (returns null when done)
    ElfSymbol* nextDynamicSymbolIter(unsigned int* iter);
+   //! Raw dynamic entries (count stops before DT_NULL)
+   ElfW(Dyn)* getDynamicEntries(unsigned int* count);
+   //! Raw dynamic symbol table (count is 0 if it is not known)
+   ElfW(Sym)* getSymbolTable(unsigned int* count);
+   //! Dynamic string table and its size
+   char* getStringTable(unsigned int* size);
+   //! Raw relocation table for DT_RELA, DT_REL or DT_JMPREL
+   char* getRelocationTable(unsigned int tag, unsigned int* count,
+                            unsigned int* withAddends);
+   //! Index of the defined dynamic symbol covering a vaddr, or -1
+   int findSymbolByAddress(ElfW(Addr) vaddr);
+   unsigned long getMemoryUsage();  //!< Bytes of lookup tables (in arena)
   private:
    ElfW(Dyn)* dynamicSec;   //!< Pointer to dynamic section
    LoadObject* loadObject;  //!< Load object of this section
@@ -353,8 +711,1137 @@ class DynamicSection
    unsigned int RelaSize, RelaEntSize;
    unsigned int RelSize, RelEntSize;
    unsigned int PLTRSize, PLTRType, PLTREntSize;
+   unsigned int numUsedEntries;  //!< Entries before DT_NULL
+   //! First entry of each tag slot (index + 1, 0 if none)
+   unsigned int firstEntry[DYNAMIC_TAG_SLOTS];
+   unsigned int entryCount[DYNAMIC_TAG_SLOTS]; //!< Entries per slot
+   unsigned int* nextEntry;      //!< Next entry with the same tag (+1)
+   char* gnuHashTable;           //!< GNU hash table for dynamic syms
+   ElfW(Half)* versymTable;      //!< Version index of each dynamic sym
+   char** versionNames;          //!< Name of each version index
+   char** versionFiles;          //!< Needed library of each version index
+   unsigned int numVersions;     //!< Size of the two arrays above
+   //! Defined symbols sorted by address (lazy)
+   struct SymbolAddressEntry* addressIndex;
+   unsigned int numAddressed;    //!< Entries in it
+   int lookupSymbol(const char* name, unsigned int nameLength,
+                    const char* version, unsigned int defaultOnly,
+                    unsigned int definedOnly=0);
+   unsigned int matchesLookup(unsigned int index, const char* name,
+                              const char* version, unsigned int pltClass,
+                              struct LookupCounts* counts);
+   void readVersions();
+   void buildAddressIndex();
+   ElfSymbol* newSymbol(unsigned int index);
+};
+
+//! The PLT sections PLTMap decodes
+enum PLTSectionKind
+{
+   PLT_SECTION_PLT,   //!< .plt (lazy entries, or the only PLT)
+   PLT_SECTION_SEC,   //!< .plt.sec (second PLT of IBT/CET objects)
+   PLT_SECTION_GOT,   //!< .plt.got (stubs through GLOB_DAT slots)
+   PLT_NUM_SECTIONS
+};
+
+//! What fills a GOT slot
+enum PLTSlotKind
+{
+   PLT_SLOT_JUMP,      //!< JUMP_SLOT relocation (a PLT slot)
+   PLT_SLOT_DATA,      //!< GLOB_DAT relocation
+   PLT_SLOT_IRELATIVE  //!< IRELATIVE relocation (no symbol)
+};
+
+/**
+ * One GOT slot filled by the dynamic linker, with the PLT stub that
+ * jumps through it (if any). Addresses are link-time vaddrs; use
+ * PLTMap::getGOTEntry() and getPLTEntry() for run-time ones.
+ */
+struct PLTSlot
+{
+   ElfW(Addr) gotVaddr;      //!< GOT entry
+   ElfW(Addr) pltVaddr;      //!< Stub using it (0 if none)
+   unsigned int symIndex;    //!< Dynamic symbol (0 for IRELATIVE)
+   unsigned int kind;        //!< PLTSlotKind
+   unsigned int pltSection;  //!< PLTSectionKind of the stub
+};
+
+//! Decoded stubs of one PLT section
+struct PLTSection
+{
+   ElfW(Addr) vaddr;         //!< Start of the section
+   unsigned long size;       //!< Its size in bytes
+   unsigned int entrySize;   //!< Stub spacing
+   unsigned int numEntries;  //!< size / entrySize
+   unsigned int* entrySlots; //!< Slot of each stub (+1, 0 if none)
+};
+
+/**
+ * PLTMap ties PLT stubs, GOT slots and dynamic symbols together. It
+ * is built once per object (LoadObject::getPLTMap()) from the
+ * JUMP_SLOT, GLOB_DAT and IRELATIVE relocations and from decoding
+ * every stub in .plt, .plt.sec and .plt.got, so each stub is mapped
+ * to the GOT slot it really jumps through rather than one guessed
+ * from its position. After that, lookups in any direction (symbol,
+ * GOT entry or PLT address) are constant time.
+ * -- x86-64 (with or without IBT) and AArch64 stubs are decoded;
+ *    other machines get GOT slots but no PLT entries
+ * -- only RELA relocation tables are read
+ * -- stubs are only found through section headers, so objects
+ *    without them have no PLT entries either
+ */
+class PLTMap
+{
+  public:
+   PLTMap(class LoadObject* loadObject);
+   ~PLTMap();
+   unsigned int getNumberOfSlots();
+   unsigned int getNumberOfStubs();   //!< Stubs that decoded to a slot
+   struct PLTSlot* getSlot(unsigned int index);
+   //! Slot for a run-time GOT entry address, or null
+   struct PLTSlot* findSlotByGOTEntry(char* address);
+   //! Slot whose stub contains a run-time address, or null
+   struct PLTSlot* findSlotByPLTEntry(char* address);
+   //! True if a run-time address is inside a PLT section
+   unsigned int isPLTAddress(char* address);
+   struct PLTSlot* findJumpSlot(unsigned int symIndex); //!< JUMP_SLOT
+   struct PLTSlot* findDataSlot(unsigned int symIndex); //!< GLOB_DAT
+   char* getGOTEntry(struct PLTSlot* slot);  //!< Run-time GOT address
+   char* getPLTEntry(struct PLTSlot* slot);  //!< Run-time stub (or null)
+   //! Where a live object's calls to an import go (0 if unknown)
+   ElfW(Addr) getImportTarget(unsigned int symIndex);
+   //! Look an import up as the dynamic linker would (0 if not found)
+   ElfW(Addr) resolveImport(unsigned int symIndex);
+   static const char* getSectionName(unsigned int which);
+   unsigned long getMemoryUsage();  //!< Bytes held by the tables
+  private:
+   class LoadObject* loadObject; //!< Object mapped
+   struct PLTSlot* slots;        //!< Slots in relocation order
+   unsigned int numSlots;        //!< Number of slots
+   unsigned int* gotBuckets;     //!< GOT address hash buckets
+   unsigned int* gotChains;      //!< GOT address hash chains
+   unsigned int numGOTBuckets;   //!< Number of buckets (power of 2)
+   unsigned int* jumpSlots;      //!< JUMP_SLOT of each symbol (+1)
+   unsigned int* dataSlots;      //!< GLOB_DAT slot of each symbol (+1)
+   unsigned int numSymbols;      //!< Size of the two arrays above
+   unsigned int numStubs;        //!< Stubs mapped to slots
+   struct PLTSection sections[PLT_NUM_SECTIONS]; //!< Decoded stubs
+   unsigned int gotHash(ElfW(Addr) gotVaddr);
+   struct PLTSlot* lookupGOT(ElfW(Addr) gotVaddr);
+   void decodeSection(unsigned int which, unsigned int wellKnown,
+                      unsigned int machine);
+};
+
+/**
+ * One GOT slot queued in a GOTRebinder.
+ */
+struct GOTBinding
+{
+   class LoadObject* loadObject; //!< Object owning the slot
+   ElfW(Addr)* slot;             //!< The GOT entry (run-time address)
+   ElfW(Addr) newTarget;         //!< Target apply() writes
+   ElfW(Addr) oldTarget;         //!< Target apply() replaced
+   unsigned int applied;         //!< Nonzero between apply()/rollback()
+   unsigned int readOnly;        //!< Slot is on a RELRO page
+};
+
+/**
+ * GOTRebinder redirects dynamic bindings in the running process: it
+ * takes (object, symbol, new target) requests, finds their GOT slots
+ * through the PLTMap, and writes them all in one go. Slots on RELRO
+ * pages are grouped by page so each range needs one mprotect() to
+ * open and one to close, and every slot is written with an atomic
+ * store, so threads calling through the PLT meanwhile see either the
+ * old target or the new one. rollback() puts the old targets back.
+ * -- only for live objects (not file images or snapshots)
+ * -- a lazily bound slot that another thread is resolving at the
+ *    moment of apply() may get the resolver's value written over
+ *    ours; bind the slots first (or link with -z now) if that matters
+ * -- the GOT is only rewritten, so calls that do not go through it
+ *    (direct or in-object calls) are not redirected
+ * -- each slot is queued once; queuing it again replaces its target
+ */
+class GOTRebinder
+{
+  public:
+   GOTRebinder();
+   ~GOTRebinder();
+   //! Queue one slot by its run-time address
+   int addSlot(class LoadObject* loadObject, char* gotEntry, void* target);
+   //! Queue the PLT and GLOB_DAT slots an object has for a symbol
+   int addSymbol(class LoadObject* loadObject, char* symbolName,
+                 void* target);
+   //! Queue a symbol's slots in every object of a program
+   int addProgramSymbol(class ProgramInfo* program, char* symbolName,
+                        void* target);
+   int apply();     //!< Write the new targets (count, or -1)
+   int rollback();  //!< Restore the old targets (count, or -1)
+   unsigned int getNumberOfBindings();
+   struct GOTBinding* getBinding(unsigned int index);
+  private:
+   struct GOTBinding* bindings;  //!< Queued slots
+   unsigned int numBindings;     //!< Number of queued slots
+   unsigned int maxBindings;     //!< Size of the array
+   int writeSlots(unsigned int restore);
+};
+
+/**
+ * One counter copied out by CallCounter::snapshot().
+ */
+struct CallCount
+{
+   class LoadObject* loadObject; //!< Object making the calls
+   const char* symbolName;       //!< Function called
+   unsigned long count;          //!< Calls counted
+};
+
+/**
+ * CallCounter counts the calls objects make to their imports, such
+ * as every malloc() call from libfoo.so. For each (object, symbol)
+ * it generates a small trampoline that increments a counter and
+ * jumps on to the real target, and points the object's GOT slots for
+ * the symbol at it (through a GOTRebinder). The counters are sharded
+ * by thread, one cache line per shard, so threads seldom share one;
+ * a counted call costs a few nanoseconds more than a plain one.
+ * -- trampolines are only generated for x86-64 (see isSupported())
+ * -- shards are picked by hashing the thread pointer, so two threads
+ *    can share a shard; the increment is atomic, so no counts are lost
+ * -- the caveats of GOTRebinder apply
+ */
+class CallCounter
+{
+  public:
+   CallCounter();
+   ~CallCounter();
+   static unsigned int isSupported(); //!< True if trampolines work here
+   //! Count the calls an object makes to an import (before install())
+   int addSymbol(class LoadObject* loadObject, char* symbolName);
+   //! Count a symbol's calls from every object that imports it
+   int addProgramSymbol(class ProgramInfo* program, char* symbolName);
+   int install();   //!< Redirect the slots (count, or -1)
+   int remove();    //!< Restore the slots (count, or -1)
+   unsigned int getNumberOfCounters();
+   unsigned long getCount(unsigned int index);
+   //! Copy out every counter; returns the number copied
+   unsigned int snapshot(struct CallCount* counts, unsigned int maxCounts);
+   void reset();    //!< Zero the counters
+  private:
+   struct CallSite* sites;       //!< Counted imports
+   unsigned int numSites;        //!< Number of counted imports
+   unsigned int maxSites;        //!< Size of the array
+   unsigned char* code;          //!< Trampolines (start of the mapping)
+   unsigned long mapSize;        //!< Size of the mapping
+   ElfW(Addr)* targets;          //!< Where each trampoline jumps
+   unsigned long* counters;      //!< Shard 0 of the counters
+   unsigned int shardStride;     //!< Bytes from one shard to the next
+   class GOTRebinder* rebinder;  //!< Slots pointed at the trampolines
+   unsigned int installed;       //!< Nonzero between install()/remove()
+};
+
+/**
+ * One site's latencies, as summarized by CallTracer::getLatency()
+ * (times in nanoseconds, percentiles to within about 3%).
+ */
+struct CallLatency
+{
+   class LoadObject* loadObject; //!< Object making the calls
+   const char* symbolName;       //!< Function called
+   unsigned long calls;          //!< Calls measured
+   double mean;                  //!< Average latency
+   double p50;                   //!< Median
+   double p90;                   //!< 90th percentile
+   double p99;                   //!< 99th percentile
+   double p999;                  //!< 99.9th percentile
+   double max;                   //!< Longest call
+};
+
+/**
+ * CallTracer measures how long objects' calls to their imports take,
+ * such as every write() from libfoo.so. Like CallCounter it points
+ * the GOT slots of each (object, symbol) at a generated trampoline;
+ * this one takes a TSC timestamp on entry, makes the call, and takes
+ * another when it returns, keeping the caller's return address on a
+ * per-thread shadow stack meanwhile. Latencies go into a per-thread
+ * lock-free ring, and a background thread drains the rings into a
+ * log-linear (HdrHistogram-style) histogram per site. Tracing can be
+ * enabled and disabled at any time. The stub XSAVEs the x87, SSE,
+ * AVX and AVX-512 state around its helpers, so long double, __m256
+ * and __m512 arguments and results pass through intact; that makes
+ * a traced call cost one to two hundred nanoseconds more than a
+ * plain one, and about half of it lands inside the measured latency.
+ * -- trampolines are only generated for x86-64 with XSAVE (see
+ *    isSupported())
+ * -- the stub has no unwind information, so C++ exceptions must not
+ *    be thrown through a traced call, and the shadow stack and return
+ *    jump do not work with CET shadow stacks
+ * -- a call that never returns (longjmp() out of it) leaves a frame
+ *    behind; once 256 are in use, further calls on that
+ *    thread go untraced
+ * -- if the drainer falls behind a ring, new records are dropped and
+ *    counted (getDroppedRecords())
+ * -- the caveats of GOTRebinder apply
+ */
+class CallTracer
+{
+  public:
+   CallTracer();
+   ~CallTracer();
+   static unsigned int isSupported(); //!< True if trampolines work here
+   //! Trace the calls an object makes to an import (before enable())
+   int addSymbol(class LoadObject* loadObject, char* symbolName);
+   //! Trace a symbol's calls from every object that imports it
+   int addProgramSymbol(class ProgramInfo* program, char* symbolName);
+   int enable();    //!< Redirect the slots (count, or -1)
+   int disable();   //!< Restore the slots (count, or -1)
+   unsigned int isEnabled();
+   unsigned long drain(); //!< Aggregate the records buffered so far
+   unsigned int getNumberOfSites();
+   int getLatency(unsigned int index, struct CallLatency* latency);
+   //! Summarize every site; returns the number copied
+   unsigned int snapshot(struct CallLatency* latencies,
+                         unsigned int maxLatencies);
+   static unsigned long getDroppedRecords();
+   void reset();    //!< Empty the histograms
+   void writeReport(class OutputBuffer* out);
+  private:
+   struct TraceSite* sites;      //!< Traced imports
+   unsigned int numSites;        //!< Number of traced imports
+   unsigned int maxSites;        //!< Size of the array
+   unsigned char* code;          //!< Trampolines
+   unsigned long codeSize;       //!< Size of their mapping
+   unsigned long* buckets;       //!< Histograms of all sites
+   class GOTRebinder* rebinder;  //!< Slots pointed at the trampolines
+   unsigned int enabled;         //!< Nonzero between enable()/disable()
+   unsigned int drainerRunning;  //!< Nonzero if drainer was started
+   pthread_t drainer;            //!< Background drain thread
+};
+
+/**
+ * GOTWarmer binds lazily bound PLT slots ahead of their first call,
+ * so that no request pays for a trip through the dynamic linker's
+ * lazy resolver. Slots are queued per symbol, per object or for a
+ * whole program (from each object's DT_JMPREL relocations), then
+ * resolved in the calling thread (warm()) or a background one
+ * (start(), wait()); afterwards the counts and the time taken can be
+ * read back.
+ * -- binding is done with dlsym()/dlvsym(), so it follows the global
+ *    scope and then the object's own dependencies; dlmopen()
+ *    namespaces are not supported
+ * -- warmed slots bypass LD_AUDIT's la_symbind() and la_pltenter()
+ * -- nothing needs warming in objects linked -z now (or run with
+ *    LD_BIND_NOW); their slots count as already bound
+ */
+class GOTWarmer
+{
+  public:
+   GOTWarmer();
+   ~GOTWarmer();   //!< Waits for a background warm-up
+   //! Queue every PLT slot of an object (count, or -1)
+   int addObject(class LoadObject* loadObject);
+   //! Queue one import's PLT slot (0, or -1)
+   int addSymbol(class LoadObject* loadObject, char* symbolName);
+   int addProgram(class ProgramInfo* program); //!< All objects' slots
+   int warm();     //!< Resolve now; returns the number resolved
+   int start();    //!< Resolve in a background thread (0, or -1)
+   int wait();     //!< Join that thread; returns the number resolved
+   unsigned int isDone();
+   unsigned int getNumberOfSlots();       //!< Slots queued
+   unsigned int getNumberResolved();      //!< Slots warm() bound
+   unsigned int getNumberAlreadyBound();  //!< Slots bound before it
+   unsigned int getNumberFailed();        //!< Symbols not found
+   unsigned long getElapsedTime();        //!< Time warm() took (ns)
+  private:
+   struct WarmSlot* slots;       //!< Queued slots
+   unsigned int numSlots;        //!< Number of queued slots
+   unsigned int maxSlots;        //!< Size of the array
+   unsigned int numResolved;     //!< Results of the last warm()
+   unsigned int numBound;
+   unsigned int numFailed;
+   unsigned long elapsed;
+   unsigned int done;            //!< Nonzero once warm() finished
+   unsigned int threadRunning;   //!< Nonzero until wait()
+   pthread_t thread;             //!< Background warm-up thread
+   void addSlot(class LoadObject* loadObject, struct PLTSlot* slot);
+};
+
+//! How a GOT slot changed between two GOTSnapshot captures
+enum GOTChangeKind
+{
+   GOT_CHANGE_RESOLVED,   //!< Pointed into its PLT, now bound
+   GOT_CHANGE_REBOUND,    //!< Bound, now bound elsewhere
+   GOT_CHANGE_UNRESOLVED  //!< Bound, now back in its PLT
+};
+
+/**
+ * One changed slot, as described by GOTSnapshot::diff().
+ */
+struct GOTChange
+{
+   unsigned int slot;              //!< Slot index in the snapshot
+   unsigned int kind;              //!< GOTChangeKind
+   class LoadObject* loadObject;   //!< Object owning the slot
+   const char* symbolName;         //!< Its symbol (null for IRELATIVE)
+   ElfW(Addr) oldValue;            //!< Value in the earlier capture
+   ElfW(Addr) newValue;            //!< Value in the later capture
+   class LoadObject* targetObject; //!< Object newValue points into
+   const char* targetSymbol;       //!< Symbol there (null if unknown)
+};
+
+/**
+ * GOTSnapshot shows which imports a workload binds as it runs. It
+ * indexes every GOT slot of a live program once; capture() then
+ * copies all their values into a flat array (one address per slot),
+ * which takes microseconds, and diff() compares two captures. A slot
+ * that still points back into its own object's PLT is unresolved.
+ * Changed slots are attributed to the object and exported symbol
+ * they now point to (ProgramInfo::findObjectByAddress() and
+ * DynamicSection::findSymbolByAddress()).
+ * -- the slot list is fixed when the snapshot is made; objects
+ *    loaded or unloaded later are not seen (make a new GOTSnapshot)
+ * -- targets inside IFUNC implementations or other unexported code
+ *    are attributed to their object only
+ */
+class GOTSnapshot
+{
+  public:
+   GOTSnapshot(class ProgramInfo* program);
+   ~GOTSnapshot();
+   unsigned int getNumberOfSlots();
+   ElfW(Addr)* newCapture();            //!< Array for capture()
+   void capture(ElfW(Addr)* values);    //!< Read every slot
+   //! True if a captured value is bound (not back in its PLT)
+   unsigned int isResolved(unsigned int slot, ElfW(Addr) value);
+   unsigned int countResolved(ElfW(Addr)* values);
+   class LoadObject* getSlotObject(unsigned int slot);
+   struct PLTSlot* getSlot(unsigned int slot);
+   const char* getSlotSymbol(unsigned int slot);
+   //! Object (and exported symbol) a run-time address belongs to
+   class LoadObject* findTarget(ElfW(Addr) address,
+                                const char** symbolName);
+   //! Describe the slots that changed; returns how many did
+   unsigned int diff(ElfW(Addr)* before, ElfW(Addr)* after,
+                     struct GOTChange* changes, unsigned int maxChanges);
+   static const char* getChangeName(unsigned int kind);
+   void writeDiff(class OutputBuffer* out, ElfW(Addr)* before,
+                  ElfW(Addr)* after);
+  private:
+   class ProgramInfo* program;     //!< Program indexed
+   ElfW(Addr)** addresses;         //!< Run-time address of each slot
+   struct GOTSnapshotSlot* slots;  //!< Owner and relocation of each
+   unsigned int numSlots;          //!< Number of slots
+};
+
+//! How a GOT slot came to be bound where it is (ResolutionMap)
+enum ResolutionStatus
+{
+   RESOLUTION_UNRESOLVED,    //!< Still points into its PLT (or is 0)
+   RESOLUTION_FIRST_DEFINER, //!< Bound to the first definer in load order
+   RESOLUTION_INTERPOSED,    //!< Bound past the first definer
+   RESOLUTION_PRELOADED,     //!< First definer, loaded by LD_PRELOAD
+   RESOLUTION_FOREIGN,       //!< Points outside every known object
+   RESOLUTION_LOCAL,         //!< IRELATIVE or DT_SYMBOLIC self-binding
+   RESOLUTION_NUM_STATUSES
+};
+
+/**
+ * One GOT slot and its binding, as described by ResolutionMap.
+ */
+struct GOTResolution
+{
+   class LoadObject* loadObject;   //!< Object owning the slot
+   struct PLTSlot* slot;           //!< The slot
+   const char* symbolName;         //!< Import (null for IRELATIVE)
+   const char* version;            //!< Its version (null if none)
+   ElfW(Addr) value;               //!< Slot value when last read
+   class LoadObject* targetObject; //!< Object value points into
+   const char* targetSymbol;       //!< Symbol there (null if unknown)
+   class LoadObject* firstDefiner; //!< First definer in load order
+   unsigned int status;            //!< ResolutionStatus
+};
+
+/**
+ * ResolutionMap tells, for every GOT slot of a live program, where
+ * the slot points and whether that is where the dynamic linker's
+ * global scope would have bound it: the first object in load order
+ * (link map order) that defines the symbol. A slot bound to a later
+ * definer has been interposed on (by dlsym tricks, a GOTRebinder,
+ * symbol versioning surprises, or a copy of the library loaded
+ * twice); one bound to an LD_PRELOAD or /etc/ld.so.preload object is
+ * reported as preloaded. Objects are indexed in parallel, and
+ * rebuild() reclassifies all the slots again in about a millisecond.
+ * -- the lookup is the global scope only; objects opened with
+ *    RTLD_LOCAL or RTLD_DEEPBIND resolve in their own scopes and may
+ *    be reported as interposed
+ * -- the object list is fixed when the map is made (make a new
+ *    ResolutionMap after dlopen() or dlclose())
+ */
+class ResolutionMap
+{
+  public:
+   ResolutionMap(class ProgramInfo* program, unsigned int numThreads=0);
+   ~ResolutionMap();
+   unsigned long rebuild();   //!< Reread the slots (returns ns taken)
+   unsigned int getNumberOfResolutions();
+   struct GOTResolution* getResolution(unsigned int index);
+   struct GOTResolution* findResolution(class LoadObject* loadObject,
+                                        char* symbolName);
+   unsigned int getStatusCount(unsigned int status);
+   static const char* getStatusName(unsigned int status);
+   unsigned long getBuildTime();   //!< Nanoseconds of the last rebuild
+   void writeReport(class OutputBuffer* out, unsigned int flaggedOnly=1);
+   //! One object's share of a build phase (for the worker threads)
+   void processObject(unsigned int index, unsigned int phase);
+  private:
+   void runPhase(unsigned int phase);
+   void addDefinerKeys();
+   unsigned int getFirstDefiner(unsigned int resolution);
+   unsigned int getObjectIndex(class LoadObject* loadObject);
+   class ProgramInfo* program;         //!< Program mapped
+   class LoadObject** objects;         //!< Live objects in load order
+   unsigned int* preloaded;            //!< Nonzero for preloaded objects
+   unsigned int* firstResolution;      //!< Each object's first slot
+   unsigned int numObjects;            //!< Number of objects
+   struct GOTResolution* resolutions;  //!< Slots, object by object
+   unsigned int numResolutions;        //!< Number of slots
+   struct DefinerKey* definerKeys;     //!< Hash of (name, version) imports
+   unsigned int definerMask;           //!< definerKeys size - 1
+   unsigned int* resolutionKeys;       //!< Each slot's definerKeys entry
+   unsigned int statusCounts[RESOLUTION_NUM_STATUSES]; //!< Per status
+   unsigned int numThreads;            //!< Threads to build with (0: per CPU)
+   unsigned long buildTime;            //!< ns taken by the last rebuild
+};
+
+//! Relocations of one type (LookupCostModel)
+struct RelocTypeCount
+{
+   unsigned int type;   //!< r_type
+   unsigned long count; //!< Relocations of it
+};
+
+/**
+ * The startup relocation work of one object, and the lookup work
+ * its tables cost other objects, as estimated by LookupCostModel.
+ */
+struct ObjectLookupCost
+{
+   class LoadObject* loadObject;    //!< The object
+   unsigned long relocations;       //!< All its dynamic relocations
+   unsigned long relative;          //!< RELATIVE ones (and DT_RELR)
+   unsigned long irelative;         //!< IRELATIVE ones (resolver calls)
+   unsigned long localSymbols;      //!< Bound to itself, no lookup
+   unsigned long cachedLookups;     //!< Repeats served by ld.so's cache
+   unsigned long lazySlots;         //!< JUMP_SLOTs lazy binding defers
+   unsigned int bindNow;            //!< Object asks for DF_BIND_NOW
+   struct LookupCounts eager;       //!< Lookups made at startup anyway
+   struct LookupCounts plt;         //!< JUMP_SLOT lookups
+   struct LookupCounts served;      //!< Work done in this object's tables
+   unsigned long definitions;       //!< Lookups this object satisfied
+   double nowCost;                  //!< Estimated ns with BIND_NOW
+   double lazyCost;                 //!< Estimated ns with lazy binding
+   double servedCost;               //!< Estimated ns spent in its tables
+   struct RelocTypeCount* types;    //!< Relocations by type
+   unsigned int numTypes;           //!< Entries in types
+   unsigned int maxTypes;           //!< Its allocated size
+};
+
+/**
+ * LookupCostModel estimates what the dynamic linker spends relocating
+ * a program at startup, object by object. Every relocation is counted
+ * by type; every symbol-bound one is looked up as ld.so would: the
+ * reference is hashed once, then each object of the scope is tried
+ * in turn (bloom filter, hash chain, check_match() name compare) up
+ * to the first definition, honouring DT_SYMBOLIC, COPY relocations
+ * (which skip the executable), local and protected references (no
+ * lookup) and ld.so's cache of the last symbol looked up. The counts
+ * are turned into nanoseconds with fixed per-operation weights, once
+ * with every JUMP_SLOT bound at startup (BIND_NOW) and once with
+ * them left to lazy binding; each object is also charged for the
+ * lookups that pass through its own hash table.
+ * -- the scope is either a live program in link map order or a list
+ *    of files in the order given (the executable first); it is the
+ *    global scope only, as for objects loaded at startup
+ * -- the weights are rough figures for a warm x86-64 core; the
+ *    estimate is meant for ranking objects, not for predicting time
+ */
+class LookupCostModel
+{
+  public:
+   //! Model a live program (0 threads means one per CPU)
+   LookupCostModel(class ProgramInfo* program, unsigned int numThreads=0);
+   //! Model a scope given as a list of objects, executable first
+   LookupCostModel(class LoadObject** objects, unsigned int numObjects,
+                   unsigned int numThreads=0);
+   ~LookupCostModel();
+   unsigned int getNumberOfObjects();
+   //! An object's costs (index is its position in the scope)
+   struct ObjectLookupCost* getObjectCost(unsigned int index);
+   //! Program totals (loadObject and types are null)
+   struct ObjectLookupCost* getTotalCost();
+   unsigned long getAnalysisTime();   //!< Nanoseconds the model took
+   //! Name of a dynamic relocation type (null if not known)
+   static const char* getRelocationTypeName(unsigned int machine,
+                                            unsigned int type);
+   //! Ranked report: the costliest objects and scope members, types
+   void writeReport(class OutputBuffer* out, unsigned int maxObjects=20);
+   //! One item of an analysis phase (for the worker threads)
+   void runStep(unsigned int phase, unsigned int index, unsigned int worker);
+  private:
+   void analyze(unsigned int numThreads);
+   void runPhase(unsigned int phase, unsigned int numItems);
+   void collectObject(unsigned int index, unsigned int worker);
+   void addReference(unsigned int index, unsigned int symIndex,
+                     unsigned int typeClass, unsigned int plt,
+                     unsigned int worker);
+   void internKeys();
+   void walkScope(unsigned int keyIndex, unsigned int worker);
+   void finishObject(unsigned int index);
+   void countType(struct ObjectLookupCost* cost, unsigned int type,
+                  unsigned long count);
+   class LoadObject** objects;         //!< The scope, in search order
+   unsigned int numObjects;            //!< Objects in it
+   unsigned int ownsObjects;           //!< Nonzero if objects is new[]'d
+   struct ObjectLookupCost* costs;     //!< Per object, in scope order
+   struct ObjectLookupCost total;      //!< Sum over all objects
+   struct ObjectPending* pending;      //!< Per object, references to look up
+   struct LookupKey* keys;             //!< Distinct references
+   unsigned int numKeys;               //!< Entries in keys
+   unsigned int maxKeys;               //!< Its allocated size
+   unsigned int* keyBuckets;           //!< Key hash buckets (+1)
+   unsigned int numKeyBuckets;         //!< Number of buckets (power of 2)
+   struct LookupCounts* served;        //!< Per worker, per object
+   unsigned int numWorkers;            //!< Rows in served
+   unsigned long analysisTime;         //!< ns taken by analyze()
+};
+
+//! Which symbol hash table HashQualityReport measured
+enum HashTableKind
+{
+   HASH_TABLE_NONE,  //!< The object has neither
+   HASH_TABLE_SYSV,  //!< DT_HASH
+   HASH_TABLE_GNU    //!< DT_GNU_HASH (preferred when both are present)
+};
+
+//! Problems HashQualityReport flags (bits)
+enum HashTableFlag
+{
+   HASH_FLAG_SYSV_ONLY = 1,        //!< No GNU table: slow lookups, no bloom
+   HASH_FLAG_OVERLOADED = 2,       //!< Far too few buckets for the symbols
+   HASH_FLAG_SKEWED = 4,           //!< Chains much longer than the load explains
+   HASH_FLAG_BLOOM_SATURATED = 8,  //!< Bloom filter lets most misses through
+   HASH_FLAG_SPARSE = 16,          //!< Mostly empty buckets (wasted space)
+   HASH_NUM_FLAGS = 5
+};
+
+//! Chain lengths in the histogram: 0 .. HASH_CHAIN_HISTOGRAM-2, then more
+#define HASH_CHAIN_HISTOGRAM 16
+
+/**
+ * Quality of one object's symbol hash table, as measured by
+ * HashQualityReport. Probes are hash chain entries examined.
+ */
+struct HashTableStats
+{
+   class LoadObject* loadObject;   //!< The object
+   unsigned int kind;              //!< HashTableKind measured
+   unsigned int numBuckets;        //!< Buckets in the table
+   unsigned int usedBuckets;       //!< Buckets with a chain
+   unsigned int numHashed;         //!< Symbols in the chains
+   unsigned int numDefined;        //!< Defined symbols among them
+   unsigned int longestChain;      //!< Entries in the longest chain
+   //! Buckets by chain length (the last entry counts the longer ones)
+   unsigned int chainHistogram[HASH_CHAIN_HISTOGRAM];
+   double averageProbes;           //!< To find a defined symbol, mean
+   unsigned int worstProbes;       //!< ... and most for any one
+   double expectedProbes;          //!< Mean for an ideal hash, same load
+   unsigned int optimalBuckets;    //!< Fewest buckets giving OPTIMAL probes
+   double optimalProbes;           //!< Mean with that many buckets
+   unsigned int bloomWords;        //!< Bloom filter size (GNU only)
+   unsigned int bloomShift;        //!< Its second hash shift
+   double bloomFill;               //!< Fraction of its bits set
+   unsigned long importsTested;    //!< Distinct imports tried
+   unsigned long bloomPasses;      //!< ... that the bloom let through
+   unsigned long bloomFalsePositives; //!< ... with no definition here
+   double falsePositiveRate;       //!< Of the imports not defined here
+   unsigned int flags;             //!< HashTableFlag bits
+};
+
+/**
+ * HashQualityReport measures the .hash and .gnu.hash tables of a set
+ * of objects: bucket occupancy, a chain length histogram, the mean
+ * and worst probes needed to find each defined symbol (against what
+ * an ideal hash would need at the same load), the bucket count that
+ * would bring lookups down to about 1.5 probes, and how often the
+ * bloom filter lets through names the object does not define. The
+ * bloom filters are tested against the imports the objects really
+ * make: every distinct undefined dynamic symbol among them (a live
+ * program's imports, or those of a whole directory tree). Objects
+ * with pathological tables are flagged.
+ * -- objects are measured in parallel, one per thread at a time
+ * -- for the optimal count, bucket counts are tried from GNU ld's
+ *    list of primes, on the symbols' real hash values
+ */
+class HashQualityReport
+{
+  public:
+   //! Measure a live program's objects (0 threads means one per CPU)
+   HashQualityReport(class ProgramInfo* program, unsigned int numThreads=0);
+   //! Measure a list of objects (the caller keeps them)
+   HashQualityReport(class LoadObject** objects, unsigned int numObjects,
+                     unsigned int numThreads=0);
+   ~HashQualityReport();
+   unsigned int getNumberOfObjects();
+   struct HashTableStats* getStats(unsigned int index);
+   unsigned int getNumberOfImports();  //!< Distinct imports tested
+   unsigned int getNumberOfFlagged();  //!< Objects with any flag
+   unsigned long getAnalysisTime();    //!< Nanoseconds the analysis took
+   static const char* getFlagName(unsigned int flag);
+   //! Per object report (flagged objects only, if asked) and summary
+   void writeReport(class OutputBuffer* out, unsigned int flaggedOnly=0);
+   //! One object's share of a phase (for the worker threads)
+   void runStep(unsigned int phase, unsigned int index);
+  private:
+   void analyze(unsigned int numThreads);
+   void runPhase(unsigned int phase, unsigned int numItems);
+   void measureTable(unsigned int index);
+   void collectImports();
+   void addImport(const char* name);
+   void testBloom(unsigned int index);
+   class LoadObject** objects;         //!< Objects measured
+   unsigned int numObjects;            //!< Number of them
+   unsigned int ownsObjects;           //!< Nonzero if objects is new[]'d
+   unsigned int numWorkers;            //!< Threads per phase
+   struct HashTableStats* stats;       //!< Per object
+   struct ImportName* imports;         //!< Distinct imports
+   unsigned int numImports;            //!< Entries in imports
+   unsigned int maxImports;            //!< Its allocated size
+   unsigned int* importBuckets;        //!< Hash of imports (index + 1)
+   unsigned int numImportBuckets;      //!< Power of 2
+   unsigned int numFlagged;            //!< Objects with any flag
+   unsigned long analysisTime;         //!< Nanoseconds analyze() took
+};
+
+/**
+ * DebugInfoFinder locates the separate debug file for a stripped
+ * LoadObject. It first tries the NT_GNU_BUILD_ID note, which names
+ * a file under <debug-root>/.build-id/, and then the .gnu_debuglink
+ * section, which gives a file name plus a CRC32 of the debug file's
+ * contents. The debug root is /usr/lib/debug unless the environment
+ * variable ELFREADER_DEBUG_ROOT says otherwise.
+ * -- debuglink matches whose CRC has been verified are recorded in a
+ *    cache file (ELFREADER_DEBUG_CACHE, default is
+ *    $HOME/.cache/elfreader-debuglink), keyed by path, size, mtime
+ *    and inode, so later processes skip checksumming the file.
+ */
+class DebugInfoFinder
+{
+  public:
+   DebugInfoFinder(LoadObject* loadObject);
+   ~DebugInfoFinder();
+   LoadObject* findDebugObject();
+   LoadObject* findByBuildId();
+   LoadObject* findByDebugLink();
+   //! CRC32 (as used by .gnu_debuglink), slicing-by-8
+   static unsigned int crc32(unsigned int crc, const unsigned char* buf,
+                             unsigned long len);
+  private:
+   LoadObject* tryDebugLinkFile(char* path, unsigned int crc);
+   int isCachedMatch(char* path, unsigned int crc);
+   void addCachedMatch(char* path, unsigned int crc);
+   LoadObject* loadObject; //!< Stripped object we look for
+   char* debugRoot;        //!< Root of debug file tree
+};
+
+/**
+ * ArchiveFile reads a static library (an "ar" archive of relocatable
+ * objects). The archive is mmap()'d once; each member can be had as
+ * a file-mode LoadObject over its slice of the mapping (no copying),
+ * and the archive symbol index answers "which member defines X"
+ * without opening any member (an archive without an index, or with
+ * a malformed one, has its members' symbol tables scanned instead).
+ */
+class ArchiveFile
+{
+  public:
+   ArchiveFile(char* archiveFilename);
+   ~ArchiveFile();
+   unsigned int isValidArchive();
+   char* getName();
+   unsigned int getNumberOfMembers();
+   char* getMemberName(unsigned int index);
+   char* getMemberData(unsigned int index, unsigned long* size);
+   LoadObject* getMemberObject(unsigned int index);
+   //! Parse all members concurrently (0 threads means one per CPU)
+   unsigned int parseAllMembers(unsigned int numThreads=0);
+   unsigned int getNumberOfIndexSymbols();
+   char* getIndexSymbol(unsigned int index, unsigned int* member);
+   //! Member number defining a symbol, from the index (-1 if none)
+   int findMemberDefiningSymbol(char* symbolName);
+  private:
+   int parseMembers();
+   int parseSymbolIndex(char* data, unsigned long size, 
+                        unsigned int wordSize);
+   void dropSymbolIndex();
+   int scanMembersForSymbol(char* symbolName);
+   char* fileName;                 //!< Archive file name
+   char* image;                    //!< Start of archive mapping
+   unsigned long imageSize;        //!< Size of archive mapping
+   struct ArchiveMember* members;  //!< Member array
+   unsigned int numMembers;        //!< Number of (non-special) members
+   char* longNames;                //!< GNU long-name table ("//")
+   unsigned long longNamesSize;    //!< Size of long-name table
+   unsigned int numIndexSymbols;   //!< Entries in the symbol index
+   char** indexNames;              //!< Symbol names from the index
+   unsigned int* indexMembers;     //!< Defining member of each entry
+   unsigned int* hashBuckets;      //!< Hash buckets over index names
+   unsigned int* hashChains;       //!< Hash chains over index names
+   unsigned int numBuckets;        //!< Number of buckets (power of 2)
+};
+
+/**
+ * Kinds of data blocks kept for each object in a ProgramSnapshot.
+ * Memory blocks are keyed by runtime address, file blocks by file
+ * offset; the symtab/strtab blocks hold the object's effective static
+ * symbol table (which may have come from a separate debug file).
+ */
+enum SnapshotBlockKind
+{
+   SNAPSHOT_MEMORY_BLOCK = 1,
+   SNAPSHOT_FILE_BLOCK = 2,
+   SNAPSHOT_SYMTAB_BLOCK = 3,
+   SNAPSHOT_STRTAB_BLOCK = 4
+};
+
+/**
+ * A ProgramSnapshot is a single binary file holding what ProgramInfo
+ * knows about a running process, so that it can be analysed on
+ * another host. The file is a header, a table directory, and flat
+ * tables (objects, blocks, strings, raw data) addressed by file
+ * offset. For each object it keeps the ELF and segment headers, the
+ * section header table, the dynamic section and everything it points
+ * to (dynsym, dynstr, hash tables, relocations, version tables), the
+ * GOT and PLT contents, notes, and the static symbol table, plus the
+ * object's position in the dynamic linker's link-map list.
+ * Loading mmap()s the file and builds a read-only ProgramInfo whose
+ * LoadObjects read everything in place from the mapping.
+ */
+class ProgramSnapshot
+{
+  public:
+   ProgramSnapshot(char* snapshotFilename);
+   ~ProgramSnapshot();
+   //! Write a snapshot of a (live) program
+   static int writeSnapshot(ProgramInfo* program, char* snapshotFilename);
+   unsigned int isValidSnapshot();
+   char* getProgramName();
+   unsigned int getProcessId();
+   unsigned int getNumberOfObjects();
+   char* getObjectName(unsigned int object);
+   char* getObjectBaseAddress(unsigned int object);
+   char* getObjectHighAddress(unsigned int object);
+   int getObjectLinkMapIndex(unsigned int object); //!< -1 if not in list
+   //! Find the data of a block covering [address, address+size)
+   char* findBlock(unsigned int object, unsigned int kind, 
+                   unsigned long address, unsigned long size,
+                   unsigned long* blockSize=0);
+  private:
+   char* image;                     //!< Snapshot file mapping
+   unsigned long imageSize;         //!< Size of the mapping
+   struct SnapshotHeader* header;   //!< File header
+   struct SnapshotObject* objects;  //!< Object table
+   struct SnapshotBlock* blocks;    //!< Block table
+   unsigned long numBlocks;         //!< Entries in block table
+   char* strings;                   //!< String pool
+   unsigned long stringsSize;       //!< Size of string pool
 };
 
+/**
+ * OutputBuffer is a reusable buffered writer for bulk text output.
+ * Data is formatted straight into one large buffer that is written
+ * to the file descriptor only when it fills up (or on flush()), and
+ * integers are formatted with table-driven code rather than printf,
+ * so streaming millions of records costs no heap allocation at all.
+ */
+class OutputBuffer
+{
+  public:
+   OutputBuffer(int fd, unsigned int bufferSize=1<<20);
+   ~OutputBuffer(); //!< Flushes (does not close the descriptor)
+   void putChar(char c);
+   void putBytes(const char* data, unsigned int length);
+   void putString(const char* str);
+   //! Hex digits without prefix, zero padded to minDigits
+   void putHex(unsigned long value, unsigned int minDigits=1);
+   void putDecimal(unsigned long value);
+   void putSigned(long value);
+   //! String as a JSON string literal (quotes and escapes)
+   void putJSONString(const char* str);
+   //! String as a CSV field (quoted only if it needs to be)
+   void putCSVString(const char* str);
+   int flush();                     //!< Returns -1 if a write failed
+   unsigned long getBytesWritten(); //!< Total bytes, flushed or not
+   unsigned int hasError();         //!< True if a write failed
+  private:
+   void makeRoom(unsigned int length);
+   void writeOut(const char* data, unsigned int length);
+   int fd;                   //!< Output file descriptor
+   char* buffer;             //!< Output buffer
+   unsigned int size;        //!< Buffer size
+   unsigned int used;        //!< Bytes in buffer
+   unsigned long flushed;    //!< Bytes already written out
+   unsigned int writeError;  //!< Nonzero once a write has failed
+};
+
+/**
+ * Record kinds an ElfExporter can produce (bit mask).
+ */
+enum ExportRecordKind
+{
+   EXPORT_SYMTAB   = 0x01, //!< Static symbol table
+   EXPORT_DYNSYM   = 0x02, //!< Dynamic symbol table
+   EXPORT_SECTIONS = 0x04, //!< Section headers
+   EXPORT_SEGMENTS = 0x08, //!< Program (segment) headers
+   EXPORT_DYNAMIC  = 0x10, //!< Dynamic section entries
+   EXPORT_RELOCS   = 0x20  //!< Relocations
+};
+
+/**
+ * ElfExporter streams the contents of load objects as NDJSON (one JSON
+ * object per line) or CSV, for feeding symbol dumps into other tools.
+ * Records are formatted directly from the raw ELF tables into an
+ * OutputBuffer; no ElfSymbol or other object is created per record.
+ * Each record kind has a fixed set of columns, of which a subset can
+ * be selected, and symbol records can be filtered by name (a shell
+ * glob), type, binding and defined/undefined.
+ * -- CSV output starts a new header line whenever the record kind
+ *    changes, since the kinds have different columns.
+ */
+class ElfExporter
+{
+  public:
+   ElfExporter(OutputBuffer* out, unsigned int csv=0);
+   ~ElfExporter();
+   //! Select columns by name (comma separated); -1 if a name is unknown
+   int setColumns(char* columnList);
+   void setNameFilter(char* pattern); //!< Glob on symbol/section names
+   void setTypeFilter(int type);      //!< STT_* value, -1 for any
+   void setBindFilter(int bind);      //!< STB_* value, -1 for any
+   void setDefinedFilter(int defined); //!< 1 defined, 0 undefined, -1 any
+   //! Export the selected record kinds of one object
+   unsigned long exportObject(LoadObject* lo, unsigned int kinds);
+   //! Export every object of a program
+   unsigned long exportProgram(ProgramInfo* program, unsigned int kinds);
+   unsigned long getRecordCount();
+   static const char* getSymbolTypeName(unsigned int type);
+   static const char* getSymbolBindName(unsigned int bind);
+  private:
+   void exportSymbols(LoadObject* lo, ElfW(Sym)* syms, unsigned int count,
+                      char* strTable, unsigned long strTableSize,
+                      const char* tableName);
+   void exportSections(LoadObject* lo);
+   void exportSegments(LoadObject* lo);
+   void exportDynamic(LoadObject* lo);
+   void exportRelocations(LoadObject* lo);
+   void exportRelocationTable(LoadObject* lo, const char* tableName,
+                              char* rels, unsigned int count,
+                              unsigned int withAddends, ElfW(Sym)* syms,
+                              unsigned int numSyms, char* strTable,
+                              unsigned long strTableSize);
+   unsigned int nameMatches(const char* name);
+   void beginRecord(unsigned int kind);
+   void beginField(unsigned int field);
+   void endRecord();
+   void putString(const char* str);
+   void putHexField(unsigned long value);
+   OutputBuffer* out;        //!< Where records go
+   unsigned int csv;         //!< Nonzero for CSV, else NDJSON
+   unsigned int kind;        //!< Kind of the record being written
+   unsigned int lastKind;    //!< Kind of the last CSV header written
+   unsigned int numFields;   //!< Fields written in current record
+   unsigned char columns[5][16];  //!< Selected columns per kind
+   unsigned int numColumns[5];    //!< Number of selected columns
+   char* namePattern;        //!< Name glob (or null)
+   unsigned int prefixLength;     //!< Literal characters before a wildcard
+   unsigned int prefixOnly;  //!< Pattern is "literal*"
+   int typeFilter;           //!< STT_* to keep, or -1
+   int bindFilter;           //!< STB_* to keep, or -1
+   int definedFilter;        //!< 1, 0, or -1
+   unsigned long records;    //!< Records written
+};
+
+/**
+ * What an ElfDiffChange is about, and how it changed.
+ */
+enum ElfDiffItem
+{
+   DIFF_SYMBOL = 1,   //!< A symbol, keyed by (name, version)
+   DIFF_SECTION = 2,  //!< A section, keyed by name
+   DIFF_NEEDED = 3    //!< A DT_NEEDED library name
+};
+
+enum ElfDiffKind
+{
+   DIFF_ADDED = 1,
+   DIFF_REMOVED = 2,
+   DIFF_CHANGED = 3
+};
+
+/**
+ * One difference found by ElfDiff. Names point into the objects
+ * being compared, so they live as long as the ElfDiff does.
+ */
+struct ElfDiffChange
+{
+   unsigned int item;     //!< ElfDiffItem
+   unsigned int change;   //!< ElfDiffKind
+   const char* name;      //!< Symbol, section or library name
+   const char* version;   //!< Symbol version (or null)
+   ElfW(Sym)* oldSym;     //!< Old symbol (symbols only, null if added)
+   ElfW(Sym)* newSym;     //!< New symbol (symbols only, null if removed)
+   unsigned long oldSize; //!< Old size in bytes
+   unsigned long newSize; //!< New size in bytes
+};
+
+/**
+ * ElfDiff compares two versions of an object: the symbol tables
+ * (dynamic symbols, or the global static symbols if there is no
+ * dynamic symbol table), section sizes, and DT_NEEDED entries.
+ * Both sides are hashed by key and joined in one pass each, so a
+ * comparison takes time linear in the table sizes; only the list of
+ * changes is sorted, for the report.
+ * -- a symbol counts as changed if its size, type, binding or
+ *    defined/undefined state differs; address changes are ignored
+ * -- a section counts as changed if its size or content hash differs
+ */
+class ElfDiff
+{
+  public:
+   ElfDiff(LoadObject* oldObject, LoadObject* newObject);
+   ElfDiff(char* oldFilename, char* newFilename);
+   ~ElfDiff();
+   unsigned int isValidDiff();  //!< False if either object failed to load
+   int compare();
+   unsigned int getNumberOfChanges();
+   struct ElfDiffChange* getChange(unsigned int index);
+   unsigned int countChanges(unsigned int item, unsigned int change);
+   void writeReport(OutputBuffer* out);
+   //! Diff many file pairs in parallel (0 threads means one per CPU)
+   static ElfDiff** compareFiles(char** oldFiles, char** newFiles,
+                                 unsigned int count,
+                                 unsigned int numThreads=0);
+  private:
+   void init(LoadObject* oldObject, LoadObject* newObject);
+   void compareSymbols();
+   void compareSections();
+   void compareNeeded();
+   struct ElfDiffChange* addChange(unsigned int item, unsigned int change,
+                                   const char* name);
+   LoadObject* oldObject;          //!< Old version
+   LoadObject* newObject;          //!< New version
+   unsigned int ownsObjects;       //!< Nonzero if we created the objects
+   struct ElfDiffChange* changes;  //!< Change array
+   unsigned int numChanges;        //!< Changes found
+   unsigned int maxChanges;        //!< Size of change array
+};
+
+/**
+ * Phases of reading an object that LoadStats times. Phases can nest
+ * (the dynamic section is decoded while the segment headers are
+ * processed), so their times do not add up to the total.
+ */
+enum LoadStatsPhase
+{
+   STATS_PHASE_MAPS,             //!< Parsing /proc/pid/maps
+   STATS_PHASE_FILE_MAP,         //!< Opening and mmap()ing a file image
+   STATS_PHASE_SECTION_HEADERS,  //!< Fetching and processing section headers
+   STATS_PHASE_SEGMENT_HEADERS,  //!< Processing segment headers
+   STATS_PHASE_DYNAMIC,          //!< Decoding the dynamic section
+   STATS_PHASE_LINK_MAP,         //!< Finding the link_map entry
+   STATS_PHASE_SYMBOLS,          //!< Fetching a symtab from a debug file
+   STATS_NUM_PHASES
+};
+
+/**
+ * Event counters kept by LoadStats.
+ */
+enum LoadStatsCounter
+{
+   STATS_FILE_OPENS,    //!< Files opened
+   STATS_BYTES_READ,    //!< Bytes read from files
+   STATS_BYTES_MAPPED,  //!< Bytes of files mmap()'d
+   STATS_ALLOCATIONS,   //!< Heap buffers and arrays allocated
+   STATS_OBJECTS,       //!< Library objects (LoadObject, ElfSection...) made
+   STATS_NUM_COUNTERS
+};
+
+/**
+ * LoadStats records phase times (from the monotonic clock) and event
+ * counters. Each LoadObject and ProgramInfo built while statistics are
+ * enabled gets its own record, and every thread also keeps running
+ * totals; all updates go to thread-local records, so nothing is
+ * shared between threads while objects are being read.
+ * Statistics are off until setEnabled(1) is called, and then cost a
+ * flag test per event; building with -DELFREADER_NO_STATS removes
+ * the instrumentation entirely.
+ */
+class LoadStats
+{
+  public:
+   LoadStats();
+   void reset();
+   void add(LoadStats* other);       //!< Add another record into this one
+   unsigned long getPhaseTime(unsigned int phase);  //!< Nanoseconds
+   unsigned long getPhaseCount(unsigned int phase); //!< Times entered
+   unsigned long getCounter(unsigned int counter);
+   void writeReport(OutputBuffer* out, const char* title);
+   static const char* getPhaseName(unsigned int phase);
+   static const char* getCounterName(unsigned int counter);
+   static void setEnabled(unsigned int on);
+   static unsigned int isEnabled();
+   //! Make a record the calling thread's target; returns the previous one
+   static LoadStats* setCurrent(LoadStats* stats);
+   static LoadStats* getCurrent();
+   //! Sum of every thread's running totals
+   static void getProcessTotals(LoadStats* totals);
+   static unsigned long now();       //!< Monotonic clock, nanoseconds
+   static void count(unsigned int counter, unsigned long amount);
+   static void endPhase(unsigned int phase, unsigned long startTime);
+   static unsigned int enabled;      //!< Runtime switch (use the macros)
+  private:
+   unsigned long phaseTime[STATS_NUM_PHASES];   //!< Nanoseconds per phase
+   unsigned long phaseCount[STATS_NUM_PHASES];  //!< Entries per phase
+   unsigned long counters[STATS_NUM_COUNTERS];  //!< Event counts
+};
+
+/**
+ * Makes a LoadStats record the thread's current target for the
+ * lifetime of a scope (such as a constructor), then restores the
+ * previous one. Does nothing for a null record.
+ */
+class LoadStatsScope
+{
+  public:
+   LoadStatsScope(LoadStats* stats);
+   ~LoadStatsScope();
+  private:
+   LoadStats* previous;   //!< Target to restore
+   unsigned int active;   //!< Nonzero if we changed the target
+};
+
+#ifndef ELFREADER_NO_STATS
+#define STATS_ENABLED (LoadStats::enabled)
+#define STATS_COUNT(counter, amount) \
+   do { if (LoadStats::enabled) LoadStats::count(counter, amount); } while (0)
+#define STATS_PHASE_BEGIN(var) \
+   unsigned long var = LoadStats::enabled ? LoadStats::now() : 0
+#define STATS_PHASE_END(phase, var) \
+   do { if (var) LoadStats::endPhase(phase, var); } while (0)
+#else
+#define STATS_ENABLED 0
+#define STATS_COUNT(counter, amount) do { } while (0)
+#define STATS_PHASE_BEGIN(var) do { } while (0)
+#define STATS_PHASE_END(phase, var) do { } while (0)
+#endif
+
 //
 // NOT USED (YET)
 //
@@ -1,6 +1,7 @@
 
 #include <ElfProgram.h>
 #include <stdio.h>
+#include <string.h>
 
 /**
  * Sets up object holding info about an ELF section. This does
@@ -21,6 +22,7 @@ ElfSection::ElfSection(int secIndex, ElfW(Shdr) *secHeader,
    unsigned int symbolEntrySize;
    unsigned int stringTableIndex;
 
+   STATS_COUNT(STATS_OBJECTS, 1);
    stringTable=0;
    symbolTable=0;
    stringTableSize=0;
@@ -30,31 +32,45 @@ ElfSection::ElfSection(int secIndex, ElfW(Shdr) *secHeader,
 
    index = secIndex;
    this->secHeader = secHeader;
+   this->loadObject = loadObject;
    baseAddress = loadObject->getBaseAddress() + (int) secHeader->sh_offset;
+   sectionDataPtr = baseAddress;
 
    //
-   // executable has blank spaces -- maybe a DSO does, too?
+   // executable has blank spaces -- and so does a DSO: segments are
+   // mapped separately, so a loaded section must be found through
+   // its virtual address rather than its file offset (the data
+   // pointer differs from the address only for snapshot objects)
    //
-   if ((char*)secHeader->sh_addr > baseAddress && 
-       loadObject->isExecutable() && 
-       isLoadedInMemory())
-      baseAddress = (char*) secHeader->sh_addr;
+   if (!loadObject->isFileImage() && isLoadedInMemory() && 
+       secHeader->sh_addr)
+   {
+      baseAddress = (char*) (loadObject->getLoadBias() + secHeader->sh_addr);
+      sectionDataPtr = loadObject->getVaddrDataPtr(secHeader->sh_addr);
+   }
    
    highAddress = baseAddress + (int) secHeader->sh_size;
-   sectionDataPtr = baseAddress;
    alignMask = ~(1 - (int) secHeader->sh_addralign);
-   this->loadObject = loadObject;
+   contentHash = 0;
+   hashValid = 0;
+   ownsData = 0;
 
    //debugPrintInfo();
 
    // if not in memory, then fetch section data from file
    if ((getType() == SHT_SYMTAB || getType() == SHT_STRTAB) &&
-       (baseAddress > loadObject->getHighAddress() ||
-        highAddress > loadObject->getHighAddress()))
+       !loadObject->isFileImage() && !isLoadedInMemory())
    {
       sectionDataPtr = 
-         loadObject->getFileSection((unsigned int) secHeader->sh_offset,
-                                    (unsigned int) secHeader->sh_size);
+         loadObject->getFileRangePtr(secHeader->sh_offset,
+                                     secHeader->sh_size);
+      if (!sectionDataPtr)
+      {
+         sectionDataPtr = 
+            loadObject->getFileSection((unsigned int) secHeader->sh_offset,
+                                       (unsigned int) secHeader->sh_size);
+         ownsData = sectionDataPtr != 0;
+      }
       //printf("section fetched from file\n");
       assert(sectionDataPtr);
    }
@@ -82,6 +98,20 @@ ElfSection::ElfSection(int secIndex, ElfW(Shdr) *secHeader,
    return;
 }
 
+/**
+ * Frees section data that the constructor fetched from the file.
+ */
+ElfSection::~ElfSection()
+{
+   if (ownsData)
+      delete[] sectionDataPtr;
+}
+
+unsigned long ElfSection::getOwnedDataSize()
+{
+   return ownsData ? secHeader->sh_size : 0;
+}
+
 void ElfSection::debugPrintInfo(char *shStrTable)
 {
    //unsigned int i, count;
@@ -324,3 +354,149 @@ unsigned int ElfSection::isThreadLocalStorage() //sh_flags
 {
    return (secHeader->sh_flags & SHF_TLS);
 }
+
+/**
+ * Tell whether the section contents can be read through
+ * getSectionDataPtr(): always for file images; for loaded objects
+ * only for sections that are in memory and for the symbol and string
+ * tables (which are fetched from the file).
+ */
+unsigned int ElfSection::hasContentData()
+{
+   if (getType() == SHT_NOBITS || !sectionDataPtr)
+      return 0;
+   return loadObject->isFileImage() || isLoadedInMemory() ||
+          getType() == SHT_SYMTAB || getType() == SHT_STRTAB;
+}
+
+/**
+ * Get a hash of the section contents, for finding identical sections
+ * and sections that changed. The hash is computed once and kept. For
+ * a loaded object, the hash is of the contents in memory, which for
+ * writable sections has been changed by relocation. A NOBITS section
+ * hashes as empty.
+ * @param hash is a return parameter set to the hash.
+ * @return 0 on success, -1 if the contents cannot be read.
+ */
+int ElfSection::getContentHash(unsigned long* hash)
+{
+   if (!hashValid)
+   {
+      if (getType() == SHT_NOBITS)
+         contentHash = xxHash64(0, 0);
+      else if (!hasContentData())
+         return -1;
+      else
+         contentHash = xxHash64(sectionDataPtr, secHeader->sh_size);
+      hashValid = 1;
+   }
+   *hash = contentHash;
+   return 0;
+}
+
+void ElfSection::setContentHash(unsigned long hash)
+{
+   contentHash = hash;
+   hashValid = 1;
+}
+
+#define XXH_PRIME64_1 0x9E3779B185EBCA87UL
+#define XXH_PRIME64_2 0xC2B2AE3D27D4EB4FUL
+#define XXH_PRIME64_3 0x165667B19E3779F9UL
+#define XXH_PRIME64_4 0x85EBCA77C2B2CA63UL
+#define XXH_PRIME64_5 0x27D4EB2F165667C5UL
+
+static inline unsigned long rotl64(unsigned long x, unsigned int r)
+{
+   return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long xxhRound(unsigned long acc, unsigned long input)
+{
+   acc += input * XXH_PRIME64_2;
+   return rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static inline unsigned long xxhMerge(unsigned long acc, unsigned long val)
+{
+   acc ^= xxhRound(0, val);
+   return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static inline unsigned long read64(const unsigned char* p)
+{
+   unsigned long v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+static inline unsigned int read32(const unsigned char* p)
+{
+   unsigned int v;
+   memcpy(&v, p, sizeof(v));
+   return v;
+}
+
+/**
+ * XXH64 (little-endian form, as in the reference implementation).
+ * The bulk loop keeps four independent accumulators, one per 8-byte
+ * lane of a 32-byte stripe, so the multiplies of the lanes overlap
+ * in the pipeline; this is what makes XXH64 run near memory speed.
+ * @param data is the data to hash.
+ * @param length is its length in bytes.
+ * @param seed is the hash seed.
+ * @return The 64-bit hash.
+ */
+unsigned long ElfSection::xxHash64(const void* data, unsigned long length,
+                                   unsigned long seed)
+{
+   const unsigned char* p = (const unsigned char*) data;
+   const unsigned char* end = p + length;
+   unsigned long h, v1, v2, v3, v4;
+   if (length >= 32)
+   {
+      const unsigned char* limit = end - 32;
+      v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+      v2 = seed + XXH_PRIME64_2;
+      v3 = seed;
+      v4 = seed - XXH_PRIME64_1;
+      do {
+         v1 = xxhRound(v1, read64(p));
+         v2 = xxhRound(v2, read64(p+8));
+         v3 = xxhRound(v3, read64(p+16));
+         v4 = xxhRound(v4, read64(p+24));
+         p += 32;
+      } while (p <= limit);
+      h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+      h = xxhMerge(h, v1);
+      h = xxhMerge(h, v2);
+      h = xxhMerge(h, v3);
+      h = xxhMerge(h, v4);
+   }
+   else
+      h = seed + XXH_PRIME64_5;
+   h += length;
+   while (p + 8 <= end)
+   {
+      h ^= xxhRound(0, read64(p));
+      h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+      p += 8;
+   }
+   if (p + 4 <= end)
+   {
+      h ^= (unsigned long) read32(p) * XXH_PRIME64_1;
+      h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+      p += 4;
+   }
+   while (p < end)
+   {
+      h ^= (*p++) * XXH_PRIME64_5;
+      h = rotl64(h, 11) * XXH_PRIME64_1;
+   }
+   h ^= h >> 33;
+   h *= XXH_PRIME64_2;
+   h ^= h >> 29;
+   h *= XXH_PRIME64_3;
+   h ^= h >> 32;
+   return h;
+}
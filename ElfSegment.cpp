@@ -13,6 +13,7 @@ ElfSegment::ElfSegment(int segIndex, ElfW(Phdr) *segHeader,
                        LoadObject *loadObject)
 {
    index = segIndex;
+   STATS_COUNT(STATS_OBJECTS, 1);
    //printf("segment constructor\n");
    type = (int) segHeader->p_type;
    this->segHeader = segHeader;
@@ -22,11 +23,10 @@ ElfSegment::ElfSegment(int segIndex, ElfW(Phdr) *segHeader,
    this->loadObject = loadObject;
    if (isDynamicInfo()) //segHeader->p_type == PT_DYNAMIC)
    {
-      char * dynaddr = (char *) segHeader->p_vaddr;
-      printf("**Do Dynamic Section** (%p, %p)\n", dynaddr, baseAddress);
-      if (dynaddr < baseAddress)
-         dynaddr += (long) loadObject->getBaseAddress();
-      loadObject->processDynamicSection(dynaddr, segHeader->p_memsz);
+      char * dynaddr = loadObject->getVaddrDataPtr(segHeader->p_vaddr);
+      //printf("**Do Dynamic Section** (%p, %p)\n", dynaddr, baseAddress);
+      if (dynaddr)
+         loadObject->processDynamicSection(dynaddr, segHeader->p_filesz);
    }
 }
 
@@ -55,6 +55,11 @@ char* ElfSegment::getHighAddress()
    return highAddress;
 }
 
+ElfW(Phdr)* ElfSegment::getSegmentHeader()
+{
+   return segHeader;
+}
+
 unsigned int ElfSegment::getAlignmentMask()
 {
    return alignMask;
@@ -75,6 +80,16 @@ unsigned int ElfSegment::getFileOffset()
    return segHeader->p_offset;
 }
 
+unsigned long ElfSegment::getFileSize()
+{
+   return segHeader->p_filesz;
+}
+
+unsigned long ElfSegment::getMemorySize()
+{
+   return segHeader->p_memsz;
+}
+
 unsigned int ElfSegment::getType()
 {
    return segHeader->p_type;
@@ -14,6 +14,7 @@
 ElfSymbol::ElfSymbol(ElfW(Sym)* sym, char* strTable, LoadObject* loadObject,
                      char* PLT, char* GOT)
 {
+   STATS_COUNT(STATS_OBJECTS, 1);
    this->sym = sym;
    this->strTable = strTable;
    this->loadObject = loadObject;
@@ -102,6 +103,29 @@ LoadObject* ElfSymbol::getLoadObject()
    return loadObject;
 }
 
+/**
+ * Get the symbol's version, for dynamic symbols of objects that have
+ * version tables.
+ * @return The version name (e.g. "GLIBC_2.14"), or null.
+ */
+char* ElfSymbol::getVersionName()
+{
+   DynamicSection* dyn = loadObject ? loadObject->getDynamicSection() : 0;
+   int index;
+   if (!dyn || (index = dyn->getSymbolIndex(sym)) < 0)
+      return 0;
+   return dyn->getSymbolVersionName(index);
+}
+
+unsigned int ElfSymbol::isDefaultVersion()
+{
+   DynamicSection* dyn = loadObject ? loadObject->getDynamicSection() : 0;
+   int index;
+   if (!dyn || (index = dyn->getSymbolIndex(sym)) < 0)
+      return 1;
+   return !dyn->isHiddenVersion(index);
+}
+
 /**
  * Fairly complex logic here to get an address for a symbol. We
  * need to do different things for data/code symbols, symbols in
@@ -115,20 +139,9 @@ char* ElfSymbol::getSymbolAddress()
    //
    if (getSHIndex() != 0 && getSHIndex() < 1000)
    {
-      if (loadObject->isSharedLibrary()) // must add objects base address
-         return loadObject->getBaseAddress() + sym->st_value;
-      // 
-      // The above should maybe use the load segment's virtual address
-      // plus the base address, or some formula like that, because
-      // there can be gaps between the loaded segments (because of
-      // page alignment. But how to find that? We could simply compare
-      // the symbol's value to the start/stop of each segment, but it
-      // seems like it ought to be easier. Maybe not, though, because
-      // the static symbols are not meant to be used at runtime so this
-      // was not planned out.
-      //
-      else // executable has actual value (does the above apply?)
-         return (char*) sym->st_value;
+      // st_value is a link-time address; the load bias accounts for
+      // where the object was mapped (0 for fixed executables)
+      return loadObject->vaddrToAddress(sym->st_value);
    }
    else // is a use (and undefined symbol)
    {
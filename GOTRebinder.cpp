@@ -0,0 +1,282 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ElfProgram.h>
+
+/*
+ * A range of read-only (RELRO) pages that apply() or rollback() must
+ * make writable for a moment.
+ */
+struct PageRange
+{
+   unsigned long start;   // First page
+   unsigned long end;     // Past the last page
+};
+
+static unsigned long pageSize()
+{
+   static unsigned long size;
+   if (!size)
+      size = sysconf(_SC_PAGESIZE);
+   return size;
+}
+
+/*
+ * The pages of an object that the dynamic linker made read-only
+ * after relocation: PT_GNU_RELRO, with both ends rounded down to a
+ * page, as ld.so does (the partial page at the end stays writable).
+ */
+static int getRelroPages(LoadObject* lo, unsigned long* start,
+                         unsigned long* end)
+{
+   ElfSegment* seg;
+   ElfW(Phdr)* ph;
+   unsigned long mask = ~(pageSize() - 1);
+   int i;
+   for (i=0; i < lo->getNumberOfSegments(); i++)
+   {
+      seg = lo->getSegment(i);
+      if (!seg || seg->getType() != PT_GNU_RELRO)
+         continue;
+      ph = seg->getSegmentHeader();
+      *start = (unsigned long) lo->vaddrToAddress(ph->p_vaddr) & mask;
+      *end = (unsigned long) lo->vaddrToAddress(ph->p_vaddr + ph->p_memsz)
+             & mask;
+      return *end > *start;
+   }
+   return 0;
+}
+
+static int compareSlots(const void* a, const void* b)
+{
+   const GOTBinding* x = *(const GOTBinding* const*) a;
+   const GOTBinding* y = *(const GOTBinding* const*) b;
+   return (x->slot > y->slot) - (x->slot < y->slot);
+}
+
+GOTRebinder::GOTRebinder()
+{
+   bindings = 0;
+   numBindings = 0;
+   maxBindings = 0;
+}
+
+/**
+ * Forget the bindings; slots that were changed keep their new
+ * targets (call rollback() first to undo them).
+ */
+GOTRebinder::~GOTRebinder()
+{
+   delete[] bindings;
+}
+
+/**
+ * Queue one GOT slot for rebinding. A slot has one binding: queuing
+ * it again before apply() only changes its new target, so rollback()
+ * still finds the value it expects and restores the original.
+ * @param loadObject is the (live) object the slot belongs to.
+ * @param gotEntry is the run-time address of the slot.
+ * @param target is the new target.
+ * @return Zero, or -1 if the object is not part of this process, the
+ *         slot is not aligned, or it is queued and already applied.
+ */
+int GOTRebinder::addSlot(LoadObject* loadObject, char* gotEntry,
+                         void* target)
+{
+   GOTBinding* b;
+   unsigned long start, end;
+   unsigned int i;
+   if (!loadObject || loadObject->isFileImage() ||
+       loadObject->isSnapshotObject() || !gotEntry ||
+       ((unsigned long) gotEntry & (sizeof(ElfW(Addr)) - 1)))
+      return -1;
+   for (i=0; i < numBindings; i++)
+   {
+      if (bindings[i].slot != (ElfW(Addr)*) gotEntry)
+         continue;
+      if (bindings[i].applied)
+         return -1;
+      bindings[i].newTarget = (ElfW(Addr)) target;
+      return 0;
+   }
+   if (numBindings >= maxBindings)
+   {
+      GOTBinding* tmp;
+      maxBindings = maxBindings ? maxBindings * 2 : 16;
+      tmp = new GOTBinding[maxBindings];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (numBindings)
+         memcpy(tmp, bindings, sizeof(GOTBinding) * numBindings);
+      delete[] bindings;
+      bindings = tmp;
+   }
+   b = &bindings[numBindings++];
+   b->loadObject = loadObject;
+   b->slot = (ElfW(Addr)*) gotEntry;
+   b->newTarget = (ElfW(Addr)) target;
+   b->oldTarget = 0;
+   b->applied = 0;
+   b->readOnly = getRelroPages(loadObject, &start, &end) &&
+                 (unsigned long) gotEntry >= start &&
+                 (unsigned long) gotEntry < end;
+   return 0;
+}
+
+/**
+ * Queue every GOT slot through which an object reaches a symbol:
+ * its PLT slot and its GLOB_DAT slot (used by .plt.got stubs and
+ * for the symbol's address), whichever it has.
+ * @param loadObject is the (live) object whose imports change.
+ * @param symbolName is the symbol ("name", "name@VER", "name@@VER").
+ * @param target is the new target.
+ * @return The number of slots queued (0 if the object has none).
+ */
+int GOTRebinder::addSymbol(LoadObject* loadObject, char* symbolName,
+                           void* target)
+{
+   DynamicSection* dyn = loadObject ? loadObject->getDynamicSection() : 0;
+   PLTMap* map = loadObject ? loadObject->getPLTMap() : 0;
+   PLTSlot* slots[2];
+   int index, i, n = 0;
+   if (!dyn || !map || (index = dyn->lookupVersionedSymbol(symbolName)) < 0)
+      return 0;
+   slots[0] = map->findJumpSlot(index);
+   slots[1] = map->findDataSlot(index);
+   for (i=0; i < 2; i++)
+      if (slots[i] && !addSlot(loadObject, map->getGOTEntry(slots[i]),
+                               target))
+         n++;
+   return n;
+}
+
+/**
+ * Queue a symbol's slots in every object of a program.
+ * @param program is the (live) program.
+ * @param symbolName is the symbol.
+ * @param target is the new target.
+ * @return The number of slots queued.
+ */
+int GOTRebinder::addProgramSymbol(ProgramInfo* program, char* symbolName,
+                                  void* target)
+{
+   LoadObject* lo;
+   int n = 0;
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      n += addSymbol(lo, symbolName, target);
+   return n;
+}
+
+/*
+ * Write the new (or, to restore, the old) target of every binding
+ * that is not (or is) applied. The slots are sorted by address so
+ * that read-only ones can be grouped into page ranges, each made
+ * writable with one mprotect() and read-only again with another.
+ * Each slot is written with one atomic store, so a thread calling
+ * through it sees either the old or the new target.
+ */
+int GOTRebinder::writeSlots(unsigned int restore)
+{
+   GOTBinding** todo;
+   PageRange* ranges;
+   unsigned long page, mask = ~(pageSize() - 1);
+   unsigned int i, n = 0, numRanges = 0, r;
+   GOTBinding* b;
+   ElfW(Addr) expected;
+   int written = 0;
+
+   if (!numBindings)
+      return 0;
+   todo = new GOTBinding*[numBindings];
+   ranges = new PageRange[numBindings];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   for (i=0; i < numBindings; i++)
+      if (bindings[i].applied == restore)
+         todo[n++] = &bindings[i];
+   qsort(todo, n, sizeof(GOTBinding*), compareSlots);
+   for (i=0; i < n; i++)
+   {
+      if (!todo[i]->readOnly)
+         continue;
+      page = (unsigned long) todo[i]->slot & mask;
+      if (numRanges && page <= ranges[numRanges-1].end)
+      {
+         if (page == ranges[numRanges-1].end)
+            ranges[numRanges-1].end += pageSize();
+         continue;
+      }
+      ranges[numRanges].start = page;
+      ranges[numRanges].end = page + pageSize();
+      numRanges++;
+   }
+   for (r=0; r < numRanges; r++)
+      if (mprotect((void*) ranges[r].start, ranges[r].end - ranges[r].start,
+                   PROT_READ | PROT_WRITE))
+         break;
+   if (r < numRanges)
+   {
+      // give back what we did open and leave every slot alone
+      while (r-- > 0)
+         mprotect((void*) ranges[r].start, ranges[r].end - ranges[r].start,
+                  PROT_READ);
+      delete[] todo;
+      delete[] ranges;
+      return -1;
+   }
+   for (i=0; i < n; i++)
+   {
+      b = todo[i];
+      if (!restore)
+      {
+         b->oldTarget = __atomic_exchange_n(b->slot, b->newTarget,
+                                            __ATOMIC_SEQ_CST);
+         b->applied = 1;
+         written++;
+         continue;
+      }
+      // only undo our own change; if someone rebound the slot since,
+      // theirs stays
+      expected = b->newTarget;
+      if (__atomic_compare_exchange_n(b->slot, &expected, b->oldTarget, 0,
+                                      __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+         written++;
+      b->applied = 0;
+   }
+   for (r=0; r < numRanges; r++)
+      mprotect((void*) ranges[r].start, ranges[r].end - ranges[r].start,
+               PROT_READ);
+   delete[] todo;
+   delete[] ranges;
+   return written;
+}
+
+/**
+ * Point every queued slot at its new target, remembering the old one.
+ * @return The number of slots written, or -1 if read-only pages could
+ *         not be made writable (then nothing was changed).
+ */
+int GOTRebinder::apply()
+{
+   return writeSlots(0);
+}
+
+/**
+ * Put back the targets apply() replaced.
+ * @return The number of slots restored (slots changed by someone else
+ *         since apply() are left alone), or -1 as for apply().
+ */
+int GOTRebinder::rollback()
+{
+   return writeSlots(1);
+}
+
+unsigned int GOTRebinder::getNumberOfBindings()
+{
+   return numBindings;
+}
+
+GOTBinding* GOTRebinder::getBinding(unsigned int index)
+{
+   return index < numBindings ? &bindings[index] : 0;
+}
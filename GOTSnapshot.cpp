@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ElfProgram.h>
+
+/*
+ * What a captured value belongs to. Kept apart from the slot
+ * addresses so that capture() reads one dense array.
+ */
+struct GOTSnapshotSlot
+{
+   LoadObject* loadObject;  // Object owning the slot
+   PLTSlot* slot;           // Its relocation
+};
+
+static const char* changeNames[] = { "resolved", "rebound", "unresolved" };
+
+/**
+ * Index every GOT slot (JUMP_SLOT, GLOB_DAT and IRELATIVE) of a live
+ * program's objects, in object order.
+ * @param program is the program; objects that are not live (file
+ *        or snapshot based) are skipped.
+ */
+GOTSnapshot::GOTSnapshot(ProgramInfo* program)
+{
+   LoadObject* lo;
+   PLTMap* map;
+   unsigned int i, n = 0;
+   this->program = program;
+   numSlots = 0;
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      if (!lo->isFileImage() && !lo->isSnapshotObject() &&
+          (map = lo->getPLTMap()))
+         n += map->getNumberOfSlots();
+   addresses = new ElfW(Addr)*[n ? n : 1];
+   slots = new GOTSnapshotSlot[n ? n : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+   {
+      if (lo->isFileImage() || lo->isSnapshotObject() ||
+          !(map = lo->getPLTMap()))
+         continue;
+      for (i=0; i < map->getNumberOfSlots(); i++)
+      {
+         addresses[numSlots] = (ElfW(Addr)*) map->getGOTEntry(map->getSlot(i));
+         slots[numSlots].loadObject = lo;
+         slots[numSlots].slot = map->getSlot(i);
+         numSlots++;
+      }
+   }
+}
+
+GOTSnapshot::~GOTSnapshot()
+{
+   delete[] addresses;
+   delete[] slots;
+}
+
+unsigned int GOTSnapshot::getNumberOfSlots()
+{
+   return numSlots;
+}
+
+/**
+ * Allocate an array that capture() can fill (delete[] it when done).
+ */
+ElfW(Addr)* GOTSnapshot::newCapture()
+{
+   ElfW(Addr)* values = new ElfW(Addr)[numSlots ? numSlots : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   return values;
+}
+
+/**
+ * Read every slot into an array, one address per slot in index
+ * order. This is a plain copy loop, cheap enough to run often; each
+ * slot is read atomically, though the dynamic linker may bind others
+ * while the copy runs.
+ * @param values receives getNumberOfSlots() addresses.
+ */
+void GOTSnapshot::capture(ElfW(Addr)* values)
+{
+   unsigned int i;
+   for (i=0; i < numSlots; i++)
+      values[i] = __atomic_load_n(addresses[i], __ATOMIC_RELAXED);
+}
+
+/**
+ * Decide whether a captured value is bound: a slot still pointing
+ * back into its own object's PLT (or null) has not been resolved.
+ * @param slot is the slot index.
+ * @param value is its captured value.
+ */
+unsigned int GOTSnapshot::isResolved(unsigned int slot, ElfW(Addr) value)
+{
+   if (slot >= numSlots || !value)
+      return 0;
+   return !slots[slot].loadObject->getPLTMap()->isPLTAddress((char*) value);
+}
+
+/**
+ * Count the bound slots of a capture.
+ */
+unsigned int GOTSnapshot::countResolved(ElfW(Addr)* values)
+{
+   unsigned int i, n = 0;
+   for (i=0; i < numSlots; i++)
+      n += isResolved(i, values[i]);
+   return n;
+}
+
+LoadObject* GOTSnapshot::getSlotObject(unsigned int slot)
+{
+   return slot < numSlots ? slots[slot].loadObject : 0;
+}
+
+PLTSlot* GOTSnapshot::getSlot(unsigned int slot)
+{
+   return slot < numSlots ? slots[slot].slot : 0;
+}
+
+/**
+ * Get the name of the symbol a slot is for.
+ * @return The name, or null for IRELATIVE slots.
+ */
+const char* GOTSnapshot::getSlotSymbol(unsigned int slot)
+{
+   DynamicSection* dyn;
+   ElfW(Sym)* syms;
+   unsigned int numSyms;
+   if (slot >= numSlots || !slots[slot].slot->symIndex ||
+       !(dyn = slots[slot].loadObject->getDynamicSection()) ||
+       !(syms = dyn->getSymbolTable(&numSyms)))
+      return 0;
+   return dyn->getSymbolString(syms + slots[slot].slot->symIndex);
+}
+
+/**
+ * Find the object and dynamic symbol a run-time address belongs to.
+ * @param address is the address (a slot's value).
+ * @param symbolName receives the symbol's name, or null if no
+ *        exported symbol covers the address (IFUNC implementations,
+ *        for one).
+ * @return The object, or null if the address is in none.
+ */
+LoadObject* GOTSnapshot::findTarget(ElfW(Addr) address,
+                                    const char** symbolName)
+{
+   LoadObject* target = program->findObjectByAddress((char*) address);
+   DynamicSection* dyn;
+   ElfW(Sym)* syms;
+   unsigned int numSyms;
+   int index;
+   *symbolName = 0;
+   if (target && (dyn = target->getDynamicSection()) &&
+       (syms = dyn->getSymbolTable(&numSyms)) &&
+       (index = dyn->findSymbolByAddress(
+           target->addressToVaddr((char*) address))) >= 0)
+      *symbolName = dyn->getSymbolString(syms + index);
+   return target;
+}
+
+/**
+ * Compare two captures and describe the slots whose value changed,
+ * with the object and symbol each now points to.
+ * @param before is the earlier capture.
+ * @param after is the later one.
+ * @param changes receives up to maxChanges descriptions (may be null
+ *        just to count).
+ * @param maxChanges is the size of that array.
+ * @return The number of slots that changed (which may be more than
+ *         maxChanges).
+ */
+unsigned int GOTSnapshot::diff(ElfW(Addr)* before, ElfW(Addr)* after,
+                               GOTChange* changes, unsigned int maxChanges)
+{
+   unsigned int i, n = 0, wasResolved, nowResolved;
+   GOTChange* c;
+   for (i=0; i < numSlots; i++)
+   {
+      if (before[i] == after[i])
+         continue;
+      if (n++ >= maxChanges || !changes)
+         continue;
+      c = &changes[n-1];
+      wasResolved = isResolved(i, before[i]);
+      nowResolved = isResolved(i, after[i]);
+      c->slot = i;
+      c->kind = (!wasResolved && nowResolved) ? GOT_CHANGE_RESOLVED :
+                (wasResolved && !nowResolved) ? GOT_CHANGE_UNRESOLVED :
+                GOT_CHANGE_REBOUND;
+      c->loadObject = slots[i].loadObject;
+      c->symbolName = getSlotSymbol(i);
+      c->oldValue = before[i];
+      c->newValue = after[i];
+      c->targetObject = nowResolved ?
+         findTarget(after[i], &c->targetSymbol) : 0;
+      if (!nowResolved)
+         c->targetSymbol = 0;
+   }
+   return n;
+}
+
+const char* GOTSnapshot::getChangeName(unsigned int kind)
+{
+   return kind <= GOT_CHANGE_UNRESOLVED ? changeNames[kind] : "unknown";
+}
+
+/**
+ * Write the differences between two captures as text, one line per
+ * changed slot: what happened, the object and symbol of the slot,
+ * and where it points now.
+ * @param out is where the report goes.
+ * @param before is the earlier capture.
+ * @param after is the later one.
+ */
+void GOTSnapshot::writeDiff(OutputBuffer* out, ElfW(Addr)* before,
+                            ElfW(Addr)* after)
+{
+   GOTChange* changes;
+   unsigned int n, i;
+   char line[1024];
+   n = diff(before, after, 0, 0);
+   changes = new GOTChange[n ? n : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   n = diff(before, after, changes, n);
+   for (i=0; i < n; i++)
+   {
+      snprintf(line, sizeof(line), "%-10s %-32s %s -> %s in %s (%#lx)\n",
+               getChangeName(changes[i].kind),
+               changes[i].symbolName ? changes[i].symbolName : "(irelative)",
+               changes[i].loadObject->getName(),
+               changes[i].targetSymbol ? changes[i].targetSymbol : "?",
+               changes[i].targetObject ? changes[i].targetObject->getName() :
+                  "?",
+               (unsigned long) changes[i].newValue);
+      out->putString(line);
+   }
+   delete[] changes;
+}
@@ -0,0 +1,233 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <ElfProgram.h>
+
+/*
+ * One PLT slot queued for warming.
+ */
+struct WarmSlot
+{
+   LoadObject* loadObject;  // Object owning the slot
+   PLTSlot* slot;           // Its JUMP_SLOT relocation
+};
+
+static void* warmThread(void* arg)
+{
+   ((GOTWarmer*) arg)->warm();
+   return 0;
+}
+
+GOTWarmer::GOTWarmer()
+{
+   slots = 0;
+   numSlots = 0;
+   maxSlots = 0;
+   numResolved = 0;
+   numBound = 0;
+   numFailed = 0;
+   elapsed = 0;
+   done = 0;
+   threadRunning = 0;
+}
+
+/**
+ * Wait for a background warm-up to finish, then free the queue.
+ */
+GOTWarmer::~GOTWarmer()
+{
+   wait();
+   delete[] slots;
+}
+
+/*
+ * Queue one slot (growing the array as needed).
+ */
+void GOTWarmer::addSlot(LoadObject* loadObject, PLTSlot* slot)
+{
+   if (numSlots >= maxSlots)
+   {
+      WarmSlot* tmp;
+      maxSlots = maxSlots ? maxSlots * 2 : 16;
+      tmp = new WarmSlot[maxSlots];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (numSlots)
+         memcpy(tmp, slots, sizeof(WarmSlot) * numSlots);
+      delete[] slots;
+      slots = tmp;
+   }
+   slots[numSlots].loadObject = loadObject;
+   slots[numSlots].slot = slot;
+   numSlots++;
+}
+
+/**
+ * Queue every PLT slot of an object (its DT_JMPREL JUMP_SLOT
+ * relocations; IRELATIVE ones are always bound at load time).
+ * @param loadObject is the (live) object.
+ * @return The number of slots queued, or -1 if the object is not
+ *         live or a warm-up has already started.
+ */
+int GOTWarmer::addObject(LoadObject* loadObject)
+{
+   PLTMap* map;
+   PLTSlot* slot;
+   unsigned int i;
+   int n = 0;
+   if (threadRunning || !loadObject || loadObject->isFileImage() ||
+       loadObject->isSnapshotObject() || !(map = loadObject->getPLTMap()))
+      return -1;
+   for (i=0; (slot = map->getSlot(i)); i++)
+      if (slot->kind == PLT_SLOT_JUMP)
+      {
+         addSlot(loadObject, slot);
+         n++;
+      }
+   return n;
+}
+
+/**
+ * Queue the PLT slot through which an object calls one import.
+ * @param loadObject is the (live) object.
+ * @param symbolName is the import ("name", "name@VER", "name@@VER").
+ * @return Zero, or -1 if the object has no PLT slot for it (or is not
+ *         live, or a warm-up has already started).
+ */
+int GOTWarmer::addSymbol(LoadObject* loadObject, char* symbolName)
+{
+   DynamicSection* dyn;
+   PLTMap* map;
+   PLTSlot* slot;
+   int index;
+   if (threadRunning || !loadObject || loadObject->isFileImage() ||
+       loadObject->isSnapshotObject() ||
+       !(dyn = loadObject->getDynamicSection()) ||
+       !(map = loadObject->getPLTMap()) ||
+       (index = dyn->lookupVersionedSymbol(symbolName)) < 0 ||
+       !(slot = map->findJumpSlot(index)))
+      return -1;
+   addSlot(loadObject, slot);
+   return 0;
+}
+
+/**
+ * Queue the PLT slots of every object of a program.
+ * @param program is the (live) program.
+ * @return The number of slots queued.
+ */
+int GOTWarmer::addProgram(ProgramInfo* program)
+{
+   LoadObject* lo;
+   int n = 0, k;
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      if ((k = addObject(lo)) > 0)
+         n += k;
+   return n;
+}
+
+/**
+ * Resolve the queued slots in this thread. A slot that still points
+ * into its object's PLT is looked up as the dynamic linker would
+ * (PLTMap::resolveImport(): scope and symbol version) and the final
+ * address stored in it, so the first call no longer goes through the
+ * lazy resolver; slots that are bound already are left alone.
+ * @return The number of slots resolved.
+ */
+int GOTWarmer::warm()
+{
+   unsigned long start = LoadStats::now();
+   unsigned int i, resolved = 0, bound = 0, failed = 0;
+   ElfW(Addr) *got, value, target;
+   PLTMap* map;
+   for (i=0; i < numSlots; i++)
+   {
+      map = slots[i].loadObject->getPLTMap();
+      got = (ElfW(Addr)*) map->getGOTEntry(slots[i].slot);
+      value = __atomic_load_n(got, __ATOMIC_RELAXED);
+      if (value && !map->isPLTAddress((char*) value))
+      {
+         bound++;
+         continue;
+      }
+      target = map->resolveImport(slots[i].slot->symIndex);
+      if (!target)
+      {
+         failed++;
+         continue;
+      }
+      // the dynamic linker may get there first (a call on another
+      // thread); its binding is the same, so keep whichever is stored
+      if (__atomic_compare_exchange_n(got, &value, target, 0,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+         resolved++;
+      else
+         bound++;
+   }
+   numResolved = resolved;
+   numBound = bound;
+   numFailed = failed;
+   elapsed = LoadStats::now() - start;
+   __atomic_store_n(&done, 1, __ATOMIC_RELEASE);
+   return resolved;
+}
+
+/**
+ * Resolve the queued slots in a background thread.
+ * @return Zero, or -1 if the thread could not be started (or one is
+ *         already running).
+ */
+int GOTWarmer::start()
+{
+   if (threadRunning)
+      return -1;
+   done = 0;
+   if (pthread_create(&thread, 0, warmThread, this))
+      return -1;
+   threadRunning = 1;
+   return 0;
+}
+
+/**
+ * Wait for the background warm-up, if one was started.
+ * @return The number of slots resolved.
+ */
+int GOTWarmer::wait()
+{
+   if (threadRunning)
+   {
+      pthread_join(thread, 0);
+      threadRunning = 0;
+   }
+   return numResolved;
+}
+
+unsigned int GOTWarmer::isDone()
+{
+   return __atomic_load_n(&done, __ATOMIC_ACQUIRE);
+}
+
+unsigned int GOTWarmer::getNumberOfSlots()
+{
+   return numSlots;
+}
+
+unsigned int GOTWarmer::getNumberResolved()
+{
+   return numResolved;
+}
+
+unsigned int GOTWarmer::getNumberAlreadyBound()
+{
+   return numBound;
+}
+
+unsigned int GOTWarmer::getNumberFailed()
+{
+   return numFailed;
+}
+
+unsigned long GOTWarmer::getElapsedTime()
+{
+   return elapsed;
+}
@@ -0,0 +1,540 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <ElfProgram.h>
+
+//! Mean probes per symbol a table is sized for (see optimalBuckets)
+#define OPTIMAL_PROBES  1.5
+
+//
+// Thresholds for the flags; a table has to be clearly bad, since
+// most small libraries get away with rough sizing.
+//
+#define OVERLOAD_FACTOR     4     // symbols per bucket
+#define OVERLOAD_MIN_SYMBOLS 64   // ... in a table at least this big
+#define SKEW_FACTOR         1.5   // probes over what the load explains
+#define SKEW_MIN_CHAIN      8     // ... with a chain at least this long
+#define BLOOM_MAX_FILL      0.6   // fraction of bloom bits set
+#define BLOOM_MAX_FP_RATE   0.3   // false positives per import missed
+#define BLOOM_MIN_MISSES    100   // imports tested before the rate counts
+#define SPARSE_MIN_BUCKETS  64    // buckets before emptiness counts
+#define SPARSE_FRACTION     8     // at most 1/8 of them used
+
+/*
+ * Bucket counts GNU ld chooses among (bfd's elf_buckets[]), so the
+ * suggested size is one the linker could actually have picked.
+ */
+static const unsigned int bucketPrimes[] = {
+   1, 3, 17, 37, 67, 97, 131, 197, 263, 521, 1031, 2053, 4099, 8209,
+   16411, 32771, 65537, 131101, 262147, 524309, 1048583, 2097169, 0
+};
+
+static const char* flagNames[HASH_NUM_FLAGS] = {
+   "sysv-only", "overloaded", "skewed", "bloom-saturated", "sparse"
+};
+
+/*
+ * A distinct import: an undefined dynamic symbol of some object.
+ */
+struct ImportName
+{
+   const char* name;
+   unsigned int gnuHashValue;
+   unsigned int next;       // hash chain (+1)
+};
+
+/*
+ * A phase being run over the objects.
+ */
+struct HashPhase
+{
+   HashQualityReport* report;
+   unsigned int phase;
+};
+
+static void hashStep(void* arg, unsigned int index, unsigned int worker)
+{
+   HashPhase* p = (HashPhase*) arg;
+   p->report->runStep(p->phase, index);
+}
+
+/**
+ * Measure a live program's objects, testing their bloom filters
+ * against the program's own imports.
+ * @param program is the (live) program.
+ * @param numThreads is the number of threads to work with (0 means
+ *        one per CPU); each object is handled by one thread.
+ */
+HashQualityReport::HashQualityReport(ProgramInfo* program,
+                                     unsigned int numThreads)
+{
+   unsigned int i, n = 0;
+   objects = program->getObjectsInLoadOrder(&numObjects);
+   ownsObjects = 1;
+   // the vDSO has tables, but nobody links against it by name
+   for (i=0; i < numObjects; i++)
+      if (!objects[i]->getName() || objects[i]->getName()[0] != '[')
+         objects[n++] = objects[i];
+   numObjects = n;
+   analyze(numThreads);
+}
+
+/**
+ * Measure a list of objects (file images will do), testing their
+ * bloom filters against all of their imports together.
+ * @param objects is the list (the caller keeps it and the objects).
+ * @param numObjects is its length.
+ * @param numThreads is as above.
+ */
+HashQualityReport::HashQualityReport(LoadObject** objects,
+                                     unsigned int numObjects,
+                                     unsigned int numThreads)
+{
+   this->objects = objects;
+   this->numObjects = numObjects;
+   ownsObjects = 0;
+   analyze(numThreads);
+}
+
+HashQualityReport::~HashQualityReport()
+{
+   delete[] stats;
+   delete[] imports;
+   delete[] importBuckets;
+   if (ownsObjects)
+      delete[] objects;
+}
+
+/*
+ * Run one phase over the objects with the configured threads.
+ */
+void HashQualityReport::runPhase(unsigned int phase, unsigned int numItems)
+{
+   HashPhase p;
+   p.report = this;
+   p.phase = phase;
+   ParallelFor::run(numItems, numWorkers, hashStep, &p);
+}
+
+/**
+ * Do one object's share of a phase (called by the worker threads).
+ * Phase 0 measures its hash table, phase 1 tests its bloom filter.
+ * @param phase is the phase.
+ * @param index is the object.
+ */
+void HashQualityReport::runStep(unsigned int phase, unsigned int index)
+{
+   if (phase == 0)
+      measureTable(index);
+   else
+      testBloom(index);
+}
+
+/*
+ * Run the analysis: measure every table, gather the distinct
+ * imports, test every bloom filter against them, then flag.
+ */
+void HashQualityReport::analyze(unsigned int numThreads)
+{
+   unsigned long start = LoadStats::now();
+   HashTableStats* s;
+   unsigned long misses;
+   unsigned int i;
+
+   numWorkers = ParallelFor::getThreadCount(numThreads, numObjects);
+   stats = new HashTableStats[numObjects ? numObjects : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   memset(stats, 0, sizeof(HashTableStats) * numObjects);
+   imports = 0;
+   numImports = maxImports = 0;
+   importBuckets = 0;
+   numImportBuckets = 0;
+   numFlagged = 0;
+   for (i=0; i < numObjects; i++)
+   {
+      stats[i].loadObject = objects[i];
+      objects[i]->getDynamicSection();   // made before the threads share it
+   }
+   runPhase(0, numObjects);
+   collectImports();
+   runPhase(1, numObjects);
+
+   for (i=0; i < numObjects; i++)
+   {
+      s = &stats[i];
+      if (s->kind == HASH_TABLE_NONE)
+         continue;
+      misses = s->importsTested - (s->bloomPasses - s->bloomFalsePositives);
+      s->falsePositiveRate = misses ?
+         (double) s->bloomFalsePositives / misses : 0.0;
+      if (s->kind == HASH_TABLE_SYSV)
+         s->flags |= HASH_FLAG_SYSV_ONLY;
+      if (s->numHashed >= OVERLOAD_MIN_SYMBOLS &&
+          s->numHashed > OVERLOAD_FACTOR * s->numBuckets)
+         s->flags |= HASH_FLAG_OVERLOADED;
+      if (s->averageProbes > SKEW_FACTOR * s->expectedProbes &&
+          s->longestChain >= SKEW_MIN_CHAIN)
+         s->flags |= HASH_FLAG_SKEWED;
+      if (s->bloomFill > BLOOM_MAX_FILL ||
+          (misses >= BLOOM_MIN_MISSES &&
+           s->falsePositiveRate > BLOOM_MAX_FP_RATE))
+         s->flags |= HASH_FLAG_BLOOM_SATURATED;
+      if (s->numBuckets >= SPARSE_MIN_BUCKETS &&
+          s->usedBuckets < s->numBuckets / SPARSE_FRACTION)
+         s->flags |= HASH_FLAG_SPARSE;
+      if (s->flags)
+         numFlagged++;
+   }
+   analysisTime = LoadStats::now() - start;
+}
+
+/*
+ * Mean probes to find each of a set of hash values if the table had
+ * some number of buckets: a symbol k'th in its chain costs k probes.
+ */
+static double probesWithBuckets(unsigned int* hashes, unsigned int count,
+                                unsigned int numBuckets, unsigned int* chains)
+{
+   unsigned long probes = 0;
+   unsigned int i;
+   memset(chains, 0, sizeof(unsigned int) * numBuckets);
+   for (i=0; i < count; i++)
+      probes += ++chains[hashes[i] % numBuckets];
+   return count ? (double) probes / count : 0.0;
+}
+
+/*
+ * Measure one object's table: walk every chain (the GNU table if
+ * there is one, as ld.so would use it), then try the bucket counts
+ * GNU ld could have chosen on the same hash values.
+ */
+void HashQualityReport::measureTable(unsigned int index)
+{
+   HashTableStats* s = &stats[index];
+   DynamicSection* dyn = objects[index]->getDynamicSection();
+   ElfW(Sym)* symbols;
+   ElfW(Addr)* bloom;
+   unsigned int *words, *buckets, *chains, *hashes, *sizing;
+   unsigned int numSymbols, symOffset, length, b, i, sym;
+   unsigned long bits = 0, probeSum = 0;
+   double probes;
+   char* name;
+
+   if (!dyn)
+      return;
+   symbols = dyn->getSymbolTable(&numSymbols);
+   if (!symbols || !numSymbols)
+      return;
+   if (dyn->getGnuHashTable())
+   {
+      s->kind = HASH_TABLE_GNU;
+      words = (unsigned int*) dyn->getGnuHashTable();
+      symOffset = words[1];
+      s->bloomWords = words[2];
+      s->bloomShift = words[3];
+      bloom = (ElfW(Addr)*) (words + 4);
+      buckets = (unsigned int*) (bloom + s->bloomWords);
+      for (i=0; i < s->bloomWords; i++)
+         bits += __builtin_popcountl(bloom[i]);
+      if (s->bloomWords)
+         s->bloomFill = (double) bits / (s->bloomWords * 8 * sizeof(*bloom));
+   }
+   else if (dyn->getHashTable())
+   {
+      s->kind = HASH_TABLE_SYSV;
+      words = (unsigned int*) dyn->getHashTable();
+      symOffset = 0;
+      buckets = words + 2;
+   }
+   else
+      return;
+   s->numBuckets = words[0];
+   chains = buckets + s->numBuckets;
+   hashes = new unsigned int[numSymbols];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+
+   for (b=0; b < s->numBuckets; b++)
+   {
+      sym = buckets[b];
+      length = 0;
+      // no table holds more entries than symbols, so a chain that
+      // would is broken (or loops)
+      while (sym && sym >= symOffset && sym < numSymbols &&
+             s->numHashed < numSymbols)
+      {
+         length++;
+         name = dyn->getSymbolString(&symbols[sym]);
+         hashes[s->numHashed++] = s->kind == HASH_TABLE_GNU ?
+            DynamicSection::getGnuHash(name) :
+            dyn->elfHash((const unsigned char*) name);
+         if (symbols[sym].st_shndx != SHN_UNDEF)
+         {
+            s->numDefined++;
+            probeSum += length;
+            if (length > s->worstProbes)
+               s->worstProbes = length;
+         }
+         if (s->kind == HASH_TABLE_GNU)
+         {
+            if (chains[sym - symOffset] & 1)
+               break;
+            sym++;
+         }
+         else
+            sym = chains[sym];
+      }
+      if (length)
+         s->usedBuckets++;
+      if (length > s->longestChain)
+         s->longestChain = length;
+      s->chainHistogram[length < HASH_CHAIN_HISTOGRAM - 1 ?
+                        length : HASH_CHAIN_HISTOGRAM - 1]++;
+   }
+   if (s->numDefined)
+      s->averageProbes = (double) probeSum / s->numDefined;
+   if (s->numBuckets && s->numHashed)
+      s->expectedProbes = 1.0 + (s->numHashed - 1) / (2.0 * s->numBuckets);
+
+   // even a perfect spread averages (n/b + 1) / 2 probes, so counts
+   // under half the symbols can be passed over untried; names that
+   // share a hash (one symbol in several versions) can keep any count
+   // from reaching the target, so stop well past the symbol count
+   // and settle for the best seen
+   s->optimalBuckets = 1;
+   sizing = 0;
+   for (i=0; s->numHashed && bucketPrimes[i]; i++)
+   {
+      if (2 * bucketPrimes[i] < s->numHashed && bucketPrimes[i+1])
+         continue;
+      if (s->optimalProbes && bucketPrimes[i] > 4 * s->numHashed)
+         break;
+      delete[] sizing;
+      sizing = new unsigned int[bucketPrimes[i]];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      probes = probesWithBuckets(hashes, s->numHashed, bucketPrimes[i],
+                                 sizing);
+      if (!s->optimalProbes || probes < s->optimalProbes)
+      {
+         s->optimalBuckets = bucketPrimes[i];
+         s->optimalProbes = probes;
+      }
+      if (probes <= OPTIMAL_PROBES)
+         break;
+   }
+   delete[] sizing;
+   delete[] hashes;
+}
+
+/*
+ * Add a name to the distinct imports (if it is new).
+ */
+void HashQualityReport::addImport(const char* name)
+{
+   unsigned int h = DynamicSection::getGnuHash(name);
+   unsigned int b = h & (numImportBuckets - 1);
+   unsigned int k, i;
+   for (k = importBuckets[b]; k; k = imports[k-1].next)
+      if (imports[k-1].gnuHashValue == h && !strcmp(imports[k-1].name, name))
+         return;
+   if (numImports >= maxImports)
+   {
+      ImportName* tmp;
+      maxImports = maxImports ? maxImports * 2 : 16;
+      tmp = new ImportName[maxImports];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (numImports)
+         memcpy(tmp, imports, sizeof(ImportName) * numImports);
+      delete[] imports;
+      imports = tmp;
+   }
+   i = numImports++;
+   imports[i].name = name;
+   imports[i].gnuHashValue = h;
+   imports[i].next = importBuckets[b];
+   importBuckets[b] = i + 1;
+}
+
+/*
+ * Gather the distinct undefined dynamic symbols of all the objects:
+ * the names the dynamic linker will look up in their scope.
+ */
+void HashQualityReport::collectImports()
+{
+   DynamicSection* dyn;
+   ElfW(Sym)* symbols;
+   unsigned long total = 0;
+   unsigned int i, j, count;
+   char* name;
+
+   for (i=0; i < numObjects; i++)
+      if ((dyn = objects[i]->getDynamicSection()) &&
+          dyn->getSymbolTable(&count))
+         total += count;
+   for (numImportBuckets=16; numImportBuckets < total; numImportBuckets <<= 1)
+      ;
+   importBuckets = new unsigned int[numImportBuckets];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   memset(importBuckets, 0, sizeof(unsigned int) * numImportBuckets);
+   for (i=0; i < numObjects; i++)
+   {
+      dyn = objects[i]->getDynamicSection();
+      if (!dyn || !(symbols = dyn->getSymbolTable(&count)))
+         continue;
+      for (j=1; j < count; j++)
+      {
+         if (symbols[j].st_shndx != SHN_UNDEF ||
+             GEN_ST_BIND(symbols[j].st_info) == STB_LOCAL)
+            continue;
+         name = dyn->getSymbolString(&symbols[j]);
+         if (name && name[0])
+            addImport(name);
+      }
+   }
+}
+
+/*
+ * Try every import against one object's bloom filter; a name that
+ * gets through but has no definition here is a false positive, a
+ * chain walked for nothing.
+ */
+void HashQualityReport::testBloom(unsigned int index)
+{
+   HashTableStats* s = &stats[index];
+   DynamicSection* dyn = objects[index]->getDynamicSection();
+   unsigned int bitsPerWord = sizeof(ElfW(Addr)) * 8;
+   unsigned int *words, h, i;
+   ElfW(Addr)* bloom;
+   ElfW(Addr) bits;
+
+   if (s->kind != HASH_TABLE_GNU || !s->bloomWords || !s->numBuckets)
+      return;
+   words = (unsigned int*) dyn->getGnuHashTable();
+   bloom = (ElfW(Addr)*) (words + 4);
+   for (i=0; i < numImports; i++)
+   {
+      h = imports[i].gnuHashValue;
+      s->importsTested++;
+      bits = bloom[(h / bitsPerWord) & (s->bloomWords - 1)];
+      if (!((bits >> (h % bitsPerWord)) &
+            (bits >> ((h >> s->bloomShift) % bitsPerWord)) & 1))
+         continue;
+      s->bloomPasses++;
+      if (dyn->findDefinition(imports[i].name, 0) < 0)
+         s->bloomFalsePositives++;
+   }
+}
+
+unsigned int HashQualityReport::getNumberOfObjects()
+{
+   return numObjects;
+}
+
+HashTableStats* HashQualityReport::getStats(unsigned int index)
+{
+   return index < numObjects ? &stats[index] : 0;
+}
+
+unsigned int HashQualityReport::getNumberOfImports()
+{
+   return numImports;
+}
+
+unsigned int HashQualityReport::getNumberOfFlagged()
+{
+   return numFlagged;
+}
+
+unsigned long HashQualityReport::getAnalysisTime()
+{
+   return analysisTime;
+}
+
+/**
+ * Get the name of a flag.
+ * @param flag is one HashTableFlag bit.
+ * @return Its name (as in reports), or null for anything else.
+ */
+const char* HashQualityReport::getFlagName(unsigned int flag)
+{
+   unsigned int i;
+   for (i=0; i < HASH_NUM_FLAGS; i++)
+      if (flag == (1U << i))
+         return flagNames[i];
+   return 0;
+}
+
+static double percent(unsigned long part, unsigned long whole)
+{
+   return whole ? 100.0 * part / whole : 0.0;
+}
+
+/**
+ * Write the report as text: one line per object with a table (the
+ * chain histogram under it), then a count of objects per flag.
+ * @param out is where to write.
+ * @param flaggedOnly is nonzero to list only the flagged objects.
+ */
+void HashQualityReport::writeReport(OutputBuffer* out,
+                                    unsigned int flaggedOnly)
+{
+   HashTableStats* s;
+   char line[PATH_MAX + 256];
+   unsigned int flagCounts[HASH_NUM_FLAGS];
+   unsigned int i, f, len;
+
+   memset(flagCounts, 0, sizeof(flagCounts));
+   snprintf(line, sizeof(line),
+            "%u objects, %u distinct imports tested, %u flagged\n",
+            numObjects, numImports, numFlagged);
+   out->putString(line);
+   out->putString("kind  buckets  used%   syms   defs longest  avg worst"
+                  " ideal  optimal  bloom%  fp%  object / flags\n");
+   for (i=0; i < numObjects; i++)
+   {
+      s = &stats[i];
+      for (f=0; f < HASH_NUM_FLAGS; f++)
+         if (s->flags & (1U << f))
+            flagCounts[f]++;
+      if (s->kind == HASH_TABLE_NONE || (flaggedOnly && !s->flags))
+         continue;
+      snprintf(line, sizeof(line),
+               "%-4s%9u%7.1f%7u%7u%8u%5.2f%6u%6.2f%9u",
+               s->kind == HASH_TABLE_GNU ? "gnu" : "sysv", s->numBuckets,
+               percent(s->usedBuckets, s->numBuckets), s->numHashed,
+               s->numDefined, s->longestChain, s->averageProbes,
+               s->worstProbes, s->expectedProbes, s->optimalBuckets);
+      out->putString(line);
+      if (s->kind == HASH_TABLE_GNU)
+         snprintf(line, sizeof(line), "%8.1f%5.1f  ", 100.0 * s->bloomFill,
+                  100.0 * s->falsePositiveRate);
+      else
+         snprintf(line, sizeof(line), "%8s%5s  ", "-", "-");
+      out->putString(line);
+      out->putString(s->loadObject->getName());
+      for (f=0; f < HASH_NUM_FLAGS; f++)
+         if (s->flags & (1U << f))
+         {
+            out->putChar(' ');
+            out->putString(flagNames[f]);
+         }
+      out->putString("\n    chains:");
+      for (len=0; len < HASH_CHAIN_HISTOGRAM; len++)
+      {
+         if (!s->chainHistogram[len])
+            continue;
+         snprintf(line, sizeof(line), " %u%s:%u", len,
+                  len == HASH_CHAIN_HISTOGRAM - 1 ? "+" : "",
+                  s->chainHistogram[len]);
+         out->putString(line);
+      }
+      out->putChar('\n');
+   }
+   out->putString("flagged:");
+   for (f=0; f < HASH_NUM_FLAGS; f++)
+   {
+      snprintf(line, sizeof(line), " %s %u", flagNames[f], flagCounts[f]);
+      out->putString(line);
+   }
+   out->putChar('\n');
+}
@@ -1,6 +1,12 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <limits.h>
+#include <new>
 #include <ElfProgram.h>
 
 /***
@@ -43,6 +49,87 @@ EH_FRAME off    0x00113ea4 vaddr 0x00113ea4 paddr 0x00113ea4 align 2**2
 
 ***/
 
+static const char* wellKnownSectionNames[SECTION_NUM_WELL_KNOWN] = {
+   ".text", ".rodata", ".data", ".bss", ".plt", ".plt.sec", ".plt.got",
+   ".got", ".got.plt", ".dynamic", ".dynsym", ".dynstr", ".symtab",
+   ".strtab", ".hash", ".gnu.hash", ".gnu.version", ".gnu.version_d",
+   ".gnu.version_r", ".rela.dyn", ".rela.plt", ".interp", ".eh_frame",
+   ".eh_frame_hdr", ".init_array", ".fini_array", ".note.gnu.build-id",
+   ".gnu_debuglink"
+};
+
+/*
+ * One entry of the sorted section name table used for prefix queries.
+ */
+struct SectionNameEntry
+{
+   char* name;          // section name (in .shstrtab)
+   unsigned int index;  // section index
+};
+
+/*
+ * Address intervals, for the address to segment/section lookups. Each
+ * table is sorted by start; the ends are exclusive.
+ */
+struct AddressInterval
+{
+   ElfW(Addr) start;    // first vaddr or file offset
+   ElfW(Addr) end;      // one past the last
+   unsigned int index;  // segment or section index
+};
+
+enum AddressMapTable
+{
+   MAP_SEGMENT_VADDR, MAP_SEGMENT_OFFSET, MAP_SECTION_VADDR,
+   MAP_SECTION_OFFSET, MAP_NUM_TABLES
+};
+
+struct AddressMap
+{
+   AddressInterval* tables[MAP_NUM_TABLES]; // one array per table
+   unsigned int counts[MAP_NUM_TABLES];     // entries in each
+   ElfW(Addr) loadBias;                     // cached getLoadBias()
+};
+
+static int compareIntervals(const void* a, const void* b)
+{
+   const AddressInterval* x = (const AddressInterval*) a;
+   const AddressInterval* y = (const AddressInterval*) b;
+   return (x->start > y->start) - (x->start < y->start);
+}
+
+/*
+ * Binary search for the interval containing a value; returns its
+ * position in the table, or -1.
+ */
+static int findInterval(AddressInterval* table, unsigned int count,
+                        ElfW(Addr) value)
+{
+   unsigned int lo = 0, hi = count, mid;
+   // find the last interval starting at or before the value
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if (table[mid].start <= value)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   if (lo == 0 || value >= table[lo-1].end)
+      return -1;
+   return lo - 1;
+}
+
+static int compareSectionNames(const void* a, const void* b)
+{
+   const SectionNameEntry* x = (const SectionNameEntry*) a;
+   const SectionNameEntry* y = (const SectionNameEntry*) b;
+   int c = strcmp(x->name, y->name);
+   if (c)
+      return c;
+   return (x->index > y->index) - (x->index < y->index);
+}
+
 
 /**
  * A LoadObject is created for each loaded program object: the
@@ -58,47 +145,49 @@ EH_FRAME off    0x00113ea4 vaddr 0x00113ea4 paddr 0x00113ea4 align 2**2
  */
 LoadObject::LoadObject(char* objectName, char* baseAddress, char* endAddress)
 {
+   char* secHeaders;
+   initMembers();
+   LoadStatsScope statsScope(stats);
    elfHeader = (ElfW(Ehdr)*) baseAddress;
-   segments = 0; sections = 0; 
-   //got = 0; plt = 0; //dynamicSymbols = 0; 
-   staticSymbols = 0; 
-   numStaticSymbols = 0;
-   next = 0;
-   l_map = 0;
-   PLTAddress = 0;
-   GOTAddress = 0;
 
    // verify that it is an ELF object
    if (!(elfHeader->e_ident[1]=='E' && elfHeader->e_ident[2]=='L' &&
          elfHeader->e_ident[3]=='F'))
    {
       printf("ERROR: Address %p not an ELF object: skipping\n",elfHeader);
+      elfHeader = 0;
       return;
    }
 
-   objectFileName = objectName;
+   objectFileName = strdup(objectName);
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
    this->baseAddress = baseAddress;
    this->highAddress = endAddress;
 
    // if the section header section is loaded, process it 
    // (usually it is not loaded, since section headers are
-   //  not used at run time)
-   if ((baseAddress + elfHeader->e_shoff) < highAddress)
+   //  not used at run time; the vdso is the exception)
+   STATS_PHASE_BEGIN(sectionStart);
+   secHeaders = getFileRangePtr(getSectionTableOffset(),
+                                getSectionHeaderSize()*getNumberOfSections());
+   if (secHeaders)
    {
-      processSectionHeaders();
+      processSectionHeaders(secHeaders);
    } 
    else 
    {
-      // grab the section header section from the actual file
-      char* secHeaders = getFileSection(getSectionTableOffset(),
-                                        getSectionHeaderSize()* 
-                                        getNumberOfSections());
+      // grab the section header section from the actual file; the
+      // ElfSections point into it, so it is kept until we go away
+      secHeaders = getFileSection(getSectionTableOffset(),
+                                  getSectionHeaderSize()* 
+                                  getNumberOfSections());
       if (secHeaders)
       {
+         sectionHeaderCopy = secHeaders;
          processSectionHeaders(secHeaders);
       }
-      // need to delete secHeaders????
    }
+   STATS_PHASE_END(STATS_PHASE_SECTION_HEADERS, sectionStart);
    // if segment header section is loaded, process it 
    // (this should always be true, as segment headers are 
    //  needed at runtime)
@@ -107,8 +196,201 @@ LoadObject::LoadObject(char* objectName, char* baseAddress, char* endAddress)
       //printf("...DoSegmentHeaders\n");
       processSegmentHeaders();
    }
+   STATS_PHASE_BEGIN(linkMapStart);
    findAndSetLinkMap();
-   debugPrintInfo();
+   STATS_PHASE_END(STATS_PHASE_LINK_MAP, linkMapStart);
+   // stripped objects may have their symtab in a separate debug file
+   if (!staticSymbols)
+      findAndLoadDebugObject();
+   //debugPrintInfo();
+}
+
+/**
+ * Constructor for reading an object file directly rather than a
+ * loaded object. The whole file is mmap()'d read-only, so every
+ * section is available at its file offset and nothing needs to
+ * be fetched with getFileSection().
+ * @param objFilename is the path of the ELF file.
+ * @param findDebugInfo says whether to look for a separate debug
+ *        file if the object has no static symbol table.
+ */
+LoadObject::LoadObject(char* objFilename, unsigned int findDebugInfo)
+{
+   int fd;
+   struct stat st;
+   void* image;
+   initMembers();
+   LoadStatsScope statsScope(stats);
+   STATS_PHASE_BEGIN(mapStart);
+   fd = open(objFilename, O_RDONLY);
+   STATS_COUNT(STATS_FILE_OPENS, 1);
+   if (fd < 0)
+      return;
+   if (fstat(fd, &st) || st.st_size < (off_t) sizeof(ElfW(Ehdr)))
+   {
+      close(fd);
+      return;
+   }
+   image = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   STATS_PHASE_END(STATS_PHASE_FILE_MAP, mapStart);
+   if (image == MAP_FAILED)
+      return;
+   STATS_COUNT(STATS_BYTES_MAPPED, st.st_size);
+   if (initFileImage((char*) image, st.st_size, objFilename, findDebugInfo))
+   {
+      munmap(image, st.st_size);
+      return;
+   }
+   ownsImage = 1;
+}
+
+/**
+ * Constructor for an ELF image that is already in memory in file
+ * layout, such as a member of an archive. The image is not copied
+ * and not freed; it must outlive this object.
+ * @param objectName is the name to report for the object.
+ * @param image is the start of the ELF file image.
+ * @param imageSize is the size of the image in bytes.
+ * @param findDebugInfo says whether to look for a separate debug file.
+ */
+LoadObject::LoadObject(char* objectName, char* image, unsigned long imageSize,
+                       unsigned int findDebugInfo)
+{
+   initMembers();
+   LoadStatsScope statsScope(stats);
+   initFileImage(image, imageSize, objectName, findDebugInfo);
+}
+
+/**
+ * Constructor for an object captured in a ProgramSnapshot. Nothing
+ * is copied: headers, dynamic data and symbol tables are read in
+ * place from the snapshot's blocks, which must outlive this object.
+ * Addresses reported by the object are those of the original process.
+ * @param snapshot is the loaded snapshot.
+ * @param objectIndex is the object's number in the snapshot.
+ */
+LoadObject::LoadObject(ProgramSnapshot* snapshot, unsigned int objectIndex)
+{
+   char* secHeaders;
+   unsigned long size;
+   initMembers();
+   LoadStatsScope statsScope(stats);
+   this->snapshot = snapshot;
+   snapshotIndex = objectIndex;
+   baseAddress = snapshot->getObjectBaseAddress(objectIndex);
+   highAddress = snapshot->getObjectHighAddress(objectIndex);
+   objectFileName = strdup(snapshot->getObjectName(objectIndex));
+   elfHeader = (ElfW(Ehdr)*) snapshot->findBlock(objectIndex,
+                                                 SNAPSHOT_MEMORY_BLOCK,
+                                                 (ElfW(Addr)) baseAddress,
+                                                 sizeof(ElfW(Ehdr)));
+   if (!elfHeader)
+      return;
+   STATS_PHASE_BEGIN(sectionStart);
+   secHeaders = getFileRangePtr(getSectionTableOffset(),
+                                getSectionHeaderSize()*getNumberOfSections());
+   if (secHeaders)
+      processSectionHeaders(secHeaders);
+   STATS_PHASE_END(STATS_PHASE_SECTION_HEADERS, sectionStart);
+   // segment headers are read right after the ELF header
+   if (snapshot->findBlock(objectIndex, SNAPSHOT_MEMORY_BLOCK, 
+                           (ElfW(Addr)) baseAddress, elfHeader->e_phoff +
+                           getSegmentHeaderSize()*getNumberOfSegments()))
+      processSegmentHeaders();
+   // the effective static symbols (perhaps from a debug file)
+   staticSymbols = (ElfW(Sym)*) snapshot->findBlock(objectIndex,
+                                                    SNAPSHOT_SYMTAB_BLOCK,
+                                                    0, 0, &size);
+   numStaticSymbols = size / sizeof(ElfW(Sym));
+   symbolStringTable = snapshot->findBlock(objectIndex, SNAPSHOT_STRTAB_BLOCK,
+                                           0, 0, &size);
+   symbolStringTableSize = size;
+   if (!symbolStringTable)
+      staticSymbols = 0;
+}
+
+/**
+ * Common setup for objects read from a file image.
+ * @return Zero on success, -1 if the image is not a native ELF object.
+ */
+int LoadObject::initFileImage(char* image, unsigned long size, 
+                              char* objectName, unsigned int findDebugInfo)
+{
+   if (size < sizeof(ElfW(Ehdr)) || memcmp(ELFMAG, image, SELFMAG) ||
+       ((ElfW(Ehdr)*)image)->e_ident[EI_CLASS] != 
+       (__ELF_NATIVE_CLASS == 64 ? ELFCLASS64 : ELFCLASS32))
+      return -1;
+   fileImage = 1;
+   imageSize = size;
+   elfHeader = (ElfW(Ehdr)*) image;
+   objectFileName = strdup(objectName);
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   baseAddress = image;
+   highAddress = baseAddress + imageSize;
+
+   STATS_PHASE_BEGIN(sectionStart);
+   if (getSectionTableOffset() && 
+       getFileRangePtr(getSectionTableOffset(),
+                       getSectionHeaderSize()*getNumberOfSections()))
+      processSectionHeaders();
+   STATS_PHASE_END(STATS_PHASE_SECTION_HEADERS, sectionStart);
+   if (elfHeader->e_phoff &&
+       getFileRangePtr(elfHeader->e_phoff,
+                       getSegmentHeaderSize()*getNumberOfSegments()))
+      processSegmentHeaders();
+   if (!staticSymbols && findDebugInfo)
+      findAndLoadDebugObject();
+   return 0;
+}
+
+/**
+ * Set all members to a known empty state; used by both constructors.
+ */
+void LoadObject::initMembers()
+{
+   name = 0;
+   elfHeader = 0;
+   baseAddress = 0;
+   highAddress = 0;
+   objectFileName = 0;
+   type = 0;
+   permissions = 0;
+   segments = 0; sections = 0; 
+   numSegments = 0; numSections = 0;
+   dynamicSection = 0;
+   //got = 0; plt = 0; //dynamicSymbols = 0; 
+   staticSymbols = 0; 
+   numStaticSymbols = 0;
+   symbolStringTable = 0;
+   secHeaderStringTable = 0;
+   next = 0;
+   l_map = 0;
+   PLTAddress = 0;
+   GOTAddress = 0;
+   symbolStringTableSize = 0;
+   fileImage = 0;
+   ownsImage = 0;
+   snapshot = 0;
+   snapshotIndex = 0;
+   imageSize = 0;
+   debugObject = 0;
+   sectionZeroState = 0;
+   sectionHeaderCopy = 0;
+   arena = 0;
+   staticStore = 0;
+   dynamicStore = 0;
+   secHeaderStringTableSize = 0;
+   sectionHashBuckets = 0;
+   sectionHashChains = 0;
+   numSectionBuckets = 0;
+   sectionsByName = 0;
+   memset(wellKnownSections, 0, sizeof(wellKnownSections));
+   addressMap = 0;
+   pltMap = 0;
+   stats = STATS_ENABLED ? new LoadStats() : 0;
+   // counted for whoever is creating us
+   STATS_COUNT(STATS_OBJECTS, 1);
 }
 
 /**
@@ -150,11 +432,11 @@ void LoadObject::debugPrintInfo()
 
    for (i=0; i < numSegments; i++)
    {
-      segments[i]->debugPrintInfo();
+      segments[i].debugPrintInfo();
    }
    for (i=0; i < numSections; i++)
    {
-      sections[i]->debugPrintInfo(secHeaderStringTable);
+      sections[i].debugPrintInfo(secHeaderStringTable);
    }
    if (dynamicSection)
       dynamicSection->debugPrintInfo();
@@ -204,18 +486,69 @@ void LoadObject::debugPrintInfo()
           getGOTEntryAddressByName("printf"));
 }
 
-LoadObject::LoadObject(char* objFilename)
+/**
+ * Free everything the object built or copied: sections (and any
+ * section data they fetched from the file), segments, the dynamic
+ * section, the copied section headers, the debug object, and the
+ * file mapping if we made it. ElfSymbols handed out earlier point
+ * into this data and must not be used afterwards.
+ */
+LoadObject::~LoadObject()
+{
+   unsigned int i;
+   // the wrappers live in the arena: run their destructors, then
+   // free the arena in one go
+   for (i=0; i < numSections; i++)
+      sections[i].~ElfSection();
+   for (i=0; i < numSegments; i++)
+      segments[i].~ElfSegment();
+   if (dynamicSection)
+      dynamicSection->~DynamicSection();
+   delete arena;
+   delete staticStore;
+   delete dynamicStore;
+   delete pltMap;
+   delete[] sectionHashBuckets;
+   delete[] sectionHashChains;
+   delete[] sectionsByName;
+   if (addressMap)
+   {
+      for (i=0; i < MAP_NUM_TABLES; i++)
+         delete[] addressMap->tables[i];
+      delete addressMap;
+   }
+   delete[] sectionHeaderCopy;
+   if (debugObject)
+      delete debugObject;
+   if (ownsImage && elfHeader)
+      munmap(elfHeader, imageSize);
+   free(objectFileName);
+   delete stats;
+}
+
+char* LoadObject::getName()
 {
+   return objectFileName;
 }
 
+unsigned int LoadObject::isValidObject()
+{
+   return (elfHeader != 0);
+}
 
-LoadObject::~LoadObject()
+unsigned int LoadObject::isFileImage()
 {
+   return fileImage;
 }
 
-char* LoadObject::getName()
+unsigned long LoadObject::getImageSize()
 {
-   return objectFileName;
+   return imageSize;
+}
+
+unsigned int LoadObject::isSnapshotObject()
+{
+   return (snapshot != 0);
 }
 
 /**
@@ -225,20 +558,22 @@ char* LoadObject::getName()
  */
 int LoadObject::processSegmentHeaders()
 {
-   ElfSegment* newseg;
    unsigned int i;
-   ElfW(Phdr)* segHeader = (ElfW(Phdr)*)(getBaseAddress()+elfHeader->e_phoff);
+   ElfW(Phdr)* segHeader = (ElfW(Phdr)*)((char*)elfHeader+elfHeader->e_phoff);
    int segHeaderSize = getSegmentHeaderSize();
-   numSegments = getNumberOfSegments();
-   segments = new ElfSegment*[numSegments];
+   STATS_PHASE_BEGIN(segmentStart);
+   numSegments = 0;
+   segments = (ElfSegment*) allocateMetadata(getNumberOfSegments() * 
+                                              sizeof(ElfSegment));
    //char* baseAddress = getBaseAddress();
-   for (i=0; i < numSegments; i++)
+   for (i=0; i < (unsigned int) getNumberOfSegments(); i++)
    {
       //printf("new segment\n");
-      newseg = new ElfSegment(i, segHeader, this);
-      segments[i] = newseg;
+      new (&segments[i]) ElfSegment(i, segHeader, this);
+      numSegments++;
       segHeader = (ElfW(Phdr)*)(((char*)segHeader)+segHeaderSize);
    }
+   STATS_PHASE_END(STATS_PHASE_SEGMENT_HEADERS, segmentStart);
    return 0;
 }
 
@@ -257,22 +592,22 @@ int LoadObject::processSectionHeaders(char* secHeaderData)
    if (secHeaderData)
       secHeader = (ElfW(Shdr)*) secHeaderData;
    else
-      secHeader = (ElfW(Shdr)*)(getBaseAddress()+ elfHeader->e_shoff);
+      secHeader = (ElfW(Shdr)*)((char*)elfHeader+ elfHeader->e_shoff);
    int secHeaderSize = getSectionHeaderSize();
    numSections = getNumberOfSections();
-   sections = new ElfSection*[numSections];
+   sections = (ElfSection*) allocateMetadata(numSections * sizeof(ElfSection));
    //char* baseAddress = getBaseAddress();
    unsigned int i, sti;
    for (i=0; i < numSections; i++)
    {
       //printf("new section\n");
-      newsec = new ElfSection(i, secHeader, this);
-      sections[i] = newsec;
+      newsec = new (&sections[i]) ElfSection(i, secHeader, this);
       if (i == getSectionHeaderStringIndex())
       {
          secHeaderStringTable = newsec->getSectionDataPtr();
+         secHeaderStringTableSize = newsec->getSizeInBytes();
       }
-      if (newsec->isSymbolTable())
+      if (newsec->isSymbolTable() && newsec->getSectionDataPtr())
       {
          staticSymbols = (ElfW(Sym)* ) newsec->getSectionDataPtr();
          numStaticSymbols =  newsec->getSizeInBytes() / 
@@ -281,17 +616,12 @@ int LoadObject::processSectionHeaders(char* secHeaderData)
       }
       secHeader = (ElfW(Shdr)*)(((char*)secHeader)+secHeaderSize);
    }
-   for (i=0; i < numSections; i++)
-   {
-      if (!strcmp(sections[i]->getName(secHeaderStringTable),".plt"))
-         PLTAddress = sections[i]->getSectionDataPtr();
-      //if (!strcmp(sections[i]->getName(secHeaderStringTable),".got.plt"))
-      //   GOTAddress = sections[i]->getSectionDataPtr();
-   }
+   buildSectionNameIndex();
    if (staticSymbols)
    {
       //printf("static symbols, count = %d\n", numStaticSymbols);
-      symbolStringTable = sections[sti]->getSectionDataPtr();
+      symbolStringTable = sections[sti].getSectionDataPtr();
+      symbolStringTableSize = sections[sti].getSizeInBytes();
    }
    return 0;
 }
@@ -306,10 +636,133 @@ int LoadObject::processDynamicSection(char* dynamicSectionAddress,
                                       unsigned int size)
 {
    //printf("new dynamic section\n");
-   dynamicSection = new DynamicSection(dynamicSectionAddress, size, this);
+   STATS_PHASE_BEGIN(dynamicStart);
+   dynamicSection = new (allocateMetadata(sizeof(DynamicSection))) 
+      DynamicSection(dynamicSectionAddress, size, this);
+   STATS_PHASE_END(STATS_PHASE_DYNAMIC, dynamicStart);
    return 0;
 }
 
+ElfSection* LoadObject::getSection(unsigned int index)
+{
+   if (index >= numSections)
+      return 0;
+   return &sections[index];
+}
+
+ElfSegment* LoadObject::getSegment(unsigned int index)
+{
+   if (index >= numSegments)
+      return 0;
+   return &segments[index];
+}
+
+DynamicSection* LoadObject::getDynamicSection()
+{
+   return dynamicSection;
+}
+
+char* LoadObject::getSectionHeaderStringTable()
+{
+   return secHeaderStringTable;
+}
+
+/**
+ * Get the raw static symbol table, for callers that want to walk it
+ * without creating an ElfSymbol per entry.
+ * @param count is a return parameter set to the number of symbols.
+ * @param strTable is a return parameter set to the string table.
+ * @param strTableSize is a return parameter set to its size (may be null).
+ * @return The symbol array, or null if there is no static symbol table.
+ */
+ElfW(Sym)* LoadObject::getStaticSymbolTable(unsigned int* count, 
+                                            char** strTable,
+                                            unsigned long* strTableSize)
+{
+   *count = staticSymbols ? numStaticSymbols : 0;
+   *strTable = symbolStringTable;
+   if (strTableSize)
+      *strTableSize = symbolStringTableSize;
+   return staticSymbols;
+}
+
+/**
+ * Get the column-wise copy of a symbol table, making it on first use.
+ * @param dynamic is nonzero for the dynamic symbols, zero for the
+ *        static ones.
+ * @return The store, or null if there is no such symbol table.
+ */
+SymbolStore* LoadObject::getSymbolStore(unsigned int dynamic)
+{
+   ElfW(Sym)* syms;
+   char* strTable;
+   unsigned long strSize;
+   unsigned int count;
+   SymbolStore** store = dynamic ? &dynamicStore : &staticStore;
+   if (*store)
+      return *store;
+   if (dynamic)
+      syms = getDynamicSymbolTable(&count, &strTable, &strSize);
+   else
+      syms = getStaticSymbolTable(&count, &strTable, &strSize);
+   if (!syms || !count)
+      return 0;
+   *store = new SymbolStore(syms, count, strTable, strSize, this);
+   return *store;
+}
+
+/**
+ * Get the map between PLT stubs, GOT slots and dynamic symbols,
+ * decoding the PLT on first use.
+ * @return The map, or null if the object has no dynamic section.
+ */
+PLTMap* LoadObject::getPLTMap()
+{
+   if (!pltMap && dynamicSection)
+      pltMap = new PLTMap(this);
+   return pltMap;
+}
+
+/**
+ * Find the dynamic symbol table with a trustworthy count: from the
+ * .dynsym section header if there is one, else from the dynamic
+ * section (whose count is only known with a DT_HASH table).
+ * @param count is a return parameter set to the number of symbols.
+ * @param strTable is a return parameter set to the string table.
+ * @param strSize is a return parameter set to its size.
+ * @return The symbol array, or null.
+ */
+ElfW(Sym)* LoadObject::getDynamicSymbolTable(unsigned int* count,
+                                             char** strTable,
+                                             unsigned long* strSize)
+{
+   ElfSection *sec, *strSec;
+   ElfW(Sym)* syms;
+   unsigned int i, size;
+   for (i=0; (sec = getSection(i)); i++)
+   {
+      if (sec->getType() != SHT_DYNSYM || !sec->getEntrySize())
+         continue;
+      strSec = getSection(sec->getSectionLink());
+      if (!strSec || !sec->getSectionDataPtr() ||
+          !strSec->getSectionDataPtr())
+         break;
+      *count = sec->getSizeInBytes() / sec->getEntrySize();
+      *strTable = strSec->getSectionDataPtr();
+      *strSize = strSec->getSizeInBytes();
+      return (ElfW(Sym)*) sec->getSectionDataPtr();
+   }
+   *count = 0;
+   *strTable = 0;
+   *strSize = 0;
+   if (!dynamicSection)
+      return 0;
+   syms = dynamicSection->getSymbolTable(count);
+   *strTable = dynamicSection->getStringTable(&size);
+   *strSize = size;
+   return (syms && *strTable) ? syms : 0;
+}
+
 /**
  * Open a file, read a block of data from the file, and return a
  * pointer to that data (allocated).
@@ -321,7 +774,19 @@ char* LoadObject::getFileSection(unsigned int offset, unsigned int size)
 {
    FILE* fp;
    char* dataBlock;
+   if (fileImage || snapshot)
+   {
+      // no need to go to the file, but still hand back a copy
+      char* data = getFileRangePtr(offset, size);
+      if (!data)
+         return 0;
+      dataBlock = new char[size];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      memcpy(dataBlock, data, size);
+      return dataBlock;
+   }
    fp = fopen(objectFileName,"r");
+   STATS_COUNT(STATS_FILE_OPENS, 1);
    if (!fp)
       return 0;
    if (fseek(fp, offset, SEEK_SET))
@@ -330,9 +795,11 @@ char* LoadObject::getFileSection(unsigned int offset, unsigned int size)
       return 0;
    }
    dataBlock = new char[size];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   STATS_COUNT(STATS_BYTES_READ, size);
    if (fread(dataBlock, sizeof(char), size, fp) != size)
    {
-      delete dataBlock;
+      delete[] dataBlock;
       dataBlock = 0;
    }
    fclose(fp);
@@ -340,23 +807,803 @@ char* LoadObject::getFileSection(unsigned int offset, unsigned int size)
 }
 
 /**
- * Iterate through the section header string table and find a section
- * index by name.
- * @param name is the section name (e.g. ".text").
- * @return An ElfSection object pointer for the found section, or null.
+ * Return a pointer to a range of the object's file contents if that
+ * range is already readable in memory, without any file access. For
+ * a file image every in-bounds range is; for a loaded object only
+ * ranges that are inside the file part of some PT_LOAD segment are.
+ * @param offset is the offset from the file start.
+ * @param size is the number of bytes wanted.
+ * @return Pointer to the data (not allocated), or null.
  */
-ElfSection* LoadObject::findSectionByName(char* name)
+char* LoadObject::getFileRangePtr(unsigned long offset, unsigned long size)
+{
+   ElfW(Phdr)* ph;
+   unsigned int i;
+   if (!elfHeader)
+      return 0;
+   if (fileImage)
+   {
+      if (offset > imageSize || size > imageSize - offset)
+         return 0;
+      return baseAddress + offset;
+   }
+   if (snapshot)
+      return snapshot->findBlock(snapshotIndex, SNAPSHOT_FILE_BLOCK, 
+                                 offset, size);
+   ph = (ElfW(Phdr)*) ((char*)elfHeader + elfHeader->e_phoff);
+   for (i=0; i < (unsigned int) getNumberOfSegments(); i++, ph++)
+   {
+      if (ph->p_type != PT_LOAD)
+         continue;
+      if (offset >= ph->p_offset && 
+          offset + size <= ph->p_offset + ph->p_filesz)
+         return getVaddrDataPtr(ph->p_vaddr + (offset - ph->p_offset));
+   }
+   return 0;
+}
+
+/**
+ * Convert a virtual address taken from this object's headers or
+ * dynamic section into a pointer we can read through. For a loaded
+ * object, an address that already lies inside the object is taken
+ * to be relocated (the dynamic linker relocates most dynamic entries
+ * in place, but not those of the vdso); anything else gets the load
+ * bias added. A snapshot object then looks the runtime address up in
+ * the captured memory blocks. For a file image the PT_LOAD segments
+ * are used to find the file offset.
+ * @param vaddr is the virtual address.
+ * @return Readable pointer, or null if there is no data there.
+ */
+char* LoadObject::getVaddrDataPtr(ElfW(Addr) vaddr)
 {
+   ElfW(Phdr)* ph;
    unsigned int i;
-   if (!secHeaderStringTable)
+   if (!elfHeader)
       return 0;
+   if (fileImage)
+   {
+      ph = (ElfW(Phdr)*) ((char*)elfHeader + elfHeader->e_phoff);
+      for (i=0; i < (unsigned int) getNumberOfSegments(); i++, ph++)
+      {
+         if (ph->p_type == PT_LOAD && vaddr >= ph->p_vaddr &&
+             vaddr < ph->p_vaddr + ph->p_filesz)
+            return baseAddress + ph->p_offset + (vaddr - ph->p_vaddr);
+      }
+      return 0;
+   }
+   if (!((char*) vaddr >= baseAddress && (char*) vaddr < highAddress))
+      vaddr += getLoadBias();
+   if (snapshot)
+      return snapshot->findBlock(snapshotIndex, SNAPSHOT_MEMORY_BLOCK,
+                                 vaddr, 1);
+   return (char*) vaddr;
+}
+
+/**
+ * The load bias is what must be added to a virtual address in the
+ * object's headers to get its runtime address: the first PT_LOAD
+ * maps file offset 0 at the base address. It is zero for a fixed
+ * address executable and for file images.
+ * @return The load bias.
+ */
+ElfW(Addr) LoadObject::getLoadBias()
+{
+   ElfW(Phdr)* ph;
+   unsigned int i;
+   if (!elfHeader || fileImage)
+      return 0;
+   ph = (ElfW(Phdr)*) ((char*)elfHeader + elfHeader->e_phoff);
+   for (i=0; i < (unsigned int) getNumberOfSegments(); i++, ph++)
+   {
+      if (ph->p_type == PT_LOAD)
+         return (ElfW(Addr)) baseAddress - (ph->p_vaddr - ph->p_offset);
+   }
+   return (ElfW(Addr)) baseAddress;
+}
+
+/**
+ * Make the address interval tables: PT_LOAD segments by vaddr (memory
+ * size) and by file offset (file size), and SHF_ALLOC sections by
+ * vaddr and, if they have file contents, by file offset. Empty
+ * sections and .tbss (which overlaps the sections after it) are left
+ * out. Made on first use; lookups after that do not allocate.
+ * @return The map, or null if the object has no headers.
+ */
+AddressMap* LoadObject::getAddressMap()
+{
+   AddressInterval* t;
+   ElfW(Phdr)* ph;
+   ElfW(Shdr)* sh;
+   unsigned int i, m;
+   if (addressMap)
+      return addressMap;
+   if (!elfHeader)
+      return 0;
+   addressMap = new AddressMap;
+   addressMap->loadBias = getLoadBias();
+   for (m=0; m < MAP_NUM_TABLES; m++)
+   {
+      addressMap->counts[m] = 0;
+      addressMap->tables[m] = new AddressInterval[m < MAP_SECTION_VADDR ?
+                                                  numSegments + 1 :
+                                                  numSections + 1];
+   }
+   STATS_COUNT(STATS_ALLOCATIONS, 1 + MAP_NUM_TABLES);
+   for (i=0; i < numSegments; i++)
+   {
+      ph = segments[i].getSegmentHeader();
+      if (ph->p_type != PT_LOAD)
+         continue;
+      if (ph->p_memsz)
+      {
+         t = &addressMap->tables[MAP_SEGMENT_VADDR]
+                               [addressMap->counts[MAP_SEGMENT_VADDR]++];
+         t->start = ph->p_vaddr;
+         t->end = ph->p_vaddr + ph->p_memsz;
+         t->index = i;
+      }
+      if (ph->p_filesz)
+      {
+         t = &addressMap->tables[MAP_SEGMENT_OFFSET]
+                               [addressMap->counts[MAP_SEGMENT_OFFSET]++];
+         t->start = ph->p_offset;
+         t->end = ph->p_offset + ph->p_filesz;
+         t->index = i;
+      }
+   }
    for (i=0; i < numSections; i++)
-      if (!strcmp(name,sections[i]->getName(secHeaderStringTable)))
+   {
+      sh = sections[i].getSectionHeader();
+      if (!(sh->sh_flags & SHF_ALLOC) || !sh->sh_size)
+         continue;
+      if ((sh->sh_flags & SHF_TLS) && sh->sh_type == SHT_NOBITS)
+         continue;
+      t = &addressMap->tables[MAP_SECTION_VADDR]
+                            [addressMap->counts[MAP_SECTION_VADDR]++];
+      t->start = sh->sh_addr;
+      t->end = sh->sh_addr + sh->sh_size;
+      t->index = i;
+      if (sh->sh_type == SHT_NOBITS)
+         continue;
+      t = &addressMap->tables[MAP_SECTION_OFFSET]
+                            [addressMap->counts[MAP_SECTION_OFFSET]++];
+      t->start = sh->sh_offset;
+      t->end = sh->sh_offset + sh->sh_size;
+      t->index = i;
+   }
+   for (m=0; m < MAP_NUM_TABLES; m++)
+      qsort(addressMap->tables[m], addressMap->counts[m],
+            sizeof(AddressInterval), compareIntervals);
+   return addressMap;
+}
+
+/**
+ * Convert a link-time virtual address to a runtime address.
+ * @param vaddr is the address as given in the object's headers.
+ * @return vaddr plus the load bias.
+ */
+char* LoadObject::vaddrToAddress(ElfW(Addr) vaddr)
+{
+   AddressMap* map = getAddressMap();
+   return (char*) (vaddr + (map ? map->loadBias : 0));
+}
+
+/**
+ * Convert a runtime address to a link-time virtual address.
+ * @param address is the runtime address.
+ * @return address minus the load bias.
+ */
+ElfW(Addr) LoadObject::addressToVaddr(char* address)
+{
+   AddressMap* map = getAddressMap();
+   return (ElfW(Addr)) address - (map ? map->loadBias : 0);
+}
+
+/**
+ * Find the file offset that a virtual address is loaded from.
+ * @param vaddr is the link-time virtual address.
+ * @param offset is a return parameter set to the file offset.
+ * @return 0 on success, -1 if no PT_LOAD segment has file contents
+ *         at that address (including the .bss part of a segment).
+ */
+int LoadObject::vaddrToFileOffset(ElfW(Addr) vaddr, unsigned long* offset)
+{
+   ElfSegment* seg = findSegmentByVaddr(vaddr);
+   ElfW(Phdr)* ph;
+   if (!seg)
+      return -1;
+   ph = seg->getSegmentHeader();
+   if (vaddr - ph->p_vaddr >= ph->p_filesz)
+      return -1;
+   *offset = ph->p_offset + (vaddr - ph->p_vaddr);
+   return 0;
+}
+
+/**
+ * Find the virtual address that a file offset is loaded at.
+ * @param offset is the file offset.
+ * @param vaddr is a return parameter set to the link-time address.
+ * @return 0 on success, -1 if the offset is not in a PT_LOAD segment.
+ */
+int LoadObject::fileOffsetToVaddr(unsigned long offset, ElfW(Addr)* vaddr)
+{
+   ElfSegment* seg = findSegmentByFileOffset(offset);
+   ElfW(Phdr)* ph;
+   if (!seg)
+      return -1;
+   ph = seg->getSegmentHeader();
+   *vaddr = ph->p_vaddr + (offset - ph->p_offset);
+   return 0;
+}
+
+ElfSegment* LoadObject::findSegmentByAddress(char* address)
+{
+   return findSegmentByVaddr(addressToVaddr(address));
+}
+
+ElfSegment* LoadObject::findSegmentByVaddr(ElfW(Addr) vaddr)
+{
+   AddressMap* map = getAddressMap();
+   int i;
+   if (!map)
+      return 0;
+   i = findInterval(map->tables[MAP_SEGMENT_VADDR],
+                    map->counts[MAP_SEGMENT_VADDR], vaddr);
+   return i < 0 ? 0 : &segments[map->tables[MAP_SEGMENT_VADDR][i].index];
+}
+
+ElfSegment* LoadObject::findSegmentByFileOffset(unsigned long offset)
+{
+   AddressMap* map = getAddressMap();
+   int i;
+   if (!map)
+      return 0;
+   i = findInterval(map->tables[MAP_SEGMENT_OFFSET],
+                    map->counts[MAP_SEGMENT_OFFSET], offset);
+   return i < 0 ? 0 : &segments[map->tables[MAP_SEGMENT_OFFSET][i].index];
+}
+
+ElfSection* LoadObject::findSectionByAddress(char* address)
+{
+   return findSectionByVaddr(addressToVaddr(address));
+}
+
+ElfSection* LoadObject::findSectionByVaddr(ElfW(Addr) vaddr)
+{
+   AddressMap* map = getAddressMap();
+   int i;
+   if (!map)
+      return 0;
+   i = findInterval(map->tables[MAP_SECTION_VADDR],
+                    map->counts[MAP_SECTION_VADDR], vaddr);
+   return i < 0 ? 0 : &sections[map->tables[MAP_SECTION_VADDR][i].index];
+}
+
+ElfSection* LoadObject::findSectionByFileOffset(unsigned long offset)
+{
+   AddressMap* map = getAddressMap();
+   int i;
+   if (!map)
+      return 0;
+   i = findInterval(map->tables[MAP_SECTION_OFFSET],
+                    map->counts[MAP_SECTION_OFFSET], offset);
+   return i < 0 ? 0 : &sections[map->tables[MAP_SECTION_OFFSET][i].index];
+}
+
+/*
+ * Scan a block of notes for the GNU build-id note.
+ */
+static unsigned char* findBuildIdNote(char* notes, unsigned long size,
+                                      unsigned long align,
+                                      unsigned int* length)
+{
+   unsigned long pos = 0, namesz, descsz;
+   ElfW(Nhdr)* note;
+   if (align < 4)
+      align = 4;
+   while (pos + sizeof(ElfW(Nhdr)) <= size)
+   {
+      note = (ElfW(Nhdr)*) (notes + pos);
+      namesz = (note->n_namesz + align-1) & ~(align-1);
+      descsz = (note->n_descsz + align-1) & ~(align-1);
+      if (pos + sizeof(ElfW(Nhdr)) + namesz + note->n_descsz > size)
          break;
-   if (i < numSections)
-      return sections[i];
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 &&
+          !memcmp(notes + pos + sizeof(ElfW(Nhdr)), "GNU", 4))
+      {
+         *length = note->n_descsz;
+         return (unsigned char*) (notes + pos + sizeof(ElfW(Nhdr)) + namesz);
+      }
+      pos += sizeof(ElfW(Nhdr)) + namesz + descsz;
+   }
+   return 0;
+}
+
+/**
+ * Find the NT_GNU_BUILD_ID note of this object. A file image is
+ * searched through its SHT_NOTE sections (a debug file keeps its
+ * notes but has no loaded segment contents), a loaded object
+ * through its PT_NOTE segments.
+ * @param length is a return parameter set to the build-id length.
+ * @return Pointer to the build-id bytes, or null if there is none.
+ */
+unsigned char* LoadObject::getBuildId(unsigned int* length)
+{
+   unsigned char* id;
+   unsigned int i;
+   char* notes;
+   if (fileImage)
+   {
+      for (i=0; i < numSections; i++)
+      {
+         if (!sections[i].isNote())
+            continue;
+         notes = getFileRangePtr(sections[i].getFileOffset(),
+                                 sections[i].getSizeInBytes());
+         if (!notes)
+            continue;
+         id = findBuildIdNote(notes, sections[i].getSizeInBytes(),
+                              sections[i].getSectionHeader()->sh_addralign,
+                              length);
+         if (id)
+            return id;
+      }
+      return 0;
+   }
+   for (i=0; i < numSegments; i++)
+   {
+      if (!segments[i].isNote())
+         continue;
+      notes = getVaddrDataPtr((ElfW(Addr)) segments[i].getVirtualAddress());
+      if (!notes)
+         continue;
+      id = findBuildIdNote(notes, segments[i].getFileSize(),
+                           segments[i].getSegmentHeader()->p_align, length);
+      if (id)
+         return id;
+   }
+   return 0;
+}
+
+/**
+ * Look for a separate debug file (see DebugInfoFinder) and, if one
+ * is found, use its static symbol table as ours. The debug object
+ * keeps its file mapped for as long as this object lives.
+ * @return Zero if a debug file was found, -1 otherwise.
+ */
+int LoadObject::findAndLoadDebugObject()
+{
+   DebugInfoFinder finder(this);
+   if (debugObject)
+      return 0;
+   STATS_PHASE_BEGIN(symbolStart);
+   debugObject = finder.findDebugObject();
+   STATS_PHASE_END(STATS_PHASE_SYMBOLS, symbolStart);
+   if (!debugObject)
+      return -1;
+   staticSymbols = debugObject->staticSymbols;
+   numStaticSymbols = debugObject->numStaticSymbols;
+   symbolStringTable = debugObject->symbolStringTable;
+   symbolStringTableSize = debugObject->symbolStringTableSize;
+   return 0;
+}
+
+LoadObject* LoadObject::getDebugObject()
+{
+   return debugObject;
+}
+
+/**
+ * Allocate memory for metadata that lives as long as this object,
+ * from its arena (created on first use).
+ * @param size is the number of bytes wanted.
+ * @return Pointer to the (uninitialized) memory.
+ */
+void* LoadObject::allocateMetadata(unsigned long size)
+{
+   if (!arena)
+      arena = new Arena();
+   return arena->allocate(size);
+}
+
+LoadStats* LoadObject::getStats()
+{
+   return stats;
+}
+
+static const char* memoryCategoryNames[MEM_NUM_CATEGORIES] = {
+   "section-headers", "symtab", "strtab", "objects", "indexes", "other"
+};
+
+const char* LoadObject::getMemoryCategoryName(unsigned int category)
+{
+   return category < MEM_NUM_CATEGORIES ? memoryCategoryNames[category] :
+      "unknown";
+}
+
+/**
+ * Count the heap bytes this object holds in one category, as the
+ * sizes requested from the allocator (its own overhead is not
+ * included). File images and snapshots are mapped, not copied, so
+ * for them only the wrappers and indexes count. A separate debug
+ * object is held by this one, so its memory is included.
+ * @param category is a LoadMemoryCategory.
+ * @return Number of bytes.
+ */
+unsigned long LoadObject::getMemoryUsage(unsigned int category)
+{
+   unsigned long bytes = 0;
+   unsigned int i;
+   switch (category)
+   {
+    case MEM_SECTION_HEADERS:
+      if (sectionHeaderCopy)
+         bytes = (unsigned long) getSectionHeaderSize() * numSections;
+      break;
+    case MEM_SYMTAB:
+    case MEM_STRTAB:
+      for (i=0; i < numSections; i++)
+         if ((category == MEM_SYMTAB) == (sections[i].getType() == SHT_SYMTAB))
+            bytes += sections[i].getOwnedDataSize();
+      break;
+    case MEM_OBJECTS:
+      bytes = sizeof(LoadObject);
+      // the dynamic section's tables are in the arena, but they are
+      // counted with the indexes
+      if (arena)
+         bytes += sizeof(Arena) + arena->getBytesReserved() -
+                  (dynamicSection ? dynamicSection->getMemoryUsage() : 0);
+      break;
+    case MEM_INDEXES:
+      if (sectionHashBuckets)
+         bytes += sizeof(unsigned int) * (numSectionBuckets + numSections);
+      if (sectionsByName)
+         bytes += sizeof(SectionNameEntry) * numSections;
+      if (addressMap)
+         bytes += sizeof(AddressMap) + sizeof(AddressInterval) *
+            (2 * (numSegments + 1) + 2 * (numSections + 1));
+      if (staticStore)
+         bytes += sizeof(SymbolStore) + staticStore->getMemoryUsage();
+      if (dynamicStore)
+         bytes += sizeof(SymbolStore) + dynamicStore->getMemoryUsage();
+      if (pltMap)
+         bytes += sizeof(PLTMap) + pltMap->getMemoryUsage();
+      if (dynamicSection)
+         bytes += dynamicSection->getMemoryUsage();
+      break;
+    case MEM_OTHER:
+      if (objectFileName)
+         bytes = strlen(objectFileName) + 1;
+      if (stats)
+         bytes += sizeof(LoadStats);
+      break;
+   }
+   if (debugObject)
+      bytes += debugObject->getMemoryUsage(category);
+   return bytes;
+}
+
+unsigned long LoadObject::getTotalMemoryUsage()
+{
+   unsigned long bytes = 0;
+   unsigned int i;
+   for (i=0; i < MEM_NUM_CATEGORIES; i++)
+      bytes += getMemoryUsage(i);
+   return bytes;
+}
+
+/*
+ * Section hashes are cached per build-id, in a tree laid out like
+ * the .build-id debug tree: <root>/xx/yyyy, where the root is
+ * ELFREADER_HASH_CACHE or $HOME/.cache/elfreader-hashes. A cache
+ * file is a header line "elfreader-section-hashes 1 <numSections>"
+ * and then "index size hash" for each section that could be hashed.
+ */
+static int getHashCacheFileName(LoadObject* lo, char* buf, unsigned int size)
+{
+   unsigned char* id;
+   unsigned int idLen, i;
+   char* root = getenv("ELFREADER_HASH_CACHE");
+   char* home;
+   int pos;
+   id = lo->getBuildId(&idLen);
+   if (!id || idLen < 2)
+      return -1;
+   if (root)
+      pos = snprintf(buf, size, "%s/%02x/", root, id[0]);
    else
+   {
+      home = getenv("HOME");
+      pos = snprintf(buf, size, "%s/.cache/elfreader-hashes/%02x/",
+                     home ? home : "/tmp", id[0]);
+   }
+   for (i=1; i < idLen && pos < (int) size - 3; i++)
+      pos += sprintf(buf+pos, "%02x", id[i]);
+   return (pos < (int) size - 3) ? 0 : -1;
+}
+
+/*
+ * Fill in section hashes from the cache file. Every entry must
+ * name an existing section of the recorded size, else the whole
+ * file is ignored.
+ */
+static int readHashCache(LoadObject* lo, char* fileName)
+{
+   FILE* fp = fopen(fileName, "r");
+   unsigned int index, numSections, count = 0;
+   unsigned long size, hash;
+   ElfSection* sec;
+   if (!fp)
+      return -1;
+   if (fscanf(fp, "elfreader-section-hashes 1 %u", &numSections) != 1 ||
+       numSections != (unsigned int) lo->getNumberOfSections())
+   {
+      fclose(fp);
+      return -1;
+   }
+   while (fscanf(fp, "%u %lu %lx", &index, &size, &hash) == 3)
+   {
+      sec = lo->getSection(index);
+      if (!sec || sec->getSizeInBytes() != size)
+      {
+         fclose(fp);
+         return -1;
+      }
+      count++;
+   }
+   if (!feof(fp))
+   {
+      fclose(fp);
+      return -1;
+   }
+   // all entries check out, now use them
+   rewind(fp);
+   if (fscanf(fp, "elfreader-section-hashes 1 %u", &numSections) != 1)
+      count = 0;
+   while (count && fscanf(fp, "%u %lu %lx", &index, &size, &hash) == 3)
+      lo->getSection(index)->setContentHash(hash);
+   fclose(fp);
+   return 0;
+}
+
+/*
+ * Write the cache file through a temporary name and rename(), so a
+ * reader never sees half a file. Failing to write is not an error.
+ */
+static void writeHashCache(LoadObject* lo, char* fileName)
+{
+   char tmpName[PATH_MAX+32], *slash;
+   unsigned int i;
+   unsigned long hash;
+   ElfSection* sec;
+   FILE* fp;
+   snprintf(tmpName, sizeof(tmpName), "%s.%d", fileName, (int) getpid());
+   fp = fopen(tmpName, "w");
+   for (slash=tmpName; !fp && (slash = strchr(slash+1, '/')); )
+   {
+      // create missing directories, then try again
+      *slash = '\0';
+      mkdir(tmpName, 0755);
+      *slash = '/';
+      fp = fopen(tmpName, "w");
+   }
+   if (!fp)
+      return;
+   fprintf(fp, "elfreader-section-hashes 1 %d\n", lo->getNumberOfSections());
+   for (i=0; (sec = lo->getSection(i)); i++)
+      if (!sec->getContentHash(&hash))
+         fprintf(fp, "%u %u %016lx\n", i, sec->getSizeInBytes(), hash);
+   if (fclose(fp) || rename(tmpName, fileName))
+      unlink(tmpName);
+}
+
+static void hashSection(void* arg, unsigned int index, unsigned int worker)
+{
+   unsigned long hash;
+   ((LoadObject*) arg)->getSection(index)->getContentHash(&hash);
+}
+
+/**
+ * Hash the contents of every section (see ElfSection::getContentHash()).
+ * For file images, hashes are looked up in, and saved to, a cache
+ * keyed by build-id, so an object is only hashed once per build.
+ * Loaded objects are not cached, since relocation changes their
+ * writable sections in memory.
+ * @param numThreads is the number of threads to hash with (0 means
+ *        one per CPU); each section is hashed by one thread.
+ * @param useCache is nonzero to use the build-id cache.
+ * @return The number of sections that have a hash.
+ */
+unsigned int LoadObject::hashSections(unsigned int numThreads,
+                                      unsigned int useCache)
+{
+   char cacheName[PATH_MAX];
+   unsigned int i, count;
+   unsigned long hash;
+   int cached = -1;
+
+   if (!useCache || !fileImage ||
+       getHashCacheFileName(this, cacheName, sizeof(cacheName)))
+      useCache = 0;
+   if (useCache)
+      cached = readHashCache(this, cacheName);
+   if (cached)
+   {
+      ParallelFor::run(numSections, numThreads, hashSection, this);
+      if (useCache)
+         writeHashCache(this, cacheName);
+   }
+   count = 0;
+   for (i=0; i < numSections; i++)
+      if (!sections[i].getContentHash(&hash))
+         count++;
+   return count;
+}
+
+/**
+ * Name of a section, checked against the size of the section header
+ * string table.
+ * @param index is the section index.
+ * @return The name, or null if it cannot be had.
+ */
+char* LoadObject::getSectionName(unsigned int index)
+{
+   unsigned int nameIndex;
+   if (!secHeaderStringTable || index >= numSections)
+      return 0;
+   nameIndex = sections[index].getNameIndex();
+   if (nameIndex >= secHeaderStringTableSize)
+      return 0;
+   return secHeaderStringTable + nameIndex;
+}
+
+/**
+ * Build the hash index over the section names, and resolve the well
+ * known sections into their slots. Called once the section objects
+ * and the section header string table are in place.
+ */
+void LoadObject::buildSectionNameIndex()
+{
+   unsigned int i, h, w;
+   char* name;
+   ElfSection* sec;
+   if (!secHeaderStringTable || !numSections)
+      return;
+   for (numSectionBuckets=16; numSectionBuckets < numSections; 
+        numSectionBuckets *= 2)
+      ;
+   sectionHashBuckets = new unsigned int[numSectionBuckets];
+   sectionHashChains = new unsigned int[numSections];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   memset(sectionHashBuckets, 0xff, sizeof(unsigned int)*numSectionBuckets);
+   // insert in reverse so that chains list the first section first
+   for (i=numSections; i > 0; i--)
+   {
+      sectionHashChains[i-1] = 0xffffffff;
+      if (!(name = getSectionName(i-1)) || !*name)
+         continue;
+      h = DynamicSection::getGnuHash(name) & (numSectionBuckets-1);
+      sectionHashChains[i-1] = sectionHashBuckets[h];
+      sectionHashBuckets[h] = i-1;
+   }
+   for (w=0; w < SECTION_NUM_WELL_KNOWN; w++)
+      if ((sec = findSectionByName((char*) wellKnownSectionNames[w])))
+         wellKnownSections[w] = sec->getIndex();
+   if (wellKnownSections[SECTION_PLT])
+      PLTAddress = sections[wellKnownSections[SECTION_PLT]].getBaseAddress();
+}
+
+/**
+ * Find a section by name, using the section name hash index.
+ * @param name is the section name (e.g. ".text").
+ * @return An ElfSection object pointer for the found section (the
+ *         first one, if several have the name), or null.
+ */
+ElfSection* LoadObject::findSectionByName(char* name)
+{
+   unsigned int i;
+   char* secName;
+   if (!sectionHashBuckets || !name)
+      return 0;
+   i = sectionHashBuckets[DynamicSection::getGnuHash(name) &
+                          (numSectionBuckets-1)];
+   while (i != 0xffffffff)
+   {
+      secName = getSectionName(i);
+      if (!strcmp(name, secName))
+         return &sections[i];
+      i = sectionHashChains[i];
+   }
+   return 0;
+}
+
+/**
+ * Sort the section names for prefix queries; done on first use.
+ * @return 0 on success, -1 if there are no section names.
+ */
+int LoadObject::buildSortedSectionNames()
+{
+   unsigned int i, n = 0;
+   char* name;
+   if (sectionsByName)
       return 0;
+   if (!secHeaderStringTable || !numSections)
+      return -1;
+   sectionsByName = new SectionNameEntry[numSections];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   for (i=0; i < numSections; i++)
+   {
+      if (!(name = getSectionName(i)) || !*name)
+         name = (char*) "";
+      sectionsByName[n].name = name;
+      sectionsByName[n].index = i;
+      n++;
+   }
+   qsort(sectionsByName, numSections, sizeof(SectionNameEntry),
+         compareSectionNames);
+   return 0;
+}
+
+/**
+ * Find all sections whose names start with a prefix (e.g. ".text."
+ * or ".debug_"). The first call sorts the section names; after that
+ * a query is a binary search plus the matches.
+ * @param prefix is the name prefix (an empty prefix matches every
+ *        named section).
+ * @param numFound is a return parameter set to the number of sections.
+ * @return Array of matching sections in name order (allocated with
+ *         new[]), or null if there are none.
+ */
+ElfSection** LoadObject::findSectionsByPrefix(char* prefix, 
+                                              unsigned int* numFound)
+{
+   unsigned int lo, hi, mid, first, n, len;
+   ElfSection** found;
+   *numFound = 0;
+   if (!prefix || buildSortedSectionNames())
+      return 0;
+   len = strlen(prefix);
+   // lower bound of the prefix; unnamed sections sort first
+   lo = 0; hi = numSections;
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if (strcmp(sectionsByName[mid].name, prefix) < 0)
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   while (lo < numSections && !*sectionsByName[lo].name)
+      lo++;
+   first = lo;
+   while (lo < numSections && !strncmp(sectionsByName[lo].name, prefix, len))
+      lo++;
+   if (lo == first)
+      return 0;
+   found = new ElfSection*[lo - first];
+   for (n=0; first < lo; first++)
+      found[n++] = &sections[sectionsByName[first].index];
+   *numFound = n;
+   return found;
+}
+
+/**
+ * Get one of the commonly used sections, as resolved when the
+ * section headers were read.
+ * @param which is a WellKnownSection value.
+ * @return The section, or null if the object has no such section.
+ */
+ElfSection* LoadObject::getWellKnownSection(unsigned int which)
+{
+   if (which >= SECTION_NUM_WELL_KNOWN || !wellKnownSections[which])
+      return 0;
+   return &sections[wellKnownSections[which]];
+}
+
+const char* LoadObject::getWellKnownSectionName(unsigned int which)
+{
+   return which < SECTION_NUM_WELL_KNOWN ? wellKnownSectionNames[which] :
+      "unknown";
 }
 
 ElfSymbol* LoadObject::startDynamicSymbolIter(unsigned int* iter)
@@ -392,6 +1639,11 @@ ElfSymbol* LoadObject::nextStaticSymbolIter(unsigned int* iter)
    return esym;
 }
 
+unsigned int LoadObject::getNumberOfStaticSymbols()
+{
+   return staticSymbols ? numStaticSymbols : 0;
+}
+
 ElfSymbol* LoadObject::findStaticSymbolByName(char* name)
 {
    unsigned int i;
@@ -428,6 +1680,34 @@ struct link_map* LoadObject::getLinkMap()
    return l_map;
 }
 
+/**
+ * Find the object's position in the dynamic linker's list of loaded
+ * objects, which is load order (and, for objects loaded at startup,
+ * symbol search order). Objects are matched on the address of their
+ * dynamic section, so this works whether or not getLinkMap() does.
+ * @return The position (0 is the executable), or -1 if the object is
+ *         not live or not in the list.
+ */
+int LoadObject::getLinkMapIndex()
+{
+   struct link_map* lm;
+   ElfSegment* seg;
+   char* dyn = 0;
+   unsigned int n;
+   int index;
+   if (fileImage || snapshot)
+      return -1;
+   for (n=0; (seg = getSegment(n)); n++)
+      if (seg->isDynamicInfo())
+         dyn = (char*) getLoadBias() + (ElfW(Addr)) seg->getVirtualAddress();
+   if (!dyn)
+      return -1;
+   for (lm = _r_debug.r_map, index = 0; lm; lm = lm->l_next, index++)
+      if ((char*) lm->l_ld == dyn)
+         return index;
+   return -1;
+}
+
 /**
  * Find this load object's link_map structure that the dynamic linker
  * uses to keep track of it. Assumes that the load object's GOT table
@@ -441,7 +1721,7 @@ int LoadObject::findAndSetLinkMap()
    // find address of GOT by locating DT_PLTGOT entry in dynamic section
    // link map entry is GOT[1] (can vary on other platforms)
    ElfW(Addr) *got;
-   if (!GOTAddress)
+   if (!GOTAddress || fileImage || snapshot)
       return -1;
    got = (ElfW(Addr)*) GOTAddress;
    l_map = (struct link_map *) got[1];
@@ -478,9 +1758,12 @@ char* LoadObject::getGOTEntryAddressByName(char *symbolName)
 char* LoadObject::getPLTEntryAddressByName(char *symbolName)
 {
    ElfSymbol* esym = findDynamicSymbolByName(symbolName);
-   if (!esym || esym->getRawValue() == 0 || esym->getSHIndex() != 0)
+   char* plte;
+   if (!esym)
       return 0;
-   return (char*) esym->getRawValue();
+   plte = esym->getPLTEntryAddress();
+   delete esym;
+   return plte;
 }
 
 char* LoadObject::getSymbolAddressByName(char *symbolName)
@@ -499,12 +1782,53 @@ int LoadObject::getSectionHeaderSize()
       return 0;
 }
 
+/**
+ * Get the number of sections. Objects with SHN_LORESERVE or more
+ * sections use extended numbering: e_shnum is zero and the real count
+ * is in the sh_size field of section header zero.
+ * @return Number of section headers.
+ */
 int LoadObject::getNumberOfSections()
 {
-   if (elfHeader)
-      return (int) elfHeader->e_shnum;
-   else
+   ElfW(Shdr)* sh;
+   if (!elfHeader)
       return 0;
+   if (elfHeader->e_shnum == 0 && elfHeader->e_shoff &&
+       (sh = getSectionZeroHeader()))
+      return (int) sh->sh_size;
+   return (int) elfHeader->e_shnum;
+}
+
+/**
+ * Fetch section header zero, which carries the overflow values for
+ * extended section and segment numbering. It is read once and kept.
+ * @return Pointer to our copy of the header, or null if unreadable.
+ */
+ElfW(Shdr)* LoadObject::getSectionZeroHeader()
+{
+   char* data;
+   if (sectionZeroState)
+      return sectionZeroState > 0 ? &sectionZero : 0;
+   sectionZeroState = -1;
+   if (!elfHeader || !elfHeader->e_shoff)
+      return 0;
+   // a loaded object reads it from the file; getFileRangePtr() would
+   // need the segment count, which may itself be stored here
+   if (fileImage || snapshot)
+   {
+      if ((data = getFileRangePtr(elfHeader->e_shoff, sizeof(ElfW(Shdr)))))
+      {
+         memcpy(&sectionZero, data, sizeof(ElfW(Shdr)));
+         sectionZeroState = 1;
+      }
+   }
+   else if ((data = getFileSection(elfHeader->e_shoff, sizeof(ElfW(Shdr)))))
+   {
+      memcpy(&sectionZero, data, sizeof(ElfW(Shdr)));
+      delete[] data;
+      sectionZeroState = 1;
+   }
+   return sectionZeroState > 0 ? &sectionZero : 0;
 }
 
 int LoadObject::getSegmentHeaderSize()
@@ -517,15 +1841,18 @@ int LoadObject::getSegmentHeaderSize()
 
 int LoadObject::getNumberOfSegments()
 {
-   if (elfHeader)
-      return (int) elfHeader->e_phnum;
-   else
+   ElfW(Shdr)* sh;
+   if (!elfHeader)
       return 0;
+   // PN_XNUM means the real count is in section zero's sh_info
+   if (elfHeader->e_phnum == PN_XNUM)
+      return (sh = getSectionZeroHeader()) ? (int) sh->sh_info : 0;
+   return (int) elfHeader->e_phnum;
 }
 
 char* LoadObject::getBaseAddress()
 {
-   return (char*) elfHeader;
+   return baseAddress;
 }
 
 char* LoadObject::getHighAddress()
@@ -550,7 +1877,7 @@ unsigned int LoadObject::getSegmentEntrySize()
 
 unsigned int LoadObject::getSegmentEntryCount()
 {
-   return elfHeader->e_phnum;
+   return getNumberOfSegments();
 }
 
 unsigned int LoadObject::getSectionTableOffset()
@@ -565,11 +1892,19 @@ unsigned int LoadObject::getSectionEntrySize()
 
 unsigned int LoadObject::getSectionEntryCount()
 {
-   return elfHeader->e_shnum;
+   return getNumberOfSections();
 }
 
+/**
+ * Get the section header string table index; SHN_XINDEX in the ELF
+ * header means the real index is in section zero's sh_link.
+ */
 unsigned int LoadObject::getSectionHeaderStringIndex()
 {
+   ElfW(Shdr)* sh;
+   if (elfHeader->e_shstrndx == SHN_XINDEX && 
+       (sh = getSectionZeroHeader()))
+      return sh->sh_link;
    return elfHeader->e_shstrndx;
 }
 
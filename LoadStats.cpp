@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <ElfProgram.h>
+
+unsigned int LoadStats::enabled = 0;
+
+static const char* phaseNames[STATS_NUM_PHASES] = {
+   "maps", "file-map", "section-headers", "segment-headers", "dynamic",
+   "link-map", "symbols"
+};
+
+static const char* counterNames[STATS_NUM_COUNTERS] = {
+   "file-opens", "bytes-read", "bytes-mapped", "allocations", "objects"
+};
+
+//
+// Per-thread state: the record events are charged to (if any), and
+// the thread's running totals. The totals records are linked into a
+// global list when a thread first counts something, so that
+// getProcessTotals() can add them up; they are never freed, since
+// they must outlive their threads.
+//
+struct ThreadStats
+{
+   LoadStats totals;
+   struct ThreadStats* next;
+};
+
+static __thread LoadStats* currentStats;
+static __thread ThreadStats* threadStats;
+static ThreadStats* allThreadStats;
+static pthread_mutex_t threadStatsLock = PTHREAD_MUTEX_INITIALIZER;
+
+static LoadStats* getThreadTotals()
+{
+   if (!threadStats)
+   {
+      ThreadStats* ts = new ThreadStats;
+      pthread_mutex_lock(&threadStatsLock);
+      ts->next = allThreadStats;
+      allThreadStats = ts;
+      pthread_mutex_unlock(&threadStatsLock);
+      threadStats = ts;
+   }
+   return &threadStats->totals;
+}
+
+LoadStats::LoadStats()
+{
+   reset();
+}
+
+void LoadStats::reset()
+{
+   memset(phaseTime, 0, sizeof(phaseTime));
+   memset(phaseCount, 0, sizeof(phaseCount));
+   memset(counters, 0, sizeof(counters));
+}
+
+void LoadStats::add(LoadStats* other)
+{
+   unsigned int i;
+   if (!other)
+      return;
+   for (i=0; i < STATS_NUM_PHASES; i++)
+   {
+      phaseTime[i] += other->phaseTime[i];
+      phaseCount[i] += other->phaseCount[i];
+   }
+   for (i=0; i < STATS_NUM_COUNTERS; i++)
+      counters[i] += other->counters[i];
+}
+
+unsigned long LoadStats::getPhaseTime(unsigned int phase)
+{
+   return phase < STATS_NUM_PHASES ? phaseTime[phase] : 0;
+}
+
+unsigned long LoadStats::getPhaseCount(unsigned int phase)
+{
+   return phase < STATS_NUM_PHASES ? phaseCount[phase] : 0;
+}
+
+unsigned long LoadStats::getCounter(unsigned int counter)
+{
+   return counter < STATS_NUM_COUNTERS ? counters[counter] : 0;
+}
+
+const char* LoadStats::getPhaseName(unsigned int phase)
+{
+   return phase < STATS_NUM_PHASES ? phaseNames[phase] : "unknown";
+}
+
+const char* LoadStats::getCounterName(unsigned int counter)
+{
+   return counter < STATS_NUM_COUNTERS ? counterNames[counter] : "unknown";
+}
+
+/**
+ * Write the record as text: a title line, then one line per phase
+ * that was entered and one per counter.
+ * @param out is where the report goes.
+ * @param title names what the record is for.
+ */
+void LoadStats::writeReport(OutputBuffer* out, const char* title)
+{
+   char line[128];
+   unsigned int i;
+   out->putString(title);
+   out->putChar('\n');
+   for (i=0; i < STATS_NUM_PHASES; i++)
+   {
+      if (!phaseCount[i])
+         continue;
+      snprintf(line, sizeof(line), "  phase   %-16s %8lu calls %12.3f ms\n",
+               phaseNames[i], phaseCount[i], phaseTime[i] / 1e6);
+      out->putString(line);
+   }
+   for (i=0; i < STATS_NUM_COUNTERS; i++)
+   {
+      snprintf(line, sizeof(line), "  counter %-16s %14lu\n",
+               counterNames[i], counters[i]);
+      out->putString(line);
+   }
+}
+
+void LoadStats::setEnabled(unsigned int on)
+{
+   enabled = on ? 1 : 0;
+}
+
+unsigned int LoadStats::isEnabled()
+{
+   return enabled;
+}
+
+LoadStats* LoadStats::setCurrent(LoadStats* stats)
+{
+   LoadStats* previous = currentStats;
+   currentStats = stats;
+   return previous;
+}
+
+LoadStats* LoadStats::getCurrent()
+{
+   return currentStats;
+}
+
+/**
+ * Add up every thread's running totals. Threads that are still
+ * reading objects may be part way through an update, so the sum is
+ * only exact once they are done.
+ * @param totals is reset and then receives the sum.
+ */
+void LoadStats::getProcessTotals(LoadStats* totals)
+{
+   ThreadStats* ts;
+   totals->reset();
+   pthread_mutex_lock(&threadStatsLock);
+   for (ts=allThreadStats; ts; ts = ts->next)
+      totals->add(&ts->totals);
+   pthread_mutex_unlock(&threadStatsLock);
+}
+
+unsigned long LoadStats::now()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+/**
+ * Count an event for the current record and the thread's totals.
+ * Called through STATS_COUNT(), which tests the enabled flag first.
+ */
+void LoadStats::count(unsigned int counter, unsigned long amount)
+{
+   getThreadTotals()->counters[counter] += amount;
+   if (currentStats)
+      currentStats->counters[counter] += amount;
+}
+
+/**
+ * Charge the time since startTime to a phase. Called through
+ * STATS_PHASE_END(), with a start time from STATS_PHASE_BEGIN().
+ */
+void LoadStats::endPhase(unsigned int phase, unsigned long startTime)
+{
+   unsigned long elapsed = now() - startTime;
+   LoadStats* totals = getThreadTotals();
+   totals->phaseTime[phase] += elapsed;
+   totals->phaseCount[phase]++;
+   if (currentStats)
+   {
+      currentStats->phaseTime[phase] += elapsed;
+      currentStats->phaseCount[phase]++;
+   }
+}
+
+LoadStatsScope::LoadStatsScope(LoadStats* stats)
+{
+   previous = 0;
+   active = stats != 0;
+   if (active)
+      previous = LoadStats::setCurrent(stats);
+}
+
+LoadStatsScope::~LoadStatsScope()
+{
+   if (active)
+      LoadStats::setCurrent(previous);
+}
@@ -0,0 +1,847 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <ElfProgram.h>
+
+//
+// Estimated cost of each step, in nanoseconds. These are rough
+// figures for glibc's ld.so on a warm x86-64 core; the model is for
+// ranking objects, so only their proportions really matter.
+//
+#define COST_RELATIVE   0.5   // apply a RELATIVE relocation
+#define COST_IFUNC      30.0  // call an IRELATIVE resolver
+#define COST_LOCAL      3.0   // bind a local or protected reference
+#define COST_CACHED     3.0   // repeat served by the lookup cache
+#define COST_LOOKUP     25.0  // hash the name, set up, apply the result
+#define COST_OBJECT     4.0   // try one scope object (bloom word load)
+#define COST_PROBE      2.0   // examine one hash chain entry
+#define COST_COMPARE    12.0  // check_match(): symbol tests and strcmp
+#define COST_LAZY_SLOT  1.0   // relocate a lazy JUMP_SLOT's GOT entry
+
+//! Type class bits of a lookup (as ld.so's ELF_RTYPE_CLASS_*)
+#define CLASS_PLT   1
+#define CLASS_COPY  2
+
+/*
+ * What a relocation type asks of the dynamic linker.
+ */
+enum RelocKind
+{
+   RELOC_KIND_NONE,        // nothing
+   RELOC_KIND_RELATIVE,    // base + addend, no symbol
+   RELOC_KIND_IRELATIVE,   // call a resolver, no symbol
+   RELOC_KIND_JUMP_SLOT,   // PLT slot (lazy binding can defer it)
+   RELOC_KIND_COPY,        // copy relocation (lookup skips the executable)
+   RELOC_KIND_SYMBOL       // anything else: look the symbol up
+};
+
+/*
+ * One dynamic relocation type of a machine. The values are the same
+ * as in <elf.h>, spelled out (as in PLTMap.cpp) so objects for other
+ * machines read the same on any host.
+ */
+struct RelocTypeInfo
+{
+   unsigned int type;
+   const char* name;
+   unsigned int kind;
+};
+
+static const RelocTypeInfo x86_64Types[] = {
+   { 0, "R_X86_64_NONE", RELOC_KIND_NONE },
+   { 1, "R_X86_64_64", RELOC_KIND_SYMBOL },
+   { 2, "R_X86_64_PC32", RELOC_KIND_SYMBOL },
+   { 5, "R_X86_64_COPY", RELOC_KIND_COPY },
+   { 6, "R_X86_64_GLOB_DAT", RELOC_KIND_SYMBOL },
+   { 7, "R_X86_64_JUMP_SLOT", RELOC_KIND_JUMP_SLOT },
+   { 8, "R_X86_64_RELATIVE", RELOC_KIND_RELATIVE },
+   { 10, "R_X86_64_32", RELOC_KIND_SYMBOL },
+   { 11, "R_X86_64_32S", RELOC_KIND_SYMBOL },
+   { 16, "R_X86_64_DTPMOD64", RELOC_KIND_SYMBOL },
+   { 17, "R_X86_64_DTPOFF64", RELOC_KIND_SYMBOL },
+   { 18, "R_X86_64_TPOFF64", RELOC_KIND_SYMBOL },
+   { 24, "R_X86_64_PC64", RELOC_KIND_SYMBOL },
+   { 32, "R_X86_64_SIZE32", RELOC_KIND_SYMBOL },
+   { 33, "R_X86_64_SIZE64", RELOC_KIND_SYMBOL },
+   { 36, "R_X86_64_TLSDESC", RELOC_KIND_SYMBOL },
+   { 37, "R_X86_64_IRELATIVE", RELOC_KIND_IRELATIVE },
+   { 38, "R_X86_64_RELATIVE64", RELOC_KIND_RELATIVE },
+   { 0, 0, 0 }
+};
+
+static const RelocTypeInfo aarch64Types[] = {
+   { 0, "R_AARCH64_NONE", RELOC_KIND_NONE },
+   { 257, "R_AARCH64_ABS64", RELOC_KIND_SYMBOL },
+   { 258, "R_AARCH64_ABS32", RELOC_KIND_SYMBOL },
+   { 260, "R_AARCH64_PREL64", RELOC_KIND_SYMBOL },
+   { 261, "R_AARCH64_PREL32", RELOC_KIND_SYMBOL },
+   { 1024, "R_AARCH64_COPY", RELOC_KIND_COPY },
+   { 1025, "R_AARCH64_GLOB_DAT", RELOC_KIND_SYMBOL },
+   { 1026, "R_AARCH64_JUMP_SLOT", RELOC_KIND_JUMP_SLOT },
+   { 1027, "R_AARCH64_RELATIVE", RELOC_KIND_RELATIVE },
+   { 1028, "R_AARCH64_TLS_DTPMOD", RELOC_KIND_SYMBOL },
+   { 1029, "R_AARCH64_TLS_DTPREL", RELOC_KIND_SYMBOL },
+   { 1030, "R_AARCH64_TLS_TPREL", RELOC_KIND_SYMBOL },
+   { 1031, "R_AARCH64_TLSDESC", RELOC_KIND_SYMBOL },
+   { 1032, "R_AARCH64_IRELATIVE", RELOC_KIND_IRELATIVE },
+   { 0, 0, 0 }
+};
+
+static const RelocTypeInfo i386Types[] = {
+   { 0, "R_386_NONE", RELOC_KIND_NONE },
+   { 1, "R_386_32", RELOC_KIND_SYMBOL },
+   { 2, "R_386_PC32", RELOC_KIND_SYMBOL },
+   { 5, "R_386_COPY", RELOC_KIND_COPY },
+   { 6, "R_386_GLOB_DAT", RELOC_KIND_SYMBOL },
+   { 7, "R_386_JMP_SLOT", RELOC_KIND_JUMP_SLOT },
+   { 8, "R_386_RELATIVE", RELOC_KIND_RELATIVE },
+   { 14, "R_386_TLS_TPOFF", RELOC_KIND_SYMBOL },
+   { 35, "R_386_TLS_DTPMOD32", RELOC_KIND_SYMBOL },
+   { 36, "R_386_TLS_DTPOFF32", RELOC_KIND_SYMBOL },
+   { 37, "R_386_TLS_TPOFF32", RELOC_KIND_SYMBOL },
+   { 41, "R_386_TLS_DESC", RELOC_KIND_SYMBOL },
+   { 42, "R_386_IRELATIVE", RELOC_KIND_IRELATIVE },
+   { 0, 0, 0 }
+};
+
+static const RelocTypeInfo* findTypeInfo(unsigned int machine,
+                                         unsigned int type)
+{
+   const RelocTypeInfo* info;
+   if (machine == EM_X86_64)
+      info = x86_64Types;
+   else if (machine == EM_AARCH64)
+      info = aarch64Types;
+   else if (machine == EM_386)
+      info = i386Types;
+   else
+      return 0;
+   for (; info->name; info++)
+      if (info->type == type)
+         return info;
+   return 0;
+}
+
+static unsigned int relocKind(unsigned int machine, unsigned int type)
+{
+   const RelocTypeInfo* info = findTypeInfo(machine, type);
+   return info ? info->kind : RELOC_KIND_SYMBOL;
+}
+
+/*
+ * One symbol-bound reference waiting for its scope walk. References
+ * to the same name, version and type class walk the global scope the
+ * same way, so each distinct one (a LookupKey) is walked only once.
+ */
+struct PendingLookup
+{
+   const char* name;
+   const char* version;
+   unsigned int gnuHashValue;
+   unsigned short typeClass;
+   unsigned short plt;      // counted in plt, else in eager
+   unsigned int key;        // LookupKey, once interned
+};
+
+/*
+ * The references an object makes, collected in phase 0.
+ */
+struct ObjectPending
+{
+   PendingLookup* list;
+   unsigned int count;
+   unsigned int max;
+};
+
+/*
+ * A distinct reference and the work its scope walk does.
+ */
+struct LookupKey
+{
+   const char* name;
+   const char* version;
+   unsigned int gnuHashValue;
+   unsigned int typeClass;
+   unsigned long hits;      // references sharing it
+   unsigned int next;       // hash chain (+1)
+   LookupCounts counts;     // one walk (lookups is 1)
+};
+
+/*
+ * A phase being run over its items (objects or keys); the worker
+ * number picks the thread's row of counters.
+ */
+struct CostPhase
+{
+   LookupCostModel* model;
+   unsigned int phase;
+};
+
+static void costStep(void* arg, unsigned int index, unsigned int worker)
+{
+   CostPhase* p = (CostPhase*) arg;
+   p->model->runStep(p->phase, index, worker);
+}
+
+static void addCounts(LookupCounts* to, LookupCounts* from)
+{
+   to->lookups += from->lookups;
+   to->objectsSearched += from->objectsSearched;
+   to->bloomRejects += from->bloomRejects;
+   to->bloomFalsePositives += from->bloomFalsePositives;
+   to->chainProbes += from->chainProbes;
+   to->stringCompares += from->stringCompares;
+   to->unresolved += from->unresolved;
+}
+
+/*
+ * Time spent in the tables of the objects searched.
+ */
+static double searchCost(LookupCounts* c)
+{
+   return c->objectsSearched * COST_OBJECT + c->chainProbes * COST_PROBE +
+          c->stringCompares * COST_COMPARE;
+}
+
+static double lookupCost(LookupCounts* c)
+{
+   return c->lookups * COST_LOOKUP + searchCost(c);
+}
+
+/*
+ * Number of relative relocations packed in a DT_RELR table: an even
+ * entry is one address, an odd one a bitmap of the words after it.
+ */
+static unsigned long countRelr(ElfW(Addr)* relr, unsigned int count)
+{
+   unsigned long n = 0;
+   unsigned int i;
+   for (i=0; i < count; i++)
+      n += (relr[i] & 1) ? __builtin_popcountl(relr[i] >> 1) : 1;
+   return n;
+}
+
+/**
+ * Model a live program: its objects in link map order, which is the
+ * global scope its libraries were relocated in.
+ * @param program is the (live) program.
+ * @param numThreads is the number of threads to work with (0 means
+ *        one per CPU); each object is handled by one thread.
+ */
+LookupCostModel::LookupCostModel(ProgramInfo* program,
+                                 unsigned int numThreads)
+{
+   unsigned int i, n = 0;
+   objects = program->getObjectsInLoadOrder(&numObjects);
+   ownsObjects = 1;
+   // the vDSO is in the link map but not in the search scope
+   for (i=0; i < numObjects; i++)
+      if (!objects[i]->getName() || objects[i]->getName()[0] != '[')
+         objects[n++] = objects[i];
+   numObjects = n;
+   analyze(numThreads);
+}
+
+/**
+ * Model a scope given as a list of objects (file images will do),
+ * searched in that order; the first is taken to be the executable.
+ * @param objects is the list (the caller keeps it and the objects).
+ * @param numObjects is its length.
+ * @param numThreads is as above.
+ */
+LookupCostModel::LookupCostModel(LoadObject** objects,
+                                 unsigned int numObjects,
+                                 unsigned int numThreads)
+{
+   this->objects = objects;
+   this->numObjects = numObjects;
+   ownsObjects = 0;
+   analyze(numThreads);
+}
+
+LookupCostModel::~LookupCostModel()
+{
+   unsigned int i;
+   for (i=0; i < numObjects; i++)
+   {
+      delete[] costs[i].types;
+      delete[] pending[i].list;
+   }
+   delete[] total.types;
+   delete[] costs;
+   delete[] pending;
+   delete[] served;
+   delete[] keys;
+   delete[] keyBuckets;
+   if (ownsObjects)
+      delete[] objects;
+}
+
+/*
+ * Run one phase over its items with the configured threads.
+ */
+void LookupCostModel::runPhase(unsigned int phase, unsigned int numItems)
+{
+   CostPhase p;
+   p.model = this;
+   p.phase = phase;
+   ParallelFor::run(numItems, numWorkers, costStep, &p);
+}
+
+/**
+ * Do one item of a phase (called by the worker threads). Phase 0
+ * goes through object index's relocations, phase 1 walks the scope
+ * for key index, phase 2 adds up object index's lookups.
+ * @param phase is the phase.
+ * @param index is the object or key.
+ * @param worker is the calling thread's row of scope counters.
+ */
+void LookupCostModel::runStep(unsigned int phase, unsigned int index,
+                              unsigned int worker)
+{
+   if (phase == 0)
+      collectObject(index, worker);
+   else if (phase == 1)
+      walkScope(index, worker);
+   else
+      finishObject(index);
+}
+
+/*
+ * Run the model: collect every object's references, give each
+ * distinct one a key, walk the scope once per key, then add the
+ * walks up per object and the per-worker scope counters per object.
+ */
+void LookupCostModel::analyze(unsigned int numThreads)
+{
+   unsigned long start = LoadStats::now();
+   ObjectLookupCost* cost;
+   LookupCounts* row;
+   unsigned int i, w, k;
+
+   numWorkers = ParallelFor::getThreadCount(numThreads, numObjects);
+   costs = new ObjectLookupCost[numObjects ? numObjects : 1];
+   pending = new ObjectPending[numObjects ? numObjects : 1];
+   served = new LookupCounts[numWorkers * numObjects + 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 3);
+   memset(costs, 0, sizeof(ObjectLookupCost) * numObjects);
+   memset(pending, 0, sizeof(ObjectPending) * numObjects);
+   memset(served, 0, sizeof(LookupCounts) * numWorkers * numObjects);
+   memset(&total, 0, sizeof(total));
+   keys = 0;
+   numKeys = maxKeys = 0;
+   keyBuckets = 0;
+   numKeyBuckets = 0;
+   for (i=0; i < numObjects; i++)
+   {
+      costs[i].loadObject = objects[i];
+      objects[i]->getDynamicSection();   // made before the threads share it
+   }
+   runPhase(0, numObjects);
+   internKeys();
+   runPhase(1, numKeys);
+   runPhase(2, numObjects);
+
+   // a worker row counts, per scope object, the work done in its
+   // tables, with definitions found tallied in "lookups"
+   for (i=0; i < numObjects; i++)
+   {
+      cost = &costs[i];
+      for (w=0; w < numWorkers; w++)
+      {
+         row = &served[w * numObjects + i];
+         cost->definitions += row->lookups;
+         row->lookups = 0;
+         addCounts(&cost->served, row);
+      }
+      cost->served.lookups = cost->served.objectsSearched;
+      cost->servedCost = searchCost(&cost->served);
+      total.relocations += cost->relocations;
+      total.relative += cost->relative;
+      total.irelative += cost->irelative;
+      total.localSymbols += cost->localSymbols;
+      total.cachedLookups += cost->cachedLookups;
+      total.lazySlots += cost->lazySlots;
+      total.bindNow += cost->bindNow;
+      total.definitions += cost->definitions;
+      total.nowCost += cost->nowCost;
+      total.lazyCost += cost->lazyCost;
+      total.servedCost += cost->servedCost;
+      addCounts(&total.eager, &cost->eager);
+      addCounts(&total.plt, &cost->plt);
+      addCounts(&total.served, &cost->served);
+      for (k=0; k < cost->numTypes; k++)
+         countType(&total, cost->types[k].type, cost->types[k].count);
+   }
+   analysisTime = LoadStats::now() - start;
+}
+
+/*
+ * Add relocations of one type to an object's list of types.
+ */
+void LookupCostModel::countType(ObjectLookupCost* cost, unsigned int type,
+                                unsigned long count)
+{
+   unsigned int i;
+   for (i=0; i < cost->numTypes; i++)
+      if (cost->types[i].type == type)
+      {
+         cost->types[i].count += count;
+         return;
+      }
+   if (cost->numTypes >= cost->maxTypes)
+   {
+      RelocTypeCount* tmp;
+      cost->maxTypes = cost->maxTypes ? cost->maxTypes * 2 : 16;
+      tmp = new RelocTypeCount[cost->maxTypes];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (cost->numTypes)
+         memcpy(tmp, cost->types, sizeof(RelocTypeCount) * cost->numTypes);
+      delete[] cost->types;
+      cost->types = tmp;
+   }
+   cost->types[cost->numTypes].type = type;
+   cost->types[cost->numTypes].count = count;
+   cost->numTypes++;
+}
+
+/*
+ * Queue one of an object's references for the scope walk. A
+ * DT_SYMBOLIC object is searched first, as _dl_lookup_symbol_x()
+ * does, and if it defines the symbol there is no walk.
+ */
+void LookupCostModel::addReference(unsigned int index, unsigned int symIndex,
+                                   unsigned int typeClass, unsigned int plt,
+                                   unsigned int worker)
+{
+   DynamicSection* dyn = objects[index]->getDynamicSection();
+   ObjectLookupCost* cost = &costs[index];
+   ObjectPending* list = &pending[index];
+   LookupCounts* counts = plt ? &cost->plt : &cost->eager;
+   LookupCounts* row = served + worker * numObjects;
+   LookupCounts work;
+   PendingLookup* p;
+   ElfW(Sym)* syms;
+   const char *name, *version;
+   unsigned int numSyms, gnuHashValue, found;
+
+   syms = dyn->getSymbolTable(&numSyms);
+   if (!(name = dyn->getSymbolString(syms + symIndex)))
+      return;
+   version = dyn->getSymbolVersionName(symIndex);
+   gnuHashValue = DynamicSection::getGnuHash(name);
+   if (dyn->hasEntry(DT_SYMBOLIC) || (dyn->getFlags() & DF_SYMBOLIC))
+   {
+      memset(&work, 0, sizeof(work));
+      found = dyn->traceLookup(name, gnuHashValue,
+                               dyn->elfHash((const unsigned char*) name),
+                               version, typeClass & CLASS_PLT, &work) >= 0;
+      addCounts(counts, &work);
+      addCounts(&row[index], &work);
+      if (found)
+      {
+         counts->lookups++;
+         row[index].lookups++;
+         return;
+      }
+   }
+   if (list->count >= list->max)
+   {
+      PendingLookup* tmp;
+      list->max = list->max ? list->max * 2 : 16;
+      tmp = new PendingLookup[list->max];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      if (list->count)
+         memcpy(tmp, list->list, sizeof(PendingLookup) * list->count);
+      delete[] list->list;
+      list->list = tmp;
+   }
+   p = &list->list[list->count++];
+   p->name = name;
+   p->version = version;
+   p->gnuHashValue = gnuHashValue;
+   p->typeClass = typeClass;
+   p->plt = plt;
+   p->key = 0;
+}
+
+/*
+ * Give every pending reference its key, making a key for each
+ * distinct name, version and type class.
+ */
+void LookupCostModel::internKeys()
+{
+   unsigned long numPending = 0;
+   PendingLookup* p;
+   LookupKey* key;
+   unsigned int i, j, k, b;
+
+   for (i=0; i < numObjects; i++)
+      numPending += pending[i].count;
+   for (numKeyBuckets=16; numKeyBuckets < numPending; numKeyBuckets <<= 1)
+      ;
+   keyBuckets = new unsigned int[numKeyBuckets];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   memset(keyBuckets, 0, sizeof(unsigned int) * numKeyBuckets);
+   for (i=0; i < numObjects; i++)
+      for (j=0; j < pending[i].count; j++)
+      {
+         p = &pending[i].list[j];
+         b = (p->gnuHashValue ^ (p->typeClass << 29)) & (numKeyBuckets - 1);
+         for (k = keyBuckets[b]; k; k = keys[k-1].next)
+         {
+            key = &keys[k-1];
+            if (key->gnuHashValue == p->gnuHashValue &&
+                key->typeClass == p->typeClass &&
+                !strcmp(key->name, p->name) &&
+                (key->version == p->version ||
+                 (key->version && p->version &&
+                  !strcmp(key->version, p->version))))
+               break;
+         }
+         if (!k)
+         {
+            if (numKeys >= maxKeys)
+            {
+               LookupKey* tmp;
+               maxKeys = maxKeys ? maxKeys * 2 : 16;
+               tmp = new LookupKey[maxKeys];
+               STATS_COUNT(STATS_ALLOCATIONS, 1);
+               if (numKeys)
+                  memcpy(tmp, keys, sizeof(LookupKey) * numKeys);
+               delete[] keys;
+               keys = tmp;
+            }
+            key = &keys[numKeys++];
+            memset(key, 0, sizeof(LookupKey));
+            key->name = p->name;
+            key->version = p->version;
+            key->gnuHashValue = p->gnuHashValue;
+            key->typeClass = p->typeClass;
+            key->next = keyBuckets[b];
+            keyBuckets[b] = k = numKeys;
+         }
+         keys[k-1].hits++;
+         p->key = k - 1;
+      }
+}
+
+/*
+ * Walk the scope for one key as do_lookup_x() would, trying every
+ * object in order up to the first definition (COPY relocations pass
+ * over the executable). The work done in each object's tables is
+ * charged to it once per reference sharing the key.
+ */
+void LookupCostModel::walkScope(unsigned int keyIndex, unsigned int worker)
+{
+   LookupKey* key = &keys[keyIndex];
+   LookupCounts* row = served + worker * numObjects;
+   LookupCounts work;
+   DynamicSection* dyn;
+   unsigned int j, sysvHashValue = 0, found = 0;
+
+   key->counts.lookups = 1;
+   for (j=0; j < numObjects && !found; j++)
+   {
+      if ((key->typeClass & CLASS_COPY) && j == 0)
+         continue;
+      if (!(dyn = objects[j]->getDynamicSection()))
+         continue;
+      if (!sysvHashValue)
+         sysvHashValue = dyn->elfHash((const unsigned char*) key->name);
+      memset(&work, 0, sizeof(work));
+      found = dyn->traceLookup(key->name, key->gnuHashValue, sysvHashValue,
+                               key->version, key->typeClass & CLASS_PLT,
+                               &work) >= 0;
+      addCounts(&key->counts, &work);
+      row[j].objectsSearched += work.objectsSearched * key->hits;
+      row[j].bloomRejects += work.bloomRejects * key->hits;
+      row[j].bloomFalsePositives += work.bloomFalsePositives * key->hits;
+      row[j].chainProbes += work.chainProbes * key->hits;
+      row[j].stringCompares += work.stringCompares * key->hits;
+      if (found)
+         row[j].lookups += key->hits;
+   }
+   key->counts.unresolved = !found;
+}
+
+/*
+ * Add the walks of an object's references to its counts, and
+ * estimate its startup cost with and without lazy binding.
+ */
+void LookupCostModel::finishObject(unsigned int index)
+{
+   ObjectLookupCost* cost = &costs[index];
+   PendingLookup* p;
+   unsigned int i;
+   double base;
+   for (i=0; i < pending[index].count; i++)
+   {
+      p = &pending[index].list[i];
+      addCounts(p->plt ? &cost->plt : &cost->eager, &keys[p->key].counts);
+   }
+   base = cost->relative * COST_RELATIVE + cost->irelative * COST_IFUNC +
+          cost->localSymbols * COST_LOCAL + cost->cachedLookups * COST_CACHED +
+          lookupCost(&cost->eager);
+   cost->nowCost = base + lookupCost(&cost->plt);
+   cost->lazyCost = base + (cost->bindNow ? lookupCost(&cost->plt) :
+                            cost->lazySlots * COST_LAZY_SLOT);
+}
+
+/*
+ * Go through one object's relocations in the order ld.so applies
+ * them (DT_RELR, DT_RELA or DT_REL, then DT_JMPREL), counting each
+ * by type and queueing each symbol-bound one for its lookup.
+ */
+void LookupCostModel::collectObject(unsigned int index, unsigned int worker)
+{
+   static const unsigned int tables[3] = { DT_RELA, DT_REL, DT_JMPREL };
+   ObjectLookupCost* cost = &costs[index];
+   LoadObject* lo = objects[index];
+   DynamicSection* dyn = lo->getDynamicSection();
+   unsigned int machine = lo->getArchitectureType();
+   unsigned int t, i, count, withAddends, entrySize, numSyms, kind;
+   unsigned int type, symIndex, typeClass, lastClass = 0, lastSym = 0;
+   char *relocs, *jmprel, *jmprelEnd, *rel;
+   ElfW(Addr)* relr;
+   ElfW(Sym)* syms;
+   ElfW(Addr) info;
+
+   if (!dyn)
+      return;
+   cost->bindNow = dyn->hasEntry(DT_BIND_NOW) ||
+                   (dyn->getFlags() & DF_BIND_NOW) ||
+                   (dyn->getFlags1() & DF_1_NOW);
+   syms = dyn->getSymbolTable(&numSyms);
+   if ((relr = dyn->getRelrTable(&count)))
+   {
+      cost->relative += countRelr(relr, count);
+      cost->relocations += countRelr(relr, count);
+   }
+   // some linkers make DT_RELA cover DT_JMPREL too; take those once
+   jmprel = dyn->getRelocationTable(DT_JMPREL, &count, &withAddends);
+   jmprelEnd = jmprel + count * (withAddends ? sizeof(ElfW(Rela)) :
+                                 sizeof(ElfW(Rel)));
+   for (t=0; t < 3; t++)
+   {
+      relocs = dyn->getRelocationTable(tables[t], &count, &withAddends);
+      entrySize = withAddends ? sizeof(ElfW(Rela)) : sizeof(ElfW(Rel));
+      for (i=0; relocs && i < count; i++)
+      {
+         rel = relocs + i * entrySize;
+         if (tables[t] != DT_JMPREL && rel >= jmprel && rel < jmprelEnd)
+            continue;
+         info = ((ElfW(Rel)*) rel)->r_info;
+         type = GEN_R_TYPE(info);
+         symIndex = GEN_R_SYM(info);
+         cost->relocations++;
+         countType(cost, type, 1);
+         kind = relocKind(machine, type);
+         if (kind == RELOC_KIND_NONE)
+            continue;
+         if (kind == RELOC_KIND_RELATIVE)
+         {
+            cost->relative++;
+            continue;
+         }
+         if (kind == RELOC_KIND_IRELATIVE)
+         {
+            cost->irelative++;
+            continue;
+         }
+         if (kind == RELOC_KIND_JUMP_SLOT)
+            cost->lazySlots++;
+         // references without a symbol, to local symbols or to
+         // non-default visibility ones bind to the object itself
+         if (!symIndex || !syms || symIndex >= numSyms ||
+             GEN_ST_BIND(syms[symIndex].st_info) == STB_LOCAL ||
+             GEN_ST_VISIBILITY(syms[symIndex].st_other) != STV_DEFAULT)
+         {
+            cost->localSymbols++;
+            continue;
+         }
+         typeClass = kind == RELOC_KIND_JUMP_SLOT ? CLASS_PLT :
+                     kind == RELOC_KIND_COPY ? CLASS_COPY : 0;
+         // ld.so remembers the last symbol it looked up for an object
+         if (symIndex == lastSym && typeClass == lastClass)
+         {
+            cost->cachedLookups++;
+            continue;
+         }
+         lastSym = symIndex;
+         lastClass = typeClass;
+         addReference(index, symIndex, typeClass,
+                      kind == RELOC_KIND_JUMP_SLOT, worker);
+      }
+   }
+}
+
+unsigned int LookupCostModel::getNumberOfObjects()
+{
+   return numObjects;
+}
+
+ObjectLookupCost* LookupCostModel::getObjectCost(unsigned int index)
+{
+   return index < numObjects ? &costs[index] : 0;
+}
+
+/**
+ * Get the program totals. Every field is the sum over the objects
+ * (bindNow counts the objects that ask for it); types holds the
+ * relocation counts by type for the whole program.
+ * @return The totals (loadObject is null).
+ */
+ObjectLookupCost* LookupCostModel::getTotalCost()
+{
+   return &total;
+}
+
+unsigned long LookupCostModel::getAnalysisTime()
+{
+   return analysisTime;
+}
+
+const char* LookupCostModel::getRelocationTypeName(unsigned int machine,
+                                                   unsigned int type)
+{
+   const RelocTypeInfo* info = findTypeInfo(machine, type);
+   return info ? info->name : 0;
+}
+
+static int compareNowCost(const void* a, const void* b)
+{
+   double x = (*(ObjectLookupCost**) a)->nowCost;
+   double y = (*(ObjectLookupCost**) b)->nowCost;
+   return (x < y) - (x > y);
+}
+
+static int compareServedCost(const void* a, const void* b)
+{
+   double x = (*(ObjectLookupCost**) a)->servedCost;
+   double y = (*(ObjectLookupCost**) b)->servedCost;
+   return (x < y) - (x > y);
+}
+
+static int compareTypeCount(const void* a, const void* b)
+{
+   unsigned long x = ((RelocTypeCount*) a)->count;
+   unsigned long y = ((RelocTypeCount*) b)->count;
+   return (x < y) - (x > y);
+}
+
+static double percent(unsigned long part, unsigned long whole)
+{
+   return whole ? 100.0 * part / whole : 0.0;
+}
+
+/**
+ * Write the model as text: program totals, the objects with the
+ * costliest relocation (ranked by the BIND_NOW estimate), the scope
+ * members whose hash tables lookups spend the most time in, and the
+ * relocation counts by type.
+ * @param out is where the report goes.
+ * @param maxObjects is how many objects each ranking lists.
+ */
+void LookupCostModel::writeReport(OutputBuffer* out, unsigned int maxObjects)
+{
+   ObjectLookupCost** ranked;
+   ObjectLookupCost* c;
+   LookupCounts all;
+   RelocTypeCount* types;
+   const char* name;
+   char line[PATH_MAX + 256];
+   unsigned int i, n, machine;
+
+   memset(&all, 0, sizeof(all));
+   addCounts(&all, &total.eager);
+   addCounts(&all, &total.plt);
+   snprintf(line, sizeof(line),
+            "%u objects, %lu relocations: %lu relative, %lu irelative, "
+            "%lu local, %lu cached, %lu lookups\n",
+            numObjects, total.relocations, total.relative, total.irelative,
+            total.localSymbols, total.cachedLookups, all.lookups);
+   out->putString(line);
+   snprintf(line, sizeof(line),
+            "estimated startup: %.3f ms with BIND_NOW, %.3f ms lazy "
+            "(%lu JUMP_SLOTs, %u objects binding now anyway)\n",
+            total.nowCost / 1e6, total.lazyCost / 1e6, total.lazySlots,
+            total.bindNow);
+   out->putString(line);
+   snprintf(line, sizeof(line),
+            "per lookup: %.1f objects searched, %.1f%% of them rejected "
+            "by bloom filters, %.2f false positives, %.2f chain probes, "
+            "%.2f name compares; %lu unresolved\n",
+            all.lookups ? (double) all.objectsSearched / all.lookups : 0.0,
+            percent(all.bloomRejects, all.objectsSearched),
+            all.lookups ? (double) all.bloomFalsePositives / all.lookups : 0.0,
+            all.lookups ? (double) all.chainProbes / all.lookups : 0.0,
+            all.lookups ? (double) all.stringCompares / all.lookups : 0.0,
+            all.unresolved);
+   out->putString(line);
+
+   ranked = new ObjectLookupCost*[numObjects ? numObjects : 1];
+   for (i=0; i < numObjects; i++)
+      ranked[i] = &costs[i];
+   n = numObjects < maxObjects ? numObjects : maxObjects;
+   qsort(ranked, numObjects, sizeof(ObjectLookupCost*), compareNowCost);
+   out->putString("\ncostliest objects to relocate\n"
+                  "     now(us)    lazy(us)   relocs  lookups  objs/lkp"
+                  "  fp/lkp  cmp/lkp  object\n");
+   for (i=0; i < n; i++)
+   {
+      c = ranked[i];
+      memset(&all, 0, sizeof(all));
+      addCounts(&all, &c->eager);
+      addCounts(&all, &c->plt);
+      snprintf(line, sizeof(line),
+               "%12.1f%12.1f%9lu%9lu%10.1f%8.2f%9.2f  %s%s\n",
+               c->nowCost / 1e3, c->lazyCost / 1e3, c->relocations,
+               all.lookups,
+               all.lookups ? (double) all.objectsSearched / all.lookups : 0.0,
+               all.lookups ?
+                  (double) all.bloomFalsePositives / all.lookups : 0.0,
+               all.lookups ? (double) all.stringCompares / all.lookups : 0.0,
+               c->loadObject->getName(), c->bindNow ? " (now)" : "");
+      out->putString(line);
+   }
+   qsort(ranked, numObjects, sizeof(ObjectLookupCost*), compareServedCost);
+   out->putString("\ncostliest hash tables to search\n"
+                  "    cost(us)  searched  bloom-rej  false-pos    probes"
+                  "  compares   defined  object\n");
+   for (i=0; i < n; i++)
+   {
+      c = ranked[i];
+      snprintf(line, sizeof(line),
+               "%12.1f%10lu%11lu%11lu%10lu%10lu%10lu  %s\n",
+               c->servedCost / 1e3, c->served.objectsSearched,
+               c->served.bloomRejects, c->served.bloomFalsePositives,
+               c->served.chainProbes, c->served.stringCompares,
+               c->definitions, c->loadObject->getName());
+      out->putString(line);
+   }
+   delete[] ranked;
+
+   // type names are the executable's machine (the scope is one machine)
+   machine = numObjects ? objects[0]->getArchitectureType() : 0;
+   types = new RelocTypeCount[total.numTypes ? total.numTypes : 1];
+   if (total.numTypes)
+      memcpy(types, total.types, sizeof(RelocTypeCount) * total.numTypes);
+   qsort(types, total.numTypes, sizeof(RelocTypeCount), compareTypeCount);
+   out->putString("\nrelocations by type\n");
+   for (i=0; i < total.numTypes; i++)
+   {
+      name = getRelocationTypeName(machine, types[i].type);
+      if (name)
+         snprintf(line, sizeof(line), "  %-22s %10lu\n", name, types[i].count);
+      else
+         snprintf(line, sizeof(line), "  type %-17u %10lu\n", types[i].type,
+                  types[i].count);
+      out->putString(line);
+   }
+   delete[] types;
+   snprintf(line, sizeof(line), "(modelled in %.3f ms)\n",
+            analysisTime / 1e6);
+   out->putString(line);
+}
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <ElfProgram.h>
+
+static const char hexDigits[] = "0123456789abcdef";
+
+// "00" "01" ... "99", so decimal conversion does two digits per divide
+static const char decimalPairs[] =
+   "0001020304050607080910111213141516171819"
+   "2021222324252627282930313233343536373839"
+   "4041424344454647484950515253545556575859"
+   "6061626364656667686970717273747576777879"
+   "8081828384858687888990919293949596979899";
+
+// JSON needs escaping for '"', '\\' and control characters
+static unsigned char jsonEscape[256];
+static unsigned char jsonEscapeReady = 0;
+
+static void initJSONEscape()
+{
+   unsigned int i;
+   for (i=0; i < 0x20; i++)
+      jsonEscape[i] = 1;
+   jsonEscape['"'] = 1;
+   jsonEscape['\\'] = 1;
+   jsonEscapeReady = 1;
+}
+
+/**
+ * Set up a buffered writer on an open file descriptor.
+ * @param fd is where the output goes.
+ * @param bufferSize is the buffer size in bytes.
+ */
+OutputBuffer::OutputBuffer(int fd, unsigned int bufferSize)
+{
+   if (!jsonEscapeReady)
+      initJSONEscape();
+   this->fd = fd;
+   if (bufferSize < 256)
+      bufferSize = 256;
+   size = bufferSize;
+   buffer = new char[size];
+   used = 0;
+   flushed = 0;
+   writeError = 0;
+}
+
+OutputBuffer::~OutputBuffer()
+{
+   flush();
+   delete[] buffer;
+}
+
+/**
+ * Write out everything in the buffer.
+ * @return 0 on success, -1 if a write has failed.
+ */
+int OutputBuffer::flush()
+{
+   writeOut(buffer, used);
+   used = 0;
+   return writeError ? -1 : 0;
+}
+
+/**
+ * Write a block of data to the descriptor, retrying short writes.
+ */
+void OutputBuffer::writeOut(const char* data, unsigned int length)
+{
+   unsigned int done = 0;
+   ssize_t n;
+   while (done < length && !writeError)
+   {
+      n = write(fd, data+done, length-done);
+      if (n < 0 && errno == EINTR)
+         continue;
+      if (n <= 0)
+         writeError = 1;
+      else
+         done += n;
+   }
+   flushed += length;
+}
+
+/**
+ * Make sure length bytes fit in the buffer (length must not be
+ * larger than the buffer itself).
+ */
+void OutputBuffer::makeRoom(unsigned int length)
+{
+   if (used + length > size)
+      flush();
+}
+
+unsigned long OutputBuffer::getBytesWritten()
+{
+   return flushed + used;
+}
+
+unsigned int OutputBuffer::hasError()
+{
+   return writeError;
+}
+
+void OutputBuffer::putChar(char c)
+{
+   if (used == size)
+      flush();
+   buffer[used++] = c;
+}
+
+void OutputBuffer::putBytes(const char* data, unsigned int length)
+{
+   if (length > size)
+   {
+      // too big to buffer, send it straight through
+      flush();
+      writeOut(data, length);
+      return;
+   }
+   makeRoom(length);
+   memcpy(buffer+used, data, length);
+   used += length;
+}
+
+void OutputBuffer::putString(const char* str)
+{
+   putBytes(str, strlen(str));
+}
+
+/**
+ * Format an integer in hex, without a "0x" prefix.
+ * @param value is the number.
+ * @param minDigits is the minimum number of digits (zero padded).
+ */
+void OutputBuffer::putHex(unsigned long value, unsigned int minDigits)
+{
+   unsigned int digits, i;
+   char* p;
+   digits = value ? (sizeof(long)*8 - __builtin_clzl(value) + 3) / 4 : 1;
+   if (digits < minDigits)
+      digits = minDigits > 16 ? 16 : minDigits;
+   makeRoom(16);
+   p = buffer + used;
+   for (i=digits; i > 0; i--)
+   {
+      p[i-1] = hexDigits[value & 0xf];
+      value >>= 4;
+   }
+   used += digits;
+}
+
+void OutputBuffer::putDecimal(unsigned long value)
+{
+   char tmp[24];
+   char* p = tmp + sizeof(tmp);
+   unsigned int pair;
+   while (value >= 100)
+   {
+      pair = (value % 100) * 2;
+      value /= 100;
+      *--p = decimalPairs[pair+1];
+      *--p = decimalPairs[pair];
+   }
+   if (value >= 10)
+   {
+      *--p = decimalPairs[value*2+1];
+      *--p = decimalPairs[value*2];
+   }
+   else
+      *--p = '0' + value;
+   putBytes(p, tmp + sizeof(tmp) - p);
+}
+
+void OutputBuffer::putSigned(long value)
+{
+   if (value < 0)
+   {
+      putChar('-');
+      putDecimal(-(unsigned long) value);
+   }
+   else
+      putDecimal(value);
+}
+
+/**
+ * Write a string as a quoted JSON string. Runs of characters that
+ * need no escaping are copied in one go.
+ * @param str is the string (null is written as an empty string).
+ */
+void OutputBuffer::putJSONString(const char* str)
+{
+   const unsigned char* s = (const unsigned char*) (str ? str : "");
+   const unsigned char* run;
+   putChar('"');
+   while (*s)
+   {
+      run = s;
+      while (*s && !jsonEscape[*s])
+         s++;
+      if (s > run)
+         putBytes((const char*) run, s - run);
+      if (!*s)
+         break;
+      makeRoom(6);
+      buffer[used++] = '\\';
+      if (*s == '"' || *s == '\\')
+         buffer[used++] = *s;
+      else if (*s == '\n')
+         buffer[used++] = 'n';
+      else if (*s == '\t')
+         buffer[used++] = 't';
+      else
+      {
+         buffer[used++] = 'u';
+         buffer[used++] = '0';
+         buffer[used++] = '0';
+         buffer[used++] = hexDigits[*s >> 4];
+         buffer[used++] = hexDigits[*s & 0xf];
+      }
+      s++;
+   }
+   putChar('"');
+}
+
+/**
+ * Write a string as a CSV field; it is quoted (with embedded quotes
+ * doubled) only if it contains a comma, quote or line break.
+ * @param str is the string (null is written as an empty field).
+ */
+void OutputBuffer::putCSVString(const char* str)
+{
+   const char* s;
+   if (!str)
+      return;
+   s = str + strcspn(str, ",\"\r\n");
+   if (!*s)
+   {
+      putBytes(str, s - str);
+      return;
+   }
+   putChar('"');
+   for (s=str; *s; s++)
+   {
+      if (*s == '"')
+         putChar('"');
+      putChar(*s);
+   }
+   putChar('"');
+}
@@ -0,0 +1,477 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+#include <ElfProgram.h>
+
+//
+// Relocation types that fill GOT slots, per machine; the values are
+// the same as in <elf.h>, spelled out so that an object for another
+// machine can be read on any host
+//
+#define X86_64_GLOB_DAT    6
+#define X86_64_JUMP_SLOT   7
+#define X86_64_IRELATIVE   37
+#define AARCH64_GLOB_DAT   1025
+#define AARCH64_JUMP_SLOT  1026
+#define AARCH64_IRELATIVE  1032
+
+static const char* pltSectionNames[PLT_NUM_SECTIONS] = {
+   ".plt", ".plt.sec", ".plt.got"
+};
+
+/*
+ * Which kind of GOT slot a relocation fills (PLT_SLOT_*), or -1 if
+ * it is not one we map.
+ */
+static int slotKind(unsigned int machine, unsigned int type)
+{
+   if (machine == EM_X86_64)
+   {
+      if (type == X86_64_JUMP_SLOT) return PLT_SLOT_JUMP;
+      if (type == X86_64_GLOB_DAT) return PLT_SLOT_DATA;
+      if (type == X86_64_IRELATIVE) return PLT_SLOT_IRELATIVE;
+   }
+   else if (machine == EM_AARCH64)
+   {
+      if (type == AARCH64_JUMP_SLOT) return PLT_SLOT_JUMP;
+      if (type == AARCH64_GLOB_DAT) return PLT_SLOT_DATA;
+      if (type == AARCH64_IRELATIVE) return PLT_SLOT_IRELATIVE;
+   }
+   return -1;
+}
+
+/*
+ * True if a relocation fills a slot we map. JUMP_SLOTs are taken
+ * only from DT_JMPREL (table 0), in case DT_RELA overlaps it, as
+ * some linkers arrange.
+ */
+static int isSlotReloc(unsigned int machine, ElfW(Rela)* rela,
+                       unsigned int table)
+{
+   int kind = slotKind(machine, GEN_R_TYPE(rela->r_info));
+   return kind >= 0 && (table == 0 || kind != PLT_SLOT_JUMP);
+}
+
+/*
+ * Decode an x86-64 stub: an optional endbr64, an optional bnd prefix,
+ * then "jmp *disp32(%rip)". This covers lazy .plt entries, .plt.sec
+ * and .plt.got entries with and without IBT. The lazy .plt entries
+ * of an IBT PLT (push; bnd jmp .plt) have no GOT reference and do not
+ * decode, which is right: calls go through .plt.sec.
+ */
+static int decodeX86_64Stub(unsigned char* code, unsigned int size,
+                            ElfW(Addr) vaddr, ElfW(Addr)* target)
+{
+   unsigned int i = 0;
+   int disp;
+   if (size >= 4 && code[0] == 0xf3 && code[1] == 0x0f &&
+       code[2] == 0x1e && code[3] == 0xfa)
+      i = 4;
+   if (i < size && code[i] == 0xf2)
+      i++;
+   if (i + 6 > size || code[i] != 0xff || code[i+1] != 0x25)
+      return 0;
+   memcpy(&disp, code + i + 2, sizeof(disp));
+   *target = vaddr + i + 6 + disp;
+   return 1;
+}
+
+/*
+ * Decode an AArch64 stub: "adrp xN, page; ldr xM, [xN, #off]", which
+ * every PLT entry has (possibly after a "bti c"). The header (PLT0)
+ * decodes too, to GOT[2], which no relocation names, so it drops out.
+ */
+static int decodeAArch64Stub(unsigned char* code, unsigned int size,
+                             ElfW(Addr) vaddr, ElfW(Addr)* target)
+{
+   unsigned int i, insn, next;
+   long imm;
+   for (i=0; i + 8 <= size; i += 4)
+   {
+      memcpy(&insn, code + i, sizeof(insn));
+      if ((insn & 0x9f000000) != 0x90000000)
+         continue;
+      memcpy(&next, code + i + 4, sizeof(next));
+      if ((next & 0xffc00000) != 0xf9400000 ||
+          ((next >> 5) & 0x1f) != (insn & 0x1f))
+         continue;
+      imm = (long) ((((insn >> 5) & 0x7ffff) << 2) | ((insn >> 29) & 3));
+      if (imm & 0x100000)
+         imm -= 0x200000;
+      *target = ((vaddr + i) & ~(ElfW(Addr)) 0xfff) + (imm << 12) +
+                ((next >> 10) & 0xfff) * 8;
+      return 1;
+   }
+   return 0;
+}
+
+/**
+ * Build the map: collect the GOT slots named by the PLT and GLOB_DAT
+ * relocations, hash them by GOT address, then walk .plt, .plt.sec and
+ * .plt.got and tie each stub to the slot it jumps through.
+ * @param loadObject is the object to map.
+ */
+PLTMap::PLTMap(LoadObject* loadObject)
+{
+   DynamicSection* dyn = loadObject->getDynamicSection();
+   unsigned int machine = loadObject->getArchitectureType();
+   unsigned int tables[2] = { DT_JMPREL, DT_RELA };
+   unsigned int t, i, count, withAddends;
+   unsigned int* symSlot;
+   char *relocs, *strTable;
+   unsigned long strSize;
+   ElfW(Rela)* rela;
+   PLTSlot* slot;
+   int k;
+
+   this->loadObject = loadObject;
+   slots = 0;
+   numSlots = 0;
+   gotBuckets = gotChains = 0;
+   numGOTBuckets = 0;
+   jumpSlots = dataSlots = 0;
+   numSymbols = 0;
+   numStubs = 0;
+   memset(sections, 0, sizeof(sections));
+   if (!dyn)
+      return;
+   if (!loadObject->getDynamicSymbolTable(&numSymbols, &strTable, &strSize))
+      numSymbols = 0;
+
+   // count, then fill the slots; RELA tables only (every x86-64 and
+   // AArch64 object), REL ones are skipped
+   for (t=0; t < 2; t++)
+   {
+      relocs = dyn->getRelocationTable(tables[t], &count, &withAddends);
+      if (!relocs || !withAddends)
+         continue;
+      for (i=0, rela=(ElfW(Rela)*) relocs; i < count; i++, rela++)
+         if (isSlotReloc(machine, rela, t))
+            numSlots++;
+   }
+   if (!numSlots)
+      return;
+   slots = new PLTSlot[numSlots];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   numSlots = 0;
+   for (t=0; t < 2; t++)
+   {
+      relocs = dyn->getRelocationTable(tables[t], &count, &withAddends);
+      if (!relocs || !withAddends)
+         continue;
+      for (i=0, rela=(ElfW(Rela)*) relocs; i < count; i++, rela++)
+      {
+         if (!isSlotReloc(machine, rela, t))
+            continue;
+         k = slotKind(machine, GEN_R_TYPE(rela->r_info));
+         slot = &slots[numSlots++];
+         slot->gotVaddr = rela->r_offset;
+         slot->pltVaddr = 0;
+         slot->symIndex = GEN_R_SYM(rela->r_info);
+         slot->kind = k;
+         slot->pltSection = PLT_NUM_SECTIONS;
+      }
+   }
+
+   // GOT address hash, filled in reverse so chains list the first
+   // slot first
+   for (numGOTBuckets=16; numGOTBuckets < numSlots; numGOTBuckets <<= 1)
+      ;
+   gotBuckets = new unsigned int[numGOTBuckets];
+   gotChains = new unsigned int[numSlots];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   memset(gotBuckets, 0xff, sizeof(unsigned int) * numGOTBuckets);
+   for (i=numSlots; i > 0; i--)
+   {
+      k = gotHash(slots[i-1].gotVaddr);
+      gotChains[i-1] = gotBuckets[k];
+      gotBuckets[k] = i-1;
+   }
+
+   // .plt.sec goes last, so that for IBT PLTs the entry a symbol
+   // gets is the one calls go to
+   decodeSection(PLT_SECTION_PLT, SECTION_PLT, machine);
+   decodeSection(PLT_SECTION_GOT, SECTION_PLT_GOT, machine);
+   decodeSection(PLT_SECTION_SEC, SECTION_PLT_SEC, machine);
+
+   // symbol index -> slot (+1); the first slot of each kind wins
+   if (numSymbols)
+   {
+      jumpSlots = new unsigned int[numSymbols];
+      dataSlots = new unsigned int[numSymbols];
+      STATS_COUNT(STATS_ALLOCATIONS, 2);
+      memset(jumpSlots, 0, sizeof(unsigned int) * numSymbols);
+      memset(dataSlots, 0, sizeof(unsigned int) * numSymbols);
+      for (i=0; i < numSlots; i++)
+      {
+         if (!slots[i].symIndex || slots[i].symIndex >= numSymbols)
+            continue;
+         symSlot = slots[i].kind == PLT_SLOT_DATA ? dataSlots : jumpSlots;
+         if (!symSlot[slots[i].symIndex])
+            symSlot[slots[i].symIndex] = i + 1;
+      }
+   }
+}
+
+PLTMap::~PLTMap()
+{
+   unsigned int i;
+   delete[] slots;
+   delete[] gotBuckets;
+   delete[] gotChains;
+   delete[] jumpSlots;
+   delete[] dataSlots;
+   for (i=0; i < PLT_NUM_SECTIONS; i++)
+      delete[] sections[i].entrySlots;
+}
+
+unsigned int PLTMap::gotHash(ElfW(Addr) gotVaddr)
+{
+   return (unsigned int) (gotVaddr / sizeof(ElfW(Addr))) &
+          (numGOTBuckets - 1);
+}
+
+/*
+ * Decode every stub of one PLT section and record, both ways, which
+ * GOT slot it jumps through. Stubs are entry-size apart (16 bytes if
+ * the section header does not say).
+ */
+void PLTMap::decodeSection(unsigned int which, unsigned int wellKnown,
+                           unsigned int machine)
+{
+   ElfSection* sec = loadObject->getWellKnownSection(wellKnown);
+   PLTSection* ps = &sections[which];
+   unsigned char* code;
+   unsigned int i, entSize;
+   ElfW(Addr) vaddr, target;
+   PLTSlot* slot;
+   int decoded;
+   if (!sec || !sec->getSizeInBytes() ||
+       !(code = (unsigned char*) loadObject->getVaddrDataPtr(
+                                    sec->getVirtualAddress())))
+      return;
+   entSize = sec->getEntrySize();
+   if (!entSize || entSize > sec->getSizeInBytes())
+      entSize = 16;
+   ps->vaddr = sec->getVirtualAddress();
+   ps->size = sec->getSizeInBytes();
+   ps->entrySize = entSize;
+   ps->numEntries = ps->size / entSize;
+   ps->entrySlots = new unsigned int[ps->numEntries];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   memset(ps->entrySlots, 0, sizeof(unsigned int) * ps->numEntries);
+   for (i=0; i < ps->numEntries; i++, code += entSize)
+   {
+      vaddr = ps->vaddr + (ElfW(Addr)) i * entSize;
+      if (machine == EM_X86_64)
+         decoded = decodeX86_64Stub(code, entSize, vaddr, &target);
+      else if (machine == EM_AARCH64)
+         decoded = decodeAArch64Stub(code, entSize, vaddr, &target);
+      else
+         decoded = 0;
+      if (!decoded || !(slot = lookupGOT(target)))
+         continue;
+      ps->entrySlots[i] = (slot - slots) + 1;
+      slot->pltVaddr = vaddr;
+      slot->pltSection = which;
+      numStubs++;
+   }
+}
+
+PLTSlot* PLTMap::lookupGOT(ElfW(Addr) gotVaddr)
+{
+   unsigned int i;
+   if (!numSlots)
+      return 0;
+   for (i = gotBuckets[gotHash(gotVaddr)]; i != 0xffffffff;
+        i = gotChains[i])
+      if (slots[i].gotVaddr == gotVaddr)
+         return &slots[i];
+   return 0;
+}
+
+unsigned int PLTMap::getNumberOfSlots()
+{
+   return numSlots;
+}
+
+unsigned int PLTMap::getNumberOfStubs()
+{
+   return numStubs;
+}
+
+PLTSlot* PLTMap::getSlot(unsigned int index)
+{
+   return index < numSlots ? &slots[index] : 0;
+}
+
+/**
+ * Find the slot for a GOT entry.
+ * @param address is the run-time address of the GOT entry.
+ * @return The slot, or null if no relocation fills that entry.
+ */
+PLTSlot* PLTMap::findSlotByGOTEntry(char* address)
+{
+   return lookupGOT(loadObject->addressToVaddr(address));
+}
+
+/**
+ * Find the slot whose stub contains an address.
+ * @param address is a run-time address anywhere in a PLT stub.
+ * @return The slot, or null if the address is not in a decoded stub.
+ */
+PLTSlot* PLTMap::findSlotByPLTEntry(char* address)
+{
+   ElfW(Addr) vaddr = loadObject->addressToVaddr(address);
+   PLTSection* ps;
+   unsigned int i, n;
+   for (i=0; i < PLT_NUM_SECTIONS; i++)
+   {
+      ps = &sections[i];
+      if (!ps->entrySlots || vaddr < ps->vaddr ||
+          vaddr >= ps->vaddr + ps->size)
+         continue;
+      n = (vaddr - ps->vaddr) / ps->entrySize;
+      return (n < ps->numEntries && ps->entrySlots[n]) ?
+         &slots[ps->entrySlots[n] - 1] : 0;
+   }
+   return 0;
+}
+
+/**
+ * Tell whether an address is in one of the object's PLT sections.
+ * A GOT slot that still points there has not been resolved yet (it
+ * leads to the lazy binding code).
+ * @param address is a run-time address.
+ * @return True if it is inside .plt, .plt.sec or .plt.got.
+ */
+unsigned int PLTMap::isPLTAddress(char* address)
+{
+   ElfW(Addr) vaddr = loadObject->addressToVaddr(address);
+   unsigned int i;
+   for (i=0; i < PLT_NUM_SECTIONS; i++)
+      if (sections[i].size && vaddr >= sections[i].vaddr &&
+          vaddr < sections[i].vaddr + sections[i].size)
+         return 1;
+   return 0;
+}
+
+/**
+ * Find the PLT slot (JUMP_SLOT relocation) of a dynamic symbol.
+ * @param symIndex is the dynamic symbol table index.
+ * @return The slot, or null if the symbol has no PLT slot.
+ */
+PLTSlot* PLTMap::findJumpSlot(unsigned int symIndex)
+{
+   if (!jumpSlots || symIndex >= numSymbols || !jumpSlots[symIndex])
+      return 0;
+   return &slots[jumpSlots[symIndex] - 1];
+}
+
+/**
+ * Find the GOT slot (GLOB_DAT relocation) of a dynamic symbol.
+ * @param symIndex is the dynamic symbol table index.
+ * @return The slot, or null if the symbol has no such slot.
+ */
+PLTSlot* PLTMap::findDataSlot(unsigned int symIndex)
+{
+   if (!dataSlots || symIndex >= numSymbols || !dataSlots[symIndex])
+      return 0;
+   return &slots[dataSlots[symIndex] - 1];
+}
+
+char* PLTMap::getGOTEntry(PLTSlot* slot)
+{
+   return slot ? loadObject->vaddrToAddress(slot->gotVaddr) : 0;
+}
+
+char* PLTMap::getPLTEntry(PLTSlot* slot)
+{
+   return (slot && slot->pltVaddr) ?
+      loadObject->vaddrToAddress(slot->pltVaddr) : 0;
+}
+
+/**
+ * Find where a live object's calls to one of its imports end up: the
+ * value of its PLT or GLOB_DAT slot if the dynamic linker has filled
+ * either, else what resolveImport() finds.
+ * @param symIndex is the dynamic symbol table index of the import.
+ * @return The run-time address, or 0 if it cannot be found.
+ */
+ElfW(Addr) PLTMap::getImportTarget(unsigned int symIndex)
+{
+   PLTSlot* found[2];
+   ElfW(Addr) value;
+   unsigned int k;
+   if (loadObject->isFileImage() || loadObject->isSnapshotObject())
+      return 0;
+   found[0] = findJumpSlot(symIndex);
+   found[1] = findDataSlot(symIndex);
+   for (k=0; k < 2; k++)
+   {
+      if (!found[k])
+         continue;
+      value = *(ElfW(Addr)*) getGOTEntry(found[k]);
+      if (value && !isPLTAddress((char*) value))
+         return value;
+   }
+   return resolveImport(symIndex);
+}
+
+/**
+ * Look up an import of a live object the way the dynamic linker
+ * binds it, whatever its GOT slots hold: in the object itself first
+ * if it was linked -Bsymbolic, then the versioned (or plain)
+ * definition in the global scope, then in the object's own
+ * dependencies (its local scope, for objects dlopen()ed without
+ * RTLD_GLOBAL).
+ * @param symIndex is the dynamic symbol table index of the import.
+ * @return The run-time address, or 0 if it cannot be found.
+ */
+ElfW(Addr) PLTMap::resolveImport(unsigned int symIndex)
+{
+   DynamicSection* dyn = loadObject->getDynamicSection();
+   ElfW(Sym)* syms;
+   unsigned int numSyms, type;
+   char *name, *version;
+   void *handle, *addr;
+   if (loadObject->isFileImage() || loadObject->isSnapshotObject() || !dyn)
+      return 0;
+   syms = dyn->getSymbolTable(&numSyms);
+   if (!syms || symIndex >= numSyms)
+      return 0;
+   type = GEN_ST_TYPE(syms[symIndex].st_info);
+   if ((dyn->hasEntry(DT_SYMBOLIC) || (dyn->getFlags() & DF_SYMBOLIC)) &&
+       syms[symIndex].st_shndx != SHN_UNDEF && type != STT_GNU_IFUNC &&
+       type != STT_TLS)
+      return (ElfW(Addr)) loadObject->vaddrToAddress(syms[symIndex].st_value);
+   name = dyn->getSymbolString(syms + symIndex);
+   version = dyn->getSymbolVersionName(symIndex);
+   addr = version ? dlvsym(RTLD_DEFAULT, name, version) :
+                    dlsym(RTLD_DEFAULT, name);
+   if (!addr && loadObject->getName() &&
+       (handle = dlopen(loadObject->getName(), RTLD_LAZY | RTLD_NOLOAD)))
+   {
+      addr = version ? dlvsym(handle, name, version) : dlsym(handle, name);
+      dlclose(handle);
+   }
+   return (ElfW(Addr)) addr;
+}
+
+const char* PLTMap::getSectionName(unsigned int which)
+{
+   return which < PLT_NUM_SECTIONS ? pltSectionNames[which] : "";
+}
+
+unsigned long PLTMap::getMemoryUsage()
+{
+   unsigned long bytes;
+   unsigned int i;
+   bytes = sizeof(PLTSlot) * numSlots +
+           sizeof(unsigned int) * (numGOTBuckets + numSlots) +
+           (jumpSlots ? 2 * sizeof(unsigned int) * numSymbols : 0);
+   for (i=0; i < PLT_NUM_SECTIONS; i++)
+      bytes += sizeof(unsigned int) * sections[i].numEntries;
+   return bytes;
+}
@@ -0,0 +1,74 @@
+#include <unistd.h>
+#include <pthread.h>
+#include <ElfProgram.h>
+
+/*
+ * A loop being run: the items are handed out from nextItem, and
+ * each thread takes a worker number from nextWorker.
+ */
+struct ParallelLoop
+{
+   ParallelWork work;
+   void* arg;
+   unsigned int count;
+   unsigned int nextItem;
+   unsigned int nextWorker;
+};
+
+static void* parallelThread(void* arg)
+{
+   ParallelLoop* loop = (ParallelLoop*) arg;
+   unsigned int worker = __sync_fetch_and_add(&loop->nextWorker, 1);
+   unsigned int i;
+   while ((i = __sync_fetch_and_add(&loop->nextItem, 1)) < loop->count)
+      loop->work(loop->arg, i, worker);
+   return 0;
+}
+
+/**
+ * Get the number of threads a loop would run on.
+ * @param numThreads is the thread count asked for (0 means one per CPU).
+ * @param count is the number of items.
+ * @return At most count threads, and at least one.
+ */
+unsigned int ParallelFor::getThreadCount(unsigned int numThreads,
+                                         unsigned int count)
+{
+   if (!numThreads)
+      numThreads = sysconf(_SC_NPROCESSORS_ONLN);
+   if (numThreads > count)
+      numThreads = count;
+   return numThreads ? numThreads : 1;
+}
+
+/**
+ * Call work(arg, i, worker) for every i below count, and return when
+ * all are done. If threads cannot be started, the ones that were (or
+ * only the caller) do the whole loop.
+ * @param count is the number of items.
+ * @param numThreads is the thread count (0 means one per CPU).
+ * @param work is called for each item.
+ * @param arg is passed to work.
+ */
+void ParallelFor::run(unsigned int count, unsigned int numThreads,
+                      ParallelWork work, void* arg)
+{
+   ParallelLoop loop;
+   pthread_t* threads;
+   unsigned int i, started;
+   loop.work = work;
+   loop.arg = arg;
+   loop.count = count;
+   loop.nextItem = 0;
+   loop.nextWorker = 0;
+   numThreads = getThreadCount(numThreads, count);
+   threads = new pthread_t[numThreads];
+   started = 0;
+   for (i=1; i < numThreads; i++)
+      if (!pthread_create(&threads[started], 0, parallelThread, &loop))
+         started++;
+   parallelThread(&loop);
+   for (i=0; i < started; i++)
+      pthread_join(threads[i], 0);
+   delete[] threads;
+}
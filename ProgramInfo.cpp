@@ -4,6 +4,7 @@
 #include <unistd.h>
 #include <string.h>
 #include <dlfcn.h>
+#include <limits.h>
 #include <ElfProgram.h>
 
 /*
@@ -15,9 +16,47 @@ typedef struct _mapinfo_struct
       char* startAddress;
       char* endAddress;
       unsigned int permissions;
-      char objectName[64];
+      char objectName[256];
 } MapObject;
 
+/*
+ * Address range of one object, for findObjectByAddress().
+ */
+struct ObjectRange
+{
+   char* start;           // ELF header
+   char* end;             // past the last PT_LOAD segment (bss too)
+   LoadObject* object;
+};
+
+static int compareRanges(const void* a, const void* b)
+{
+   const ObjectRange* x = (const ObjectRange*) a;
+   const ObjectRange* y = (const ObjectRange*) b;
+   return (x->start > y->start) - (x->start < y->start);
+}
+
+/*
+ * Position of one object in load order, for getObjectsInLoadOrder().
+ */
+struct OrderedObject
+{
+   LoadObject* object;
+   int order;             // link map index (objects not in it go last)
+   unsigned int seq;      // position in loadedObjects
+};
+
+static int compareOrder(const void* a, const void* b)
+{
+   const OrderedObject* x = (const OrderedObject*) a;
+   const OrderedObject* y = (const OrderedObject*) b;
+   unsigned int xo = x->order < 0 ? ~0U : x->order;
+   unsigned int yo = y->order < 0 ? ~0U : y->order;
+   if (xo != yo)
+      return (xo > yo) - (xo < yo);
+   return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
 /**
  * No-arg constructor: reads the current processes' maps file
  * and initializes everything about it from there. The maps file
@@ -30,54 +69,83 @@ ProgramInfo::ProgramInfo(void)
 {
    FILE *mapFile;
    char mapFilename[256];
-   char line[128];
-   MapObject mapObjects[32];
-   int numObjects, i;
+   char line[512];
+   char perms[8];
+   char *start, *end, *path;
+   unsigned long offset;
+   MapObject *mapObjects;
+   int numObjects, maxObjects, namePos, i;
 
    name=0;
    loadedObjects = 0;
+   tracer = 0;
+   objectRanges = 0;
+   numObjectRanges = 0;
    //symbols = 0;
    pid = getpid();
+   stats = STATS_ENABLED ? new LoadStats() : 0;
+   LoadStatsScope statsScope(stats);
 
    sprintf(mapFilename,"/proc/%d/maps",pid);
    //printf("my map file is (%s)\n",mapFilename);
    //sprintf(line, "/bin/cat %s", mapFilename);
    //system(line);
 
+   STATS_PHASE_BEGIN(mapsStart);
    mapFile = fopen(mapFilename,"r");
+   STATS_COUNT(STATS_FILE_OPENS, 1);
    if (!mapFile)
       return;
 
    numObjects = 0;
+   maxObjects = 32;
+   mapObjects = new MapObject[maxObjects];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
    while (fgets(line, sizeof(line), mapFile) != 0)
    {
-      unsigned int xpos = 0;
-      line[strlen(line)-1] = '\0';
+      //08048000-0804a000 r-xp 00000000 03:01 227437     /opt/kde3/bin/kwrapper
+      STATS_COUNT(STATS_BYTES_READ, strlen(line));
+      line[strcspn(line, "\n")] = '\0';
       //printf("line read: (%s)\n", line);
-      xpos = strchr(line, 'x') - line;
-      if (xpos > 30 || xpos < 20)
-      {
-         //printf("not executable: skipping\n");
+      namePos = 0;
+      if (sscanf(line,"%p-%p %7s %lx %*s %*s %n", &start, &end, perms,
+                 &offset, &namePos) < 4 || !namePos)
+         continue;
+      path = line + namePos;
+      // anonymous maps (bss, heap) and kernel maps other than the
+      // vdso are not objects
+      if (!*path || (*path == '[' && strcmp(path, "[vdso]")))
          continue;
-      }
-      //08048000-0804a000 r-xp 00000000 03:01 227437     /opt/kde3/bin/kwrapper
-      sscanf(line,"%p-%p", &mapObjects[numObjects].startAddress,
-             &mapObjects[numObjects].endAddress);
-      strcpy(mapObjects[numObjects].objectName,line+49);
       //
-      // if just another map of same object, then concatenate
+      // if just another map of same object, then extend it; objects
+      // are mapped as several segments (r--, r-x, rw-), possibly
+      // with anonymous bss maps in between
       //  -- should keep track of permissions, though
-      //  -- skipping non-exec maps above moots this
       //
-      if (numObjects > 0 && !strcmp(mapObjects[numObjects].objectName,
-                                    mapObjects[numObjects-1].objectName) &&
-          mapObjects[numObjects-1].endAddress == 
-          mapObjects[numObjects].startAddress)
+      if (numObjects > 0 && 
+          !strcmp(path, mapObjects[numObjects-1].objectName) &&
+          mapObjects[numObjects-1].endAddress <= start)
+      {
+         mapObjects[numObjects-1].endAddress = end;
+         continue;
+      }
+      // the ELF header is in the map of file offset zero
+      if (offset != 0 || perms[0] != 'r')
+         continue;
+      if (numObjects >= maxObjects)
       {
-         mapObjects[numObjects-1].endAddress = 
-            mapObjects[numObjects].endAddress;
-         numObjects--;
+         MapObject *tmp;
+         maxObjects *= 2;
+         tmp = new MapObject[maxObjects];
+         STATS_COUNT(STATS_ALLOCATIONS, 1);
+         memcpy(tmp,mapObjects,sizeof(MapObject)*numObjects);
+         delete[] mapObjects;
+         mapObjects = tmp;
       }
+      mapObjects[numObjects].startAddress = start;
+      mapObjects[numObjects].endAddress = end;
+      snprintf(mapObjects[numObjects].objectName,
+               sizeof(mapObjects[numObjects].objectName), "%s", path);
       /*
          printf("map %p %p (%s)\n---\n", 
              mapObjects[numObjects].startAddress,
@@ -87,6 +155,7 @@ ProgramInfo::ProgramInfo(void)
       numObjects++;
    }
    fclose(mapFile);
+   STATS_PHASE_END(STATS_PHASE_MAPS, mapsStart);
    LoadObject *lo=0, *tail=0;
    for (i=0; i < numObjects; i++)
    {
@@ -108,6 +177,7 @@ ProgramInfo::ProgramInfo(void)
          loadedObjects = tail = lo;
       }
    }
+   delete[] mapObjects;
    return;
 }
 
@@ -120,10 +190,45 @@ ProgramInfo::ProgramInfo(char *objFilename)
    name = 0;
    pid = -1;
    loadedObjects = 0;
+   stats = 0;
+   tracer = 0;
+   objectRanges = 0;
+   numObjectRanges = 0;
    //symbols = 0;
    return;
 }
 
+/**
+ * Build a read-only program from a snapshot written by
+ * ProgramSnapshot::writeSnapshot(). The LoadObjects read their data
+ * in place from the snapshot, which must outlive this object.
+ * @param snapshot is the loaded snapshot.
+ */
+ProgramInfo::ProgramInfo(ProgramSnapshot* snapshot)
+{
+   LoadObject *lo, *tail=0;
+   unsigned int i;
+   name = snapshot->getProgramName();
+   pid = snapshot->getProcessId();
+   loadedObjects = 0;
+   tracer = 0;
+   objectRanges = 0;
+   numObjectRanges = 0;
+   stats = STATS_ENABLED ? new LoadStats() : 0;
+   LoadStatsScope statsScope(stats);
+   for (i=0; i < snapshot->getNumberOfObjects(); i++)
+   {
+      lo = new LoadObject(snapshot, i);
+      if (tail)
+      {
+         tail->next = lo;
+         tail = lo;
+      } else {
+         loadedObjects = tail = lo;
+      }
+   }
+}
+
 /**
  * Print out debugging information. Loops through LoadObjects and
  * asks each to print out its own debug info.
@@ -139,10 +244,200 @@ void ProgramInfo::debugPrintInfo()
 }
 
 /**
- * Not implemented: need to delete a whole bunch of stuff.
+ * Delete all the load objects, and with them everything they read.
  */
 ProgramInfo::~ProgramInfo()
 {
+   LoadObject *lo, *next;
+   delete tracer;
+   delete[] objectRanges;
+   for (lo=loadedObjects; lo; lo = next)
+   {
+      next = lo->next;
+      delete lo;
+   }
+   delete stats;
+}
+
+/**
+ * Get the program's call tracer, made the first time it is asked
+ * for and deleted (tracing disabled) with the program. Symbols added
+ * with CallTracer::addProgramSymbol() are traced in every object.
+ * @return The tracer.
+ */
+CallTracer* ProgramInfo::getCallTracer()
+{
+   if (!tracer)
+      tracer = new CallTracer();
+   return tracer;
+}
+
+/**
+ * Find the object an address belongs to, such as the target of a GOT
+ * slot. The objects' ranges run from their ELF header to the end of
+ * their last loadable segment; they are sorted once, on first use.
+ * @param address is a run-time address.
+ * @return The object, or null if the address is in none of them.
+ */
+LoadObject* ProgramInfo::findObjectByAddress(char* address)
+{
+   unsigned int low = 0, high, mid, n = 0, i;
+   ElfSegment* seg;
+   ElfW(Phdr)* ph;
+   LoadObject* lo;
+   char* end;
+   if (!objectRanges)
+   {
+      for (lo=loadedObjects; lo; lo = lo->next)
+         n++;
+      objectRanges = new ObjectRange[n ? n : 1];
+      STATS_COUNT(STATS_ALLOCATIONS, 1);
+      for (lo=loadedObjects; lo; lo = lo->next)
+      {
+         objectRanges[numObjectRanges].start = lo->getBaseAddress();
+         objectRanges[numObjectRanges].end = lo->getHighAddress();
+         objectRanges[numObjectRanges].object = lo;
+         for (i=0; !lo->isFileImage() && (seg = lo->getSegment(i)); i++)
+         {
+            ph = seg->getSegmentHeader();
+            if (ph->p_type != PT_LOAD)
+               continue;
+            end = lo->vaddrToAddress(ph->p_vaddr + ph->p_memsz);
+            if (end > objectRanges[numObjectRanges].end)
+               objectRanges[numObjectRanges].end = end;
+         }
+         numObjectRanges++;
+      }
+      qsort(objectRanges, numObjectRanges, sizeof(ObjectRange),
+            compareRanges);
+   }
+   high = numObjectRanges;
+   while (low < high)
+   {
+      mid = (low + high) / 2;
+      if (objectRanges[mid].start <= address)
+         low = mid + 1;
+      else
+         high = mid;
+   }
+   if (low && address < objectRanges[low-1].end)
+      return objectRanges[low-1].object;
+   return 0;
+}
+
+/**
+ * List the live objects in load order, which is the dynamic linker's
+ * link map order (the executable first, then preloads, then the
+ * libraries breadth first as they were loaded). For objects loaded
+ * at startup this is also the global symbol search order. Objects
+ * the link map does not know go last, in list order; file images and
+ * snapshot objects are left out.
+ * @param count is a return parameter set to the number of objects.
+ * @return A new[]'d array (the caller deletes it).
+ */
+LoadObject** ProgramInfo::getObjectsInLoadOrder(unsigned int* count)
+{
+   OrderedObject* ordered;
+   LoadObject** objects;
+   LoadObject* lo;
+   unsigned int i, n = 0;
+   for (lo=loadedObjects; lo; lo = lo->next)
+      if (!lo->isFileImage() && !lo->isSnapshotObject())
+         n++;
+   ordered = new OrderedObject[n ? n : 1];
+   objects = new LoadObject*[n ? n : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   n = 0;
+   for (lo=loadedObjects; lo; lo = lo->next)
+   {
+      if (lo->isFileImage() || lo->isSnapshotObject())
+         continue;
+      ordered[n].object = lo;
+      ordered[n].order = lo->getLinkMapIndex();
+      ordered[n].seq = n;
+      n++;
+   }
+   qsort(ordered, n, sizeof(OrderedObject), compareOrder);
+   for (i=0; i < n; i++)
+      objects[i] = ordered[i].object;
+   delete[] ordered;
+   *count = n;
+   return objects;
+}
+
+LoadStats* ProgramInfo::getStats()
+{
+   return stats;
+}
+
+/**
+ * Add up the statistics of the program and all its objects,
+ * including any separate debug objects they loaded.
+ * @param totals is reset and then receives the sum.
+ */
+void ProgramInfo::getTotalStats(LoadStats* totals)
+{
+   LoadObject* lo;
+   totals->reset();
+   totals->add(stats);
+   for (lo=loadedObjects; lo; lo = lo->next)
+   {
+      totals->add(lo->getStats());
+      if (lo->getDebugObject())
+         totals->add(lo->getDebugObject()->getStats());
+   }
+}
+
+/**
+ * Write a statistics report: the program's own record, one record
+ * per object (with its debug object, if any), and the totals.
+ * Nothing is written if statistics were off when it was built.
+ * @param out is where the report goes.
+ */
+void ProgramInfo::writeStatsReport(OutputBuffer* out)
+{
+   LoadObject* lo;
+   LoadStats totals, objectStats;
+   char title[PATH_MAX+16];
+   if (!stats)
+      return;
+   stats->writeReport(out, "program");
+   for (lo=loadedObjects; lo; lo = lo->next)
+   {
+      objectStats.reset();
+      objectStats.add(lo->getStats());
+      if (lo->getDebugObject())
+         objectStats.add(lo->getDebugObject()->getStats());
+      snprintf(title, sizeof(title), "object %s", lo->getName());
+      objectStats.writeReport(out, title);
+   }
+   getTotalStats(&totals);
+   totals.writeReport(out, "total");
+}
+
+/**
+ * Add up the heap memory held by all load objects.
+ * @param category is a LoadMemoryCategory, or -1 for all of them.
+ * @return Number of bytes.
+ */
+unsigned long ProgramInfo::getMemoryUsage(int category)
+{
+   LoadObject* lo;
+   unsigned long bytes = 0;
+   int i;
+   if (category < 0)
+   {
+      for (i=0; i < MEM_NUM_CATEGORIES; i++)
+         bytes += getMemoryUsage(i);
+      return bytes;
+   }
+   if (category == MEM_OBJECTS)
+      bytes = sizeof(ProgramInfo);
+   if (category == MEM_OTHER && stats)
+      bytes = sizeof(LoadStats);
+   for (lo=loadedObjects; lo; lo = lo->next)
+      bytes += lo->getMemoryUsage(category);
+   return bytes;
 }
 
 /**
@@ -168,7 +463,8 @@ int ProgramInfo::addProgramSymbol(void)
  * Find all definitions of a symbol throughout the program. 
  * This function iterates over the load objects and finds all 
  * dynamic exported instances of a symbol.
- * @param symbolName is the string name of the symbol.
+ * @param symbolName is the string name of the symbol, optionally with
+ *        a version ("name@VER" or "name@@VER").
  * @param numDefs is a return parameter set to the number of defs found.
  * @return An array of ElfSymbol objects (use delete, not delete[])
  */
@@ -177,20 +473,15 @@ ElfSymbol** ProgramInfo::findSymbolDefinitions(char* symbolName, int* numDefs)
    LoadObject *lo;
    ElfSymbol *sym;
    ElfSymbol **defs;
-   unsigned int iter, defcnt=0, defarr=5;
+   unsigned int defcnt=0, defarr=5;
 
    defs = new ElfSymbol*[defarr];
    lo = loadedObjects;
    while (lo)
    {
-      sym = lo->startDynamicSymbolIter(&iter);
-      while (sym)
-      {
-         if (!strcmp(sym->getName(), symbolName))
-            break;
-         sym = lo->nextDynamicSymbolIter(&iter);
-      }
-      // how does the below tell if definition??!?? (need to document)
+      sym = lo->findDynamicSymbolByName(symbolName);
+      // defined in a real section (not undefined, and not SHN_ABS or
+      // one of the other reserved indexes)
       if (sym && sym->getSHIndex()!=0 && sym->getSHIndex()<1000) 
       {
          if (defcnt >= defarr)
@@ -204,6 +495,8 @@ ElfSymbol** ProgramInfo::findSymbolDefinitions(char* symbolName, int* numDefs)
          }
          defs[defcnt++] = sym;
       }
+      else
+         delete sym;
       lo = lo->next;
    }
    *numDefs = defcnt;
@@ -214,7 +507,8 @@ ElfSymbol** ProgramInfo::findSymbolDefinitions(char* symbolName, int* numDefs)
  * Find all symbol uses throughout the program. This function iterates
  * over the load objects and finds all external references to a dynamic
  * symbol.
- * @param symbolName is the string name of the symbol.
+ * @param symbolName is the string name of the symbol, optionally with
+ *        a version ("name@VER" or "name@@VER").
  * @param numUses is a return parameter set to the number of uses found.
  * @return An array of ElfSymbol objects (use delete, not delete[])
  */
@@ -223,19 +517,13 @@ ElfSymbol** ProgramInfo::findSymbolUses(char* symbolName, int* numUses)
    LoadObject *lo;
    ElfSymbol *sym;
    ElfSymbol **uses;
-   unsigned int iter, usecnt=0, usearr=10;
+   unsigned int usecnt=0, usearr=10;
 
    uses = new ElfSymbol*[usearr];
    lo = loadedObjects;
    while (lo)
    {
-      sym = lo->startDynamicSymbolIter(&iter);
-      while (sym)
-      {
-         if (!strcmp(sym->getName(), symbolName))
-            break;
-         sym = lo->nextDynamicSymbolIter(&iter);
-      }
+      sym = lo->findDynamicSymbolByName(symbolName);
       // way to tell if use: the symbol has no section defined for it
       // (there should be a better way?)
       if (sym && sym->getSHIndex()==0) 
@@ -251,6 +539,8 @@ ElfSymbol** ProgramInfo::findSymbolUses(char* symbolName, int* numUses)
          }
          uses[usecnt++] = sym;
       }
+      else
+         delete sym;
       lo = lo->next;
    }
    *numUses = usecnt;
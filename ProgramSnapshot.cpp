@@ -0,0 +1,578 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <ElfProgram.h>
+
+/*
+ * On-disk layout. Everything is native endian and addressed by
+ * offset from the start of the file:
+ *
+ *   SnapshotHeader
+ *   raw data of all blocks (each at a file offset congruent to its
+ *   address mod 16, so tables keep their alignment when mapped)
+ *   SnapshotObject table
+ *   SnapshotBlock table (per object, sorted by kind then address)
+ *   string pool
+ *   SnapshotTable directory (numTables entries)
+ *
+ * A reader only needs the header and the directory. Entry sizes are
+ * recorded as a check only: a table whose entries are not exactly the
+ * size this version uses is rejected, and layout changes bump
+ * SNAPSHOT_VERSION.
+ */
+#define SNAPSHOT_MAGIC   "ELFRSNAP"
+#define SNAPSHOT_VERSION 2
+
+enum SnapshotTableTag
+{
+   SNAPSHOT_TABLE_OBJECTS = 1,
+   SNAPSHOT_TABLE_BLOCKS = 2,
+   SNAPSHOT_TABLE_STRINGS = 3,
+   SNAPSHOT_TABLE_DATA = 4,
+   SNAPSHOT_NUM_TABLES = 4
+};
+
+struct SnapshotHeader
+{
+   char magic[8];          // SNAPSHOT_MAGIC
+   uint32_t version;       // SNAPSHOT_VERSION
+   uint32_t headerSize;    // sizeof(SnapshotHeader)
+   uint64_t fileSize;      // total file size
+   uint16_t elfClass;      // ELFCLASS32/64 of the captured process
+   uint16_t machine;       // e_machine of the captured process
+   uint32_t pid;           // captured process id
+   uint64_t captureTime;   // seconds since the epoch
+   uint64_t programName;   // string pool offset
+   uint64_t tableOffset;   // offset of the table directory
+   uint32_t numTables;     // entries in the table directory
+   uint32_t reserved;
+};
+
+struct SnapshotTable
+{
+   uint32_t tag;           // SnapshotTableTag
+   uint32_t entrySize;     // size of one entry (1 for byte tables)
+   uint64_t offset;        // file offset of the table
+   uint64_t count;         // number of entries
+};
+
+struct SnapshotObject
+{
+   uint64_t name;          // string pool offset
+   uint64_t baseAddress;   // runtime start address
+   uint64_t highAddress;   // runtime end address
+   uint64_t firstBlock;    // index of first block in block table
+   uint32_t numBlocks;     // number of blocks of this object
+   int32_t linkMapIndex;   // position in link-map list, or -1
+};
+
+struct SnapshotBlock
+{
+   uint32_t kind;          // SnapshotBlockKind
+   uint32_t reserved;
+   uint64_t address;       // runtime address or file offset
+   uint64_t size;          // size in bytes
+   uint64_t data;          // file offset of the data
+};
+
+/*
+ * A block while the snapshot is being put together.
+ */
+struct PendingBlock
+{
+   uint32_t kind;
+   uint64_t address;
+   uint64_t size;
+   const char* source;
+   uint64_t data;
+};
+
+static int comparePendingBlocks(const void* a, const void* b)
+{
+   const PendingBlock* x = (const PendingBlock*) a;
+   const PendingBlock* y = (const PendingBlock*) b;
+   if (x->kind != y->kind)
+      return (x->kind < y->kind) ? -1 : 1;
+   if (x->address != y->address)
+      return (x->address < y->address) ? -1 : 1;
+   return (x->size > y->size) ? -1 : (x->size < y->size);
+}
+
+/*
+ * Growable list of pending blocks.
+ */
+struct PendingList
+{
+   PendingBlock* blocks;
+   unsigned long count;
+   unsigned long max;
+};
+
+static void addPending(PendingList* list, uint32_t kind, uint64_t address,
+                       uint64_t size, const char* source)
+{
+   PendingBlock* tmp;
+   if (!size || !source)
+      return;
+   if (list->count >= list->max)
+   {
+      list->max = list->max ? list->max*2 : 256;
+      tmp = new PendingBlock[list->max];
+      if (list->count)
+         memcpy(tmp, list->blocks, sizeof(PendingBlock)*list->count);
+      delete[] list->blocks;
+      list->blocks = tmp;
+   }
+   list->blocks[list->count].kind = kind;
+   list->blocks[list->count].address = address;
+   list->blocks[list->count].size = size;
+   list->blocks[list->count].source = source;
+   list->blocks[list->count].data = 0;
+   list->count++;
+}
+
+/*
+ * Section contents worth keeping: everything that is loaded and
+ * describes linking (dynamic, symbols, strings, hashes, relocations,
+ * versions, notes, init arrays), plus the GOT/PLT and .interp.
+ * Code and ordinary data are not kept.
+ */
+static int isCapturedSection(ElfSection* sec, char* name)
+{
+   if (!sec->isLoadedInMemory() || sec->isProgramSpaceNoBits() ||
+       sec->getType() >= SHT_LOPROC || !sec->getSizeInBytes())
+      return 0;
+   if (!sec->isProgramBits())
+      return 1;
+   return name && (!strncmp(name, ".got", 4) || !strncmp(name, ".plt", 4) ||
+                   !strcmp(name, ".interp"));
+}
+
+/*
+ * Collect the blocks of one live object, then sort them and merge
+ * overlapping memory ranges so each address is in at most one block.
+ */
+static void collectObjectBlocks(LoadObject* lo, PendingList* list)
+{
+   unsigned long first = list->count, i, j;
+   unsigned int n, count;
+   ElfSection* sec;
+   ElfSegment* seg;
+   ElfW(Ehdr)* ehdr = (ElfW(Ehdr)*) lo->getBaseAddress();
+   ElfW(Addr) bias = lo->getLoadBias();
+   char *shstrtab, *strtab;
+   unsigned long strtabSize;
+   ElfW(Sym)* symtab;
+
+   addPending(list, SNAPSHOT_MEMORY_BLOCK, (uint64_t) ehdr,
+              ehdr->e_phoff + lo->getNumberOfSegments()*ehdr->e_phentsize,
+              (char*) ehdr);
+   for (n=0; (seg = lo->getSegment(n)); n++)
+   {
+      if (seg->isDynamicInfo() || seg->isNote() || seg->isInterpreter())
+         addPending(list, SNAPSHOT_MEMORY_BLOCK,
+                    bias + (ElfW(Addr)) seg->getVirtualAddress(),
+                    seg->getFileSize(),
+                    (char*) bias + (ElfW(Addr)) seg->getVirtualAddress());
+   }
+   sec = lo->getSection(0);
+   if (sec)
+      addPending(list, SNAPSHOT_FILE_BLOCK, lo->getSectionTableOffset(),
+                 lo->getSectionHeaderSize()*lo->getNumberOfSections(),
+                 (char*) sec->getSectionHeader());
+   shstrtab = 0;
+   if ((sec = lo->getSection(lo->getSectionHeaderStringIndex())))
+      shstrtab = sec->getSectionDataPtr();
+   for (n=0; (sec = lo->getSection(n)); n++)
+   {
+      if (isCapturedSection(sec, sec->getName(shstrtab)))
+         addPending(list, SNAPSHOT_MEMORY_BLOCK,
+                    (uint64_t) sec->getBaseAddress(), sec->getSizeInBytes(),
+                    sec->getBaseAddress());
+      else if (!sec->isLoadedInMemory() &&
+               (sec->isSymbolTable() || sec->isStringTable()))
+         addPending(list, SNAPSHOT_FILE_BLOCK, sec->getFileOffset(),
+                    sec->getSizeInBytes(), sec->getSectionDataPtr());
+   }
+   symtab = lo->getStaticSymbolTable(&count, &strtab, &strtabSize);
+   if (symtab && strtab)
+   {
+      addPending(list, SNAPSHOT_SYMTAB_BLOCK, 0, count*sizeof(ElfW(Sym)),
+                 (char*) symtab);
+      addPending(list, SNAPSHOT_STRTAB_BLOCK, 0, strtabSize, strtab);
+   }
+
+   qsort(list->blocks + first, list->count - first, sizeof(PendingBlock),
+         comparePendingBlocks);
+   // merge overlapping or touching memory blocks (live memory is
+   // contiguous there); drop file blocks contained in another one
+   for (i=first, j=first; i < list->count; i++)
+   {
+      PendingBlock* cur = &list->blocks[i];
+      PendingBlock* last = (j > first) ? &list->blocks[j-1] : 0;
+      if (last && last->kind == cur->kind &&
+          cur->address <= last->address + last->size &&
+          (cur->kind == SNAPSHOT_MEMORY_BLOCK ||
+           cur->address + cur->size <= last->address + last->size))
+      {
+         if (cur->address + cur->size > last->address + last->size)
+            last->size = cur->address + cur->size - last->address;
+         continue;
+      }
+      list->blocks[j++] = *cur;
+   }
+   list->count = j;
+}
+
+/**
+ * Write a snapshot of a live program. All sizes are known up front,
+ * so the file is written front to back in one pass: header, block
+ * data copied straight from process memory, then the tables.
+ * @param program is the program (live, not file or snapshot based).
+ * @param snapshotFilename is the file to create.
+ * @return Zero on success, -1 on error.
+ */
+int ProgramSnapshot::writeSnapshot(ProgramInfo* program,
+                                   char* snapshotFilename)
+{
+   PendingList list = {0, 0, 0};
+   LoadObject* lo;
+   unsigned int numObjects = 0, i;
+   unsigned long b, pos, stringsSize;
+   SnapshotHeader hdr;
+   SnapshotTable tables[SNAPSHOT_NUM_TABLES];
+   SnapshotObject* objs;
+   SnapshotBlock blk;
+   static const char zeros[16] = {0};
+   char* progName;
+   FILE* fp;
+   int rc = 0;
+
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+   {
+      if (lo->isFileImage() || lo->isSnapshotObject())
+         return -1;
+      numObjects++;
+   }
+   objs = new SnapshotObject[numObjects];
+   progName = program->name ? program->name : (program->loadedObjects ?
+                                  program->loadedObjects->getName() : 0);
+   stringsSize = progName ? strlen(progName) + 1 : 1;
+   for (lo = program->loadedObjects, i = 0; lo; lo = lo->next, i++)
+   {
+      objs[i].name = stringsSize;
+      stringsSize += strlen(lo->getName()) + 1;
+      objs[i].baseAddress = (uint64_t) lo->getBaseAddress();
+      objs[i].highAddress = (uint64_t) lo->getHighAddress();
+      objs[i].firstBlock = list.count;
+      collectObjectBlocks(lo, &list);
+      objs[i].numBlocks = list.count - objs[i].firstBlock;
+      objs[i].linkMapIndex = lo->getLinkMapIndex();
+   }
+
+   // lay out the file
+   pos = sizeof(SnapshotHeader);
+   tables[3].tag = SNAPSHOT_TABLE_DATA;
+   tables[3].entrySize = 1;
+   tables[3].offset = pos;
+   for (b=0; b < list.count; b++)
+   {
+      pos += (list.blocks[b].address - pos) & 15;
+      list.blocks[b].data = pos;
+      pos += list.blocks[b].size;
+   }
+   pos = (pos + 15) & ~15UL;
+   tables[3].count = pos - tables[3].offset;
+   tables[0].tag = SNAPSHOT_TABLE_OBJECTS;
+   tables[0].entrySize = sizeof(SnapshotObject);
+   tables[0].offset = pos;
+   tables[0].count = numObjects;
+   pos += sizeof(SnapshotObject)*numObjects;
+   tables[1].tag = SNAPSHOT_TABLE_BLOCKS;
+   tables[1].entrySize = sizeof(SnapshotBlock);
+   tables[1].offset = pos;
+   tables[1].count = list.count;
+   pos += sizeof(SnapshotBlock)*list.count;
+   tables[2].tag = SNAPSHOT_TABLE_STRINGS;
+   tables[2].entrySize = 1;
+   tables[2].offset = pos;
+   tables[2].count = stringsSize;
+   pos = (pos + stringsSize + 7) & ~7UL;
+
+   memset(&hdr, 0, sizeof(hdr));
+   memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+   hdr.version = SNAPSHOT_VERSION;
+   hdr.headerSize = sizeof(SnapshotHeader);
+   hdr.elfClass = (__ELF_NATIVE_CLASS == 64) ? ELFCLASS64 : ELFCLASS32;
+   hdr.machine = program->loadedObjects ?
+                 program->loadedObjects->getArchitectureType() : 0;
+   hdr.pid = program->pid;
+   hdr.captureTime = time(0);
+   hdr.programName = 0;
+   hdr.tableOffset = pos;
+   hdr.numTables = SNAPSHOT_NUM_TABLES;
+   hdr.fileSize = pos + sizeof(tables);
+
+   fp = fopen(snapshotFilename, "w");
+   if (!fp)
+   {
+      delete[] objs;
+      delete[] list.blocks;
+      return -1;
+   }
+   setvbuf(fp, 0, _IOFBF, 1 << 20);
+   fwrite(&hdr, sizeof(hdr), 1, fp);
+   pos = sizeof(hdr);
+   for (b=0; b < list.count; b++)
+   {
+      fwrite(zeros, 1, list.blocks[b].data - pos, fp);
+      fwrite(list.blocks[b].source, 1, list.blocks[b].size, fp);
+      pos = list.blocks[b].data + list.blocks[b].size;
+   }
+   fwrite(zeros, 1, (16 - (pos & 15)) & 15, fp);
+   fwrite(objs, sizeof(SnapshotObject), numObjects, fp);
+   for (b=0; b < list.count; b++)
+   {
+      memset(&blk, 0, sizeof(blk));
+      blk.kind = list.blocks[b].kind;
+      blk.address = list.blocks[b].address;
+      blk.size = list.blocks[b].size;
+      blk.data = list.blocks[b].data;
+      fwrite(&blk, sizeof(blk), 1, fp);
+   }
+   fwrite(progName ? progName : "", 1, progName ? strlen(progName)+1 : 1, fp);
+   for (lo = program->loadedObjects; lo; lo = lo->next)
+      fwrite(lo->getName(), 1, strlen(lo->getName()) + 1, fp);
+   fwrite(zeros, 1, (8 - (stringsSize & 7)) & 7, fp);
+   fwrite(tables, sizeof(tables), 1, fp);
+   if (ferror(fp))
+      rc = -1;
+   if (fclose(fp))
+      rc = -1;
+   delete[] objs;
+   delete[] list.blocks;
+   return rc;
+}
+
+/**
+ * Open a snapshot file: mmap() it and check the header, the table
+ * directory and that every table and block lies inside the file.
+ * Nothing is copied or converted.
+ * @param snapshotFilename is the snapshot file.
+ */
+ProgramSnapshot::ProgramSnapshot(char* snapshotFilename)
+{
+   int fd;
+   struct stat st;
+   void* map;
+   SnapshotTable* tables;
+   unsigned long i, numObjects = 0;
+
+   image = 0;
+   imageSize = 0;
+   header = 0;
+   objects = 0;
+   blocks = 0;
+   numBlocks = 0;
+   strings = 0;
+   stringsSize = 0;
+
+   fd = open(snapshotFilename, O_RDONLY);
+   if (fd < 0)
+      return;
+   if (fstat(fd, &st) || st.st_size < (off_t) sizeof(SnapshotHeader))
+   {
+      close(fd);
+      return;
+   }
+   map = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if (map == MAP_FAILED)
+      return;
+   image = (char*) map;
+   imageSize = st.st_size;
+   header = (SnapshotHeader*) image;
+   if (memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) ||
+       header->version != SNAPSHOT_VERSION ||
+       header->headerSize < sizeof(SnapshotHeader) ||
+       header->fileSize != imageSize ||
+       header->elfClass != ((__ELF_NATIVE_CLASS == 64) ? ELFCLASS64 :
+                                                         ELFCLASS32) ||
+       header->tableOffset > imageSize ||
+       header->numTables > (imageSize - header->tableOffset) /
+                           sizeof(SnapshotTable))
+   {
+      header = 0;
+      return;
+   }
+   tables = (SnapshotTable*) (image + header->tableOffset);
+   for (i=0; i < header->numTables; i++)
+   {
+      if (!tables[i].entrySize || tables[i].offset > imageSize ||
+          tables[i].count > (imageSize - tables[i].offset) /
+                            tables[i].entrySize)
+      {
+         header = 0;
+         return;
+      }
+      switch (tables[i].tag)
+      {
+         case SNAPSHOT_TABLE_OBJECTS:
+            if (tables[i].entrySize != sizeof(SnapshotObject))
+               break;
+            objects = (SnapshotObject*) (image + tables[i].offset);
+            numObjects = tables[i].count;
+            break;
+         case SNAPSHOT_TABLE_BLOCKS:
+            if (tables[i].entrySize != sizeof(SnapshotBlock))
+               break;
+            blocks = (SnapshotBlock*) (image + tables[i].offset);
+            numBlocks = tables[i].count;
+            break;
+         case SNAPSHOT_TABLE_STRINGS:
+            if (tables[i].entrySize != 1)
+               break;
+            strings = image + tables[i].offset;
+            stringsSize = tables[i].count;
+            break;
+      }
+   }
+   if (!objects || !blocks || !strings || !stringsSize ||
+       strings[stringsSize-1] != '\0')
+   {
+      header = 0;
+      return;
+   }
+   for (i=0; i < numObjects; i++)
+   {
+      if (objects[i].name >= stringsSize ||
+          objects[i].firstBlock > numBlocks ||
+          objects[i].numBlocks > numBlocks - objects[i].firstBlock)
+      {
+         header = 0;
+         return;
+      }
+   }
+   for (i=0; i < numBlocks; i++)
+   {
+      // a block mapped off its address alignment would make its
+      // tables misaligned
+      if (blocks[i].data > imageSize ||
+          blocks[i].size > imageSize - blocks[i].data ||
+          ((blocks[i].data ^ blocks[i].address) & 15))
+      {
+         header = 0;
+         return;
+      }
+   }
+}
+
+/**
+ * Unmaps the snapshot; any ProgramInfo built from it must be gone.
+ */
+ProgramSnapshot::~ProgramSnapshot()
+{
+   if (image)
+      munmap(image, imageSize);
+}
+
+unsigned int ProgramSnapshot::isValidSnapshot()
+{
+   return (header != 0);
+}
+
+char* ProgramSnapshot::getProgramName()
+{
+   if (!header || header->programName >= stringsSize)
+      return 0;
+   return strings + header->programName;
+}
+
+unsigned int ProgramSnapshot::getProcessId()
+{
+   return header ? header->pid : 0;
+}
+
+unsigned int ProgramSnapshot::getNumberOfObjects()
+{
+   SnapshotTable* tables;
+   unsigned int i;
+   if (!header)
+      return 0;
+   tables = (SnapshotTable*) (image + header->tableOffset);
+   for (i=0; i < header->numTables; i++)
+      if (tables[i].tag == SNAPSHOT_TABLE_OBJECTS)
+         return tables[i].count;
+   return 0;
+}
+
+char* ProgramSnapshot::getObjectName(unsigned int object)
+{
+   return strings + objects[object].name;
+}
+
+char* ProgramSnapshot::getObjectBaseAddress(unsigned int object)
+{
+   return (char*) objects[object].baseAddress;
+}
+
+char* ProgramSnapshot::getObjectHighAddress(unsigned int object)
+{
+   return (char*) objects[object].highAddress;
+}
+
+int ProgramSnapshot::getObjectLinkMapIndex(unsigned int object)
+{
+   return objects[object].linkMapIndex;
+}
+
+/**
+ * Find a block of an object that covers a range, by binary search
+ * over the object's blocks (sorted by kind, then address, and not
+ * overlapping within a kind).
+ * @param object is the object number.
+ * @param kind is the SnapshotBlockKind.
+ * @param address is the runtime address or file offset wanted.
+ * @param size is the number of bytes that must be covered.
+ * @param blockSize is a return parameter set to the size of the block
+ *        data from address on (may be null).
+ * @return Pointer to the data for address, or null if not captured.
+ */
+char* ProgramSnapshot::findBlock(unsigned int object, unsigned int kind,
+                                 unsigned long address, unsigned long size,
+                                 unsigned long* blockSize)
+{
+   SnapshotBlock* blk;
+   unsigned long lo, hi, mid;
+   if (blockSize)
+      *blockSize = 0;
+   if (!header)
+      return 0;
+   blk = blocks + objects[object].firstBlock;
+   // find the first block past (kind, address)
+   lo = 0; hi = objects[object].numBlocks;
+   while (lo < hi)
+   {
+      mid = (lo + hi) / 2;
+      if (blk[mid].kind < kind ||
+          (blk[mid].kind == kind && blk[mid].address <= address))
+         lo = mid + 1;
+      else
+         hi = mid;
+   }
+   if (lo == 0)
+      return 0;
+   blk += lo - 1;
+   if (blk->kind != kind || address - blk->address > blk->size ||
+       size > blk->size - (address - blk->address))
+      return 0;
+   if (blockSize)
+      *blockSize = blk->size - (address - blk->address);
+   return image + blk->data + (address - blk->address);
+}
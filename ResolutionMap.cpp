@@ -0,0 +1,428 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ElfProgram.h>
+
+static const char* statusNames[RESOLUTION_NUM_STATUSES] = {
+   "unresolved", "first-definer", "interposed", "preloaded", "foreign",
+   "local"
+};
+
+/*
+ * One distinct import, keyed by name and version, and the position in
+ * load order of its first definer (looked up on first use).
+ */
+struct DefinerKey
+{
+   const char* name;         // Null for an empty entry
+   const char* version;      // Null if unversioned
+   unsigned int hash;        // getGnuHash(name)
+   unsigned int definer;     // Object index, numObjects if none,
+                             // or DEFINER_UNKNOWN
+};
+
+#define DEFINER_UNKNOWN 0xffffffffU
+#define NO_DEFINER_KEY  0xffffffffU
+
+/*
+ * True if a list of library names (LD_PRELOAD syntax: separated by
+ * spaces or colons) names an object, by path or by file name.
+ */
+static unsigned int listNames(const char* list, const char* path)
+{
+   const char *p, *base, *slash;
+   unsigned int len, baseLen;
+   if (!list || !path)
+      return 0;
+   slash = strrchr(path, '/');
+   base = slash ? slash + 1 : path;
+   baseLen = strlen(base);
+   for (p=list; *p; p += len)
+   {
+      p += strspn(p, " :\t\n");
+      len = strcspn(p, " :\t\n");
+      if (!len)
+         break;
+      if ((len == strlen(path) && !strncmp(p, path, len)) ||
+          (!memchr(p, '/', len) && len == baseLen && !strncmp(p, base, len)))
+         return 1;
+   }
+   return 0;
+}
+
+/*
+ * True if an object was loaded by LD_PRELOAD or /etc/ld.so.preload.
+ */
+static unsigned int isPreloaded(LoadObject* lo, const char* fileList)
+{
+   return listNames(getenv("LD_PRELOAD"), lo->getName()) ||
+          listNames(fileList, lo->getName());
+}
+
+/*
+ * A phase being run over the objects.
+ */
+struct ResolutionPhase
+{
+   ResolutionMap* map;
+   unsigned int phase;       // 0: build indexes, 1: resolve slots
+};
+
+static void resolutionStep(void* arg, unsigned int index,
+                           unsigned int worker)
+{
+   ResolutionPhase* p = (ResolutionPhase*) arg;
+   p->map->processObject(index, p->phase);
+}
+
+/**
+ * Build the map: every GOT slot of every live object, what it points
+ * to now, and whether that is the first definition in load order.
+ * @param program is the (live) program.
+ * @param numThreads is the number of threads to work with (0 means
+ *        one per CPU); each object is handled by one thread.
+ */
+ResolutionMap::ResolutionMap(ProgramInfo* program, unsigned int numThreads)
+{
+   PLTMap* pltMap;
+   FILE* file;
+   char preloadList[4096];
+   unsigned int i, n;
+
+   this->program = program;
+   this->numThreads = numThreads;
+   buildTime = 0;
+   memset(statusCounts, 0, sizeof(statusCounts));
+   objects = program->getObjectsInLoadOrder(&numObjects);
+   firstResolution = new unsigned int[numObjects + 1];
+   preloaded = new unsigned int[numObjects ? numObjects : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   preloadList[0] = '\0';
+   if ((file = fopen("/etc/ld.so.preload", "r")))
+   {
+      n = fread(preloadList, 1, sizeof(preloadList) - 1, file);
+      preloadList[n] = '\0';
+      fclose(file);
+   }
+   for (i=0; i < numObjects; i++)
+      preloaded[i] = isPreloaded(objects[i], preloadList);
+
+   // the PLT maps and address indexes are built lazily; build them
+   // all first, in parallel, so the resolving threads only read them
+   runPhase(0);
+   program->findObjectByAddress(0);   // sorts the object ranges
+   numResolutions = 0;
+   for (i=0; i < numObjects; i++)
+   {
+      firstResolution[i] = numResolutions;
+      if ((pltMap = objects[i]->getPLTMap()))
+         numResolutions += pltMap->getNumberOfSlots();
+   }
+   firstResolution[numObjects] = numResolutions;
+   resolutions = new GOTResolution[numResolutions ? numResolutions : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 1);
+   addDefinerKeys();
+   rebuild();
+}
+
+ResolutionMap::~ResolutionMap()
+{
+   delete[] objects;
+   delete[] firstResolution;
+   delete[] preloaded;
+   delete[] resolutions;
+   delete[] definerKeys;
+   delete[] resolutionKeys;
+}
+
+/*
+ * Run one phase over all objects with the configured threads.
+ */
+void ResolutionMap::runPhase(unsigned int phase)
+{
+   ResolutionPhase p;
+   p.map = this;
+   p.phase = phase;
+   ParallelFor::run(numObjects, numThreads, resolutionStep, &p);
+}
+
+/**
+ * Read every slot again and redo the classification (the slot list
+ * stays as it was when the map was built).
+ * @return The time it took, in nanoseconds.
+ */
+unsigned long ResolutionMap::rebuild()
+{
+   unsigned long start = LoadStats::now();
+   unsigned int i;
+   runPhase(1);
+   memset(statusCounts, 0, sizeof(statusCounts));
+   for (i=0; i < numResolutions; i++)
+      statusCounts[resolutions[i].status]++;
+   buildTime = LoadStats::now() - start;
+   return buildTime;
+}
+
+/*
+ * Give every slot with a symbol the definerKeys entry of its name and
+ * version, so that the slots importing the same symbol (malloc from
+ * hundreds of objects) share one first definer lookup.
+ */
+void ResolutionMap::addDefinerKeys()
+{
+   DynamicSection* dyn;
+   PLTMap* pltMap;
+   PLTSlot* slot;
+   ElfW(Sym)* syms;
+   DefinerKey* key;
+   const char *name, *version;
+   unsigned int i, j, k, n, h, numSyms, size;
+   for (size=16; size < 2 * numResolutions; size *= 2)
+      ;
+   definerKeys = new DefinerKey[size];
+   resolutionKeys = new unsigned int[numResolutions ? numResolutions : 1];
+   STATS_COUNT(STATS_ALLOCATIONS, 2);
+   memset(definerKeys, 0, size * sizeof(DefinerKey));
+   definerMask = size - 1;
+   for (i=0; i < numObjects; i++)
+   {
+      if (!(pltMap = objects[i]->getPLTMap()))
+         continue;
+      dyn = objects[i]->getDynamicSection();
+      syms = dyn ? dyn->getSymbolTable(&numSyms) : 0;
+      for (j=0; j < pltMap->getNumberOfSlots(); j++)
+      {
+         n = firstResolution[i] + j;
+         resolutionKeys[n] = NO_DEFINER_KEY;
+         slot = pltMap->getSlot(j);
+         if (!slot->symIndex || !syms || slot->symIndex >= numSyms ||
+             !(name = dyn->getSymbolString(syms + slot->symIndex)))
+            continue;
+         version = dyn->getSymbolVersionName(slot->symIndex);
+         h = DynamicSection::getGnuHash(name);
+         for (k = h & definerMask; (key = &definerKeys[k])->name;
+              k = (k + 1) & definerMask)
+         {
+            if (key->hash == h && !strcmp(key->name, name) &&
+                (key->version == version ||
+                 (key->version && version && !strcmp(key->version, version))))
+               break;
+         }
+         if (!key->name)
+         {
+            key->name = name;
+            key->version = version;
+            key->hash = h;
+            key->definer = DEFINER_UNKNOWN;
+         }
+         resolutionKeys[n] = k;
+      }
+   }
+}
+
+/*
+ * Position in load order of the first object that defines a slot's
+ * import, or numObjects if none does. Two threads may both look a
+ * key up the first time, but they store the same answer.
+ */
+unsigned int ResolutionMap::getFirstDefiner(unsigned int resolution)
+{
+   DynamicSection* dyn;
+   DefinerKey* key;
+   unsigned int i;
+   if (resolutionKeys[resolution] == NO_DEFINER_KEY)
+      return numObjects;
+   key = &definerKeys[resolutionKeys[resolution]];
+   i = __atomic_load_n(&key->definer, __ATOMIC_RELAXED);
+   if (i != DEFINER_UNKNOWN)
+      return i;
+   for (i=0; i < numObjects; i++)
+   {
+      if ((dyn = objects[i]->getDynamicSection()) &&
+          dyn->findDefinition(key->name, key->version) >= 0)
+         break;
+   }
+   __atomic_store_n(&key->definer, i, __ATOMIC_RELAXED);
+   return i;
+}
+
+/**
+ * Do one object's share of a phase (called by the worker threads).
+ * Phase 0 builds the object's PLT map and address index; phase 1
+ * resolves its slots.
+ * @param index is the object's position in load order.
+ * @param phase is the phase.
+ */
+void ResolutionMap::processObject(unsigned int index, unsigned int phase)
+{
+   LoadObject* lo = objects[index];
+   DynamicSection* dyn = lo->getDynamicSection();
+   DynamicSection* targetDyn;
+   PLTMap* pltMap;
+   GOTResolution* r;
+   ElfW(Sym)* syms;
+   ElfW(Sym)* targetSyms;
+   unsigned int i, numSyms, numTargetSyms, symbolic, definer;
+   int k;
+
+   if (phase == 0)
+   {
+      lo->getPLTMap();
+      if (dyn)
+         dyn->findSymbolByAddress(0);   // sorts the symbols
+      return;
+   }
+   if (!(pltMap = lo->getPLTMap()) || !dyn)
+      return;
+   syms = dyn->getSymbolTable(&numSyms);
+   symbolic = dyn->hasEntry(DT_SYMBOLIC) || (dyn->getFlags() & DF_SYMBOLIC);
+   for (i=0; i < pltMap->getNumberOfSlots(); i++)
+   {
+      r = &resolutions[firstResolution[index] + i];
+      memset(r, 0, sizeof(GOTResolution));
+      r->loadObject = lo;
+      r->slot = pltMap->getSlot(i);
+      if (r->slot->symIndex && syms && r->slot->symIndex < numSyms)
+      {
+         r->symbolName = dyn->getSymbolString(syms + r->slot->symIndex);
+         r->version = dyn->getSymbolVersionName(r->slot->symIndex);
+      }
+      r->value = __atomic_load_n((ElfW(Addr)*) pltMap->getGOTEntry(r->slot),
+                                 __ATOMIC_RELAXED);
+      if (!r->value || pltMap->isPLTAddress((char*) r->value))
+      {
+         r->status = RESOLUTION_UNRESOLVED;
+         continue;
+      }
+      r->targetObject = program->findObjectByAddress((char*) r->value);
+      if (r->targetObject &&
+          (targetDyn = r->targetObject->getDynamicSection()) &&
+          (targetSyms = targetDyn->getSymbolTable(&numTargetSyms)) &&
+          (k = targetDyn->findSymbolByAddress(
+              r->targetObject->addressToVaddr((char*) r->value))) >= 0)
+         r->targetSymbol = targetDyn->getSymbolString(targetSyms + k);
+      if (!r->targetObject)
+         r->status = RESOLUTION_FOREIGN;
+      else if (!r->symbolName || (symbolic && r->targetObject == lo))
+         r->status = RESOLUTION_LOCAL;
+      else
+      {
+         definer = getFirstDefiner(firstResolution[index] + i);
+         r->firstDefiner = definer < numObjects ? objects[definer] : 0;
+         if (r->firstDefiner != r->targetObject)
+            r->status = RESOLUTION_INTERPOSED;
+         else if (preloaded[definer])
+            r->status = RESOLUTION_PRELOADED;
+         else
+            r->status = RESOLUTION_FIRST_DEFINER;
+      }
+   }
+}
+
+/*
+ * Position of an object in load order, or numObjects.
+ */
+unsigned int ResolutionMap::getObjectIndex(LoadObject* lo)
+{
+   unsigned int i;
+   for (i=0; i < numObjects && objects[i] != lo; i++)
+      ;
+   return i;
+}
+
+unsigned int ResolutionMap::getNumberOfResolutions()
+{
+   return numResolutions;
+}
+
+GOTResolution* ResolutionMap::getResolution(unsigned int index)
+{
+   return index < numResolutions ? &resolutions[index] : 0;
+}
+
+/**
+ * Find how an object's import is bound.
+ * @param loadObject is the importing object.
+ * @param symbolName is the import ("name", "name@VER", "name@@VER").
+ * @return Its PLT slot's resolution (else its GLOB_DAT slot's), or
+ *         null if the object has no slot for the symbol.
+ */
+GOTResolution* ResolutionMap::findResolution(LoadObject* loadObject,
+                                             char* symbolName)
+{
+   unsigned int index = getObjectIndex(loadObject), i;
+   DynamicSection* dyn;
+   PLTMap* pltMap;
+   PLTSlot* slot;
+   int symIndex;
+   if (index >= numObjects || !(dyn = loadObject->getDynamicSection()) ||
+       !(pltMap = loadObject->getPLTMap()) ||
+       (symIndex = dyn->lookupVersionedSymbol(symbolName)) < 0)
+      return 0;
+   if (!(slot = pltMap->findJumpSlot(symIndex)) &&
+       !(slot = pltMap->findDataSlot(symIndex)))
+      return 0;
+   for (i = firstResolution[index]; i < firstResolution[index+1]; i++)
+      if (resolutions[i].slot == slot)
+         return &resolutions[i];
+   return 0;
+}
+
+unsigned int ResolutionMap::getStatusCount(unsigned int status)
+{
+   return status < RESOLUTION_NUM_STATUSES ? statusCounts[status] : 0;
+}
+
+const char* ResolutionMap::getStatusName(unsigned int status)
+{
+   return status < RESOLUTION_NUM_STATUSES ? statusNames[status] : "unknown";
+}
+
+unsigned long ResolutionMap::getBuildTime()
+{
+   return buildTime;
+}
+
+/**
+ * Write the map as text: one line per slot (or only the flagged ones:
+ * interposed, preloaded and foreign), then a count per status.
+ * @param out is where the report goes.
+ * @param flaggedOnly is nonzero to leave out the ordinary bindings.
+ */
+void ResolutionMap::writeReport(OutputBuffer* out, unsigned int flaggedOnly)
+{
+   GOTResolution* r;
+   char line[1024];
+   unsigned int i;
+   for (i=0; i < numResolutions; i++)
+   {
+      r = &resolutions[i];
+      if (flaggedOnly && r->status != RESOLUTION_INTERPOSED &&
+          r->status != RESOLUTION_PRELOADED && r->status != RESOLUTION_FOREIGN)
+         continue;
+      snprintf(line, sizeof(line), "%-13s %s%s%s in %s -> %s in %s",
+               getStatusName(r->status),
+               r->symbolName ? r->symbolName : "(irelative)",
+               r->version ? "@" : "", r->version ? r->version : "",
+               r->loadObject->getName(),
+               r->targetSymbol ? r->targetSymbol : "?",
+               r->targetObject ? r->targetObject->getName() : "?");
+      out->putString(line);
+      if (r->status == RESOLUTION_INTERPOSED)
+      {
+         out->putString(" (first definer ");
+         out->putString(r->firstDefiner ? r->firstDefiner->getName() : "none");
+         out->putChar(')');
+      }
+      out->putChar('\n');
+   }
+   for (i=0; i < RESOLUTION_NUM_STATUSES; i++)
+   {
+      snprintf(line, sizeof(line), "%-13s %8u\n", getStatusName(i),
+               statusCounts[i]);
+      out->putString(line);
+   }
+   snprintf(line, sizeof(line), "%u slots in %u objects, %.3f ms\n",
+            numResolutions, numObjects, buildTime / 1e6);
+   out->putString(line);
+}
@@ -0,0 +1,253 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ElfProgram.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define SYMBOL_STORE_AVX2 1
+#endif
+
+/**
+ * Copy a symbol table into columns. The table itself must stay valid
+ * as long as the store does (getName() and getSymbol() use it).
+ * @param symbols is the symbol array.
+ * @param count is the number of symbols in it.
+ * @param strTable is the string table for the names.
+ * @param strTableSize is its size.
+ * @param loadObject is the object the table belongs to.
+ */
+SymbolStore::SymbolStore(ElfW(Sym)* symbols, unsigned int count,
+                         char* strTable, unsigned long strTableSize,
+                         LoadObject* loadObject)
+{
+   unsigned int i;
+   this->symbols = symbols;
+   this->count = count;
+   this->strTable = strTable;
+   this->strTableSize = strTableSize;
+   this->loadObject = loadObject;
+   values = new unsigned long[count];
+   sizes = new unsigned long[count];
+   info = new unsigned char[count];
+   shndx = new unsigned short[count];
+   nameOffsets = new unsigned int[count];
+   STATS_COUNT(STATS_ALLOCATIONS, 5);
+   for (i=0; i < count; i++)
+   {
+      values[i] = symbols[i].st_value;
+      sizes[i] = symbols[i].st_size;
+      info[i] = symbols[i].st_info;
+      shndx[i] = symbols[i].st_shndx;
+      nameOffsets[i] = symbols[i].st_name;
+   }
+}
+
+SymbolStore::~SymbolStore()
+{
+   delete[] values;
+   delete[] sizes;
+   delete[] info;
+   delete[] shndx;
+   delete[] nameOffsets;
+}
+
+/**
+ * Set up a filter that every symbol passes.
+ * @param filter is the filter to initialize.
+ */
+void SymbolStore::initFilter(SymbolFilter* filter)
+{
+   filter->typeMask = ~0U;
+   filter->bindMask = ~0U;
+   filter->definedOnly = 0;
+   filter->minSize = 0;
+   filter->maxSize = ~0UL;
+   filter->lowAddress = 0;
+   filter->highAddress = ~0UL;
+}
+
+unsigned int SymbolStore::hasSIMD()
+{
+#ifdef SYMBOL_STORE_AVX2
+   return __builtin_cpu_supports("avx2") ? 1 : 0;
+#else
+   return 0;
+#endif
+}
+
+/*
+ * Scalar scan over [start, end); matches are appended to found.
+ * Returns the number appended. Written without branches on the tests
+ * so that mixed tables do not pay for mispredictions.
+ */
+static unsigned int scanScalar(SymbolFilter* f, unsigned long* values,
+                               unsigned long* sizes, unsigned char* info,
+                               unsigned short* shndx, unsigned int start,
+                               unsigned int end, unsigned int* found)
+{
+   unsigned int i, n = 0, ok;
+   for (i=start; i < end; i++)
+   {
+      ok = (values[i] >= f->lowAddress) & (values[i] < f->highAddress) &
+           (sizes[i] >= f->minSize) & (sizes[i] <= f->maxSize) &
+           (f->typeMask >> (info[i] & 0xf)) &
+           (f->bindMask >> (info[i] >> 4)) &
+           (!f->definedOnly | (shndx[i] != SHN_UNDEF));
+      found[n] = i;
+      n += ok & 1;
+   }
+   return n;
+}
+
+#ifdef SYMBOL_STORE_AVX2
+/*
+ * AVX2 scan, four symbols per step (one 64-bit lane each). Unsigned
+ * 64-bit compares are done as signed compares after flipping the
+ * sign bits. Leftover symbols at the end go to the scalar loop.
+ */
+__attribute__((target("avx2")))
+static unsigned int scanAVX2(SymbolFilter* f, unsigned long* values,
+                             unsigned long* sizes, unsigned char* info,
+                             unsigned short* shndx, unsigned int count,
+                             unsigned int* found)
+{
+   const __m256i flip = _mm256_set1_epi64x(0x8000000000000000LL);
+   const __m256i low = _mm256_xor_si256(flip,
+                          _mm256_set1_epi64x(f->lowAddress));
+   const __m256i high = _mm256_xor_si256(flip,
+                           _mm256_set1_epi64x(f->highAddress));
+   const __m256i minSize = _mm256_xor_si256(flip,
+                              _mm256_set1_epi64x(f->minSize));
+   const __m256i maxSize = _mm256_xor_si256(flip,
+                              _mm256_set1_epi64x(f->maxSize));
+   const __m256i typeMask = _mm256_set1_epi64x(f->typeMask);
+   const __m256i bindMask = _mm256_set1_epi64x(f->bindMask);
+   const __m256i nibble = _mm256_set1_epi64x(0xf);
+   const __m256i one = _mm256_set1_epi64x(1);
+   const __m256i zero = _mm256_setzero_si256();
+   __m256i v, s, inf, sec, bad, good;
+   unsigned int i, n = 0, bits;
+   int info4;
+   long long shndx4;
+
+   for (i=0; i + 4 <= count; i += 4)
+   {
+      v = _mm256_xor_si256(flip,
+             _mm256_loadu_si256((const __m256i*) (values + i)));
+      s = _mm256_xor_si256(flip,
+             _mm256_loadu_si256((const __m256i*) (sizes + i)));
+      bad = _mm256_or_si256(_mm256_cmpgt_epi64(low, v),
+                            _mm256_cmpgt_epi64(minSize, s));
+      bad = _mm256_or_si256(bad, _mm256_cmpgt_epi64(s, maxSize));
+      good = _mm256_cmpgt_epi64(high, v);
+      memcpy(&info4, info + i, sizeof(info4));
+      inf = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(info4));
+      good = _mm256_and_si256(good, _mm256_cmpeq_epi64(one,
+                _mm256_and_si256(one, _mm256_srlv_epi64(typeMask,
+                   _mm256_and_si256(inf, nibble)))));
+      good = _mm256_and_si256(good, _mm256_cmpeq_epi64(one,
+                _mm256_and_si256(one, _mm256_srlv_epi64(bindMask,
+                   _mm256_srli_epi64(inf, 4)))));
+      if (f->definedOnly)
+      {
+         memcpy(&shndx4, shndx + i, sizeof(shndx4));
+         sec = _mm256_cvtepu16_epi64(_mm_cvtsi64_si128(shndx4));
+         bad = _mm256_or_si256(bad, _mm256_cmpeq_epi64(sec, zero));
+      }
+      good = _mm256_andnot_si256(bad, good);
+      bits = _mm256_movemask_pd(_mm256_castsi256_pd(good));
+      found[n] = i;
+      n += bits & 1;
+      found[n] = i + 1;
+      n += (bits >> 1) & 1;
+      found[n] = i + 2;
+      n += (bits >> 2) & 1;
+      found[n] = i + 3;
+      n += (bits >> 3) & 1;
+   }
+   return n + scanScalar(f, values, sizes, info, shndx, i, count,
+                         found + n);
+}
+#endif
+
+/**
+ * Find the symbols that pass a filter.
+ * @param filter is the predicate (see initFilter()).
+ * @param numFound is a return parameter set to the number of matches.
+ * @param useSIMD is zero to force the scalar loop (for comparisons).
+ * @return Array of matching symbol indexes in table order (allocated
+ *         with new[]), or null if nothing matched.
+ */
+unsigned int* SymbolStore::scan(SymbolFilter* filter, unsigned int* numFound,
+                                unsigned int useSIMD)
+{
+   unsigned int* found = new unsigned int[count];
+   unsigned int n;
+#ifdef SYMBOL_STORE_AVX2
+   if (useSIMD && hasSIMD())
+      n = scanAVX2(filter, values, sizes, info, shndx, count, found);
+   else
+#endif
+      n = scanScalar(filter, values, sizes, info, shndx, 0, count, found);
+   *numFound = n;
+   if (!n)
+   {
+      delete[] found;
+      return 0;
+   }
+   return found;
+}
+
+unsigned int SymbolStore::getCount()
+{
+   return count;
+}
+
+unsigned long SymbolStore::getValue(unsigned int index)
+{
+   return index < count ? values[index] : 0;
+}
+
+unsigned long SymbolStore::getSize(unsigned int index)
+{
+   return index < count ? sizes[index] : 0;
+}
+
+unsigned int SymbolStore::getInfo(unsigned int index)
+{
+   return index < count ? info[index] : 0;
+}
+
+unsigned int SymbolStore::getSHIndex(unsigned int index)
+{
+   return index < count ? shndx[index] : SHN_UNDEF;
+}
+
+char* SymbolStore::getName(unsigned int index)
+{
+   if (index >= count || !strTable || nameOffsets[index] >= strTableSize)
+      return 0;
+   return strTable + nameOffsets[index];
+}
+
+/**
+ * Make an ElfSymbol for one entry, for callers that want the usual
+ * interface for the (few) symbols a scan found.
+ * @param index is the symbol index.
+ * @return New ElfSymbol (caller deletes), or null if out of range.
+ */
+ElfSymbol* SymbolStore::getSymbol(unsigned int index)
+{
+   if (index >= count)
+      return 0;
+   return new ElfSymbol(&symbols[index], strTable, loadObject);
+}
+
+unsigned long SymbolStore::getMemoryUsage()
+{
+   return (unsigned long) count * (2 * sizeof(unsigned long) +
+                                   sizeof(unsigned char) +
+                                   sizeof(unsigned short) +
+                                   sizeof(unsigned int));
+}
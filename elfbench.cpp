@@ -0,0 +1,534 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <new>
+#include <elf.h>
+#include <link.h>
+#include <ElfProgram.h>
+
+//
+// Micro-benchmarks for the hot library entry points. Each benchmark
+// is one operation run in batches: a calibration run sizes the batch
+// to roughly BATCH_NSECS, one warm-up batch is thrown away, and then
+// REPETITIONS batches are timed. Results go to stdout as one JSON
+// object per line so that runs can be collected and compared over
+// time; the median batch is the headline number.
+//
+// Allocations are counted by replacing the global operator new, so
+// only C++ allocations (not malloc/strdup) show up in allocs/op.
+//
+
+#define BATCH_NSECS  20000000UL
+#define REPETITIONS  7
+
+static unsigned long allocCount;
+static unsigned long allocBytes;
+
+void* operator new(size_t size)
+{
+   void* p;
+   allocCount++;
+   allocBytes += size;
+   p = malloc(size ? size : 1);
+   if (!p)
+      throw std::bad_alloc();
+   return p;
+}
+
+void* operator new[](size_t size)
+{
+   return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+   free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+   free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+   free(p);
+}
+
+static unsigned long nowNsecs()
+{
+   struct timespec ts;
+   clock_gettime(CLOCK_MONOTONIC, &ts);
+   return ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+//
+// One benchmark: the operation, its argument block, and how many
+// items (symbols, bytes, ...) one operation covers, for reporting.
+//
+struct BenchContext
+{
+   LoadObject* lo;        //!< Object under test
+   ProgramInfo* pInfo;    //!< Program under test
+   char* path;            //!< File name for file-mode constructions
+   char* symbolName;      //!< Name to look up
+   char* address;         //!< Runtime address to look up
+   unsigned int offset;   //!< File range start for getFileSection
+   unsigned int size;     //!< File range size for getFileSection
+   SymbolStore* store;    //!< Columns for the scan benchmarks
+   SymbolFilter filter;   //!< Predicate for the scan benchmarks
+   GOTRebinder* rebinder; //!< Slots for the rebinding benchmark
+   GOTSnapshot* got;      //!< Slots for the capture benchmark
+   ElfW(Addr)* gotValues; //!< Array it captures into
+   unsigned long found;   //!< Set by lookups so misses are visible
+   unsigned long items;   //!< Items covered by the last operation
+   long matches;          //!< Symbols the last scan matched (-1 if none)
+};
+
+typedef void (*BenchFunction)(BenchContext* ctx);
+
+static int compareTimes(const void* a, const void* b)
+{
+   double x = *(const double*) a, y = *(const double*) b;
+   return (x > y) - (x < y);
+}
+
+/**
+ * Run and report one benchmark.
+ * @param name is the benchmark name.
+ * @param input is the name of the input object (for the report).
+ * @param func is the operation to time.
+ * @param ctx is the operation's argument block.
+ */
+static void runBenchmark(const char* name, const char* input,
+                         BenchFunction func, BenchContext* ctx)
+{
+   double times[REPETITIONS];
+   unsigned long start, elapsed, batch, i, r;
+   unsigned long allocs = 0, bytes = 0;
+
+   ctx->matches = -1;
+   // calibrate: grow the batch until it takes a measurable time
+   batch = 1;
+   while (1)
+   {
+      start = nowNsecs();
+      for (i=0; i < batch; i++)
+         func(ctx);
+      elapsed = nowNsecs() - start;
+      if (elapsed >= BATCH_NSECS / 10 || batch >= (1UL << 30))
+         break;
+      batch *= 10;
+   }
+   if (elapsed < BATCH_NSECS && elapsed > 0)
+      batch = batch * BATCH_NSECS / elapsed;
+   if (batch == 0)
+      batch = 1;
+   // warm-up batch, not reported
+   for (i=0; i < batch; i++)
+      func(ctx);
+   for (r=0; r < REPETITIONS; r++)
+   {
+      unsigned long ac = allocCount, ab = allocBytes;
+      ctx->found = 0;
+      start = nowNsecs();
+      for (i=0; i < batch; i++)
+         func(ctx);
+      elapsed = nowNsecs() - start;
+      allocs += allocCount - ac;
+      bytes += allocBytes - ab;
+      times[r] = (double) elapsed / batch;
+   }
+   qsort(times, REPETITIONS, sizeof(double), compareTimes);
+   printf("{\"bench\":\"%s\",\"input\":\"%s\",\"ns_per_op\":%.1f,"
+          "\"ns_min\":%.1f,\"ns_max\":%.1f,\"allocs_per_op\":%.2f,"
+          "\"bytes_per_op\":%.1f,\"items_per_op\":%lu,\"found\":%lu,",
+          name, input, times[REPETITIONS/2], times[0],
+          times[REPETITIONS-1],
+          (double) allocs / (batch * REPETITIONS),
+          (double) bytes / (batch * REPETITIONS),
+          ctx->items, ctx->found ? 1UL : 0UL);
+   if (ctx->matches >= 0)
+      printf("\"matches\":%ld,", ctx->matches);
+   printf("\"ops_per_rep\":%lu,\"reps\":%d}\n", batch, REPETITIONS);
+   fflush(stdout);
+}
+
+//
+// The benchmarked operations. Every returned object is deleted so
+// that the allocation counts reflect the per-call cost, not leaks
+// accumulated across the batch.
+//
+
+static void benchProgramInfo(BenchContext* ctx)
+{
+   ProgramInfo* pInfo = new ProgramInfo();
+   LoadObject* lo;
+   ctx->items = 0;
+   for (lo = pInfo->loadedObjects; lo; lo = lo->next)
+      ctx->items++;
+   delete pInfo;
+}
+
+static void benchLoadObjectFile(BenchContext* ctx)
+{
+   LoadObject* lo = new LoadObject(ctx->path, 0);
+   ctx->items = lo->getNumberOfStaticSymbols();
+   delete lo;
+}
+
+static void benchFindDynamic(BenchContext* ctx)
+{
+   ElfSymbol* sym = ctx->lo->findDynamicSymbolByName(ctx->symbolName);
+   ctx->items = 1;
+   if (sym)
+      ctx->found++;
+   delete sym;
+}
+
+static void benchFindStatic(BenchContext* ctx)
+{
+   ElfSymbol* sym = ctx->lo->findStaticSymbolByName(ctx->symbolName);
+   ctx->items = 1;
+   if (sym)
+      ctx->found++;
+   delete sym;
+}
+
+static void benchFindDefinitions(BenchContext* ctx)
+{
+   ElfSymbol** defs;
+   int num, i;
+   defs = ctx->pInfo->findSymbolDefinitions(ctx->symbolName, &num);
+   ctx->items = num;
+   if (num > 0)
+      ctx->found++;
+   for (i=0; i < num; i++)
+      delete defs[i];
+   delete[] defs;
+}
+
+static void benchDynamicIter(BenchContext* ctx)
+{
+   unsigned int iter;
+   ElfSymbol* sym;
+   ctx->items = 0;
+   sym = ctx->lo->startDynamicSymbolIter(&iter);
+   while (sym)
+   {
+      ctx->items++;
+      delete sym;
+      sym = ctx->lo->nextDynamicSymbolIter(&iter);
+   }
+}
+
+static void benchStaticIter(BenchContext* ctx)
+{
+   unsigned int iter;
+   ElfSymbol* sym;
+   ctx->items = 0;
+   sym = ctx->lo->startStaticSymbolIter(&iter);
+   while (sym)
+   {
+      ctx->items++;
+      delete sym;
+      sym = ctx->lo->nextStaticSymbolIter(&iter);
+   }
+}
+
+static void benchFindSection(BenchContext* ctx)
+{
+   ctx->items = 1;
+   if (ctx->lo->findSectionByName(ctx->symbolName))
+      ctx->found++;
+}
+
+static void benchFindSectionByAddress(BenchContext* ctx)
+{
+   ctx->items = 1;
+   if (ctx->lo->findSectionByAddress(ctx->address))
+      ctx->found++;
+}
+
+static void benchFileSection(BenchContext* ctx)
+{
+   char* data = ctx->lo->getFileSection(ctx->offset, ctx->size);
+   ctx->items = ctx->size;
+   if (data)
+      ctx->found++;
+   delete[] data;
+}
+
+static void benchSymbolScan(BenchContext* ctx)
+{
+   unsigned int num;
+   unsigned int* found = ctx->store->scan(&ctx->filter, &num, 1);
+   ctx->items = ctx->store->getCount();
+   ctx->matches = num;
+   if (num)
+      ctx->found++;
+   delete[] found;
+}
+
+static void benchSymbolScanScalar(BenchContext* ctx)
+{
+   unsigned int num;
+   unsigned int* found = ctx->store->scan(&ctx->filter, &num, 0);
+   ctx->items = ctx->store->getCount();
+   ctx->matches = num;
+   if (num)
+      ctx->found++;
+   delete[] found;
+}
+
+static void benchRebind(BenchContext* ctx)
+{
+   ctx->items = ctx->rebinder->getNumberOfBindings();
+   if (ctx->rebinder->apply() > 0)
+      ctx->found++;
+   ctx->rebinder->rollback();
+}
+
+static void benchGOTCapture(BenchContext* ctx)
+{
+   ctx->got->capture(ctx->gotValues);
+   ctx->items = ctx->got->getNumberOfSlots();
+   if (ctx->gotValues[0])
+      ctx->found++;
+}
+
+// the whole startup relocation cost model for this process
+static void benchLookupCostModel(BenchContext* ctx)
+{
+   LookupCostModel* model = new LookupCostModel(ctx->pInfo, 1);
+   ctx->items = model->getTotalCost()->relocations;
+   if (model->getTotalCost()->definitions)
+      ctx->found++;
+   delete model;
+}
+
+// a cheap import called through the PLT: plain, counted and traced
+static void benchImportCall(BenchContext* ctx)
+{
+   ctx->items = 1;
+   ctx->found += atoi("1");
+}
+
+/**
+ * Find the largest section of an object that has file contents,
+ * used as the getFileSection() workload.
+ */
+static ElfSection* findLargestSection(LoadObject* lo)
+{
+   ElfSection *sec, *best = 0;
+   unsigned int i;
+   for (i=0; (sec = lo->getSection(i)); i++)
+      if (sec->hasContentData() &&
+          (!best || sec->getSizeInBytes() > best->getSizeInBytes()))
+         best = sec;
+   return best;
+}
+
+/**
+ * Pick a defined dynamic symbol near the end of the table, so that
+ * linear searches pay close to their worst case.
+ */
+static char* pickDynamicSymbol(LoadObject* lo)
+{
+   ElfW(Sym) *syms;
+   char* strTable;
+   unsigned long strSize;
+   unsigned int count, i;
+   syms = lo->getDynamicSymbolTable(&count, &strTable, &strSize);
+   if (!syms || !strTable)
+      return 0;
+   for (i=count; i > 0; i--)
+      if (syms[i-1].st_shndx != SHN_UNDEF && syms[i-1].st_name &&
+          syms[i-1].st_name < strSize)
+         return strTable + syms[i-1].st_name;
+   return 0;
+}
+
+static char* pickStaticSymbol(LoadObject* lo)
+{
+   ElfW(Sym) *syms;
+   char* strTable;
+   unsigned long strSize;
+   unsigned int count, i;
+   syms = lo->getStaticSymbolTable(&count, &strTable, &strSize);
+   if (!syms || !strTable)
+      return 0;
+   for (i=count; i > 0; i--)
+      if (syms[i-1].st_shndx != SHN_UNDEF && syms[i-1].st_name &&
+          syms[i-1].st_name < strSize)
+         return strTable + syms[i-1].st_name;
+   return 0;
+}
+
+/**
+ * Run the per-object benchmarks against one object.
+ * @param lo is the object.
+ * @param input is its name in the report.
+ */
+static void benchObject(LoadObject* lo, const char* input)
+{
+   BenchContext ctx;
+   ElfSection* sec;
+   ElfSymbol* sym;
+   memset(&ctx, 0, sizeof(ctx));
+   ctx.lo = lo;
+   if ((ctx.symbolName = pickDynamicSymbol(lo)))
+   {
+      runBenchmark("findDynamicSymbolByName", input, benchFindDynamic,
+                   &ctx);
+      if ((sym = lo->findDynamicSymbolByName(ctx.symbolName)))
+      {
+         ctx.address = sym->getSymbolAddress();
+         runBenchmark("findSectionByAddress", input,
+                      benchFindSectionByAddress, &ctx);
+         delete sym;
+      }
+   }
+   if ((ctx.symbolName = pickStaticSymbol(lo)))
+      runBenchmark("findStaticSymbolByName", input, benchFindStatic, &ctx);
+   if (lo->getDynamicSection())
+      runBenchmark("dynsymIteration", input, benchDynamicIter, &ctx);
+   if (lo->getNumberOfStaticSymbols())
+      runBenchmark("symtabIteration", input, benchStaticIter, &ctx);
+   // "defined, non-empty global functions" over the columns: about
+   // half of elfgen's symbols (and of a typical library's), so the
+   // scans collect matches rather than only rejecting
+   if ((ctx.store = lo->getSymbolStore(lo->getNumberOfStaticSymbols() == 0)))
+   {
+      SymbolStore::initFilter(&ctx.filter);
+      ctx.filter.typeMask = SYMBOL_TYPE_BIT(STT_FUNC);
+      ctx.filter.bindMask = SYMBOL_BIND_BIT(STB_GLOBAL);
+      ctx.filter.definedOnly = 1;
+      ctx.filter.minSize = 1;
+      if (SymbolStore::hasSIMD())
+         runBenchmark("symbolScan", input, benchSymbolScan, &ctx);
+      runBenchmark("symbolScanScalar", input, benchSymbolScanScalar, &ctx);
+   }
+   // the last section, so that a linear search pays its worst case
+   if (lo->getNumberOfSections() > 1 &&
+       (sec = lo->getSection(lo->getNumberOfSections() - 1)) &&
+       (ctx.symbolName = sec->getName(lo->getSectionHeaderStringTable())))
+      runBenchmark("findSectionByName", input, benchFindSection, &ctx);
+   if ((sec = findLargestSection(lo)))
+   {
+      ctx.offset = sec->getFileOffset();
+      ctx.size = sec->getSizeInBytes();
+      runBenchmark("getFileSection", input, benchFileSection, &ctx);
+   }
+}
+
+//
+// Usage: elfbench [file ...]
+// Benchmarks the running process (ProgramInfo construction, symbol
+// definitions, and the live libc object), then each named file in
+// file mode.
+//
+int main(int argc, char* argv[])
+{
+   BenchContext ctx;
+   ProgramInfo* pInfo;
+   CallCounter* counter;
+   CallTracer* tracer;
+   LoadObject *lo, *libc = 0;
+   int i = 1;
+
+   printf("{\"meta\":\"elfbench\",\"time\":%ld,\"cpus\":%ld,"
+          "\"reps\":%d,\"batch_ns\":%lu}\n", (long) time(0),
+          sysconf(_SC_NPROCESSORS_ONLN), REPETITIONS, BATCH_NSECS);
+
+   memset(&ctx, 0, sizeof(ctx));
+   runBenchmark("ProgramInfo", "self", benchProgramInfo, &ctx);
+
+   pInfo = new ProgramInfo();
+   ctx.pInfo = pInfo;
+   ctx.symbolName = (char*) "malloc";
+   runBenchmark("findSymbolDefinitions", "self", benchFindDefinitions,
+                &ctx);
+
+   // apply and roll back a program-wide rebinding of malloc to itself
+   // (the mprotect() calls for RELRO pages are most of the cost)
+   ctx.rebinder = new GOTRebinder();
+   if (ctx.rebinder->addProgramSymbol(pInfo, ctx.symbolName,
+                                      (void*) malloc) > 0)
+      runBenchmark("gotRebind", "self", benchRebind, &ctx);
+   delete ctx.rebinder;
+   ctx.rebinder = 0;
+
+   // copying out every GOT slot of the process
+   ctx.got = new GOTSnapshot(pInfo);
+   ctx.gotValues = ctx.got->newCapture();
+   if (ctx.got->getNumberOfSlots())
+      runBenchmark("gotCapture", "self", benchGOTCapture, &ctx);
+   delete[] ctx.gotValues;
+   delete ctx.got;
+   ctx.got = 0;
+
+   // modelling the dynamic linker's work on every relocation (one
+   // thread, so the figure is per core)
+   runBenchmark("lookupCostModel", "self", benchLookupCostModel, &ctx);
+
+   // the added cost of a CallCounter trampoline on our own atoi()
+   runBenchmark("importCall", "self", benchImportCall, &ctx);
+   counter = new CallCounter();
+   if (CallCounter::isSupported() &&
+       !counter->addSymbol(pInfo->loadedObjects, (char*) "atoi") &&
+       counter->install() > 0)
+   {
+      runBenchmark("countedImportCall", "self", benchImportCall, &ctx);
+      counter->remove();
+   }
+   delete counter;
+
+   // and of a CallTracer trampoline (timestamps, shadow stack, ring)
+   tracer = pInfo->getCallTracer();
+   if (CallTracer::isSupported() &&
+       !tracer->addSymbol(pInfo->loadedObjects, (char*) "atoi") &&
+       tracer->enable() > 0)
+   {
+      runBenchmark("tracedImportCall", "self", benchImportCall, &ctx);
+      tracer->disable();
+   }
+
+   for (lo = pInfo->loadedObjects; lo; lo = lo->next)
+      if (lo->getName() && strstr(lo->getName(), "/libc.so"))
+         libc = lo;
+   if (libc)
+   {
+      benchObject(libc, "libc-live");
+      ctx.path = libc->getName();
+      runBenchmark("LoadObjectFile", "libc", benchLoadObjectFile, &ctx);
+      lo = new LoadObject(libc->getName(), 0);
+      if (lo->isValidObject())
+         benchObject(lo, "libc");
+      delete lo;
+   }
+
+   for (; i < argc; i++)
+   {
+      ctx.path = argv[i];
+      lo = new LoadObject(argv[i], 0);
+      if (!lo->isValidObject())
+      {
+         fprintf(stderr, "elfbench: cannot read %s\n", argv[i]);
+         delete lo;
+         continue;
+      }
+      runBenchmark("LoadObjectFile", argv[i], benchLoadObjectFile, &ctx);
+      benchObject(lo, argv[i]);
+      delete lo;
+   }
+   delete pInfo;
+   return 0;
+}
@@ -0,0 +1,792 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <elf.h>
+
+//
+// Synthetic ELF64 (x86-64) generator for scale testing. It writes a
+// shared object or an executable with a chosen number of extra
+// sections, defined symbols, data relocations, PLT entries and
+// DT_NEEDED entries. Everything is derived from the options, so a
+// given command line always produces the same bytes.
+//
+// Layout: a read-only segment (headers, hash tables, dynsym, dynstr,
+// relocations), a text segment (PLT and one 16-byte stub per
+// function), a data segment (dynamic, GOT, data objects), then the
+// non-loaded symtab, strtab, filler sections, shstrtab and the
+// section header table. Defined symbols alternate between functions
+// (gen_fn_N) and data objects (gen_obj_N); the PLT imports are
+// gen_import_N. More than SHN_LORESERVE sections are written with
+// extended numbering (e_shnum 0, e_shstrndx SHN_XINDEX).
+//
+
+#define SEGMENT_ALIGN  0x1000
+#define EXEC_BASE      0x400000
+#define STUB_SIZE      16
+#define INTERP_NAME    "/lib64/ld-linux-x86-64.so.2"
+
+//
+// Growable string table; offsets are stable as it grows.
+//
+struct StringTable
+{
+   char* data;
+   unsigned long size;
+   unsigned long allocated;
+};
+
+static unsigned long addString(StringTable* st, const char* str)
+{
+   unsigned long len = strlen(str) + 1, offset = st->size;
+   if (st->size + len > st->allocated)
+   {
+      unsigned long nsize = st->allocated ? st->allocated * 2 : 4096;
+      while (nsize < st->size + len)
+         nsize *= 2;
+      char* ndata = new char[nsize];
+      if (st->size)
+         memcpy(ndata, st->data, st->size);
+      delete[] st->data;
+      st->data = ndata;
+      st->allocated = nsize;
+   }
+   memcpy(st->data + st->size, str, len);
+   st->size += len;
+   return offset;
+}
+
+//
+// One defined symbol, in generation order; dynsym order is by GNU
+// hash bucket, as DT_GNU_HASH requires.
+//
+struct GenSymbol
+{
+   unsigned long name;       //!< Offset in dynstr (and strtab)
+   unsigned int gnuHash;     //!< GNU hash of the name
+   unsigned int bucket;      //!< gnuHash % number of buckets
+   unsigned int index;       //!< Generation index
+   unsigned int dynIndex;    //!< Position in dynsym
+};
+
+static int compareByBucket(const void* a, const void* b)
+{
+   const GenSymbol *x = (const GenSymbol*) a, *y = (const GenSymbol*) b;
+   if (x->bucket != y->bucket)
+      return x->bucket < y->bucket ? -1 : 1;
+   return x->index < y->index ? -1 : (x->index > y->index);
+}
+
+static unsigned int sysvHash(const char* name)
+{
+   unsigned int h = 0, g;
+   while (*name)
+   {
+      h = (h << 4) + (unsigned char) *name++;
+      if ((g = h & 0xf0000000))
+         h ^= g >> 24;
+      h &= ~g;
+   }
+   return h;
+}
+
+static unsigned int gnuHash(const char* name)
+{
+   unsigned int h = 5381;
+   while (*name)
+      h = h * 33 + (unsigned char) *name++;
+   return h;
+}
+
+/* bucket counts in the style of the GNU linker */
+static unsigned int chooseBuckets(unsigned int numSymbols)
+{
+   static unsigned int sizes[] = {1, 3, 17, 37, 67, 97, 131, 197, 263,
+                                  521, 1031, 2053, 4099, 8209, 16411,
+                                  32771, 65537, 131101, 262147, 524309,
+                                  1048583, 2097169, 4194319, 8388617,
+                                  16777259, 0};
+   unsigned int i, best = 1;
+   for (i=0; sizes[i]; i++)
+      if (sizes[i] <= numSymbols / 2)
+         best = sizes[i];
+   return best;
+}
+
+static unsigned long alignUp(unsigned long value, unsigned long align)
+{
+   return (value + align - 1) & ~(align - 1);
+}
+
+static void put32(char* p, unsigned int v)
+{
+   memcpy(p, &v, 4);
+}
+
+struct GenOptions
+{
+   unsigned int isExec;       //!< Write ET_EXEC instead of ET_DYN
+   unsigned int sections;     //!< Extra filler sections
+   unsigned int symbols;      //!< Defined symbols
+   unsigned int relocs;       //!< Data relocations in .rela.dyn
+   unsigned int plt;          //!< PLT entries (imported functions)
+   unsigned int symtab;       //!< Nonzero to write .symtab/.strtab
+   unsigned int sysvHash;     //!< Nonzero to write .hash
+   unsigned int gnuHash;      //!< Nonzero to write .gnu.hash
+   char** needed;             //!< DT_NEEDED names
+   unsigned int numNeeded;
+   char* soname;              //!< DT_SONAME (or null)
+   char* output;              //!< Output file name
+};
+
+//
+// Section list: built in file order once the layout is known.
+//
+struct SectionList
+{
+   Elf64_Shdr* headers;
+   unsigned int count;
+};
+
+static unsigned int addSection(SectionList* list, unsigned long name,
+                               unsigned int type, unsigned long flags,
+                               unsigned long addr, unsigned long offset,
+                               unsigned long size, unsigned long align,
+                               unsigned long entsize)
+{
+   Elf64_Shdr* sh = &list->headers[list->count];
+   sh->sh_name = name;
+   sh->sh_type = type;
+   sh->sh_flags = flags;
+   sh->sh_addr = addr;
+   sh->sh_offset = offset;
+   sh->sh_size = size;
+   sh->sh_addralign = align;
+   sh->sh_entsize = entsize;
+   return list->count++;
+}
+
+/**
+ * Build the whole object in memory and write it out.
+ * @param opt is the generation options.
+ * @return Zero on success, -1 on error.
+ */
+static int generate(GenOptions* opt)
+{
+   StringTable dynstr, shstr;
+   GenSymbol* defs;
+   unsigned long *neededNames, sonameName = 0, fileName;
+   unsigned long *importNames, *fillerNames;
+   unsigned int numFuncs, numObjs, numDyn, numBuckets, maskWords = 1;
+   unsigned int numRelative, numPhdrs, numDynamic, relaIndex = 0;
+   unsigned int i, j;
+   unsigned long base = opt->isExec ? EXEC_BASE : 0;
+   unsigned long off, phoff, interpOff = 0, hashOff = 0, hashSize = 0;
+   unsigned long gnuOff = 0, gnuSize = 0, dynsymOff, dynstrOff;
+   unsigned long relaOff, relaPltOff, pltOff = 0, pltSize, textOff;
+   unsigned long textSize, rxStart, rwStart, dynamicOff, gotOff = 0;
+   unsigned long gotSize, dataOff, dataSize, endR, endRX, endRW;
+   unsigned long symtabOff = 0, strtabOff = 0, shstrOff, shoff, fileSize;
+   unsigned int secDynsym, secDynstr, secText, secData, secSymtab;
+   unsigned int secShstr, secDynamic, secRelaPlt = 0, secGot = 0;
+   SectionList sects;
+   char name[64], *image;
+   int fd;
+   long written;
+
+   memset(&dynstr, 0, sizeof(dynstr));
+   memset(&shstr, 0, sizeof(shstr));
+   numFuncs = (opt->symbols + 1) / 2;
+   numObjs = opt->symbols / 2;
+   numDyn = 1 + opt->plt + opt->symbols;
+
+   // strings: needed, soname, file name, imports, then definitions
+   addString(&dynstr, "");
+   neededNames = new unsigned long[opt->numNeeded + 1];
+   for (i=0; i < opt->numNeeded; i++)
+      neededNames[i] = addString(&dynstr, opt->needed[i]);
+   if (opt->soname)
+      sonameName = addString(&dynstr, opt->soname);
+   fileName = addString(&dynstr, "elfgen.c");
+   importNames = new unsigned long[opt->plt + 1];
+   for (i=0; i < opt->plt; i++)
+   {
+      sprintf(name, "gen_import_%u", i);
+      importNames[i] = addString(&dynstr, name);
+   }
+   numBuckets = chooseBuckets(opt->symbols);
+   defs = new GenSymbol[opt->symbols + 1];
+   for (i=0; i < opt->symbols; i++)
+   {
+      if (i % 2 == 0)
+         sprintf(name, "gen_fn_%u", i / 2);
+      else
+         sprintf(name, "gen_obj_%u", i / 2);
+      defs[i].name = addString(&dynstr, name);
+      defs[i].gnuHash = gnuHash(name);
+      defs[i].bucket = defs[i].gnuHash % numBuckets;
+      defs[i].index = i;
+   }
+   // the GNU hash table needs defined symbols grouped by bucket
+   qsort(defs, opt->symbols, sizeof(GenSymbol), compareByBucket);
+   for (i=0; i < opt->symbols; i++)
+      defs[i].dynIndex = 1 + opt->plt + i;
+   while (maskWords * 64 < opt->symbols * 2)
+      maskWords *= 2;
+
+   // section header names
+   addString(&shstr, "");
+   fillerNames = new unsigned long[opt->sections + 1];
+   for (i=0; i < opt->sections; i++)
+   {
+      sprintf(name, ".gen.%u", i);
+      fillerNames[i] = addString(&shstr, name);
+   }
+
+   // dynamic entries: needed, soname, debug, hash tables, 4 for the
+   // symbol/string tables, 4 each for relocations and PLT, null
+   numDynamic = opt->numNeeded + (opt->soname ? 1 : 0) +
+      (opt->isExec ? 1 : 0) + opt->sysvHash + opt->gnuHash + 4 + 1;
+   if (opt->relocs)
+      numDynamic += 4;
+   if (opt->plt)
+      numDynamic += 4;
+   numRelative = opt->symbols ? (opt->relocs + 1) / 2 : opt->relocs;
+
+   // layout of the read-only segment
+   numPhdrs = opt->isExec ? 7 : 6;
+   off = phoff = sizeof(Elf64_Ehdr);
+   off += numPhdrs * sizeof(Elf64_Phdr);
+   if (opt->isExec)
+   {
+      interpOff = off;
+      off += sizeof(INTERP_NAME);
+   }
+   if (opt->sysvHash)
+   {
+      hashOff = off = alignUp(off, 8);
+      hashSize = 4UL * (2 + numBuckets + numDyn);
+      off += hashSize;
+   }
+   if (opt->gnuHash)
+   {
+      gnuOff = off = alignUp(off, 8);
+      gnuSize = 16 + 8UL * maskWords + 4UL * numBuckets +
+         4UL * opt->symbols;
+      off += gnuSize;
+   }
+   dynsymOff = off = alignUp(off, 8);
+   off += numDyn * sizeof(Elf64_Sym);
+   dynstrOff = off;
+   off += dynstr.size;
+   relaOff = off = alignUp(off, 8);
+   off += opt->relocs * sizeof(Elf64_Rela);
+   relaPltOff = off;
+   off += opt->plt * sizeof(Elf64_Rela);
+   endR = off;
+   // text segment: PLT then stubs (the first stub is the entry point)
+   rxStart = off = alignUp(off, SEGMENT_ALIGN);
+   pltSize = opt->plt ? STUB_SIZE * (1UL + opt->plt) : 0;
+   if (opt->plt)
+      pltOff = off;
+   off += pltSize;
+   textOff = off = alignUp(off, STUB_SIZE);
+   textSize = STUB_SIZE * (1UL + numFuncs);
+   off += textSize;
+   endRX = off;
+   // data segment
+   rwStart = off = alignUp(off, SEGMENT_ALIGN);
+   dynamicOff = off;
+   off += numDynamic * sizeof(Elf64_Dyn);
+   gotSize = opt->plt ? 8UL * (3 + opt->plt) : 0;
+   if (opt->plt)
+      gotOff = off;
+   off += gotSize;
+   dataOff = off = alignUp(off, 8);
+   dataSize = 8UL * (numObjs + opt->relocs);
+   off += dataSize;
+   endRW = off;
+   // non-loaded parts
+   if (opt->symtab)
+   {
+      symtabOff = off = alignUp(off, 8);
+      off += (1UL + numDyn) * sizeof(Elf64_Sym);
+      strtabOff = off;
+      off += dynstr.size;
+   }
+
+   // sections, in file order; shstrtab goes last so that it gets a
+   // high index when there are many filler sections
+   sects.count = 0;
+   sects.headers = new Elf64_Shdr[20 + opt->sections];
+   memset(sects.headers, 0, (20 + opt->sections) * sizeof(Elf64_Shdr));
+   addSection(&sects, 0, SHT_NULL, 0, 0, 0, 0, 0, 0);
+   if (opt->isExec)
+      addSection(&sects, addString(&shstr, ".interp"), SHT_PROGBITS,
+                 SHF_ALLOC, base + interpOff, interpOff,
+                 sizeof(INTERP_NAME), 1, 0);
+   if (opt->sysvHash)
+      addSection(&sects, addString(&shstr, ".hash"), SHT_HASH, SHF_ALLOC,
+                 base + hashOff, hashOff, hashSize, 8, 4);
+   if (opt->gnuHash)
+      addSection(&sects, addString(&shstr, ".gnu.hash"), SHT_GNU_HASH,
+                 SHF_ALLOC, base + gnuOff, gnuOff, gnuSize, 8, 0);
+   secDynsym = addSection(&sects, addString(&shstr, ".dynsym"), SHT_DYNSYM,
+                          SHF_ALLOC, base + dynsymOff, dynsymOff,
+                          numDyn * sizeof(Elf64_Sym), 8, sizeof(Elf64_Sym));
+   secDynstr = addSection(&sects, addString(&shstr, ".dynstr"), SHT_STRTAB,
+                          SHF_ALLOC, base + dynstrOff, dynstrOff,
+                          dynstr.size, 1, 0);
+   if (opt->relocs)
+      relaIndex = addSection(&sects, addString(&shstr, ".rela.dyn"),
+                             SHT_RELA, SHF_ALLOC, base + relaOff, relaOff,
+                             opt->relocs * sizeof(Elf64_Rela), 8,
+                             sizeof(Elf64_Rela));
+   if (opt->plt)
+   {
+      secRelaPlt = addSection(&sects, addString(&shstr, ".rela.plt"),
+                              SHT_RELA, SHF_ALLOC | SHF_INFO_LINK,
+                              base + relaPltOff, relaPltOff,
+                              opt->plt * sizeof(Elf64_Rela), 8,
+                              sizeof(Elf64_Rela));
+      addSection(&sects, addString(&shstr, ".plt"), SHT_PROGBITS,
+                 SHF_ALLOC | SHF_EXECINSTR, base + pltOff, pltOff, pltSize,
+                 STUB_SIZE, STUB_SIZE);
+   }
+   secText = addSection(&sects, addString(&shstr, ".text"), SHT_PROGBITS,
+                        SHF_ALLOC | SHF_EXECINSTR, base + textOff, textOff,
+                        textSize, STUB_SIZE, 0);
+   secDynamic = addSection(&sects, addString(&shstr, ".dynamic"),
+                           SHT_DYNAMIC, SHF_ALLOC | SHF_WRITE,
+                           base + dynamicOff, dynamicOff,
+                           numDynamic * sizeof(Elf64_Dyn), 8,
+                           sizeof(Elf64_Dyn));
+   if (opt->plt)
+      secGot = addSection(&sects, addString(&shstr, ".got.plt"),
+                          SHT_PROGBITS, SHF_ALLOC | SHF_WRITE, base + gotOff,
+                          gotOff, gotSize, 8, 8);
+   secData = addSection(&sects, addString(&shstr, ".data"), SHT_PROGBITS,
+                        SHF_ALLOC | SHF_WRITE, base + dataOff, dataOff,
+                        dataSize, 8, 0);
+   secSymtab = 0;
+   if (opt->symtab)
+   {
+      secSymtab = addSection(&sects, addString(&shstr, ".symtab"),
+                             SHT_SYMTAB, 0, 0, symtabOff,
+                             (1UL + numDyn) * sizeof(Elf64_Sym), 8,
+                             sizeof(Elf64_Sym));
+      sects.headers[secSymtab].sh_info = 2;
+      sects.headers[secSymtab].sh_link =
+         addSection(&sects, addString(&shstr, ".strtab"), SHT_STRTAB, 0, 0,
+                    strtabOff, dynstr.size, 1, 0);
+   }
+   for (i=0; i < opt->sections; i++)
+      addSection(&sects, fillerNames[i], SHT_PROGBITS, 0, 0, off, 0, 1, 0);
+   secShstr = addSection(&sects, addString(&shstr, ".shstrtab"), SHT_STRTAB,
+                         0, 0, 0, 0, 1, 0);
+   shstrOff = off;
+   sects.headers[secShstr].sh_offset = shstrOff;
+   sects.headers[secShstr].sh_size = shstr.size;
+   off += shstr.size;
+   shoff = off = alignUp(off, 8);
+   off += sects.count * sizeof(Elf64_Shdr);
+   fileSize = off;
+   // links between sections
+   sects.headers[secDynsym].sh_link = secDynstr;
+   sects.headers[secDynsym].sh_info = 1;
+   sects.headers[secDynamic].sh_link = secDynstr;
+   for (i=1; i < sects.count; i++)
+      if (sects.headers[i].sh_type == SHT_HASH ||
+          sects.headers[i].sh_type == SHT_GNU_HASH)
+         sects.headers[i].sh_link = secDynsym;
+   if (relaIndex)
+      sects.headers[relaIndex].sh_link = secDynsym;
+   if (secRelaPlt)
+   {
+      sects.headers[secRelaPlt].sh_link = secDynsym;
+      sects.headers[secRelaPlt].sh_info = secGot;
+   }
+   // extended numbering: the real values move into section zero
+   if (sects.count >= SHN_LORESERVE)
+      sects.headers[0].sh_size = sects.count;
+   if (secShstr >= SHN_LORESERVE)
+      sects.headers[0].sh_link = secShstr;
+
+   image = (char*) calloc(1, fileSize);
+   if (!image)
+   {
+      fprintf(stderr, "elfgen: cannot allocate %lu bytes\n", fileSize);
+      return -1;
+   }
+
+   // ELF header
+   Elf64_Ehdr* eh = (Elf64_Ehdr*) image;
+   memcpy(eh->e_ident, ELFMAG, SELFMAG);
+   eh->e_ident[EI_CLASS] = ELFCLASS64;
+   eh->e_ident[EI_DATA] = ELFDATA2LSB;
+   eh->e_ident[EI_VERSION] = EV_CURRENT;
+   eh->e_ident[EI_OSABI] = ELFOSABI_SYSV;
+   eh->e_type = opt->isExec ? ET_EXEC : ET_DYN;
+   eh->e_machine = EM_X86_64;
+   eh->e_version = EV_CURRENT;
+   eh->e_entry = opt->isExec ? base + textOff : 0;
+   eh->e_phoff = phoff;
+   eh->e_shoff = shoff;
+   eh->e_ehsize = sizeof(Elf64_Ehdr);
+   eh->e_phentsize = sizeof(Elf64_Phdr);
+   eh->e_phnum = numPhdrs;
+   eh->e_shentsize = sizeof(Elf64_Shdr);
+   eh->e_shnum = sects.count >= SHN_LORESERVE ? 0 : sects.count;
+   eh->e_shstrndx = secShstr >= SHN_LORESERVE ? SHN_XINDEX : secShstr;
+
+   // program headers
+   Elf64_Phdr* ph = (Elf64_Phdr*) (image + phoff);
+   ph->p_type = PT_PHDR;
+   ph->p_flags = PF_R;
+   ph->p_offset = phoff;
+   ph->p_vaddr = ph->p_paddr = base + phoff;
+   ph->p_filesz = ph->p_memsz = numPhdrs * sizeof(Elf64_Phdr);
+   ph->p_align = 8;
+   ph++;
+   if (opt->isExec)
+   {
+      ph->p_type = PT_INTERP;
+      ph->p_flags = PF_R;
+      ph->p_offset = interpOff;
+      ph->p_vaddr = ph->p_paddr = base + interpOff;
+      ph->p_filesz = ph->p_memsz = sizeof(INTERP_NAME);
+      ph->p_align = 1;
+      ph++;
+      memcpy(image + interpOff, INTERP_NAME, sizeof(INTERP_NAME));
+   }
+   ph->p_type = PT_LOAD;
+   ph->p_flags = PF_R;
+   ph->p_offset = 0;
+   ph->p_vaddr = ph->p_paddr = base;
+   ph->p_filesz = ph->p_memsz = endR;
+   ph->p_align = SEGMENT_ALIGN;
+   ph++;
+   ph->p_type = PT_LOAD;
+   ph->p_flags = PF_R | PF_X;
+   ph->p_offset = rxStart;
+   ph->p_vaddr = ph->p_paddr = base + rxStart;
+   ph->p_filesz = ph->p_memsz = endRX - rxStart;
+   ph->p_align = SEGMENT_ALIGN;
+   ph++;
+   ph->p_type = PT_LOAD;
+   ph->p_flags = PF_R | PF_W;
+   ph->p_offset = rwStart;
+   ph->p_vaddr = ph->p_paddr = base + rwStart;
+   ph->p_filesz = ph->p_memsz = endRW - rwStart;
+   ph->p_align = SEGMENT_ALIGN;
+   ph++;
+   ph->p_type = PT_DYNAMIC;
+   ph->p_flags = PF_R | PF_W;
+   ph->p_offset = dynamicOff;
+   ph->p_vaddr = ph->p_paddr = base + dynamicOff;
+   ph->p_filesz = ph->p_memsz = numDynamic * sizeof(Elf64_Dyn);
+   ph->p_align = 8;
+   ph++;
+   ph->p_type = PT_GNU_STACK;
+   ph->p_flags = PF_R | PF_W;
+
+   // dynamic symbols: null, imports, then definitions by bucket
+   Elf64_Sym* sym = (Elf64_Sym*) (image + dynsymOff);
+   for (i=0; i < opt->plt; i++)
+   {
+      sym[1 + i].st_name = importNames[i];
+      sym[1 + i].st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+      sym[1 + i].st_shndx = SHN_UNDEF;
+   }
+   for (i=0; i < opt->symbols; i++)
+   {
+      Elf64_Sym* s = &sym[defs[i].dynIndex];
+      s->st_name = defs[i].name;
+      if (defs[i].index % 2 == 0)
+      {
+         s->st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+         s->st_shndx = secText;
+         s->st_value = base + textOff + STUB_SIZE * (1 + defs[i].index / 2);
+         s->st_size = 6;
+      }
+      else
+      {
+         s->st_info = ELF64_ST_INFO(STB_GLOBAL, STT_OBJECT);
+         s->st_shndx = secData;
+         s->st_value = base + dataOff + 8 * (defs[i].index / 2);
+         s->st_size = 8;
+      }
+   }
+   memcpy(image + dynstrOff, dynstr.data, dynstr.size);
+
+   // SysV hash covers every dynamic symbol
+   if (opt->sysvHash)
+   {
+      unsigned int* h = (unsigned int*) (image + hashOff);
+      unsigned int* bucket = h + 2;
+      unsigned int* chain = bucket + numBuckets;
+      h[0] = numBuckets;
+      h[1] = numDyn;
+      for (i=1; i < numDyn; i++)
+      {
+         unsigned int b = sysvHash(dynstr.data + sym[i].st_name) % numBuckets;
+         chain[i] = bucket[b];
+         bucket[b] = i;
+      }
+   }
+   // GNU hash covers the defined symbols only
+   if (opt->gnuHash)
+   {
+      unsigned int* h = (unsigned int*) (image + gnuOff);
+      unsigned long* bloom = (unsigned long*) (h + 4);
+      unsigned int* bucket = (unsigned int*) (bloom + maskWords);
+      unsigned int* chain = bucket + numBuckets;
+      unsigned int shift = 6;
+      h[0] = numBuckets;
+      h[1] = 1 + opt->plt;
+      h[2] = maskWords;
+      h[3] = shift;
+      for (i=0; i < opt->symbols; i++)
+      {
+         unsigned int hv = defs[i].gnuHash;
+         bloom[(hv / 64) % maskWords] |= (1UL << (hv % 64)) |
+            (1UL << ((hv >> shift) % 64));
+         if (!bucket[defs[i].bucket])
+            bucket[defs[i].bucket] = defs[i].dynIndex;
+         chain[i] = hv & ~1U;
+         if (i + 1 == opt->symbols || defs[i + 1].bucket != defs[i].bucket)
+            chain[i] |= 1;
+      }
+   }
+
+   // data relocations: RELATIVE first (for DT_RELACOUNT), then 64-bit
+   // absolute relocations against the defined symbols
+   Elf64_Rela* rela = (Elf64_Rela*) (image + relaOff);
+   for (i=0; i < opt->relocs; i++)
+   {
+      rela[i].r_offset = base + dataOff + 8UL * (numObjs + i);
+      if (i < numRelative)
+      {
+         rela[i].r_info = ELF64_R_INFO(0, R_X86_64_RELATIVE);
+         rela[i].r_addend = base + textOff +
+            STUB_SIZE * (i % (1 + numFuncs));
+      }
+      else
+      {
+         j = (i - numRelative) % opt->symbols;
+         rela[i].r_info = ELF64_R_INFO(1 + opt->plt + j, R_X86_64_64);
+      }
+   }
+
+   // PLT, its relocations and GOT, in the usual lazy-binding shape
+   if (opt->plt)
+   {
+      unsigned long plt = base + pltOff, got = base + gotOff, p;
+      unsigned long* gotEntries = (unsigned long*) (image + gotOff);
+      char* code = image + pltOff;
+      rela = (Elf64_Rela*) (image + relaPltOff);
+      gotEntries[0] = base + dynamicOff;
+      // PLT0: push GOT[1]; jmp *GOT[2]; nop
+      code[0] = 0xff; code[1] = 0x35;
+      put32(code + 2, (unsigned int) (got + 8 - (plt + 6)));
+      code[6] = 0xff; code[7] = 0x25;
+      put32(code + 8, (unsigned int) (got + 16 - (plt + 12)));
+      memcpy(code + 12, "\x0f\x1f\x40\x00", 4);
+      for (i=0; i < opt->plt; i++)
+      {
+         p = plt + STUB_SIZE * (1 + i);
+         code = image + pltOff + STUB_SIZE * (1 + i);
+         // jmp *GOT[3+i]; push i; jmp PLT0
+         code[0] = 0xff; code[1] = 0x25;
+         put32(code + 2, (unsigned int) (got + 8 * (3 + i) - (p + 6)));
+         code[6] = 0x68;
+         put32(code + 7, i);
+         code[11] = 0xe9;
+         put32(code + 12, (unsigned int) (plt - (p + 16)));
+         gotEntries[3 + i] = p + 6;
+         rela[i].r_offset = got + 8 * (3 + i);
+         rela[i].r_info = ELF64_R_INFO(1 + i, R_X86_64_JUMP_SLOT);
+      }
+   }
+
+   // text: entry stub (exit(0) for executables, ret otherwise), then
+   // one "mov $n, %eax; ret" stub per function
+   memset(image + textOff, 0xcc, textSize);
+   if (opt->isExec)
+      memcpy(image + textOff, "\xb8\x3c\x00\x00\x00\x31\xff\x0f\x05", 9);
+   else
+      image[textOff] = 0xc3;
+   for (i=0; i < numFuncs; i++)
+   {
+      char* code = image + textOff + STUB_SIZE * (1 + i);
+      code[0] = 0xb8;
+      put32(code + 1, i);
+      code[5] = 0xc3;
+   }
+
+   // dynamic section
+   Elf64_Dyn* dyn = (Elf64_Dyn*) (image + dynamicOff);
+   for (i=0; i < opt->numNeeded; i++, dyn++)
+   {
+      dyn->d_tag = DT_NEEDED;
+      dyn->d_un.d_val = neededNames[i];
+   }
+   if (opt->soname)
+   {
+      dyn->d_tag = DT_SONAME;
+      dyn->d_un.d_val = sonameName;
+      dyn++;
+   }
+   if (opt->isExec)
+   {
+      dyn->d_tag = DT_DEBUG;
+      dyn++;
+   }
+   if (opt->sysvHash)
+   {
+      dyn->d_tag = DT_HASH;
+      dyn->d_un.d_ptr = base + hashOff;
+      dyn++;
+   }
+   if (opt->gnuHash)
+   {
+      dyn->d_tag = DT_GNU_HASH;
+      dyn->d_un.d_ptr = base + gnuOff;
+      dyn++;
+   }
+   dyn->d_tag = DT_STRTAB; dyn->d_un.d_ptr = base + dynstrOff; dyn++;
+   dyn->d_tag = DT_SYMTAB; dyn->d_un.d_ptr = base + dynsymOff; dyn++;
+   dyn->d_tag = DT_STRSZ; dyn->d_un.d_val = dynstr.size; dyn++;
+   dyn->d_tag = DT_SYMENT; dyn->d_un.d_val = sizeof(Elf64_Sym); dyn++;
+   if (opt->relocs)
+   {
+      dyn->d_tag = DT_RELA; dyn->d_un.d_ptr = base + relaOff; dyn++;
+      dyn->d_tag = DT_RELASZ;
+      dyn->d_un.d_val = opt->relocs * sizeof(Elf64_Rela);
+      dyn++;
+      dyn->d_tag = DT_RELAENT; dyn->d_un.d_val = sizeof(Elf64_Rela); dyn++;
+      dyn->d_tag = DT_RELACOUNT; dyn->d_un.d_val = numRelative; dyn++;
+   }
+   if (opt->plt)
+   {
+      dyn->d_tag = DT_PLTGOT; dyn->d_un.d_ptr = base + gotOff; dyn++;
+      dyn->d_tag = DT_PLTRELSZ;
+      dyn->d_un.d_val = opt->plt * sizeof(Elf64_Rela);
+      dyn++;
+      dyn->d_tag = DT_PLTREL; dyn->d_un.d_val = DT_RELA; dyn++;
+      dyn->d_tag = DT_JMPREL; dyn->d_un.d_ptr = base + relaPltOff; dyn++;
+   }
+   dyn->d_tag = DT_NULL;
+
+   // static symbol table: null, a file symbol, then the dynsym entries
+   if (opt->symtab)
+   {
+      Elf64_Sym* st = (Elf64_Sym*) (image + symtabOff);
+      st[1].st_name = fileName;
+      st[1].st_info = ELF64_ST_INFO(STB_LOCAL, STT_FILE);
+      st[1].st_shndx = SHN_ABS;
+      memcpy(st + 2, sym + 1, (numDyn - 1) * sizeof(Elf64_Sym));
+      memcpy(image + strtabOff, dynstr.data, dynstr.size);
+   }
+   memcpy(image + shstrOff, shstr.data, shstr.size);
+   memcpy(image + shoff, sects.headers, sects.count * sizeof(Elf64_Shdr));
+
+   fd = open(opt->output, O_WRONLY | O_CREAT | O_TRUNC,
+             opt->isExec ? 0755 : 0644);
+   if (fd < 0)
+   {
+      perror(opt->output);
+      free(image);
+      return -1;
+   }
+   for (off=0; off < fileSize; off += written)
+   {
+      written = write(fd, image + off, fileSize - off);
+      if (written <= 0)
+      {
+         perror(opt->output);
+         close(fd);
+         free(image);
+         return -1;
+      }
+   }
+   close(fd);
+   free(image);
+   printf("%s: %u sections, %u symbols, %u relocs, %u PLT entries, "
+          "%u needed, %lu bytes\n", opt->output, sects.count, opt->symbols,
+          opt->relocs, opt->plt, opt->numNeeded, fileSize);
+   delete[] sects.headers;
+   delete[] defs;
+   delete[] neededNames;
+   delete[] importNames;
+   delete[] fillerNames;
+   delete[] dynstr.data;
+   delete[] shstr.data;
+   return 0;
+}
+
+static void usage()
+{
+   fprintf(stderr, "usage: elfgen [-exec] [-sections n] [-symbols n] "
+           "[-relocs n] [-plt n]\n"
+           "              [-needed lib]... [-soname name] [-nosymtab] "
+           "[-hash sysv|gnu|both]\n"
+           "              -o file\n");
+}
+
+int main(int argc, char* argv[])
+{
+   GenOptions opt;
+   int i;
+
+   memset(&opt, 0, sizeof(opt));
+   opt.symbols = 1000;
+   opt.symtab = 1;
+   opt.sysvHash = 1;
+   opt.gnuHash = 1;
+   opt.needed = new char*[argc];
+   for (i=1; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-exec"))
+         opt.isExec = 1;
+      else if (!strcmp(argv[i], "-nosymtab"))
+         opt.symtab = 0;
+      else if (i + 1 >= argc)
+      {
+         usage();
+         return 1;
+      }
+      else if (!strcmp(argv[i], "-sections"))
+         opt.sections = strtoul(argv[++i], 0, 0);
+      else if (!strcmp(argv[i], "-symbols"))
+         opt.symbols = strtoul(argv[++i], 0, 0);
+      else if (!strcmp(argv[i], "-relocs"))
+         opt.relocs = strtoul(argv[++i], 0, 0);
+      else if (!strcmp(argv[i], "-plt"))
+         opt.plt = strtoul(argv[++i], 0, 0);
+      else if (!strcmp(argv[i], "-needed"))
+         opt.needed[opt.numNeeded++] = argv[++i];
+      else if (!strcmp(argv[i], "-soname"))
+         opt.soname = argv[++i];
+      else if (!strcmp(argv[i], "-o"))
+         opt.output = argv[++i];
+      else if (!strcmp(argv[i], "-hash"))
+      {
+         i++;
+         opt.sysvHash = strcmp(argv[i], "gnu") != 0;
+         opt.gnuHash = strcmp(argv[i], "sysv") != 0;
+      }
+      else
+      {
+         usage();
+         return 1;
+      }
+   }
+   if (!opt.output || (!opt.sysvHash && !opt.gnuHash))
+   {
+      usage();
+      return 1;
+   }
+   return generate(&opt) ? 1 : 0;
+}
@@ -3,6 +3,13 @@
 #include <string.h>
 #include <elf.h>
 #include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <ftw.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <limits.h>
 #include <ElfProgram.h>
 
 //
@@ -28,10 +35,12 @@ void printSymbolDU(ProgramInfo* pInfo, char* symbol)
              sym->getPLTEntryAddress(), sym->getGOTEntryAddress(),
              sym->getSymbolAddress(),
              sym->getLoadObject()->getName());
-      printf("    Bind=%2.2d Type=%2.2d I=%2.2d Size=%d Other=%d\n", 
+      printf("    Bind=%2.2d Type=%2.2d I=%2.2d Size=%d Other=%d Ver=%s%s\n", 
              sym->getBind(), sym->getType(), 
              (sym->getSHIndex()==65521)?99:sym->getSHIndex(), 
-             sym->getSize(), sym->getOther());
+             sym->getSize(), sym->getOther(),
+             sym->isDefaultVersion() ? "@@" : "@",
+             sym->getVersionName() ? sym->getVersionName() : "-");
    }
    for (i=0; i<ucount; i++)
    {
@@ -41,16 +50,1036 @@ void printSymbolDU(ProgramInfo* pInfo, char* symbol)
              sym->getPLTEntryAddress(), sym->getGOTEntryAddress(),
              sym->getSymbolAddress(),
              sym->getLoadObject()->getName());
-      printf("    Bind=%2.2d Type=%2.2d I=%2.2d Size=%d Other=%d\n", 
+      printf("    Bind=%2.2d Type=%2.2d I=%2.2d Size=%d Other=%d Ver=%s%s\n", 
              sym->getBind(), sym->getType(), 
              (sym->getSHIndex()==65521)?99:sym->getSHIndex(), 
-             sym->getSize(), sym->getOther());
+             sym->getSize(), sym->getOther(),
+             sym->isDefaultVersion() ? "@@" : "@",
+             sym->getVersionName() ? sym->getVersionName() : "-");
    }
 }
 
+//
+// List the members of a static archive, or with symbol names given,
+// tell which member defines each one (from the archive's index).
+//  usage: elfreader -archive lib.a [symbol ...]
+//
+int archiveCommand(int argc, char **argv)
+{
+   ArchiveFile *ar;
+   LoadObject *lo;
+   unsigned int i, numObjects;
+   int m;
+
+   ar = new ArchiveFile(argv[0]);
+   if (!ar->isValidArchive())
+   {
+      printf("ERROR: %s is not an archive\n", argv[0]);
+      delete ar;
+      return 1;
+   }
+   if (argc > 1)
+   {
+      for (i=1; i < (unsigned int) argc; i++)
+      {
+         m = ar->findMemberDefiningSymbol(argv[i]);
+         printf("%s: %s\n", argv[i], (m < 0) ? "(not defined)" : 
+                ar->getMemberName(m));
+      }
+      delete ar;
+      return 0;
+   }
+   numObjects = ar->parseAllMembers();
+   printf("%s: %u members (%u ELF objects), %u index symbols\n", 
+          ar->getName(), ar->getNumberOfMembers(), numObjects,
+          ar->getNumberOfIndexSymbols());
+   for (i=0; i < ar->getNumberOfMembers(); i++)
+   {
+      lo = ar->getMemberObject(i);
+      printf("  %s: %d sections, %u static symbols\n", ar->getMemberName(i),
+             lo ? lo->getNumberOfSections() : 0,
+             lo ? lo->getNumberOfStaticSymbols() : 0);
+   }
+   delete ar;
+   return 0;
+}
+
+//
+// Write a snapshot of this process, or load one and summarize it.
+//  usage: elfreader -snapshot out.snap
+//         elfreader -snapshot-info in.snap
+//
+int snapshotCommand(int write, char *fileName)
+{
+   ProgramSnapshot *snap;
+   ProgramInfo *pInfo;
+   LoadObject *lo;
+   unsigned int i, count;
+   char *strtab;
+   if (write)
+   {
+      pInfo = new ProgramInfo();
+      if (ProgramSnapshot::writeSnapshot(pInfo, fileName))
+      {
+         printf("ERROR: could not write snapshot %s\n", fileName);
+         return 1;
+      }
+      return 0;
+   }
+   snap = new ProgramSnapshot(fileName);
+   if (!snap->isValidSnapshot())
+   {
+      printf("ERROR: %s is not a valid snapshot\n", fileName);
+      delete snap;
+      return 1;
+   }
+   pInfo = new ProgramInfo(snap);
+   printf("snapshot of pid %u (%s)\n", pInfo->pid, pInfo->name);
+   for (lo = pInfo->loadedObjects, i = 0; lo; lo = lo->next, i++)
+   {
+      lo->getStaticSymbolTable(&count, &strtab, 0);
+      printf("  [%d] %p-%p %s: %d sections, %u static symbols, GOT %p\n",
+             snap->getObjectLinkMapIndex(i), lo->getBaseAddress(),
+             lo->getHighAddress(), lo->getName(), lo->getNumberOfSections(),
+             count, lo->getGOTAddress());
+   }
+   return 0;
+}
+
+//
+// Parse a comma separated list of names into a mask or a value,
+// using a table of names; returns -1 on an unknown name.
+//
+static int parseNameList(char* list, const char** names, 
+                         const int* values, int isMask)
+{
+   int result = 0, i, len;
+   char *p, *end;
+   for (p=list; *p; p = *end ? end+1 : end)
+   {
+      end = strchr(p, ',');
+      if (!end)
+         end = p + strlen(p);
+      len = end - p;
+      for (i=0; names[i]; i++)
+         if (!strncmp(names[i], p, len) && !names[i][len])
+            break;
+      if (!names[i])
+         return -1;
+      result = isMask ? result | values[i] : values[i];
+   }
+   return result;
+}
+
+//
+// Symbol type and binding names, for the -type and -bind options.
+//
+static const char* typeNames[] = { "notype", "object", "func",
+   "section", "file", "common", "tls", "ifunc", 0 };
+static const int typeValues[] = { STT_NOTYPE, STT_OBJECT, STT_FUNC,
+   STT_SECTION, STT_FILE, STT_COMMON, STT_TLS, STT_GNU_IFUNC };
+static const char* bindNames[] = { "local", "global", "weak", 
+   "unique", 0 };
+static const int bindValues[] = { STB_LOCAL, STB_GLOBAL, STB_WEAK,
+   STB_GNU_UNIQUE };
+
+//
+// Export symbols/sections/etc of files (or archives, or this process
+// if no files are given) as NDJSON or CSV.
+//  usage: elfreader -export [-csv] [-kinds k,...] [-columns c,...]
+//            [-name glob] [-type t] [-bind b] [-defined|-undefined]
+//            [-o outfile] [file ...]
+//
+int exportCommand(int argc, char **argv)
+{
+   static const char* kindNames[] = { "symtab", "dynsym", "symbols", 
+      "sections", "segments", "dynamic", "relocs", "all", 0 };
+   static const int kindValues[] = { EXPORT_SYMTAB, EXPORT_DYNSYM,
+      EXPORT_SYMTAB|EXPORT_DYNSYM, EXPORT_SECTIONS, EXPORT_SEGMENTS,
+      EXPORT_DYNAMIC, EXPORT_RELOCS, 0x3f };
+   int kinds = EXPORT_SYMTAB|EXPORT_DYNSYM;
+   int csv = 0, fd = 1, i, m, value, status = 0;
+   char *columns = 0, *outFile = 0;
+   OutputBuffer *out;
+   ElfExporter *exporter;
+   LoadObject *lo;
+   ArchiveFile *ar;
+   ProgramInfo *pInfo;
+
+   exporter = 0;
+   for (i=0; i < argc && argv[i][0] == '-'; i++)
+   {
+      if (!strcmp(argv[i], "-csv"))
+         csv = 1;
+      else if (!strcmp(argv[i], "-defined") || !strcmp(argv[i], "-undefined"))
+         continue; // handled below, once the exporter exists
+      else if (i+1 < argc && !strcmp(argv[i], "-kinds"))
+      {
+         kinds = parseNameList(argv[++i], kindNames, kindValues, 1);
+         if (kinds <= 0)
+         {
+            printf("ERROR: bad record kinds %s\n", argv[i]);
+            return 1;
+         }
+      }
+      else if (i+1 < argc && !strcmp(argv[i], "-columns"))
+         columns = argv[++i];
+      else if (i+1 < argc && !strcmp(argv[i], "-o"))
+         outFile = argv[++i];
+      else if (i+1 < argc && (!strcmp(argv[i], "-name") || 
+               !strcmp(argv[i], "-type") || !strcmp(argv[i], "-bind")))
+         i++;
+      else
+      {
+         printf("ERROR: unknown export option %s\n", argv[i]);
+         return 1;
+      }
+   }
+   if (outFile)
+   {
+      fd = open(outFile, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+      if (fd < 0)
+      {
+         printf("ERROR: cannot create %s\n", outFile);
+         return 1;
+      }
+   }
+   out = new OutputBuffer(fd);
+   exporter = new ElfExporter(out, csv);
+   if (columns && exporter->setColumns(columns))
+   {
+      printf("ERROR: unknown column in %s\n", columns);
+      return 1;
+   }
+   // second pass for the filters
+   for (i=0; i < argc && argv[i][0] == '-'; i++)
+   {
+      if (!strcmp(argv[i], "-defined"))
+         exporter->setDefinedFilter(1);
+      else if (!strcmp(argv[i], "-undefined"))
+         exporter->setDefinedFilter(0);
+      else if (!strcmp(argv[i], "-name"))
+         exporter->setNameFilter(argv[++i]);
+      else if (!strcmp(argv[i], "-type") || !strcmp(argv[i], "-bind"))
+      {
+         if (argv[i][1] == 't')
+            value = parseNameList(argv[i+1], typeNames, typeValues, 0);
+         else
+            value = parseNameList(argv[i+1], bindNames, bindValues, 0);
+         if (value < 0)
+         {
+            printf("ERROR: bad value for %s: %s\n", argv[i], argv[i+1]);
+            return 1;
+         }
+         if (argv[i][1] == 't')
+            exporter->setTypeFilter(value);
+         else
+            exporter->setBindFilter(value);
+         i++;
+      }
+      else if (strcmp(argv[i], "-csv"))
+         i++; // options with a value, handled above
+   }
+   if (i == argc)
+   {
+      pInfo = new ProgramInfo();
+      exporter->exportProgram(pInfo, kinds);
+   }
+   for (; i < argc; i++)
+   {
+      lo = new LoadObject(argv[i], 0);
+      if (lo->isValidObject())
+      {
+         exporter->exportObject(lo, kinds);
+         delete lo;
+         continue;
+      }
+      delete lo;
+      ar = new ArchiveFile(argv[i]);
+      if (!ar->isValidArchive())
+      {
+         fprintf(stderr, "elfreader: %s: not an ELF object or archive\n",
+                 argv[i]);
+         status = 1;
+      }
+      for (m=0; ar->isValidArchive() && m < (int) ar->getNumberOfMembers(); m++)
+         exporter->exportObject(ar->getMemberObject(m), kinds);
+      delete ar;
+   }
+   if (out->flush())
+   {
+      fprintf(stderr, "elfreader: error writing output\n");
+      status = 1;
+   }
+   delete exporter;
+   delete out;
+   if (outFile)
+      close(fd);
+   return status;
+}
+
+static int compareNames(const void* a, const void* b)
+{
+   return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+//
+// Compare old and new versions of objects: two files, or every file
+// of one directory against the file with the same name in another.
+//  usage: elfreader -diff [-threads n] old new
+//
+int diffCommand(int argc, char **argv)
+{
+   char **oldFiles, **newFiles, *oldDir, *newDir;
+   unsigned int i, count, maxFiles, numThreads = 0;
+   struct stat st;
+   struct dirent *de;
+   DIR *dir;
+   ElfDiff **diffs;
+   OutputBuffer *out;
+   int status = 0;
+
+   if (argc == 4 && !strcmp(argv[0], "-threads"))
+   {
+      numThreads = atoi(argv[1]);
+      argc -= 2;
+      argv += 2;
+   }
+   if (argc != 2)
+   {
+      printf("usage: elfreader -diff [-threads n] old new\n");
+      return 1;
+   }
+   oldDir = argv[0];
+   newDir = argv[1];
+   if (stat(oldDir, &st) || !S_ISDIR(st.st_mode))
+   {
+      oldFiles = &argv[0];
+      newFiles = &argv[1];
+      count = 1;
+   }
+   else
+   {
+      dir = opendir(oldDir);
+      if (!dir)
+      {
+         printf("ERROR: cannot read directory %s\n", oldDir);
+         return 1;
+      }
+      maxFiles = 64;
+      count = 0;
+      oldFiles = (char**) malloc(maxFiles * sizeof(char*));
+      while ((de = readdir(dir)))
+      {
+         if (de->d_name[0] == '.')
+            continue;
+         if (count == maxFiles)
+         {
+            maxFiles *= 2;
+            oldFiles = (char**) realloc(oldFiles, maxFiles * sizeof(char*));
+         }
+         oldFiles[count++] = strdup(de->d_name);
+      }
+      closedir(dir);
+      qsort(oldFiles, count, sizeof(char*), compareNames);
+      // keep regular files that exist on both sides
+      newFiles = (char**) malloc((count ? count : 1) * sizeof(char*));
+      maxFiles = count;
+      count = 0;
+      for (i=0; i < maxFiles; i++)
+      {
+         char *oldPath, *newPath;
+         if (asprintf(&oldPath, "%s/%s", oldDir, oldFiles[i]) < 0 ||
+             asprintf(&newPath, "%s/%s", newDir, oldFiles[i]) < 0)
+            return 1;
+         free(oldFiles[i]);
+         if (stat(oldPath, &st) || !S_ISREG(st.st_mode))
+         {
+            free(oldPath);
+            free(newPath);
+            continue;
+         }
+         if (stat(newPath, &st))
+         {
+            printf("only in %s: %s\n", oldDir, oldPath + strlen(oldDir) + 1);
+            free(oldPath);
+            free(newPath);
+            continue;
+         }
+         oldFiles[count] = oldPath;
+         newFiles[count++] = newPath;
+      }
+   }
+   diffs = ElfDiff::compareFiles(oldFiles, newFiles, count, numThreads);
+   fflush(stdout);
+   out = new OutputBuffer(1);
+   for (i=0; i < count; i++)
+   {
+      if (!diffs[i]->isValidDiff())
+         status = 2;
+      else if (diffs[i]->getNumberOfChanges() && !status)
+         status = 1;
+      diffs[i]->writeReport(out);
+      delete diffs[i];
+   }
+   delete out;
+   delete[] diffs;
+   return status;
+}
+
+//
+// Section hashing over a directory tree: the file list is collected
+// first, then a pool of threads opens and hashes the files, adding
+// one record per section to a shared array.
+//
+struct SectionCopy
+{
+   unsigned long hash;
+   unsigned long size;
+   char* file;
+   char* section;
+};
+
+struct DupWork
+{
+   char** files;
+   unsigned int numFiles;
+   char* sectionName;         // only sections of this name (or null)
+   unsigned long minSize;
+   SectionCopy* copies;
+   unsigned int numCopies, maxCopies;
+   unsigned int numObjects;
+   pthread_mutex_t lock;
+};
+
+static DupWork dupWork;
+
+static int addTreeFile(const char* path, const struct stat* st, int flag,
+                       struct FTW* ftw)
+{
+   if (flag != FTW_F || !S_ISREG(st->st_mode) || st->st_size < 64)
+      return 0;
+   if (dupWork.numFiles % 256 == 0)
+      dupWork.files = (char**) realloc(dupWork.files, 
+                                       (dupWork.numFiles+256) * sizeof(char*));
+   dupWork.files[dupWork.numFiles++] = strdup(path);
+   return 0;
+}
+
+static void dupSectionFile(void* arg, unsigned int i, unsigned int worker)
+{
+   DupWork* work = (DupWork*) arg;
+   unsigned int s;
+   unsigned long hash;
+   LoadObject* lo;
+   ElfSection* sec;
+   char *shStrTable, *name;
+   lo = new LoadObject(work->files[i], 0);
+   shStrTable = lo->getSectionHeaderStringTable();
+   if (!lo->isValidObject() || !shStrTable)
+   {
+      delete lo;
+      return;
+   }
+   lo->hashSections(1);
+   pthread_mutex_lock(&work->lock);
+   work->numObjects++;
+   for (s=1; (sec = lo->getSection(s)); s++)
+   {
+      name = sec->getName(shStrTable);
+      if (sec->getSizeInBytes() < work->minSize ||
+          sec->getType() == SHT_NOBITS || sec->getContentHash(&hash) ||
+          (work->sectionName && strcmp(name, work->sectionName)))
+         continue;
+      if (work->numCopies == work->maxCopies)
+      {
+         work->maxCopies = work->maxCopies ? work->maxCopies*2 : 1024;
+         work->copies = (SectionCopy*) realloc(work->copies,
+                           work->maxCopies * sizeof(SectionCopy));
+      }
+      work->copies[work->numCopies].hash = hash;
+      work->copies[work->numCopies].size = sec->getSizeInBytes();
+      work->copies[work->numCopies].file = work->files[i];
+      work->copies[work->numCopies].section = strdup(name);
+      work->numCopies++;
+   }
+   pthread_mutex_unlock(&work->lock);
+   delete lo;
+}
+
+static int compareCopies(const void* a, const void* b)
+{
+   const SectionCopy* x = (const SectionCopy*) a;
+   const SectionCopy* y = (const SectionCopy*) b;
+   int c;
+   if (x->hash != y->hash)
+      return x->hash < y->hash ? -1 : 1;
+   if (x->size != y->size)
+      return x->size < y->size ? -1 : 1;
+   c = strcmp(x->file, y->file);
+   return c ? c : strcmp(x->section, y->section);
+}
+
+//
+// Report sections whose contents are byte-identical (same XXH64 and
+// size) across all ELF files under some directories. Hashes are
+// cached per build-id, so a second run only reads the cache.
+//  usage: elfreader -dupsections [-threads n] [-section name]
+//            [-min bytes] dir ...
+//
+int dupSectionsCommand(int argc, char **argv)
+{
+   unsigned int i, j, numThreads = 0, numGroups = 0;
+   unsigned long wasted = 0;
+   OutputBuffer *out;
+
+   memset(&dupWork, 0, sizeof(dupWork));
+   dupWork.minSize = 1;
+   pthread_mutex_init(&dupWork.lock, 0);
+   for (i=0; i+1 < (unsigned int) argc && argv[i][0] == '-'; i += 2)
+   {
+      if (!strcmp(argv[i], "-threads"))
+         numThreads = atoi(argv[i+1]);
+      else if (!strcmp(argv[i], "-section"))
+         dupWork.sectionName = argv[i+1];
+      else if (!strcmp(argv[i], "-min"))
+         dupWork.minSize = strtoul(argv[i+1], 0, 0);
+      else
+         break;
+   }
+   if (i == (unsigned int) argc)
+   {
+      printf("usage: elfreader -dupsections [-threads n] [-section name] "
+             "[-min bytes] dir ...\n");
+      return 1;
+   }
+   for (; i < (unsigned int) argc; i++)
+      nftw(argv[i], addTreeFile, 32, FTW_PHYS);
+
+   ParallelFor::run(dupWork.numFiles, numThreads, dupSectionFile, &dupWork);
+
+   qsort(dupWork.copies, dupWork.numCopies, sizeof(SectionCopy), 
+         compareCopies);
+   out = new OutputBuffer(1);
+   for (i=0; i < dupWork.numCopies; i = j)
+   {
+      for (j=i+1; j < dupWork.numCopies && 
+                  dupWork.copies[j].hash == dupWork.copies[i].hash &&
+                  dupWork.copies[j].size == dupWork.copies[i].size; j++)
+         ;
+      if (j - i < 2)
+         continue;
+      numGroups++;
+      wasted += (j - i - 1) * dupWork.copies[i].size;
+      out->putString("group ");
+      out->putHex(dupWork.copies[i].hash, 16);
+      out->putChar(' ');
+      out->putDecimal(j - i);
+      out->putString(" copies of ");
+      out->putDecimal(dupWork.copies[i].size);
+      out->putString(" bytes\n");
+      for (; i < j; i++)
+      {
+         out->putString("  ");
+         out->putString(dupWork.copies[i].file);
+         out->putChar(' ');
+         out->putString(dupWork.copies[i].section);
+         out->putChar('\n');
+      }
+   }
+   out->putString("summary: ");
+   out->putDecimal(dupWork.numObjects);
+   out->putString(" objects, ");
+   out->putDecimal(dupWork.numCopies);
+   out->putString(" sections, ");
+   out->putDecimal(numGroups);
+   out->putString(" groups of identical sections, ");
+   out->putDecimal(wasted);
+   out->putString(" bytes in extra copies\n");
+   delete out;
+   return 0;
+}
+
 //
 // Main
 //
+//
+// Read this process (or the given files) with statistics enabled and
+// report where the time went, per object and in total.
+//  usage: elfreader -stats [file ...]
+//
+int statsCommand(int argc, char **argv)
+{
+   ProgramInfo *pInfo;
+   LoadObject *lo;
+   LoadStats totals;
+   OutputBuffer *out;
+   char title[PATH_MAX+16];
+   int i;
+
+   LoadStats::setEnabled(1);
+   out = new OutputBuffer(1);
+   if (argc == 0)
+   {
+      pInfo = new ProgramInfo();
+      pInfo->writeStatsReport(out);
+      delete pInfo;
+   }
+   for (i=0; i < argc; i++)
+   {
+      lo = new LoadObject(argv[i]);
+      if (!lo->isValidObject())
+         fprintf(stderr, "elfreader: cannot read %s\n", argv[i]);
+      totals.reset();
+      totals.add(lo->getStats());
+      if (lo->getDebugObject())
+         totals.add(lo->getDebugObject()->getStats());
+      snprintf(title, sizeof(title), "object %s", argv[i]);
+      totals.writeReport(out, title);
+      delete lo;
+   }
+   LoadStats::getProcessTotals(&totals);
+   totals.writeReport(out, "process");
+   out->flush();
+   delete out;
+   return 0;
+}
+
+//
+// Report the heap memory held for each object of this process (or
+// of the given files), by category.
+//  usage: elfreader -memory [file ...]
+//
+int memoryCommand(int argc, char **argv)
+{
+   ProgramInfo *pInfo = 0;
+   LoadObject *lo, *list = 0, *tail = 0;
+   unsigned long total, grandTotal = 0;
+   unsigned int c;
+   int i;
+
+   if (argc == 0)
+   {
+      pInfo = new ProgramInfo();
+      list = pInfo->loadedObjects;
+   }
+   for (i=0; i < argc; i++)
+   {
+      lo = new LoadObject(argv[i]);
+      if (!lo->isValidObject())
+      {
+         fprintf(stderr, "elfreader: cannot read %s\n", argv[i]);
+         delete lo;
+         continue;
+      }
+      if (tail)
+         tail->next = lo;
+      else
+         list = lo;
+      tail = lo;
+   }
+   for (lo=list; lo; lo = lo->next)
+   {
+      printf("%s\n", lo->getName());
+      total = 0;
+      for (c=0; c < MEM_NUM_CATEGORIES; c++)
+      {
+         printf("  %-16s %12lu\n", LoadObject::getMemoryCategoryName(c),
+                lo->getMemoryUsage(c));
+         total += lo->getMemoryUsage(c);
+      }
+      printf("  %-16s %12lu\n", "total", total);
+      grandTotal += total;
+   }
+   printf("all objects %lu bytes\n", grandTotal);
+   if (pInfo)
+      delete pInfo;
+   for (lo = pInfo ? 0 : list; lo; lo = tail)
+   {
+      tail = lo->next;
+      delete lo;
+   }
+   return 0;
+}
+
+//
+// List the symbols of a file that pass a filter, using the object's
+// column-wise symbol store. Types and bindings may be comma lists;
+// -range takes link-time addresses (hex with 0x is fine).
+//  usage: elfreader -filter [-dynamic] [-type t,...] [-bind b,...]
+//            [-defined] [-minsize n] [-maxsize n] [-range low high]
+//            [-scalar] [-count] file
+//
+int filterCommand(int argc, char **argv)
+{
+   SymbolFilter filter;
+   SymbolStore *store;
+   LoadObject *lo;
+   unsigned int *found, numFound, n, j, mask;
+   int i, dynamic = 0, useSIMD = 1, countOnly = 0, value;
+   unsigned long start, elapsed;
+
+   SymbolStore::initFilter(&filter);
+   for (i=0; i < argc-1 && argv[i][0] == '-'; i++)
+   {
+      if (!strcmp(argv[i], "-dynamic"))
+         dynamic = 1;
+      else if (!strcmp(argv[i], "-defined"))
+         filter.definedOnly = 1;
+      else if (!strcmp(argv[i], "-scalar"))
+         useSIMD = 0;
+      else if (!strcmp(argv[i], "-count"))
+         countOnly = 1;
+      else if (i+2 < argc && (!strcmp(argv[i], "-type") ||
+                              !strcmp(argv[i], "-bind")))
+      {
+         const char** names = argv[i][1] == 't' ? typeNames : bindNames;
+         const int* values = argv[i][1] == 't' ? typeValues : bindValues;
+         int bits[16];
+         for (n=0; names[n]; n++)
+            bits[n] = argv[i][1] == 't' ? SYMBOL_TYPE_BIT(values[n]) :
+                                          SYMBOL_BIND_BIT(values[n]);
+         value = parseNameList(argv[i+1], names, bits, 1);
+         if (value <= 0)
+         {
+            printf("ERROR: bad value for %s: %s\n", argv[i], argv[i+1]);
+            return 1;
+         }
+         mask = value;
+         if (argv[i][1] == 't')
+            filter.typeMask = mask;
+         else
+            filter.bindMask = mask;
+         i++;
+      }
+      else if (i+2 < argc && !strcmp(argv[i], "-minsize"))
+         filter.minSize = strtoul(argv[++i], 0, 0);
+      else if (i+2 < argc && !strcmp(argv[i], "-maxsize"))
+         filter.maxSize = strtoul(argv[++i], 0, 0);
+      else if (i+3 < argc && !strcmp(argv[i], "-range"))
+      {
+         filter.lowAddress = strtoul(argv[++i], 0, 0);
+         filter.highAddress = strtoul(argv[++i], 0, 0);
+      }
+      else
+      {
+         printf("ERROR: unknown filter option %s\n", argv[i]);
+         return 1;
+      }
+   }
+   if (i != argc-1)
+   {
+      printf("usage: elfreader -filter [options] file\n");
+      return 1;
+   }
+   lo = new LoadObject(argv[i], 0);
+   if (!lo->isValidObject() || !(store = lo->getSymbolStore(dynamic)))
+   {
+      fprintf(stderr, "elfreader: no %s symbols in %s\n", 
+              dynamic ? "dynamic" : "static", argv[i]);
+      delete lo;
+      return 1;
+   }
+   start = LoadStats::now();
+   found = store->scan(&filter, &numFound, useSIMD);
+   elapsed = LoadStats::now() - start;
+   for (n=0; !countOnly && n < numFound; n++)
+   {
+      j = found[n];
+      printf("%8u %16.16lx %8lu %s\n", j, store->getValue(j),
+             store->getSize(j), store->getName(j) ? store->getName(j) : "");
+   }
+   printf("%u of %u symbols match (%s scan, %lu ns)\n", numFound,
+          store->getCount(), useSIMD && SymbolStore::hasSIMD() ? 
+          "avx2" : "scalar", elapsed);
+   delete[] found;
+   delete lo;
+   return 0;
+}
+
+//
+// Tell which segment and section hold each address of a file, and
+// the file offset it is loaded from. Addresses are link-time
+// addresses; with -offset they are file offsets instead.
+//  usage: elfreader -where [-offset] file address ...
+//
+int whereCommand(int argc, char **argv)
+{
+   LoadObject *lo;
+   ElfSegment *seg;
+   ElfSection *sec;
+   ElfW(Addr) vaddr;
+   unsigned long offset;
+   int i = 0, byOffset = 0, mapped;
+
+   if (argc > 0 && !strcmp(argv[0], "-offset"))
+   {
+      byOffset = 1;
+      i++;
+   }
+   if (i >= argc)
+   {
+      printf("usage: elfreader -where [-offset] file address ...\n");
+      return 1;
+   }
+   lo = new LoadObject(argv[i], 0);
+   if (!lo->isValidObject())
+   {
+      fprintf(stderr, "elfreader: cannot read %s\n", argv[i]);
+      delete lo;
+      return 1;
+   }
+   for (i++; i < argc; i++)
+   {
+      if (byOffset)
+      {
+         offset = strtoul(argv[i], 0, 0);
+         mapped = !lo->fileOffsetToVaddr(offset, &vaddr);
+      }
+      else
+      {
+         vaddr = strtoul(argv[i], 0, 0);
+         mapped = !lo->vaddrToFileOffset(vaddr, &offset);
+      }
+      seg = byOffset ? lo->findSegmentByFileOffset(offset) :
+                       lo->findSegmentByVaddr(vaddr);
+      sec = byOffset ? lo->findSectionByFileOffset(offset) :
+                       lo->findSectionByVaddr(vaddr);
+      printf("%s:", argv[i]);
+      if (mapped)
+         printf(" vaddr 0x%lx offset 0x%lx", (unsigned long) vaddr, offset);
+      if (seg)
+         printf(" segment %u", (unsigned int) (seg - lo->getSegment(0)));
+      if (sec)
+         printf(" section %s+0x%lx",
+                sec->getName(lo->getSectionHeaderStringTable()),
+                byOffset ? offset - sec->getFileOffset() :
+                (unsigned long) (vaddr - sec->getSectionHeader()->sh_addr));
+      if (!seg && !sec)
+         printf(" not mapped");
+      printf("\n");
+   }
+   delete lo;
+   return 0;
+}
+
+//
+// List each GOT slot the dynamic linker fills, the PLT stub that
+// jumps through it (section and address) and its symbol; addresses
+// are link-time addresses.
+//  usage: elfreader -plt file ...
+//
+int pltCommand(int argc, char **argv)
+{
+   static const char* kindNames[] = { "JUMP_SLOT", "GLOB_DAT", "IRELATIVE" };
+   LoadObject *lo;
+   PLTMap *map;
+   PLTSlot *slot;
+   ElfW(Sym) *syms;
+   char *strTable, *name;
+   unsigned long strSize;
+   unsigned int numSyms, n;
+   int i;
+
+   for (i=0; i < argc; i++)
+   {
+      lo = new LoadObject(argv[i], 0);
+      if (!lo->isValidObject() || !(map = lo->getPLTMap()))
+      {
+         fprintf(stderr, "elfreader: no dynamic section in %s\n", argv[i]);
+         delete lo;
+         continue;
+      }
+      syms = lo->getDynamicSymbolTable(&numSyms, &strTable, &strSize);
+      printf("%s: %u GOT slots, %u PLT stubs\n", argv[i],
+             map->getNumberOfSlots(), map->getNumberOfStubs());
+      for (n=0; (slot = map->getSlot(n)); n++)
+      {
+         name = (syms && slot->symIndex && slot->symIndex < numSyms &&
+                 syms[slot->symIndex].st_name < strSize) ?
+            strTable + syms[slot->symIndex].st_name : (char*) "";
+         printf("  got %12.12lx %-9s", (unsigned long) slot->gotVaddr,
+                kindNames[slot->kind]);
+         if (slot->pltVaddr)
+            printf("  %-8s %12.12lx", 
+                   PLTMap::getSectionName(slot->pltSection),
+                   (unsigned long) slot->pltVaddr);
+         else
+            printf("  %-8s %12s", "-", "");
+         printf("  %s\n", name);
+      }
+      delete lo;
+   }
+   return 0;
+}
+
+//
+// Report how this process's GOT slots are bound: which go to the
+// first definer in load order, which have been interposed on or go
+// to a preloaded library. Only the flagged slots are listed unless
+// -all is given.
+//  usage: elfreader -bindings [-all] [-threads n]
+//
+int bindingsCommand(int argc, char **argv)
+{
+   ProgramInfo *pInfo;
+   ResolutionMap *map;
+   OutputBuffer *out;
+   unsigned int all = 0, numThreads = 0;
+   int i;
+
+   for (i=0; i < argc; i++)
+   {
+      if (!strcmp(argv[i], "-all"))
+         all = 1;
+      else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+         numThreads = strtoul(argv[++i], 0, 0);
+      else
+      {
+         fprintf(stderr, "elfreader: unknown option %s\n", argv[i]);
+         return 1;
+      }
+   }
+   pInfo = new ProgramInfo();
+   map = new ResolutionMap(pInfo, numThreads);
+   out = new OutputBuffer(1);
+   map->writeReport(out, !all);
+   delete out;
+   delete map;
+   delete pInfo;
+   return 0;
+}
+
+//
+// Estimate what the dynamic linker spends relocating this process
+// (or a list of files, searched in the order given with the
+// executable first) and rank the objects by it.
+//  usage: elfreader -startup [-top n] [-threads n] [file ...]
+//
+int startupCommand(int argc, char **argv)
+{
+   ProgramInfo *pInfo = 0;
+   LookupCostModel *model;
+   LoadObject **objects = 0;
+   OutputBuffer *out;
+   unsigned int top = 20, numThreads = 0, numObjects = 0;
+   int i;
+
+   for (i=0; i < argc && argv[i][0] == '-'; i++)
+   {
+      if (!strcmp(argv[i], "-top") && i + 1 < argc)
+         top = strtoul(argv[++i], 0, 0);
+      else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+         numThreads = strtoul(argv[++i], 0, 0);
+      else
+      {
+         fprintf(stderr, "elfreader: unknown option %s\n", argv[i]);
+         return 1;
+      }
+   }
+   if (i == argc)
+   {
+      pInfo = new ProgramInfo();
+      model = new LookupCostModel(pInfo, numThreads);
+   }
+   else
+   {
+      objects = new LoadObject*[argc - i];
+      for (; i < argc; i++)
+      {
+         objects[numObjects] = new LoadObject(argv[i], 0);
+         if (!objects[numObjects]->isValidObject())
+         {
+            fprintf(stderr, "elfreader: cannot read %s\n", argv[i]);
+            delete objects[numObjects];
+            continue;
+         }
+         numObjects++;
+      }
+      model = new LookupCostModel(objects, numObjects, numThreads);
+   }
+   out = new OutputBuffer(1);
+   model->writeReport(out, top);
+   delete out;
+   delete model;
+   while (numObjects)
+      delete objects[--numObjects];
+   delete[] objects;
+   delete pInfo;
+   return 0;
+}
+
+//
+// Report the quality of the symbol hash tables of this process's
+// objects (or of every ELF file under some directories): chain
+// lengths, probes per lookup, bloom filter false positives against
+// the imports of the same objects, and a better bucket count.
+//  usage: elfreader -hashes [-flagged] [-threads n] [dir ...]
+//
+// Open file i of dupWork.files into arg's slot i (null if unusable)
+static void hashLoadFile(void* arg, unsigned int i, unsigned int worker)
+{
+   LoadObject* lo = new LoadObject(dupWork.files[i], 0);
+   if (!lo->isValidObject() || !lo->getDynamicSection())
+   {
+      delete lo;
+      lo = 0;
+   }
+   ((LoadObject**) arg)[i] = lo;
+}
+
+int hashesCommand(int argc, char **argv)
+{
+   ProgramInfo *pInfo = 0;
+   HashQualityReport *report;
+   OutputBuffer *out;
+   LoadObject **objects = 0;
+   unsigned int flagged = 0, numThreads = 0, numObjects = 0, j;
+   int i;
+
+   for (i=0; i < argc && argv[i][0] == '-'; i++)
+   {
+      if (!strcmp(argv[i], "-flagged"))
+         flagged = 1;
+      else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+         numThreads = strtoul(argv[++i], 0, 0);
+      else
+      {
+         fprintf(stderr, "elfreader: unknown option %s\n", argv[i]);
+         return 1;
+      }
+   }
+   memset(&dupWork, 0, sizeof(dupWork));
+   if (i == argc)
+   {
+      pInfo = new ProgramInfo();
+      report = new HashQualityReport(pInfo, numThreads);
+   }
+   else
+   {
+      for (; i < argc; i++)
+         nftw(argv[i], addTreeFile, 32, FTW_PHYS);
+      objects = new LoadObject*[dupWork.numFiles + 1];
+      ParallelFor::run(dupWork.numFiles, numThreads, hashLoadFile, objects);
+      for (j=0; j < dupWork.numFiles; j++)
+         if (objects[j])
+            objects[numObjects++] = objects[j];
+      report = new HashQualityReport(objects, numObjects, numThreads);
+   }
+   out = new OutputBuffer(1);
+   report->writeReport(out, flagged);
+   delete out;
+   delete report;
+   for (j=0; j < numObjects; j++)
+      delete objects[j];
+   delete[] objects;
+   for (j=0; j < dupWork.numFiles; j++)
+      free(dupWork.files[j]);
+   free(dupWork.files);
+   delete pInfo;
+   return 0;
+}
+
 int main(int argc, char **argv)
 {
    ProgramInfo *pInfo;
@@ -61,6 +1090,35 @@ int main(int argc, char **argv)
    void *p1;
    void *p2;
 
+   if (argc > 2 && !strcmp(argv[1], "-archive"))
+      return archiveCommand(argc-2, argv+2);
+   if (argc > 2 && !strcmp(argv[1], "-snapshot"))
+      return snapshotCommand(1, argv[2]);
+   if (argc > 2 && !strcmp(argv[1], "-snapshot-info"))
+      return snapshotCommand(0, argv[2]);
+   if (argc > 2 && !strcmp(argv[1], "-dupsections"))
+      return dupSectionsCommand(argc-2, argv+2);
+   if (argc > 3 && !strcmp(argv[1], "-diff"))
+      return diffCommand(argc-2, argv+2);
+   if (argc > 1 && !strcmp(argv[1], "-export"))
+      return exportCommand(argc-2, argv+2);
+   if (argc > 1 && !strcmp(argv[1], "-stats"))
+      return statsCommand(argc-2, argv+2);
+   if (argc > 1 && !strcmp(argv[1], "-memory"))
+      return memoryCommand(argc-2, argv+2);
+   if (argc > 2 && !strcmp(argv[1], "-filter"))
+      return filterCommand(argc-2, argv+2);
+   if (argc > 2 && !strcmp(argv[1], "-where"))
+      return whereCommand(argc-2, argv+2);
+   if (argc > 2 && !strcmp(argv[1], "-plt"))
+      return pltCommand(argc-2, argv+2);
+   if (argc > 1 && !strcmp(argv[1], "-bindings"))
+      return bindingsCommand(argc-2, argv+2);
+   if (argc > 1 && !strcmp(argv[1], "-startup"))
+      return startupCommand(argc-2, argv+2);
+   if (argc > 1 && !strcmp(argv[1], "-hashes"))
+      return hashesCommand(argc-2, argv+2);
+
    //
    // get some sample function pointers and print values
    //